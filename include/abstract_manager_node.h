@@ -17,6 +17,7 @@
 #include "control_parameters.h"
 #include "delay_table_akima.h"
 #include "uvw_model.h"
+#include "correlator_node_scheduler.h"
 
 class Connexion_params
 {
@@ -74,8 +75,14 @@ public:
   // ...
 
   /* set Data_writers */
-  // for files
-  void set_data_writer(int rank, int stream_nr, const std::string &filename);
+  // for files, with a size >= 0 the file is truncated to size and
+  // appended to
+  void set_data_writer(int rank, int stream_nr, const std::string &filename,
+                       int64_t size = -1);
+  // Requests an index of the output file stream_nr of the output node
+  void set_output_index_file(int stream_nr, const std::string &filename);
+  // Averages the output stream stream_nr on the correlator nodes
+  void set_output_averaging(int stream_nr, int channels, int integrations);
 
   /// Interface to Input node
 
@@ -91,6 +98,10 @@ public:
   void input_node_set_time_slice(const std::string &station, int32_t channel,
                                  int32_t stream_nr,
                                  Time start_time, Time stop_time);
+  // Send nr_slices consecutive time slices in one message
+  void input_node_set_time_slices(const std::string &station, int32_t channel,
+                                  int32_t stream_nr, Time start_time,
+                                  Time slice_duration, int32_t nr_slices);
 
 
   void output_node_set_global_header(char* header_msg, int size);
@@ -104,13 +115,17 @@ public:
   size_t input_rank(size_t input_node_nr) const;
   size_t input_rank(const std::string &station_name) const;
 
-  int correlator_rank(int correlator);
+  int correlator_rank(int correlator) const;
   void correlator_node_set(Correlation_parameters &parameters,
                            int corr_node_nr);
-  void correlator_node_set_all(Delay_table &delay_table,
-                               const std::string &station_name);
-  void correlator_node_set_all(Uvw_model &uvw_table,
-                               const std::string &station_name);
+  /// The delay and uvw tables of the current scan are sent to a correlator
+  /// node together with its first job in the scan
+  void correlator_node_clear_scan_tables();
+  void correlator_node_add_scan_table(Delay_table &delay_table,
+                                      const std::string &station_name);
+  void correlator_node_add_scan_table(Uvw_model &uvw_table,
+                                      const std::string &station_name);
+  void correlator_node_send_scan_tables(int corr_node_nr);
   void correlator_node_set_all(Pulsar_parameters &pulsar);
   void correlator_node_set_all(Mask_parameters &mask);
   void correlator_node_set_all(std::set<std::string> &sources);
@@ -156,11 +171,23 @@ protected:
 
   Time integration_time_;
   int n_sources_in_current_scan;
+
+  struct Scan_table {
+    int tag;
+    std::vector<char> message;
+  };
+  /// The delay and uvw tables of the current scan, packed for sending
+  std::vector<Scan_table> scan_tables;
+  /// Number of the current scan tables and of the tables that every
+  /// correlator node has
+  int scan_tables_nr;
+  std::vector<int> correlator_node_scan_tables_nr;
 #ifdef SFXC_DETERMINISTIC
   /// Status of the correlation node
   std::vector<bool> correlator_node_ready;
 #else
-  std::queue<int> ready_correlator_nodes;
+  /// The correlator nodes that asked for a job
+  Correlator_node_scheduler correlator_node_scheduler;
 #endif
 };
 
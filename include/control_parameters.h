@@ -10,6 +10,7 @@
 #include <math.h>
 #include "utils.h"
 #include "correlator_time.h"
+#include "output_header.h"
 
 
 /** Information about the mark5 tracks needed by the input node. **/
@@ -119,7 +120,11 @@ public:
   Correlation_parameters()
       : number_channels(0), fft_size_delaycor(0), fft_size_correlation(0), integration_nr(-1), slice_nr(-1), 
         slice_offset(-1), sample_rate(0), channel_freq(0), bandwidth(0),
-        sideband('n'), frequency_nr(-1), polarisation('n'), pulsar_binning(false), window(SFXC_WINDOW_RECT) {}
+        sideband('n'), frequency_nr(-1), polarisation('n'), pulsar_binning(false), window(SFXC_WINDOW_RECT),
+        output_format_version(OUTPUT_FORMAT_VERSION),
+        first_integration_in_block(-1), last_integration_in_block(-1),
+        baseline_averaging_integrations(0), baseline_averaging_fov(0),
+        baseline_averaging_smearing(0) {}
 
 
   bool operator==(const Correlation_parameters& other) const;
@@ -174,6 +179,16 @@ public:
 
   Station_list station_streams; // input streams used
   int window;                   // Windowing function to be used
+  int32_t output_format_version;// Type of the visibilities in the output
+  // The consecutive integrations of this channel that are correlated by
+  // the same node, output products can be averaged over these integrations
+  int32_t first_integration_in_block, last_integration_in_block;
+  // Baseline dependent averaging: the maximum number of integrations that
+  // are averaged (0 if disabled), the radius of the field of view around
+  // the phase centers [rad] and the maximum amplitude loss at its edge
+  int32_t baseline_averaging_integrations;
+  double baseline_averaging_fov;
+  double baseline_averaging_smearing;
   char source[11];              // name of the source under observation
   int32_t n_phase_centers;   // The number of phase centers in the current scan
   int32_t pulsar_binning;
@@ -235,6 +250,43 @@ public:
   double LO_offset(const std::string &station) const;
   int tsys_freq(const std::string &station) const;
   bool exit_on_empty_datastream() const;
+  bool output_index() const;
+  // Output format version for the visibility type in "output_precision"
+  int output_format_version() const;
+  // Averaging of an output product (a source, or "default"), in number of
+  // channels and number of integrations
+  int output_averaging_channels(const std::string &product) const;
+  int output_averaging_integrations(const std::string &product) const;
+  // Number of consecutive integrations of a channel that are correlated
+  // by the same correlator node, the largest integration averaging
+  int output_averaging_block() const;
+  // Number of consecutive integrations of a channel in one job for a
+  // correlator node, a multiple of output_averaging_block
+  int slices_per_job() const;
+  // Number of jobs that are assigned to a correlator node in advance
+  int scheduler_queue_depth() const;
+  // True if the jobs go to the fastest correlator nodes ("scheduler")
+  bool throughput_scheduling() const;
+  // True if the delay and uvw tables are sent compressed to the correlator nodes
+  bool compress_delay_tables() const;
+  // Where the nodes dump their telemetry ("telemetry"), empty if disabled
+  std::string telemetry() const;
+  bool telemetry_prometheus() const;
+  int telemetry_interval_ms() const;
+  // Where the manager node publishes the status of the correlation
+  // ("status"), empty if disabled
+  std::string status() const;
+  int status_interval_ms() const;
+  // Whether the output node keeps checkpoints of the output files
+  // ("checkpoint"), so that a correlation can be resumed
+  bool checkpoint() const;
+  int checkpoint_interval_ms() const;
+  // Baseline dependent averaging ("baseline_averaging"), the maximum number
+  // of integrations is 0 if it is not used
+  int baseline_averaging_integrations() const;
+  // Radius of the field of view in radians
+  double baseline_averaging_fov() const;
+  double baseline_averaging_smearing() const;
   
   Time reader_offset(const std::string &s) const{
     return reader_offsets.find(s)->second;
@@ -361,6 +413,22 @@ private:
 		       const std::string &station,
 		       Input_node_parameters &input_parameters) const;
 
+  int find_bits_per_sample(const std::string& mode, const std::string& station) const;
+  std::string find_frequency_channel(size_t channel_nr, const std::string& mode_name,
+                                     const std::string &station_name) const;
+  int find_cross_channel(const std::string &channel_nr,
+                         const std::string &mode) const;
+  char find_polarisation(const std::string &channel_name,
+                         const std::string &station_name,
+                         const std::string &mode) const;
+  std::string find_frequency(const std::string &channel_name,
+                             const std::string &station_name,
+                             const std::string &mode) const;
+  char find_sideband(const std::string &channel_name,
+                     const std::string &station_name,
+                     const std::string &mode) const;
+  bool find_cross_polarize() const;
+
   std::string ctrl_filename;
   std::string vex_filename;
   std::map<std::string, Time> reader_offsets; // Contains the formatter clock offsets for all input nodes
@@ -370,6 +438,21 @@ private:
   bool        initialised; // The control parameters are initialised
 
   mutable std::map<std::string, int> station_map;
+
+  // The lookups in the vex file that the manager node does for every time
+  // slice walk the vex tree, their results are kept here. The key is the
+  // concatenation of the arguments (see lookup_key()), the maps are
+  // cleared by initialise().
+  mutable std::map<std::string, int> bits_per_sample_map;
+  mutable std::map<std::string, std::string> frequency_channel_map;
+  mutable std::map<std::string, int> cross_channel_map;
+  mutable std::map<std::string, char> polarisation_map;
+  mutable std::map<std::string, std::string> frequency_map;
+  mutable std::map<std::string, char> sideband_map;
+  mutable int cross_polarize_value; // -1 if not determined yet
+  // Running maximum of the stop times of the scans in the control file,
+  // scan(const Time &) does a binary search in it
+  mutable std::vector<Vex::Date> scan_stop_times;
 };
 
 #endif /*CONTROL_PARAMETERS_H_*/
@@ -0,0 +1,115 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Cor_file, a memory mapped correlator output
+ *       (.cor) file.
+ */
+
+#ifndef COR_FILE_H
+#define COR_FILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <complex>
+
+#include "output_header.h"
+
+/**
+ * Memory mapped correlator output file. Opening the file only walks over
+ * the time slice headers, the headers and visibilities are returned as
+ * pointers into the mapping, so nothing is copied. A time slice that is
+ * only partly written (the file is still growing) is left out, open the
+ * file again to see the new time slices.
+ *
+ * A time slice holds the baselines of one channel, all time slices with
+ * the same integration_slice together form an integration.
+ **/
+class Cor_file {
+public:
+  Cor_file();
+  ~Cor_file();
+
+  bool open(const std::string &filename);
+  void close();
+
+  const Output_header_global &global_header() const {
+    return global_header_;
+  }
+  int number_channels() const {
+    return global_header_.number_channels;
+  }
+  /// Bytes per visibility in the output format of the file
+  size_t visibility_size() const {
+    return visibility_size_;
+  }
+  /// Bytes per baseline, the header followed by number_channels+1
+  /// visibilities
+  size_t baseline_size() const {
+    return sizeof(Output_header_baseline) +
+           (number_channels() + 1) * visibility_size_;
+  }
+  /// Size of the mapped part of the file that contains complete time
+  /// slices
+  uint64_t size() const {
+    return size_;
+  }
+
+  size_t nr_timeslices() const {
+    return timeslices_.size();
+  }
+  const Output_header_timeslice &timeslice(size_t i) const {
+    return *(const Output_header_timeslice *)(data_ + timeslices_[i]);
+  }
+  uint64_t timeslice_offset(size_t i) const {
+    return timeslices_[i];
+  }
+  const Output_uvw_coordinates *uvw_coordinates(size_t i) const {
+    return (const Output_uvw_coordinates *)
+      (data_ + timeslices_[i] + sizeof(Output_header_timeslice));
+  }
+  const Output_header_bitstatistics *statistics(size_t i) const {
+    return (const Output_header_bitstatistics *)
+      (uvw_coordinates(i) + timeslice(i).number_uvw_coordinates);
+  }
+  /// Start of the baselines of a time slice, every baseline is
+  /// baseline_size() bytes
+  const char *baselines(size_t i) const {
+    return (const char *)(statistics(i) + timeslice(i).number_statistics);
+  }
+  const Output_header_baseline &baseline(size_t i, int b) const {
+    return *(const Output_header_baseline *)(baselines(i) + b * baseline_size());
+  }
+  /// The visibilities of a baseline as stored in the file
+  const char *visibilities(size_t i, int b) const {
+    return baselines(i) + b * baseline_size() + sizeof(Output_header_baseline);
+  }
+  /// The visibilities of a baseline converted to float
+  void get_visibilities(size_t i, int b, std::complex<float> *data) const;
+
+  /// The first integration of the interval covered by time slice i, with
+  /// baseline dependent averaging this precedes integration_slice (the
+  /// last integration of the interval), otherwise they are equal
+  int32_t first_integration_slice(size_t i) const;
+
+  /// The index of the first time slice of the integration that follows
+  /// the integration of time slice i
+  size_t next_integration(size_t i) const;
+
+private:
+  Cor_file(const Cor_file &);
+  Cor_file &operator=(const Cor_file &);
+
+  const char *data_;
+  size_t map_size_;
+  uint64_t size_;
+  Output_header_global global_header_;
+  size_t visibility_size_;
+  // File offsets of the time slice headers
+  std::vector<uint64_t> timeslices_;
+};
+
+#endif // COR_FILE_H
@@ -0,0 +1,206 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of the index of correlator output (.cor) files,
+ *       which gives the file offset of every time slice and baseline.
+ */
+
+#ifndef COR_INDEX_H
+#define COR_INDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <complex>
+
+#include "output_header.h"
+
+#define COR_INDEX_EXTENSION  ".coridx"
+#define COR_INDEX_MAGIC      "SFXCCOR1"
+#define COR_INDEX_VERSION    1
+
+/**
+ * Index of a correlator output file (<file>.coridx).
+ *
+ * The index contains an entry for every time slice header and every
+ * baseline in the output file, in the order in which they are written.
+ * Every output file (phase centre or pulsar bin) has its own index. The
+ * number of entries follows from the size of the index file, so the index
+ * of a file that is still being written can be used.
+ **/
+class Cor_index {
+public:
+  enum Type {
+    TIMESLICE = 0,
+    BASELINE
+  };
+
+  struct File_header {
+    char    magic[8];
+    int32_t version;
+    // Number of channels in the output file
+    int32_t number_channels;
+  };
+
+  struct Entry {
+    int32_t integration_slice;
+    uint8_t type;
+    // Baseline, only for BASELINE entries
+    uint8_t station_nr1, station_nr2;
+    uint8_t polarisation1, polarisation2;
+    uint8_t sideband, frequency_nr;
+    uint8_t reserved;
+    // Offset of the header in the output file
+    uint64_t offset;
+  };
+
+  Cor_index();
+  ~Cor_index();
+
+  /// Maps the index file, returns false if it can't be read
+  bool open(const std::string &filename);
+  /// Creates the index by scanning the output file
+  bool create(const std::string &cor_filename);
+  void close();
+
+  int number_channels() const {
+    return number_channels_;
+  }
+  size_t size() const {
+    return nr_entries_;
+  }
+  const Entry &operator[](size_t i) const {
+    return entries_[i];
+  }
+
+  /// Index of the entry of the first time slice header of an integration
+  /// (there is one for every channel), or -1 if not found
+  ssize_t find_timeslice(int32_t integration_slice) const;
+  /// Index of the entry of a baseline, or -1 if not found
+  ssize_t find_baseline(int32_t integration_slice,
+                        const Output_header_baseline &baseline) const;
+
+private:
+  Cor_index(const Cor_index &);
+  Cor_index &operator=(const Cor_index &);
+
+  void *map_;
+  size_t map_size_;
+  // Entries of an index created by scanning the output file
+  std::vector<Entry> created_;
+  const Entry *entries_;
+  size_t nr_entries_;
+  int number_channels_;
+};
+
+/**
+ * Creates the index while the output file is written. All data that is
+ * written to the output file is passed to add_data, which parses the
+ * headers. The entries of a time slice are written to the index file
+ * when the next time slice starts. Without an index file the entries
+ * are kept in memory.
+ **/
+class Cor_index_writer {
+public:
+  Cor_index_writer();
+  ~Cor_index_writer();
+
+  bool open(const std::string &filename);
+  void add_data(const char *data, size_t size);
+  void close();
+
+  int32_t number_channels() const {
+    return number_channels_;
+  }
+  std::vector<Cor_index::Entry> &entries() {
+    return entries_;
+  }
+
+private:
+  enum State {
+    GLOBAL_HEADER,
+    TIMESLICE_HEADER,
+    UVW_COORDINATES,
+    STATISTICS,
+    BASELINE_HEADER,
+    BASELINE_DATA
+  };
+
+  // Called when all bytes of the current item are received
+  void end_of_item();
+  void start_item(State state, size_t size);
+  void write_header();
+
+  FILE *file_;
+  State state_;
+  // Offset in the output file of the start of the current item
+  uint64_t item_offset_;
+  size_t item_size_, item_received_;
+  // The first bytes of the current item (the headers)
+  std::vector<char> item_;
+
+  int32_t number_channels_;
+  // Size of one visibility in the output format of the file
+  size_t visibility_size_;
+  Output_header_timeslice timeslice_;
+  int32_t baselines_left_;
+  // Entries that are not written yet
+  std::vector<Cor_index::Entry> entries_;
+};
+
+/**
+ * Random access reader for correlator output files. It uses the index
+ * if it is present, otherwise the output file is scanned once to create
+ * the index in memory.
+ **/
+class Cor_reader {
+public:
+  Cor_reader();
+  ~Cor_reader();
+
+  bool open(const std::string &filename);
+  /// Returns false if the index was created by scanning the file
+  bool has_index_file() const {
+    return has_index_file_;
+  }
+
+  const Output_header_global &global_header() const {
+    return global_header_;
+  }
+  const Cor_index &index() const {
+    return index_;
+  }
+
+  /// The integration slices in the file
+  void get_integration_slices(std::vector<int32_t> &slices) const;
+
+  /// Reads the header, uvw coordinates and statistics of the first time
+  /// slice of an integration
+  bool read_timeslice(int32_t integration_slice,
+                      Output_header_timeslice &timeslice,
+                      std::vector<Output_uvw_coordinates> &uvw,
+                      std::vector<Output_header_bitstatistics> &statistics);
+
+  /// Reads one baseline of a time slice, the station numbers, polarisations,
+  /// sideband and frequency_nr of baseline select the baseline. Reduced
+  /// precision visibilities are converted to float
+  bool read_baseline(int32_t integration_slice,
+                     Output_header_baseline &baseline,
+                     std::vector< std::complex<float> > &data);
+
+private:
+  bool read_at(uint64_t offset, void *data, size_t size);
+
+  FILE *file_;
+  Output_header_global global_header_;
+  Cor_index index_;
+  // The visibilities as stored in the file
+  std::vector<char> buffer_;
+  bool has_index_file_;
+};
+
+#endif // COR_INDEX_H
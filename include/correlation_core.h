@@ -12,6 +12,11 @@
 #include "timer.h"
 #include <fstream>
 
+// Speed of light [m/s] and rotation rate of the earth [rad/s], for the
+// baseline dependent averaging
+#define SPEED_OF_LIGHT       299792458.0
+#define EARTH_ROTATION_RATE  7.2921150e-5
+
 class Correlation_core : public Tasklet {
 //friend class Correlation_core_pulsar;
 public:
@@ -58,12 +63,40 @@ public:
   std::vector<std::vector<double> > uvw_table;
   void add_source_list(const std::map<std::string, int> &sources_);
 
+  /// Averages the output stream over channels and integrations
+  void set_output_averaging(int stream, int channels, int integrations);
+  /// Number of bytes that are written to the output node for a phase
+  /// center or pulsar bin in the current integration, only the output
+  /// stream and size if the integration is averaged with later ones
+  size_t output_size(int bin);
+
 protected:
   virtual void integration_initialise();
   void integration_step(std::vector<Complex_buffer> &integration_buffer, int nbuffer, int stride);
   void integration_normalize(std::vector<Complex_buffer> &integration_buffer);
-  void integration_write(std::vector<Complex_buffer> &integration_buffer, int phase_center, int bin);
-  void tsys_write();
+  virtual void integration_write(std::vector<Complex_buffer> &integration_buffer,
+                                 int phase_center, int bin);
+  void integration_write_baseline_averaged(std::vector<Complex_buffer> &integration_buffer,
+                                           int phase_center, int sourcenr);
+  // The uvw coordinates and bit statistics of the current integration
+  void integration_headers(int phase_center,
+                           std::vector<Output_uvw_coordinates> &uvw,
+                           std::vector<Output_header_bitstatistics> &stats);
+  void add_statistics(Output_header_bitstatistics &sum,
+                      const Output_header_bitstatistics &stats);
+  // Computes the visibilities of baseline i averaged over channels and
+  // fills the baseline header, returns a pointer to n_points visibilities
+  std::complex<float> *baseline_visibilities(std::vector<Complex_buffer> &integration_buffer,
+                                             size_t i, int channels,
+                                             Output_header_baseline &hbaseline,
+                                             size_t &n_points);
+  std::complex<float> *average_visibilities(std::vector< std::complex<float> > &sum,
+                                            int64_t weight,
+                                            Output_header_baseline &hbaseline);
+  void write_baseline(Output_header_baseline &hbaseline,
+                      const std::complex<float> *data, size_t size);
+  // Sends the system temperatures of the integration to the output node
+  virtual void tsys_write();
   void sub_integration();
   void find_invalid();
 
@@ -81,6 +114,37 @@ protected:
   void create_weights();
   void create_mask();
 
+  /// The output stream (output file) of a phase center or pulsar bin
+  virtual int output_stream(int bin);
+
+  struct Output_averaging {
+    Output_averaging() : channels(1), integrations(1) {}
+    int channels, integrations;
+  };
+  Output_averaging get_output_averaging(int stream);
+  // Size of the data of an output stream in one integration, without
+  // the output stream number and size
+  size_t record_size(int stream);
+  size_t timeslice_header_size();
+  size_t baseline_size(int stream);
+  // First and last integration of the integrations that are averaged
+  // for the output stream
+  bool start_of_averaging(int stream);
+  bool end_of_averaging(int stream);
+  // Averages integration_buffer_float into channel_average_buffer
+  void average_channels(int factor);
+
+  // Chooses the number of integrations that are averaged for every
+  // baseline at the start of a block of integrations
+  void update_baseline_averaging();
+  // First and last integration of the current averaging interval of a
+  // baseline with baseline dependent averaging
+  void baseline_averaging_interval(size_t baseline, int &start, int &end);
+  // Number of baselines that are written in the current integration, per
+  // number of averaged integrations
+  void baseline_averaging_groups(std::map<int, int> &groups);
+  size_t baseline_averaged_size(int stream, const std::map<int, int> &groups);
+
 protected:
   int previous_fft;
   std::vector<Input_buffer_ptr>           input_buffers;
@@ -102,12 +166,46 @@ protected:
   std::vector<Complex_buffer>                          accumulation_buffers;
   std::vector< std::vector<Complex_buffer> >           phase_centers;
   Complex_buffer_float                                 integration_buffer_float;
+  // The visibilities in a reduced precision output format
+  std::vector<char>                                    integration_buffer_output;
+  std::vector< std::complex<float> >                   channel_average_buffer;
+
+  // Averaging of the output streams, indexed by output stream
+  std::vector<Output_averaging>                        output_averaging;
+  // An output stream that is averaged over several integrations
+  struct Averaged_output {
+    Averaged_output() : nr_integrations(0) {}
+    int nr_integrations;
+    // Sum of the uvw coordinates and of the statistics
+    std::vector<Output_uvw_coordinates>                uvw;
+    std::vector<Output_header_bitstatistics>           statistics;
+    // Per baseline the weighted sum of the visibilities and the weight
+    std::vector< std::vector< std::complex<float> > >  visibilities;
+    std::vector<int64_t>                               weights;
+  };
+  std::map<int, Averaged_output>                       averaged_outputs;
+
+  // Baseline dependent averaging: the number of integrations that are
+  // averaged per baseline, chosen for the block that starts at
+  // baseline_averaging_block
+  std::vector<int>                                     baseline_averaging_factors;
+  int                                                  baseline_averaging_block;
+  struct Baseline_averaged_output {
+    // The uvw coordinates and statistics of the integrations in the block
+    std::vector< std::vector<Output_uvw_coordinates> >      uvw;
+    std::vector< std::vector<Output_header_bitstatistics> > statistics;
+    // Per baseline the weighted sum of the visibilities and the weight
+    std::vector< std::vector< std::complex<float> > >       visibilities;
+    std::vector<int64_t>                                    weights;
+  };
+  std::map<int, Baseline_averaged_output>              baseline_averaged_outputs;
   std::vector< std::pair<size_t, size_t> >             baselines;
   int number_ffts_in_integration, number_ffts_in_sub_integration, current_fft, total_ffts;
 
   boost::shared_ptr<Data_writer>                       writer;
 
   Timer fft_timer;
+  Telemetry_counter ffts_;
 
   SFXC_FFT fft_f2t, fft_t2f;
   Complex_buffer temp_buffer;
@@ -16,6 +16,10 @@ public:
                       int node_nr);
 protected:
   virtual void integration_initialise();
+  // Every pulsar bin has its own output file
+  virtual int output_stream(int bin) {
+    return bin;
+  }
   void integration_step(std::vector<Complex_buffer> &integration_buffer, int buf_idx);
   void dedisperse_buffer();
 
@@ -0,0 +1,166 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Node_status, the progress and utilisation
+ *       record that the nodes send to the manager node, and of
+ *       Correlation_status, which aggregates them into the live status
+ *       of the correlation.
+ */
+
+#ifndef CORRELATION_STATUS_H
+#define CORRELATION_STATUS_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+
+#include "correlator_time.h"
+#include "telemetry.h"
+
+/**
+ * Progress and utilisation of a node, taken from its telemetry. All
+ * values are totals since the start of the node, the manager node
+ * computes the rates from two consecutive records. The record is sent
+ * as an array of NR_FIELDS MPI_INT64 with MPI_TAG_NODE_STATUS.
+ **/
+struct Node_status {
+  enum Field {
+    /// Wall clock time of the measurement in microseconds
+    TIME = 0,
+    /// Busy and idle time of the thread that reads the input data
+    INPUT_BUSY, INPUT_IDLE,
+    /// Busy and idle time of the bit to float conversion thread
+    BIT2FLOAT_BUSY, BIT2FLOAT_IDLE,
+    /// Busy and idle time of the correlation thread, which does the
+    /// delay correction and the correlation
+    CORRELATOR_BUSY, CORRELATOR_IDLE,
+    /// Part of the busy time of the correlation thread spent in the
+    /// delay correction (F) and in the correlation (X)
+    DELAY_CORRECTION_BUSY, CORRELATION_BUSY,
+    /// Busy and idle time of the output node
+    OUTPUT_BUSY, OUTPUT_IDLE,
+    /// Bytes read by the input node
+    INPUT_BYTES,
+    /// Integrations finished by the correlator node
+    INTEGRATIONS,
+    NR_FIELDS
+  };
+
+  Node_status();
+
+  /// Fills the record from the telemetry of this process
+  void measure();
+
+  int64_t value[NR_FIELDS];
+};
+
+/**
+ * The status of the correlation as seen by the manager node: the real
+ * time factor, the integrations in flight, the lag of every correlator
+ * node, the input rate of every station and the utilisation of the
+ * input, F (bit to float conversion and delay correction), X
+ * (correlation) and output stages. The stage with the highest
+ * utilisation is the one that limits the correlation.
+ *
+ * The status is written as one JSON object, which replaces the previous
+ * one in a file or is sent as one line to a local socket.
+ **/
+class Correlation_status {
+public:
+  enum Stage {
+    INPUT = 0, F, X, OUTPUT, NR_STAGES
+  };
+
+  Correlation_status();
+
+  /// Publishes the status every interval_ms milliseconds to output
+  /// ("file://<path>" or "unix://<path>"). input_ranks holds the MPI rank
+  /// of the input node of every station, correlator_ranks the MPI rank
+  /// of every correlator node.
+  /// \return false if the output is not valid
+  bool initialise(const std::string &output, int interval_ms,
+                  const std::vector<std::string> &stations,
+                  const std::vector<int> &input_ranks,
+                  const std::vector<int> &correlator_ranks,
+                  Time start_time, Time stop_time, Time integration_time);
+  bool enabled() const {
+    return interval_usec_ > 0;
+  }
+
+  /// The correlator node got a job with nr_integrations integrations
+  /// starting at start, jobs_per_integration jobs (channels) together
+  /// correlate an integration of all data
+  void add_job(int correlator_node, Time start, int nr_integrations,
+               int jobs_per_integration);
+  /// A status record of the node with the given rank arrived
+  void set_node_status(int rank, const Node_status &status);
+
+  /// Publishes the status if the interval passed since the last time
+  void publish_if_due();
+
+  void write(std::ostream &out);
+
+private:
+  struct Node_state {
+    Node_state() : nr_records(0) {}
+    // The last two records, the rates are computed over their interval
+    Node_status previous, current;
+    int nr_records;
+
+    /// Fraction of the time between the two records that the thread
+    /// with the given busy and idle fields was busy, -1 if unknown
+    double usage(Node_status::Field busy, Node_status::Field idle) const;
+    /// Fraction of the time between the records spent in field
+    double share(Node_status::Field busy, Node_status::Field total_busy,
+                 Node_status::Field total_idle) const;
+    /// Increase of field per second between the records
+    double rate(Node_status::Field field) const;
+  };
+  struct Integration {
+    Time start;
+    // Seconds of observation that the integration contributes
+    double seconds;
+  };
+  struct Correlator_state {
+    Correlator_state() : integrations_done(0), correlated_sec(0) {}
+    // The integrations that are assigned and not finished yet, oldest
+    // first
+    std::deque<Integration> pending;
+    int64_t integrations_done;
+    double correlated_sec;
+  };
+
+  int input_rank(int station) const {
+    return input_ranks_[station];
+  }
+  int correlator_rank(int node) const {
+    return correlator_ranks_[node];
+  }
+
+  Telemetry_output output_;
+  int64_t interval_usec_;
+  uint64_t last_publish_;
+
+  std::vector<std::string> stations_;
+  std::vector<int> input_ranks_, correlator_ranks_;
+  // The correlator node of every rank, -1 for the other nodes
+  std::vector<int> rank_correlator_;
+  Time start_time_, stop_time_, integration_time_;
+  // Start time of the last job that was assigned
+  Time frontier_;
+
+  uint64_t wall_start_;
+  // Correlated time at the previous publication, for the real time
+  // factor over the last interval
+  double previous_correlated_sec_;
+  uint64_t previous_wall_;
+
+  std::vector<Node_state> nodes_;
+  std::vector<Correlator_state> correlators_;
+};
+
+#endif // CORRELATION_STATUS_H
@@ -23,6 +23,7 @@
 #include "delay_correction.h"
 #include <tasklet/tasklet_manager.h>
 #include "timer.h"
+#include "telemetry.h"
 
 #include "monitor.h"
 #include "eventor_poll.h"
@@ -95,7 +96,11 @@ public:
   void output_node_set_timeslice(int slice_nr, int slice_offset, int n_slices,
                                  int stream_nr, int bytes, int nbins);
 
-  void receive_parameters(const Correlation_parameters &parameters);
+  // Receives a job of one or more consecutive integrations
+  void receive_parameters(const Correlation_parameters &job);
+
+  /// Averages an output stream over channels and integrations
+  void set_output_averaging(int stream, int channels, int integrations);
 
   void set_parameters();
 
@@ -123,7 +128,14 @@ class Reader_thread : public Thread {
     /// Time spend in really reading the data
     Timer timer_reading_;
 
+    /// Time waiting for a new slice (idle) and reading (busy)
+    Telemetry_thread_usage usage_;
+
   public:
+    Reader_thread() : usage_("correlator_reader") {
+      queue_.set_name("correlator_reader_jobs");
+    }
+
     std::vector< Bit_sample_reader_ptr >& bit_sample_readers() {
       return bit_sample_readers_;
     }
@@ -167,6 +179,7 @@ class Reader_thread : public Thread {
 					if ( readers_active_ == false ) {
 //            timer_waiting_.resume();
             fetch_new_time_slice();
+            usage_.idle();
 //            timer_waiting_.stop();
           } else {
             timer_reading_.resume();
@@ -177,6 +190,7 @@ class Reader_thread : public Thread {
              readers_active_=bit_sample_readers_[i]->active();
             }
             timer_reading_.stop();
+            usage_.busy();
           }
         }
       } catch (QueueClosedException& exp) {
@@ -269,6 +283,10 @@ private:
   std::vector<Uvw_model>                      uvw_tables;
 
   Timer bit_sample_reader_timer_, bits_to_float_timer_, delay_timer_, correlation_timer_;
+  Telemetry_thread_usage correlation_usage_;
+  // Time spent in the delay correction and the correlation, which share
+  // the correlation thread, and the number of finished integrations
+  Telemetry_counter delay_busy_, correlation_busy_, integrations_;
 
   bool isinitialized_;
 
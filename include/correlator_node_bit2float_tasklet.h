@@ -11,6 +11,7 @@
 #include "utils.h"
 #include "timer.h"
 #include "thread.h"
+#include "telemetry.h"
 #include "correlator_node_types.h"
 #include "control_parameters.h"
 #include "bit2float_worker.h"
@@ -88,6 +89,7 @@ private:
 
   /// Amount of processing time.
   Timer timer_;
+  Telemetry_thread_usage usage_;
 
   uint64_t data_processed_;
 };
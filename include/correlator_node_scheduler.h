@@ -0,0 +1,98 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Correlator_node_scheduler, which chooses the
+ *       correlator node for the next job of the manager node.
+ */
+
+#ifndef CORRELATOR_NODE_SCHEDULER_H
+#define CORRELATOR_NODE_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <iostream>
+
+// Weight of the last job in the throughput estimate of a node
+#define SCHEDULER_THROUGHPUT_WEIGHT   0.3
+// A job waits for a busy node near the end of a scan if that node is
+// expected to finish it this much earlier than the fastest ready node
+#define SCHEDULER_WAIT_MARGIN         1.2
+
+/**
+ * Keeps track of the correlator nodes that asked for a job.
+ *
+ * By default the nodes get jobs in the order in which they asked for
+ * them. With throughput scheduling the scheduler estimates the throughput
+ * of every node (cost of a job per second) from the time between the
+ * assignment of a job and the request for the next job, and:
+ * - gives a job to the fastest ready node;
+ * - near the end of a scan, keeps a job for a busy node that is expected
+ *   to finish it clearly earlier than any ready node, so that slow nodes
+ *   don't delay the end of the scan.
+ * Nodes without an estimate count as average nodes.
+ **/
+class Correlator_node_scheduler {
+public:
+  Correlator_node_scheduler();
+
+  void set_throughput_scheduling(bool enable) {
+    throughput_scheduling_ = enable;
+  }
+
+  /// A correlator node asks for a new job, which also marks the end of
+  /// its oldest job
+  void set_ready(int node);
+  bool has_ready_node() const {
+    return !ready_.empty();
+  }
+
+  /// Chooses a ready node for a job with the given cost and removes it
+  /// from the ready nodes. Returns -1 if the job should wait for a busy
+  /// node; jobs_left is the number of jobs left in the scan, including
+  /// this one.
+  int select_node(double cost, int jobs_left);
+  /// Registers the job that was given to the node
+  void assign(int node, double cost);
+
+  /// Estimated cost per second of the node, 0 if unknown
+  double throughput(int node) const;
+
+  /// Writes the statistics of every node
+  void print_statistics(std::ostream &out) const;
+
+private:
+  struct Job {
+    double assign_time;
+    double cost;
+  };
+  struct Node_state {
+    Node_state() : throughput(0), last_end(0), nr_jobs(0), total_cost(0), busy_time(0) {}
+    // Jobs that are assigned and not finished yet, oldest first
+    std::deque<Job> jobs;
+    double throughput;
+    // Time at which the last job ended
+    double last_end;
+    int nr_jobs;
+    double total_cost, busy_time;
+  };
+
+  Node_state &state(int node);
+  // Seconds since the creation of the scheduler
+  double now() const;
+  // Throughput used for the decisions, the average for unknown nodes
+  double expected_throughput(int node) const;
+  // Time at which the node is expected to finish its assigned jobs
+  double expected_free_time(int node, double now) const;
+
+  bool throughput_scheduling_;
+  std::vector<Node_state> nodes_;
+  // Nodes that asked for a job, in the order of the requests
+  std::deque<int> ready_;
+  // Time at which the scheduler was created
+  double start_time_;
+};
+
+#endif // CORRELATOR_NODE_SCHEDULER_H
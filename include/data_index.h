@@ -0,0 +1,109 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Data_index, the time index of a recording
+ *       that is stored next to the recording in <file>.sfxcidx
+ */
+
+#ifndef DATA_INDEX_H
+#define DATA_INDEX_H
+
+#include <vector>
+#include <string>
+
+#include "types.h"
+#include "correlator_time.h"
+
+#define DATA_INDEX_EXTENSION  ".sfxcidx"
+#define DATA_INDEX_MAGIC      "SFXCIDX1"
+#define DATA_INDEX_VERSION    1
+
+/**
+ * Maps time stamps in a recording to byte offsets.
+ *
+ * The index contains an entry every few seconds and an entry at every
+ * discontinuity in the data (a gap in the time stamps, lost
+ * synchronisation or a region without valid headers). The data between
+ * two consecutive entries is regular, so the position of any time in it
+ * follows from the data rate.
+ *
+ * Time stamps are stored as clock ticks (see Time) of the time in the
+ * headers, before the clock offset of the station is applied. For formats
+ * that only store part of the date in the headers (e.g. Mark5B only stores
+ * the MJD modulo 1000) the time stamps are taken modulo the period.
+ **/
+class Data_index {
+public:
+  enum Flags {
+    // The time stamps jump at this entry
+    GAP     = 1,
+    // The entry is not at the expected position, the reader lost sync
+    RESYNC  = 2,
+    // The data starting at this entry has no valid headers (fill pattern)
+    INVALID = 4,
+    // The end of the recording
+    END     = 8
+  };
+
+  struct Entry {
+    int64_t  ticks;
+    uint64_t position;
+    uint32_t flags;
+    uint32_t reserved;
+  };
+
+  struct File_header {
+    char     magic[8];
+    uint32_t version;
+    // Nominal number of seconds between the entries
+    uint32_t interval;
+    // Period of the time stamps in clock ticks, 0 if they are absolute
+    int64_t  period;
+    char     format[16];
+    uint64_t nr_entries;
+    // Size of the indexed file, to detect stale indices
+    uint64_t data_size;
+  };
+
+  Data_index();
+
+  /// Appends the entries of the index file of a data file of data_size
+  /// bytes, the positions of the entries are shifted by start. Returns
+  /// false if the index can't be used.
+  bool load(const std::string &filename, uint64_t start, uint64_t data_size);
+  bool save(const std::string &filename, uint64_t data_size) const;
+
+  void add(int64_t ticks, uint64_t position, uint32_t flags);
+  void set_period(int64_t period);
+  void set_format(const std::string &format, int interval);
+
+  bool empty() const {
+    return entries_.empty();
+  }
+  size_t size() const {
+    return entries_.size();
+  }
+  const Entry &operator[](size_t i) const {
+    return entries_[i];
+  }
+
+  /// Looks up the header time (without clock offset) time. begin is the
+  /// position of the last valid entry at or before time, end the position
+  /// of the first entry after time (or the maximum uint64_t if there is
+  /// none). Returns false if time is not covered by the index.
+  bool lookup(const Time &time, uint64_t &begin, uint64_t &end) const;
+
+private:
+  // Ticks of time relative to the first entry, taking the period into account
+  int64_t relative_ticks(int64_t ticks) const;
+
+  std::vector<Entry> entries_;
+  int64_t period_;
+  int interval_;
+  std::string format_;
+};
+
+#endif // DATA_INDEX_H
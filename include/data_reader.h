@@ -13,6 +13,9 @@
 
 #include <types.h>
 #include <iostream>
+#include "telemetry.h"
+
+class Data_index;
 
 /** Virtual class defining the interface for obtaining input.
  **/
@@ -43,6 +46,12 @@ public:
    **/
   void reset_data_counter();
 
+  /** Name of the stream in the telemetry
+   **/
+  void set_name(const std::string &name) {
+    bytes_in_.set_instance(name);
+  }
+
   /** Sets the size of the data slice to read.
       - -1: Don't use the dataslice counter
       - 0: End of data slice
@@ -65,17 +74,44 @@ public:
   /** returns true if stream supports seek **/
   bool is_seekable(){return is_seekable_;}
 
+  /** Moves the read pointer to an absolute position (in bytes from the
+      start of the stream). Only supported if is_seekable() is true.
+      \return true if the position could be reached.
+  **/
+  bool seek(uint64_t position);
+
+  /** Returns the position of the read pointer in the stream
+   **/
+  uint64_t position() {
+    return position_;
+  }
+
   virtual int get_fd() {
     return -1;
   }
 
+  /** Returns the time index of the stream, or NULL if there is none
+   **/
+  virtual const Data_index *get_index() {
+    return NULL;
+  }
+
 private:
   /** Function that actually writes the data to the output device.
   **/
   virtual size_t do_get_bytes(size_t nBytes, char *buff) = 0;
 
+  /** Function that actually moves the read pointer, the default
+      implementation doesn't support seeking.
+  **/
+  virtual bool do_seek(uint64_t /*position*/) {
+    return false;
+  }
+
   uint64_t _data_counter;
+  uint64_t position_;
   int data_slice;
+  Telemetry_counter bytes_in_;
 protected:
   bool is_seekable_;
 };
@@ -0,0 +1,136 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Data_reader_async_file, a file reader that
+ *       streams the input files through a read-ahead thread.
+ */
+
+#ifndef DATA_READER_ASYNC_FILE_H
+#define DATA_READER_ASYNC_FILE_H
+
+#include <vector>
+#include <string>
+
+#include "data_reader.h"
+#include "data_index.h"
+#include "threadsafe_queue.h"
+#include "condition.h"
+#include "thread.h"
+#include "rttimer.h"
+
+// Size of the blocks in which the input files are read from disk
+#define ASYNC_FILE_BLOCK_SIZE     (4*1024*1024)
+// Number of blocks that are read ahead of the reader
+#define ASYNC_FILE_NR_BLOCKS      8
+// Alignment of the buffers, file offsets and read sizes (needed for O_DIRECT)
+#define ASYNC_FILE_ALIGNMENT      4096
+
+/**
+ * Data reader for recorded baseband data (afile://).
+ *
+ * The files are read in large aligned blocks by a separate thread, using
+ * O_DIRECT if the file system supports it. The (small) requests of the
+ * data format readers are served from these blocks. The next file in the
+ * list is opened before the current one is finished, so there is no stall
+ * at file boundaries. Skipping beyond the read-ahead window restarts the
+ * read-ahead at the new position instead of reading the skipped data.
+ *
+ * The sizes of the files are determined when the reader is constructed,
+ * data appended to a file afterwards is not read.
+ **/
+class Data_reader_async_file : public Data_reader {
+public:
+  Data_reader_async_file(const std::vector<std::string> &sources);
+  ~Data_reader_async_file();
+
+  bool eof();
+  bool can_read();
+  const Data_index *get_index();
+
+private:
+  struct Block {
+    char     *data;
+    // The valid data is data[begin, end)
+    size_t   begin, end;
+    // Position in the stream of data[begin]
+    uint64_t position;
+    // Blocks read before the last seek are discarded
+    int      generation;
+    // Set if the block could not be read
+    bool     error;
+  };
+
+  struct Input_file {
+    std::string filename;
+    // Position in the stream of the first byte of the file
+    uint64_t    start;
+    uint64_t    size;
+  };
+
+  class Read_ahead_thread : public Thread {
+  public:
+    Read_ahead_thread(Data_reader_async_file &reader);
+    ~Read_ahead_thread();
+
+    void do_execute();
+
+    uint64_t bytes_read() const {
+      return bytes_read_;
+    }
+  private:
+    void fill_block(Block *block);
+    bool open_file(size_t file_nr);
+    void prefetch_file(size_t file_nr);
+    int open_fd(const std::string &filename);
+    void close_files();
+
+    Data_reader_async_file &reader_;
+
+    // Position in the stream of the next block to read
+    uint64_t position_;
+    int generation_;
+
+    size_t file_nr_, next_file_nr_;
+    int fd_, next_fd_;
+
+    uint64_t bytes_read_;
+    RTTimer file_timer_;
+  };
+  friend class Read_ahead_thread;
+
+  size_t do_get_bytes(size_t nBytes, char *out);
+  // Makes sure that current_block_ contains stream_position_
+  bool get_block();
+  void release_block();
+  // Restarts the read-ahead at a new position in the stream
+  bool do_seek(uint64_t position);
+
+  std::vector<Input_file> files_;
+  uint64_t total_size_;
+  // Time index of the files (from <file>.sfxcidx)
+  Data_index index_;
+
+  std::vector<char *> buffers_;
+  std::vector<Block> blocks_;
+  Threadsafe_queue<Block *> free_blocks_, full_blocks_;
+
+  // State of the reader side
+  Block *current_block_;
+  uint64_t stream_position_;
+  bool read_error_;
+
+  // Seek requests, protected by request_cond_
+  Condition request_cond_;
+  int generation_;
+  uint64_t request_position_;
+  // Position up to which the read-ahead thread filled blocks
+  uint64_t read_ahead_position_;
+
+  Read_ahead_thread read_ahead_thread_;
+  RTTimer timer_;
+};
+
+#endif // DATA_READER_ASYNC_FILE_H
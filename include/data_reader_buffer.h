@@ -104,8 +104,7 @@ bool Data_reader_buffer<Element>::eof() {
 
 template <class Element>
 bool Data_reader_buffer<Element>::can_read() {
-  DEBUG_MSG("Data_reader_buffer: can read not implemented");
-  return true;
+  return (bytes_left > 0) || !queue->empty();
 }
 
 #endif // DATA_READER_BUFFER_H
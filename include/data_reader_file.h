@@ -8,11 +8,11 @@
 #ifndef DATA_READER_FILE_H
 #define DATA_READER_FILE_H
 
-#include <queue>
 #include <vector>
 #include <fstream>
 
 #include "data_reader.h"
+#include "data_index.h"
 
 class Data_reader_file : public Data_reader {
 public:
@@ -22,14 +22,24 @@ public:
 
   bool eof();
   bool can_read();
+  const Data_index *get_index();
 
 private:
   void init(const std::vector<std::string> &sources);
+  void load_index();
   bool open_next_file();
+  bool open_file(size_t file_nr);
   size_t do_get_bytes(size_t nBytes, char *out);
+  bool do_seek(uint64_t position);
 
-  std::queue<std::string> filenames;
+  std::vector<std::string> filenames;
   std::ifstream file;
+  // Index in filenames of the current file
+  size_t current_file;
+  // Position in the stream of the start and the size of the current file
+  uint64_t file_start, file_size;
+  // Time index of the files (from <file>.sfxcidx)
+  Data_index index;
 };
 
 #endif // DATA_READER_FILE_H
@@ -11,116 +11,104 @@
  * This file contains:
  *   - declaration of a data_reader that from an udp socket.
  *     WARNING: this is not a realiable transmission system.
- *              the missing packets are replaced with a user
- *              provided function.
+ *              the missing packets are replaced with fill pattern.
  */
 #ifndef DATA_READER_UDP_HH
 #define DATA_READER_UDP_HH
 
-#include <cassert>
-#include "simple_memory_pool.h"
-#include "threadsafe_queue.h"
-#include "network.h"
+#include <vector>
+#include <string>
+#include <time.h>
+
 #include "data_reader.h"
-#include "udp_packet.h"
+#include "condition.h"
 #include "thread.h"
 
-template<class T>
-class Ring_buffer {
-  unsigned int size_;
-
-  std::vector<T> buffer_;
-public:
-  Ring_buffer(unsigned int size) {
-    size_ = size;
-    buffer_.resize(size);
-  }
-
-  void set_at(unsigned int idx, T& val) {
-    buffer_[idx%size_] = val;
-  }
-
-  T& operator[](unsigned int i) {
-    return buffer_[i%size_];
-  }
-};
-
-
+// Maximum size of a packet (jumbo frames)
+#define UDP_MAX_PACKET_SIZE   9000
+// Number of packets received with one recvmmsg call
+#define UDP_BATCH_SIZE        64
+// Default size of the reordering ring in bytes
+#define UDP_RING_SIZE         (128*1024*1024)
+// A missing packet is declared lost when this many later packets arrived
+#define UDP_REORDER_WINDOW    1024
+// Requested size of the socket receive buffer
+#define UDP_RCVBUF_SIZE       (64*1024*1024)
+// Interval in seconds between the statistics in the log
+#define UDP_LOG_INTERVAL      10
+
+/**
+ * Data reader for a stream of UDP packets.
+ *
+ * Every packet starts with a 32 bit packet counter in network byte order
+ * (as sent by Data_writer_udp), followed by the payload. The payload size
+ * is taken from the first packet, so VDIF frames and jumbo packets can be
+ * received as well. Packets are received in batches by a separate thread
+ * and stored in a ring indexed by the packet counter, which restores the
+ * order of the packets. Missing packets are replaced by fill pattern.
+ * Statistics on lost, duplicated and reordered packets are written to the
+ * log.
+ **/
 class Data_reader_udp : public Data_reader {
 public:
-  Data_reader_udp(int socket);
-  //Data_reader_udp(Connexion* connexion);
+  Data_reader_udp(int socket, size_t ring_size = UDP_RING_SIZE);
+  /// Opens a socket for a source of the form udp://[address:]port
+  Data_reader_udp(const std::string &source, size_t ring_size = UDP_RING_SIZE);
 
   virtual ~Data_reader_udp();
   virtual bool eof();
   bool can_read();
 
-  void closef() {
-    assert(false && "not implemented");
+  int get_fd() {
+    return socket_;
   }
 
-protected:
-  size_t do_get_bytes(size_t nBytes, char *buff);
-
-  int socket_;
-  int baseidx;
-  bool isfirst;
-
-  // the packet size. This is either
-  // 1450 or with jumbo frame: 8950
-  int psize_;
-  int size_;
-
-  typedef Simple_memory_pool<Packet_fixed_size>::pElement pool_element;
-  Simple_memory_pool< Packet_fixed_size >  pool_;
-  Threadsafe_queue<pool_element>    queue_;
-
-class Reading_thread : public Thread {
-    friend class Data_reader_udp;
-    uint64_t packet_lost_;
-    uint64_t packet_received_;
-    uint64_t packet_dropped_;
-    uint64_t packet_duplicated_;
-    uint64_t packet_outoforder_;
-    uint64_t packet_base_;
-    // the packet size. This is either
-    // 1450 or with jumbo frame: 8950
-    int psize_;
-    int size_;
-    int socket_;
-    int prev_packet_;
-
-
-    Simple_memory_pool<Packet_fixed_size>& parent_pool_;
-    Threadsafe_queue<pool_element>&        parent_queue_;
-
-    Ring_buffer<pool_element>       ringbuffer_;
+private:
+  struct Statistics {
+    uint64_t received, lost, duplicated, reordered, late, overflow, bad_size;
+  };
 
-    void add_packet(int i, pool_element p);
+  class Reading_thread : public Thread {
   public:
-    Reading_thread(Simple_memory_pool<Packet_fixed_size>& pool,
-                   Threadsafe_queue<pool_element>& queue,
-                   size_t psize, size_t size, int socket):
-        parent_pool_(pool), parent_queue_(queue),
-        ringbuffer_(size) {
-      socket_ = socket;
-      psize_ = psize;
-      size_ = size;
-      packet_lost_ = 0;
-      packet_received_ = 0;
-      packet_dropped_ = 0;
-      packet_duplicated_ = 0;
-      packet_base_ = 0;
-      packet_outoforder_=0;
-    }
+    Reading_thread(Data_reader_udp &reader);
     void do_execute();
+  private:
+    void add_packet(const char *packet, size_t size);
+
+    Data_reader_udp &reader_;
   };
+  friend class Reading_thread;
 
-  Reading_thread reading_thread_;
+  void init();
+  size_t do_get_bytes(size_t nBytes, char *buff);
+  // Returns true if the packet read_seq_ can be delivered, read_cond_ is locked
+  bool packet_ready();
+  void log_statistics();
 
-  // used to handle half-filled packet.
-  uint64_t old_current_idx_;
-private:
+  int socket_;
+  bool own_socket_;
+  size_t ring_size_;
+
+  // Protected by read_cond_
+  Condition read_cond_;
+  // Payload size, 0 until the first packet is received
+  size_t payload_size_;
+  size_t nr_slots_;
+  std::vector<char> ring_;
+  std::vector<bool> present_;
+  // Sequence number of the next packet to deliver and one past the
+  // highest sequence number received
+  uint64_t read_seq_, max_seq_;
+  bool first_packet_;
+  // Set if the socket can't be read anymore
+  bool error_;
+  Statistics stats_;
+
+  // Bytes of packet read_seq_ that are already delivered
+  size_t read_offset_;
+  time_t last_log_;
+
+  Reading_thread reading_thread_;
 };
 
-#endif // DATAREADER_SOCKET_HH
+#endif // DATA_READER_UDP_HH
@@ -14,6 +14,7 @@
 #include <stddef.h> // defines size_t
 #include <string>
 #include <boost/shared_ptr.hpp>
+#include "telemetry.h"
 
 class Data_writer {
 public:
@@ -35,6 +36,12 @@ public:
    **/
   void reset_data_counter();
 
+  /** Name of the stream in the telemetry
+   **/
+  void set_name(const std::string &name) {
+    bytes_out_.set_instance(name);
+  }
+
 
   /** Sets the size of the data slice to write.
       - -1: Don't use the dataslice counter
@@ -55,6 +62,13 @@ public:
   /** returns whether we can write at least 1 byte **/
   virtual bool can_write() = 0;
 
+  /** Waits until all data written so far is on disk, returns false on
+   * a write error. Writers that don't buffer have nothing to do.
+   **/
+  virtual bool sync() {
+    return can_write();
+  }
+
   /** Mark the data writer as active (currently writing data), returns false if already active **/
   bool activate();
   void deactivate();
@@ -69,6 +83,7 @@ private:
   uint64_t _data_counter;
   int data_slice;
   bool active; // Flag that indicates if data writer is currently in use
+  Telemetry_counter bytes_out_;
 
 };
 
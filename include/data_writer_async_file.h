@@ -0,0 +1,125 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Data_writer_async_file, a file writer that
+ *       writes large blocks from a separate thread.
+ */
+
+#ifndef DATA_WRITER_ASYNC_FILE_H
+#define DATA_WRITER_ASYNC_FILE_H
+
+#include <vector>
+#include <deque>
+#include <string>
+
+#include "data_writer.h"
+#include "condition.h"
+#include "thread.h"
+#include "rttimer.h"
+
+// Size of the blocks in which the output file is written
+#define ASYNC_WRITE_BLOCK_SIZE      (4*1024*1024)
+// Maximum number of blocks per file, they are allocated when needed
+#define ASYNC_WRITE_NR_BLOCKS       8
+// Alignment of the buffers, file offsets and write sizes (needed for O_DIRECT)
+#define ASYNC_WRITE_ALIGNMENT       4096
+// A partially filled block is written after this many seconds
+#define ASYNC_WRITE_FLUSH_INTERVAL  1
+// Interval in seconds between the statistics in the log
+#define ASYNC_WRITE_LOG_INTERVAL    60
+
+/**
+ * Data writer for the correlator output files.
+ *
+ * The data is collected in large aligned blocks, which are written by a
+ * separate thread with pwrite, using O_DIRECT if the file system supports
+ * it. The node that produces the data therefore doesn't wait for the
+ * disk, unless all blocks are in use.
+ *
+ * A block that is not full is written by the writer thread after
+ * ASYNC_WRITE_FLUSH_INTERVAL seconds, also when no new data arrives, so
+ * that the output file can be followed while it is written.
+ * The next block then starts at the preceding aligned file offset and
+ * writes the unaligned tail again.
+ *
+ * sync() waits for the writer thread and flushes the file to disk, the
+ * output node calls it before it records a checkpoint of the file size.
+ **/
+class Data_writer_async_file : public Data_writer {
+public:
+  /// With size >= 0 the existing file is truncated to size and the
+  /// data is appended, otherwise the file is overwritten
+  Data_writer_async_file(const char *filename, int64_t size = -1);
+  ~Data_writer_async_file();
+
+  bool can_write();
+  bool sync();
+
+private:
+  struct Block {
+    char     *data;
+    // Number of valid bytes in data
+    size_t   size;
+    // File offset of data[0], a multiple of ASYNC_WRITE_ALIGNMENT
+    uint64_t position;
+  };
+
+  class Writer_thread : public Thread {
+  public:
+    Writer_thread(Data_writer_async_file &writer);
+    void do_execute();
+
+    uint64_t bytes_written() const {
+      return bytes_written_;
+    }
+  private:
+    // Returns false on a write error
+    bool write_block(Block *block);
+
+    Data_writer_async_file &writer_;
+    uint64_t bytes_written_;
+  };
+  friend class Writer_thread;
+
+  size_t do_put_bytes(size_t nBytes, const char *buff);
+  // Hands the current block to the writer thread, called with cond_ locked
+  void flush_block();
+  // Returns a block that can be filled, waits for the writer if needed,
+  // called with cond_ locked
+  Block *get_free_block();
+  void log_statistics();
+
+  std::string filename_;
+  // File descriptors for aligned and unaligned writes
+  int fd_direct_, fd_;
+
+  // Guards the blocks, write_error_ and stop_, it is signalled when a
+  // block is full, a block is written or the writer has to stop
+  Condition cond_;
+  bool write_error_;
+  bool stop_;
+  // Set while the writer thread writes a block
+  bool writing_;
+
+  std::vector<char *> buffers_;
+  std::vector<Block> blocks_;
+  std::deque<Block *> free_blocks_, full_blocks_;
+
+  Block *current_block_;
+  // Unaligned end of the last block that was flushed early
+  std::vector<char> tail_;
+  // File offset of the next byte
+  uint64_t file_position_;
+  time_t block_start_, last_log_;
+  size_t max_queue_depth_;
+  // Number of times put_bytes had to wait for the disk
+  uint64_t nr_waits_;
+
+  Writer_thread writer_thread_;
+  RTTimer timer_;
+};
+
+#endif // DATA_WRITER_ASYNC_FILE_H
@@ -103,6 +103,8 @@ private:
   Output_buffer_ptr   output_buffer;
   Output_memory_pool  output_memory_pool;
 
+  Telemetry_counter   ffts_;
+
   Time fft_length;
   SFXC_FFT        fft_t2f, fft_f2t, fft_t2f_cor;
   Memory_pool_vector_element< std::complex<FLOAT> >  exp_array;
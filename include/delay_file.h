@@ -0,0 +1,112 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the declaration of Delay_file, a memory mapped delay file with an
+ *       index of its scans.
+ */
+
+#ifndef DELAY_FILE_H
+#define DELAY_FILE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "correlator_time.h"
+
+#define DELAY_INDEX_EXTENSION  ".index"
+#define DELAY_INDEX_MAGIC      "SFXCDLY1"
+#define DELAY_INDEX_VERSION    2
+
+/**
+ * A delay file that is mapped in memory.
+ *
+ * The delay file contains a header followed by the scans, every scan
+ * (or phase centre of a scan) consists of the source name, the mjd and
+ * records of 7 doubles: time, u, v, w, delay, phase and amplitude. A
+ * record with time and delay 0 ends a scan. The scans are found once
+ * and stored in an index (<file>.index), which is used as long as the
+ * size and modification time (in nanoseconds) of the delay file don't
+ * change and the scans in the index still start with their source name
+ * and mjd in the delay file.
+ **/
+class Delay_file {
+public:
+  enum Field {
+    TIME = 0,
+    U, V, W,
+    DELAY,
+    PHASE,
+    AMPLITUDE,
+    NR_FIELDS
+  };
+
+  struct Scan {
+    // Source name without trailing spaces
+    char     source[81];
+    int32_t  mjd;
+    // Offset of the first record in the delay file
+    uint64_t offset;
+    // Number of records, without the record that ends the scan
+    int32_t  nr_records;
+  };
+
+  /// Returns the delay file, which is kept mapped for the following
+  /// calls unless it changed on disk. Aborts if the file can't be read.
+  static const Delay_file &get(const std::string &filename);
+
+  size_t number_scans() const {
+    return scans_.size();
+  }
+  const Scan &scan(size_t i) const {
+    return scans_[i];
+  }
+
+  /// Field of a record of a scan, read directly from the mapped file
+  double value(const Scan &scan, int record, Field field) const;
+  Time time(const Scan &scan, int record) const {
+    return Time(scan.mjd, value(scan, record, TIME));
+  }
+  /// The first record of the scan at or after the time, nr_records if
+  /// there is none
+  int find_record(const Scan &scan, const Time &time) const;
+
+private:
+  struct Index_header {
+    char     magic[8];
+    int32_t  version;
+    int32_t  nr_scans;
+    // Size and modification time of the delay file
+    uint64_t file_size;
+    int64_t  file_mtime;
+    int64_t  file_mtime_nsec;
+  };
+
+  Delay_file();
+  ~Delay_file();
+  Delay_file(const Delay_file &);
+  Delay_file &operator=(const Delay_file &);
+
+  bool open(const std::string &filename);
+  bool read_index(const std::string &filename);
+  // Checks that a scan read from the index is one of the delay file
+  bool valid_scan(const Scan &scan) const;
+  void create_index();
+  void write_index(const std::string &filename);
+
+  const char *map_;
+  size_t map_size_;
+  time_t mtime_;
+  long mtime_nsec_;
+  std::vector<Scan> scans_;
+
+  // The delay files that are open, by file name
+  static std::map<std::string, Delay_file *> files_;
+};
+
+#endif // DELAY_FILE_H
@@ -108,6 +108,8 @@ public:
   void set_clock_offset(const double offset, const Time start, const double rate, const Time epoch);
 
   void add_scans(const Delay_table &other);
+  /// Removes the scans before the current scan
+  void remove_finished_scans();
 
   // Get source at phase_center for current scan
   const std::string &get_source(int phase_center){
@@ -18,6 +18,8 @@
 #include <boost/shared_ptr.hpp>
 
 #define RESYNC_MAX_DATA_FRAMES  16
+// Maximum number of blocks read while searching for a time in a seekable stream
+#define SEEK_MAX_PROBES         64
 
 class Input_data_format_reader {
 public:
@@ -51,6 +53,20 @@ public:
   virtual TRANSPORT_TYPE get_transport_type() const = 0;
 
 protected:
+  /// Fast path for goto_time on seekable input streams. Jumps to the byte
+  /// offset computed from the data rate (block_size bytes per block_time)
+  /// and refines the position with a binary search on the time stamps.
+  /// Afterwards the current block is the last block before time, the caller
+  /// reads the remaining blocks up to time. Returns false for irregular
+  /// data, in which case the reader is positioned at the block that
+  /// follows the block that was current when it was called.
+  bool seek_to_time(Data_frame &data, Time time,
+                    size_t block_size, Time block_time);
+
+  /// Called by seek_to_time before a block is read from a new position,
+  /// to reset state that depends on the previously read block.
+  virtual void reset_after_seek() {}
+
   // Data reader: input stream
   boost::shared_ptr<Data_reader> data_reader_;
   // Set to true if there is a valid header found in the data stream
@@ -22,6 +22,7 @@
 #include "correlator_time.h"
 #ifdef RUNTIME_STATISTIC
 #include "monitor.h"
+#include "telemetry.h"
 #endif // RUNTIME_STATISTIC
 
 class Input_data_format_reader_tasklet : public Tasklet, public Thread {
@@ -131,6 +132,9 @@ private:
   int seqno;
 
   std::vector< std::vector<int> > duplicate;
+
+  /// Time waiting for a new interval (idle) and reading (busy)
+  Telemetry_thread_usage usage_;
 };
 
 #endif // INPUT_DATA_FORMAT_READER_TASKLET_H
@@ -19,6 +19,7 @@
 #include "thread.h"
 #include "timer.h"
 #include "rttimer.h"
+#include "telemetry.h"
 #include "input_node_types.h"
 #include "control_parameters.h"
 
@@ -53,6 +54,11 @@ public:
   /// Set the input
   void connect_to(Input_buffer_ptr new_input_buffer);
 
+  /// Name of the thread in the telemetry
+  void set_name(const std::string &name) {
+    usage_.set_name(name);
+  }
+
   void add_timeslice(Data_writer_sptr data_writer, int64_t nr_samples);
 
 	/// return the amount of data sent...
@@ -135,6 +141,9 @@ private:
   Time phasecal_time;
   size_t phasecal_count;
   Time phasecal_integration_time;
+
+  /// Time waiting for data (idle) and sending it (busy)
+  Telemetry_thread_usage usage_;
 };
 
 inline Time
@@ -12,9 +12,18 @@
 
 #include "log_writer.h"
 
+/** Log writer that sends its messages to the log node. The messages are
+ * queued per thread without blocking and a background thread sends them
+ * in batches. Repeated messages are rate limited.
+ **/
 class Log_writer_mpi : public Log_writer {
 public:
   Log_writer_mpi(int rank, int message_level=0);
+
+  /// Sends the queued messages of the process and stops the background
+  /// thread, later messages are sent directly. Called before the node
+  /// tells the log node that it finished.
+  static void flush_and_stop();
 };
 
 #endif /*LOG_WRITER_MPI_H_*/
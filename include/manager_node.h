@@ -11,10 +11,12 @@
 #define CONTROLLER_NODE_H
 
 #include <vector>
+#include <set>
 
 #include "abstract_manager_node.h"
 #include "controller.h"
 #include "output_header.h"
+#include "correlation_status.h"
 
 class Manager_node;
 
@@ -54,9 +56,12 @@ public:
     END_NODE
   };
   /// Different states a correlator node can have
+  /// With resume the correlation continues at the last checkpoint of
+  /// the output files
   Manager_node(int rank, int numtasks,
                Log_writer *log_writer,
-               const Control_parameters &control_parameters);
+               const Control_parameters &control_parameters,
+               bool resume = false);
   ~Manager_node();
 
   void start();
@@ -75,17 +80,50 @@ public:
 
   /// Called when the output_node is finished
   void end_correlation();
+
+  /// Called when a node sent its status
+  void set_node_status(int rank, const Node_status &node_status) {
+    correlation_status.set_node_status(rank, node_status);
+  }
+  /// Called when a node answered that it stopped sending its status
+  void node_status_stopped(int rank) {
+    status_ranks.erase(rank);
+  }
 private:
   // Two dimensional array of dimensions [nchannels][nstations],
   // indicates per station which channels are to be correlated
   std::vector<std::vector<int> > ch_number_in_scan;
 
   std::string get_current_mode() const;
+  // Estimated amount of work of the next job, used by the scheduler
+  double job_cost() const;
+  // Estimated number of jobs left in the current scan, including the next
+  int jobs_left_in_scan() const;
   void send_global_header();
+  // Asks the output node to keep checkpoints and gets the checkpoint to
+  // resume from
+  void set_checkpoint_file();
+  // The output node writes a checkpoint when it wrote all slices before
+  // output_slice_nr
+  void send_checkpoint_mark();
+  // Whether a checkpoint can be made before integration_slice_nr
+  bool can_checkpoint() const;
+  // Stops the status of the input and correlator nodes, and receives
+  // the records they sent before they stopped
+  void stop_node_status();
+  // Opens an output file on the output node, with an index if requested
+  // product is the name of the output product for the output averaging
+  void set_output_file(int stream_nr, const std::string &filename,
+                       const std::string &product = "default");
 
   Manager_node_controller manager_controller;
   Status status;
 
+  /// The live status of the correlation, published if "status" is set
+  Correlation_status correlation_status;
+  /// Nodes that didn't answer MPI_TAG_STOP_NODE_STATUS yet
+  std::set<int> status_ranks;
+
   /// Start day and year of the experiment
   int32_t start_day, start_year;
 
@@ -98,6 +136,9 @@ private:
 
   /// The number of the integration slice
   int32_t integration_slice_nr;
+  /// Number of integration slices of a channel that are sent to one
+  /// correlator node, starting at integration_slice_nr
+  int32_t integrations_in_block;
 
   /// Number of the slice for the output node
   int32_t output_slice_nr;
@@ -113,6 +154,17 @@ private:
   size_t current_correlator_node;
 
   int n_corr_nodes;
+
+  /// Continue at the last checkpoint of the output files
+  bool resume;
+  /// The integration slice to resume at, -1 if starting from the beginning
+  int64_t resume_integration_slice;
+  /// Size of the output files at the checkpoint
+  std::vector<int64_t> resume_file_sizes;
+  /// The checkpoint is at the end of the correlation
+  bool resume_at_stop;
+  /// Time of the last checkpoint mark in usec
+  uint64_t last_checkpoint;
 };
 
 #endif // CONTROLLER_NODE_H
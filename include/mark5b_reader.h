@@ -120,6 +120,10 @@ private:
   void gen_crc16();
   // Check the integrity of the current header
   bool check_header(Header &header);
+  // Set current_jday from the julian day in the current header
+  void update_current_jday();
+
+  void reset_after_seek();
 };
 
 std::ostream &operator<<(std::ostream &out,
@@ -25,20 +25,22 @@ class MPI_Transfer {
 public:
   MPI_Transfer();
 
-  static void send(Delay_table &table, int sn, int rank);
-  static void bcast_corr_nodes(Delay_table &table, int sn[2]);
+  /// Messages that can be compressed (zlib), buffer contains the packed data
+  static void pack_message(std::vector<char> &buffer, std::vector<char> &message,
+                           bool compress);
+  static void send_message(std::vector<char> &message, int tag, int rank);
+  static void receive_message(MPI_Status &status, std::vector<char> &buffer);
+
+  static void send(Delay_table &table, int sn[2], int rank, bool compress = false);
   static void pack(std::vector<char> &buffer, Delay_table &table, int sn[2]);
 
-  static void receive(MPI_Status &status, Delay_table &table, int &sn);
-  static void receive_bcast(MPI_Status &status, Delay_table &table, int sn[2]);
+  static void receive(MPI_Status &status, Delay_table &table, int sn[2]);
   static void unpack(std::vector<char> &buffer, Delay_table &table, int sn[2]);
   
-  static void send(Uvw_model &table, int sn, int rank);
-  static void bcast_corr_nodes(Uvw_model &table, int sn);
+  static void send(Uvw_model &table, int sn, int rank, bool compress = false);
   static void pack(std::vector<char> &buffer, Uvw_model &table, int sn);
 
   static void receive(MPI_Status &status, Uvw_model &table, int &sn);
-  static void receive_bcast(MPI_Status &status, Uvw_model &table, int &sn);
   static void unpack(std::vector<char> &buffer, Uvw_model &table, int &sn);
 
   static void send(Pulsar_parameters &table, int rank);
@@ -97,18 +97,28 @@ public:
   bool get_assertion_raised() {
     return assertion_raised;
   }
+
+  /** Interval at which the node sends its Node_status to the manager
+   * node while processing messages, 0 (the default) disables it.
+   **/
+  static void set_status_interval(int interval_ms);
 private:
   /** Process an MPI event.
       Try to delegate it to the controllers, otherwise produce an error message.
    **/
   MESSAGE_RESULT process_event(MPI_Status &status);
 
+  /// Sends the status of the node if the status interval passed
+  void send_status_if_due();
+  static int64_t status_interval_usec;
+
   int rank;
   Controller_list controllers;
 
   Log_writer *log_writer;
 
   bool assertion_raised;
+  uint64_t last_status;
   STATE state_;
 };
 
@@ -2,7 +2,9 @@
 #define OUTPUT_HEADER_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include <iostream>
+#include <complex>
 
 /*
   20-11-2007 added:
@@ -37,6 +39,7 @@
       number_statistics: int32_t
       (
         station_nr : int32_t
+        averaged_integrations : int32_t
         u,v,w : double
       ){number_uvw_coordinates times}
       (
@@ -59,13 +62,49 @@
       sideband     : unsigned char:1 (LSB: 0, USB: 1)
       frequency_nr : unsigned char:5 (sorted increasingly)
  
+      scale_exponent : int8_t (output format versions 2 and 3)
+ 
       (real: float,
        imag: float){number_channels times}
     ){number_correlations times}
   )+
+
+  With baseline dependent averaging the baselines of an integration
+  are grouped in time slices by the number of integrations over which
+  they are averaged, given by averaged_integrations in the uvw
+  coordinates. Such a time slice covers the integrations
+    [integration_slice - averaged_integrations + 1, integration_slice]
+  i.e. integration_slice is the last integration of the averaged
+  interval; it is kept as the last one so that integration_slice
+  increases monotonically through the file. The interval starts at
+    time = start_time +
+           (integration_slice - averaged_integrations + 1)*integration_time
+  and its centre lies (averaged_integrations - 1)/2 integrations before
+  the time of integration_slice. The uvw coordinates are the average
+  over the interval. Without averaging (averaged_integrations is 0 or 1)
+  the interval is the single integration integration_slice.
+
+  The type of the visibilities depends on the output_format_version in
+  the global header:
+    1: float (the default)
+    2: IEEE half precision, multiplied by 2^-scale_exponent
+    3: int16, multiplied by 2^-scale_exponent
+  For versions 2 and 3 the scale exponent of a baseline is chosen such
+  that the largest real or imaginary part maps to [2^14, 2^15). The error
+  of a decoded visibility is then at most:
+    2: 2^-11 (4.9e-4) times its own real or imaginary part, if that
+       part scales to a normal half (magnitude at least 2^-14). Smaller
+       parts are subnormal, their error is at most 2^-25 before
+       scaling back, i.e. 2^-25 * 2^-scale_exponent, which is less than
+       2^-39 times the largest real or imaginary part of the baseline.
+       Parts of at most 2^-25 after scaling decode as 0.
+    3: 2^-15 (3.1e-5) times the largest real or imaginary part of the
+       baseline in that integration
 */
 
-#define OUTPUT_FORMAT_VERSION  1
+#define OUTPUT_FORMAT_VERSION          1  // float visibilities
+#define OUTPUT_FORMAT_VERSION_FLOAT16  2  // half precision visibilities
+#define OUTPUT_FORMAT_VERSION_INT16    3  // scaled int16 visibilities
 
 struct Output_header_global {
   Output_header_global()
@@ -108,9 +147,11 @@ struct Output_header_timeslice {
 };
 
 struct Output_uvw_coordinates {
-Output_uvw_coordinates() : station_nr(0), reserved(0), u(0), v(0), w(0) {}
+Output_uvw_coordinates() : station_nr(0), averaged_integrations(0), u(0), v(0), w(0) {}
   int32_t station_nr; // The station number in the vex-file
-  int32_t reserved;   // Added for 64bit alignment
+  // Number of integrations that are averaged in the time slice with
+  // baseline dependent averaging, 0 otherwise (was reserved)
+  int32_t averaged_integrations;
   double u, v, w;     // The u, v and w coordinates
 };
 
@@ -118,7 +159,7 @@ struct Output_header_baseline {
   Output_header_baseline()
       : weight(-1), station_nr1(0), station_nr2(0),
       polarisation1(0), polarisation2(0),
-  sideband(0), frequency_nr(0) {}
+  sideband(0), frequency_nr(0), scale_exponent(0) {}
   int32_t weight;       ///< The number of good samples
   uint8_t station_nr1;  ///< Station number in the vex-file
   uint8_t station_nr2;  ///< Station number in the vex-file
@@ -133,8 +174,9 @@ unsigned char sideband:
 unsigned char frequency_nr:
   5;  // The number of the channel in the vex-file,
   // sorted increasingly
-  // 1 byte left:
-  char empty;
+  // The visibilities are stored as value * 2^-scale_exponent, only for
+  // output format versions 2 and 3 (a space in version 1)
+  int8_t scale_exponent;
 };
 
 struct Output_header_bitstatistics{
@@ -213,4 +255,19 @@ bool
 operator==(const Output_header_baseline &baseline_header1,
            const Output_header_baseline &baseline_header2);
 
+/// Size in bytes of one visibility in the given output format version
+size_t
+output_visibility_size(int32_t output_format_version);
+/// Stores n visibilities in the given output format version, sets the
+/// scale exponent of the baseline header for the reduced precision formats
+void
+encode_visibilities(int32_t output_format_version,
+                    const std::complex<float> *data, size_t n,
+                    Output_header_baseline &baseline_header, char *output);
+/// Converts n visibilities in the given output format version back to float
+void
+decode_visibilities(int32_t output_format_version,
+                    const Output_header_baseline &baseline_header,
+                    const char *input, size_t n, std::complex<float> *data);
+
 #endif /*OUTPUT_HEADER_H_*/
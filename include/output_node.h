@@ -14,8 +14,18 @@
 #include "multiple_data_readers_controller.h"
 #include "multiple_data_writers_controller.h"
 #include "output_header.h"
+#include "cor_index.h"
+#include "correlator_time.h"
+#include "checkpoint_file.h"
 
 #include <memory_pool.h>
+#include "telemetry.h"
+
+// Maximum size of the time slices that are received out of order and
+// kept in memory, larger slices are spilled to disk
+#define OUTPUT_NODE_REORDER_BUFFER_SIZE   (512*1024*1024)
+// Size of the blocks read from the correlator nodes
+#define OUTPUT_NODE_READ_SIZE             (1024*1024)
 
 #include <fstream>
 #include <map>
@@ -33,11 +43,20 @@ public:
 
   Process_event_status process_event(MPI_Status &status);
 
+  /// Flushes the phase-cal and Tsys files to disk
+  bool sync_files();
+
 private:
+  // Opens a phase-cal or Tsys file. A resumed file keeps the records
+  // before the checkpoint and is appended to.
+  void open_file(std::ofstream &file, std::string &name, const char *filename,
+                 Checkpoint_file::Record_size record_size, size_t header_size);
+
   Output_node &node;
 
   std::ofstream phasecal_file;
   std::ofstream tsys_file;
+  std::string phasecal_filename, tsys_filename;
 };
 
 /**
@@ -62,32 +81,45 @@ public:
    * used to store the data from one correlator node. The data is read
    * from the reader and the slice_size queue contains the size of the
    * subsequent time slices. This has to be a queue (not a single
-   * slice) as the output node might have several slices from
-   * correlator that it has to output in the case that the output node
-   * becomes too slow to store the data. In practice this is not the case
+   * slice) as the correlator node might announce several slices before
+   * the output node has received the first one.
    **/
   class Input_stream {
   public:
+    struct Slice{
+      int64_t weight;
+      int64_t nBytes;
+      int32_t nBins;
+    };
+
     Input_stream(boost::shared_ptr<Data_reader> reader);
 
-    /** Fills the buffer with as much data as possible and returns the number of
-     * bytes written.
+    /** Reads at most nBytes of the current time slice into buffer and
+     * returns the number of bytes read.
      **/
-    int read_bytes(std::vector<char> &buffer);
+    int read_bytes(char *buffer, size_t nBytes);
     /** returns whether we reached the end of the current time slice
      **/
     bool end_of_slice();
+    /** returns whether data can be read without waiting
+     **/
+    bool can_read();
 
     /** sets the length of a new time slice
      **/
-    void set_length_time_slice(int64_t nBytes, int nbins);
+    void set_length_time_slice(int64_t weight, int64_t nBytes, int nbins);
+
+    /** returns whether a new time slice was announced **/
+    bool has_next_slice();
 
     /** Goto the next data slice **/
-    void goto_next_slice(int &new_slice_size, int &new_nbins);
-    struct Slice{
-      int64_t nBytes;
-      int32_t nBins;
-    };
+    void goto_next_slice(Slice &new_slice);
+
+    // Set while a time slice is received from this stream
+    bool active;
+    // Set if the current slice is written to the output while it is received
+    bool direct;
+    Slice current;
   private:
     // Data_reader from which the input data can be read
     boost::shared_ptr<Data_reader> reader;
@@ -95,6 +127,21 @@ public:
     std::queue<Slice> slice_size;
   };
 
+  /**
+   * A time slice that is received before all earlier slices are written.
+   * The data is kept in memory, or in the spill file when the reorder
+   * buffer is full.
+   **/
+  struct Buffered_slice {
+    int64_t nBytes;
+    int32_t nBins;
+    int64_t bytes_received;
+    // Offset in the spill file, -1 if the data is in memory
+    int64_t spill_offset;
+    std::vector<char> data;
+  };
+  typedef std::map<int64_t, Buffered_slice *>       Buffered_slice_map;
+
   Output_node(int rank, Log_writer *writer, int buffer_size = 10);
   Output_node(int rank, int buffer_size = 10);
   void initialise();
@@ -106,9 +153,7 @@ public:
 
   enum STATUS {
     STOPPED=0,
-    START_NEW_SLICE,
     WRITE_OUTPUT,
-    END_SLICE,
     END_NODE
   };
 
@@ -140,6 +185,43 @@ public:
    **/
   void set_number_of_time_slices(int n_time_slices);
 
+  /**
+   * Writes an index of output file stream to filename, all data written
+   * to the output file after this call is indexed.
+   **/
+  void set_index_file(int stream, const char *filename);
+  /// The averaging of an output file, for its global header
+  void set_output_averaging(int stream, int32_t channels, int32_t integrations);
+
+  /**
+   * Keeps checkpoints of the output files in filename, the first line
+   * of the file is the description of the correlation. A checkpoint is
+   * a line with the first integration slice that is not in the output
+   * files, its start time in clock ticks and the sizes of the output
+   * files.
+   *
+   * With resume the output continues at the last checkpoint in the file,
+   * its integration slice is returned and sizes is set to the sizes of
+   * the output files. Returns -1 if the correlation starts from the
+   * beginning.
+   **/
+  int64_t set_checkpoint_file(const char *filename,
+                              const std::string &description, bool resume,
+                              std::vector<int64_t> &sizes);
+  /// Writes a checkpoint as soon as the slices before slice are written,
+  /// time is the start of the integration slice
+  void add_checkpoint_mark(int32_t slice, int32_t integration_slice, int64_t time);
+  /// Whether the output is appended to the files of an earlier correlation
+  bool resumed() const {
+    return resumed_;
+  }
+  /// Start of the integration slice at the checkpoint of a resumed
+  /// correlation, the phase-cal and Tsys records from then on are
+  /// written again
+  const Time &resumed_time() const {
+    return resumed_time_;
+  }
+
   // Callback functions:
   void hook_added_data_reader(size_t reader);
   void hook_added_data_writer(size_t writer);
@@ -147,10 +229,23 @@ public:
 private:
 
   /**
-   * Function that writes a bit of data.
+   * Function that writes a bit of data of the slice curr_slice.
    * Returns whether it wrote something
    **/
-  bool write_output(int nBytes);
+  bool write_output(const char *buffer, int nBytes);
+
+  // Starts receiving the next announced slice of a stream
+  void start_slice(int stream);
+  // Receives the available data of a stream, returns whether data was read
+  bool receive_slice_data(int stream);
+  // Writes the buffered slices that are next in the output
+  bool write_buffered_slices();
+  // Called after the last byte of curr_slice is written
+  void end_slice();
+  void spill(Buffered_slice &slice, const char *buffer, int64_t offset, size_t nBytes);
+  // Writes the checkpoint of the first mark if it is at curr_slice
+  void write_checkpoint();
+  void unspill(const Buffered_slice &slice, char *buffer, int64_t offset, size_t nBytes);
 
   /// The number of output files we are writing to
   int n_data_writers;
@@ -162,20 +257,53 @@ private:
   Output_node_controller              output_node_ctrl;
   Multiple_data_readers_controller    data_readers_ctrl;
   Multiple_data_writers_controller    data_writer_ctrl;
+  // Indices of the output files, NULL if not requested
+  std::vector<Cor_index_writer *>     output_indices;
 
   STATUS                              status;
   // Priority map of the input streams, based on the weight (sequence
-  // number of the data blocks)
+  // number of the data blocks), of the slices that are not written yet
   Input_stream_priority_map           input_streams_order;
   // One input stream for every correlate node
   std::vector<Input_stream *>         input_streams;
 
-  int32_t curr_slice, number_of_time_slices, curr_stream, curr_slice_size;
-  int32_t total_bytes_written, number_of_bins;
-  int32_t current_output_file;
-  // In one read operation we might only partially receive the output file nr, 
+  // Slices that are received out of order
+  Buffered_slice_map                  buffered_slices;
+  // Number of bytes of the buffered slices in memory
+  int64_t                             buffered_bytes;
+  // File with the slices that don't fit in memory, and its used size
+  int                                 spill_fd;
+  int64_t                             spill_size;
+  int                                 nr_spilled_slices, total_spilled_slices;
+
+  int32_t curr_slice, number_of_time_slices, curr_slice_size;
+  int64_t total_bytes_written;
+  int32_t number_of_bins;
+  // The data from a correlator node consists of records with the output
+  // file nr, the number of bytes and the data for the output file
+  int32_t record_header[2];
+  // In one read operation we might only partially receive the record header,
   // this tracks the number of received bytes.
-  int output_file_index;
+  int record_header_index;
+  // Number of bytes of the current record that are not written yet
+  int32_t record_bytes_left;
+  // Number of channels and integrations that are averaged per output file
+  std::map<int, std::pair<int32_t, int32_t> > output_averaging;
+
+  // The checkpoint file, -1 if disabled, and the pending marks
+  struct Checkpoint_mark {
+    int32_t slice, integration_slice;
+    int64_t time;
+  };
+  int                                 checkpoint_fd;
+  std::queue<Checkpoint_mark>         checkpoint_marks;
+  bool                                resumed_;
+  Time                                resumed_time_;
+  // Size of the output files, now and at the start of curr_slice
+  std::vector<int64_t>                output_file_sizes, slice_start_sizes;
+
+  // Time waiting for data (idle) and receiving and writing it (busy)
+  Telemetry_thread_usage usage_;
 };
 
 #endif // OUTPUT_NODE_H
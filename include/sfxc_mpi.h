@@ -13,6 +13,7 @@
 #pragma GCC system_header
 #include <mpi.h>
 
+#include <string>
 #include "types.h"
 
 // Check if the application is multi-threaded
@@ -47,6 +48,12 @@ extern Mutex g_mpi_thebig_mutex;
 void start_node();
 void end_node(int32_t rank);
 void create_correlator_node_comm(int size);
+/// Broadcasts the telemetry settings of the manager node and starts the
+/// telemetry of this node. Called by all nodes, output is only used on the
+/// manager node. The nodes send their status to the manager node every
+/// status_interval_ms milliseconds, if it is not 0.
+void start_telemetry(const std::string &output, bool prometheus, int interval_ms,
+                     int status_interval_ms);
 
 enum MPI_TAG {
   // INITIALISATION OF THE DIFFERENT TYPES OF NODES:
@@ -128,7 +135,7 @@ enum MPI_TAG {
 
   /** Create a data reader stream for incoming data using TCP
    * - INT32_t: stream number
-   * - CHAR+: file descriptor file:// or mark5://
+   * - CHAR+: file descriptor file://, afile://, mark5:// or udp://
    **/
   MPI_TAG_ADD_DATA_READER,
 
@@ -142,6 +149,8 @@ enum MPI_TAG {
   /** Add a data writer to a file
    * - int32_t: channel number
    * - char[]: filename
+   * - int64_t: optional, the file is truncated to this size and
+   *   appended to instead of overwritten
    **/
   MPI_TAG_ADD_DATA_WRITER_FILE2,
 
@@ -226,6 +235,15 @@ enum MPI_TAG {
    **/
   MPI_TAG_INPUT_NODE_ADD_TIME_SLICE,
 
+  /** Adds consecutive time slices of the same duration to a time slicer
+   * - int64_t: channel
+   * - int64_t: stream
+   * - int64_t: start time of the first slice (clock ticks)
+   * - int64_t: duration of a slice (clock ticks)
+   * - int64_t: number of slices
+   **/
+  MPI_TAG_INPUT_NODE_ADD_TIME_SLICES,
+
   // Output node specific commands
   //-------------------------------------------------------------------------//
 
@@ -282,6 +300,18 @@ enum MPI_TAG {
    **/
   MPI_TAG_OUTPUT_NODE_FINISHED,
 
+  /** Progress and utilisation of a node, sent periodically to the
+   * manager node. An empty message is the answer to
+   * MPI_TAG_STOP_NODE_STATUS, the node sends no status after it.
+   * - MPI_INT64[Node_status::NR_FIELDS]: the values of the Node_status
+   **/
+  MPI_TAG_NODE_STATUS,
+
+  /** The manager node doesn't receive the status anymore
+   * - int32_t: -
+   **/
+  MPI_TAG_STOP_NODE_STATUS,
+
   // Log node specific commands
   //-------------------------------------------------------------------------//
 
@@ -308,6 +338,42 @@ enum MPI_TAG {
 
   MPI_TAG_OUTPUT_NODE_WRITE_TSYS,
 
+  /** Write an index of an output file
+   * - int32_t: stream number of the output file
+   * - char[]: filename of the index
+   **/
+  MPI_TAG_OUTPUT_NODE_SET_INDEX_FILE,
+
+  /** Average an output stream over channels and integrations, sent to
+   * the output node and to all correlator nodes
+   * - int32_t: stream number of the output file
+   * - int32_t: number of channels that are averaged
+   * - int32_t: number of integrations that are averaged
+   **/
+  MPI_TAG_SET_OUTPUT_AVERAGING,
+
+  /** Keep checkpoints of the output files, sent before the output files
+   * are opened. The output node replies with MPI_TAG_OUTPUT_NODE_CHECKPOINT
+   * - int32_t: 1 to resume from the last checkpoint in the file
+   * - char[]: description of the job, the first line of the file
+   * - char[]: filename of the checkpoint file
+   **/
+  MPI_TAG_OUTPUT_NODE_SET_CHECKPOINT_FILE,
+
+  /** The checkpoint to resume from
+   * - int64_t: first integration slice that is not in the output files,
+   *   -1 to start from the beginning
+   * - int64_t[]: size of the output files at the checkpoint
+   **/
+  MPI_TAG_OUTPUT_NODE_CHECKPOINT,
+
+  /** Write a checkpoint when all output slices before slice_nr are written
+   * - int64_t: slice_nr
+   * - int64_t: the integration slice that is correlated in slice_nr
+   * - int64_t: the start time of the integration slice in clock ticks
+   **/
+  MPI_TAG_OUTPUT_NODE_CHECKPOINT_MARK,
+
   // General messages
   //-------------------------------------------------------------------------//
 
@@ -433,6 +499,9 @@ inline const char * const do_print_MPI_TAG(MPI_TAG tag) {
   case MPI_TAG_INPUT_NODE_ADD_TIME_SLICE: {
       return "MPI_TAG_INPUT_NODE_ADD_TIME_SLICE";
     }
+  case MPI_TAG_INPUT_NODE_ADD_TIME_SLICES: {
+      return "MPI_TAG_INPUT_NODE_ADD_TIME_SLICES";
+    }
   case MPI_TAG_OUTPUT_STREAM_SLICE_SET_PRIORITY: {
       return "MPI_TAG_OUTPUT_STREAM_SLICE_SET_PRIORITY";
     }
@@ -448,6 +517,12 @@ inline const char * const do_print_MPI_TAG(MPI_TAG tag) {
   case MPI_TAG_MASK_PARAMETERS: {
       return "MPI_TAG_MASK_PARAMETERS";
     }
+  case MPI_TAG_NODE_STATUS: {
+      return "MPI_TAG_NODE_STATUS";
+    }
+  case MPI_TAG_STOP_NODE_STATUS: {
+      return "MPI_TAG_STOP_NODE_STATUS";
+    }
   case   MPI_TAG_SOURCE_LIST: {
       return "MPI_TAG_SOURCE_LIST";
     }
@@ -482,6 +557,21 @@ inline const char * const do_print_MPI_TAG(MPI_TAG tag) {
   case MPI_TAG_OUTPUT_NODE_GLOBAL_HEADER: {
       return "MPI_TAG_OUTPUT_NODE_GLOBAL_HEADER";
     }
+  case MPI_TAG_OUTPUT_NODE_SET_INDEX_FILE: {
+      return "MPI_TAG_OUTPUT_NODE_SET_INDEX_FILE";
+    }
+  case MPI_TAG_SET_OUTPUT_AVERAGING: {
+      return "MPI_TAG_SET_OUTPUT_AVERAGING";
+    }
+  case MPI_TAG_OUTPUT_NODE_SET_CHECKPOINT_FILE: {
+      return "MPI_TAG_OUTPUT_NODE_SET_CHECKPOINT_FILE";
+    }
+  case MPI_TAG_OUTPUT_NODE_CHECKPOINT: {
+      return "MPI_TAG_OUTPUT_NODE_CHECKPOINT";
+    }
+  case MPI_TAG_OUTPUT_NODE_CHECKPOINT_MARK: {
+      return "MPI_TAG_OUTPUT_NODE_CHECKPOINT_MARK";
+    }
   case MPI_TAG_DATASTREAM_EMPTY: {
       return "MPI_TAG_DATASTREAM_EMPTY";
     }
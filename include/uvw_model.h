@@ -51,6 +51,8 @@ public:
 	   const std::string &source);
 
   void add_scans(const Uvw_model &other);
+  /// Removes the scans before the current scan
+  void remove_finished_scans();
 
   std::ofstream& uvw_values(std::ofstream &, Time starttime, Time stoptime,
                             Time inttime);
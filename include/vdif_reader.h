@@ -18,10 +18,15 @@
 
 #include <fstream>
 #include <vector>
+#include <deque>
 #include <boost/shared_ptr.hpp>
 
 // The number VDIF frames to be read is rounded to this number of bytes
 #define VDIF_FRAME_BUFFER_SIZE    32128
+// Number of frames read at once when demultiplexing multi-thread VDIF
+#define VDIF_DEMUX_CHUNK_FRAMES   256
+// Maximum number of frames buffered per input stream by the demultiplexer
+#define VDIF_DEMUX_MAX_FRAMES     4096
 
 class VDIF_reader : public Input_data_format_reader {
   enum Debug_level {
@@ -114,9 +119,45 @@ private:
 
   // Convert time read from input stream to time relative to midnight on the reference day
   int64_t correct_raw_time(int64_t raw_time);
+  // Time of a header, without the clock offset
+  Time header_time(const Header &header);
 
   // Mapping between thread IDs and channel numbers.
   std::map<int, int> thread_map;
+
+  /// Demultiplexer for streams with multiple VDIF threads. The frames are
+  /// parsed from large blocks of data and queued per thread, they are
+  /// returned in time order. Gaps in a thread are filled with invalid
+  /// blocks for that thread only.
+  struct Demux_frame {
+    Header header;
+    Time time;
+    std::vector<value_type> data;
+  };
+  bool use_demux();
+  bool read_new_block_demux(Data_frame &data);
+  // Reads a block of data and queues the frames in it
+  bool read_demux_chunk();
+  void reset_demux();
+
+  // Set while seek_to_time reads single frames
+  bool seeking_;
+  // Set if the current time comes from the demultiplexer
+  bool demux_active_;
+  Time demux_time_;
+  std::vector<char> demux_buffer_;
+  // Number of bytes in demux_buffer_ that are not parsed yet
+  size_t demux_buffer_size_;
+  std::vector< std::deque<Demux_frame> > demux_queues_;
+  size_t demux_nr_queued_;
+  // Latest time stamp of the queued frames
+  Time demux_last_time_;
+  // Time of the next block of every channel (invalid if none seen yet)
+  std::vector<Time> demux_next_time_;
+  std::vector<bool> demux_started_;
+  std::vector< std::vector<value_type> > demux_free_buffers_;
+  // Number of frames dropped because they were not in time order
+  uint64_t demux_nr_dropped_;
 };
 
 inline Time 
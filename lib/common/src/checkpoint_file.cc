@@ -0,0 +1,198 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ * This file is part of:
+ *   - common library
+ * This file contains:
+ *   - the implementation of Checkpoint_file
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "checkpoint_file.h"
+
+Checkpoint_file::Checkpoint_file() : valid_size_(0) {}
+
+Checkpoint_file::Status
+Checkpoint_file::read(const char *filename, const std::string &description) {
+  record_.clear();
+  valid_size_ = 0;
+  description_.clear();
+
+  std::ifstream in(filename);
+  if (!in.is_open())
+    return MISSING;
+  // A line is complete if the newline at its end was read
+  std::string line;
+  if (!std::getline(in, line) || in.eof())
+    return EMPTY;
+  description_ = line;
+  if (line != description)
+    return DIFFERENT;
+  valid_size_ = in.tellg();
+
+  while (std::getline(in, line) && !in.eof()) {
+    std::istringstream fields(line);
+    std::vector<int64_t> record;
+    int64_t value;
+    while (fields >> value)
+      record.push_back(value);
+    if (record.empty() || !fields.eof())
+      break;
+    record_ = record;
+    valid_size_ = in.tellg();
+  }
+  return (record_.empty() ? EMPTY : FOUND);
+}
+
+bool
+Checkpoint_file::resume_records(const char *filename, size_t header_size,
+                                Record_size record_size, Record_time record_time,
+                                int64_t time) {
+  std::vector<char> data;
+  {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in.is_open())
+      return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (in.bad() || (data.size() < header_size))
+      return false;
+  }
+
+  // The records are kept in place, the file is replaced only when the
+  // new one is complete
+  size_t end = header_size;
+  size_t pos = header_size;
+  while (pos < data.size()) {
+    size_t size = record_size(&data[pos], data.size() - pos);
+    if (size == 0)
+      break;
+    if (record_time(&data[pos]) < time) {
+      memmove(&data[end], &data[pos], size);
+      end += size;
+    }
+    pos += size;
+  }
+
+  std::string tmp_filename = std::string(filename) + ".resume";
+  std::ofstream out(tmp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+    return false;
+  if (end > 0)
+    out.write(&data[0], end);
+  out.close();
+  if (out.fail() || (rename(tmp_filename.c_str(), filename) != 0)) {
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+#ifdef ENABLE_TEST_UNIT
+// Test records are a byte with their size, a byte with their time stamp
+// and the rest of the record
+static size_t test_record_size(const char *data, size_t len) {
+  return (len >= 2 && (size_t)data[0] <= len ? data[0] : 0);
+}
+
+static int64_t test_record_time(const char *record) {
+  return record[1];
+}
+
+void Checkpoint_file::Test::tests() {
+  std::ostringstream name;
+  name << "/tmp/checkpoint_file_test." << getpid();
+  const std::string filename = name.str();
+  const std::string description = "sfxc checkpoint test";
+  Checkpoint_file checkpoint;
+
+  unlink(filename.c_str());
+  TEST_ASSERT( checkpoint.read(filename.c_str(), description) == MISSING );
+
+  {
+    std::ofstream out(filename.c_str());
+    out << description << "\n" << "10 20 30\n" << "12 22 33\n";
+  }
+  TEST_ASSERT( checkpoint.read(filename.c_str(), description) == FOUND );
+  TEST_ASSERT( checkpoint.record().size() == 3 );
+  TEST_ASSERT( checkpoint.record()[0] == 12 );
+  TEST_ASSERT( checkpoint.record()[2] == 33 );
+  const int64_t size = description.size() + 19;
+  TEST_ASSERT( checkpoint.valid_size() == size );
+
+  // The last record was torn, the one before it is the checkpoint
+  {
+    std::ofstream out(filename.c_str(), std::ios::app);
+    out << "14 24";
+  }
+  TEST_ASSERT( checkpoint.read(filename.c_str(), description) == FOUND );
+  TEST_ASSERT( checkpoint.record()[0] == 12 );
+  TEST_ASSERT( checkpoint.valid_size() == size );
+
+  // A garbled record ends the file
+  {
+    std::ofstream out(filename.c_str());
+    out << description << "\n" << "10 20 30\n" << "12 x\n" << "14 24 34\n";
+  }
+  TEST_ASSERT( checkpoint.read(filename.c_str(), description) == FOUND );
+  TEST_ASSERT( checkpoint.record()[0] == 10 );
+  TEST_ASSERT( checkpoint.valid_size() == (int64_t)description.size() + 10 );
+
+  // The checkpoint of another correlation
+  TEST_ASSERT( checkpoint.read(filename.c_str(), "sfxc checkpoint other") == DIFFERENT );
+  TEST_ASSERT( checkpoint.description() == description );
+  TEST_ASSERT( checkpoint.record().empty() );
+
+  // Only a description, or not even that
+  {
+    std::ofstream out(filename.c_str());
+    out << description << "\n";
+  }
+  TEST_ASSERT( checkpoint.read(filename.c_str(), description) == EMPTY );
+  TEST_ASSERT( checkpoint.valid_size() == (int64_t)description.size() + 1 );
+  {
+    std::ofstream out(filename.c_str());
+    out << description;
+  }
+  TEST_ASSERT( checkpoint.read(filename.c_str(), description) == EMPTY );
+  TEST_ASSERT( checkpoint.valid_size() == 0 );
+
+  // Records before time 10 are kept, also the ones that arrived after
+  // later records, and the torn record at the end is removed
+  {
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    const char data[] = {'H', 'D', 3, 8, 'a', 2, 10, 4, 12, 'b', 'c', 2, 9, 3, 11, 'd', 4, 7};
+    out.write(data, sizeof(data));
+  }
+  TEST_ASSERT( resume_records(filename.c_str(), 2, test_record_size, test_record_time, 10) );
+  {
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    TEST_ASSERT( data == std::string("HD\3\10a\2\11", 7) );
+  }
+  // Resuming again doesn't change the file
+  TEST_ASSERT( resume_records(filename.c_str(), 2, test_record_size, test_record_time, 10) );
+  {
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    TEST_ASSERT( data == std::string("HD\3\10a\2\11", 7) );
+  }
+  // A file without its header
+  {
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out << "H";
+  }
+  TEST_ASSERT( !resume_records(filename.c_str(), 2, test_record_size, test_record_time, 10) );
+  unlink(filename.c_str());
+  TEST_ASSERT( !resume_records(filename.c_str(), 2, test_record_size, test_record_time, 10) );
+
+  unlink(filename.c_str());
+}
+#endif // ENABLE_TEST_UNIT
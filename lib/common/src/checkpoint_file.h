@@ -0,0 +1,90 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ * This file is part of:
+ *   - common library
+ * This file contains:
+ *   - the declaration of Checkpoint_file, which reads the last complete
+ *     record of a checkpoint file and resumes files of time stamped
+ *     records.
+ */
+#ifndef CHECKPOINT_FILE_H
+#define CHECKPOINT_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#ifdef ENABLE_TEST_UNIT
+#include "Test_unit.h"
+#endif // ENABLE_TEST_UNIT
+
+/**
+ * A checkpoint file is a text file of which the first line describes
+ * what is checkpointed, every following line is a record of integers.
+ * The records are appended, the program might stop while it writes one,
+ * so a line without a newline at the end is not part of the file.
+ **/
+class Checkpoint_file {
+public:
+  enum Status {
+    /// The file doesn't exist
+    MISSING = 0,
+    /// The description is not complete or there are no records
+    EMPTY,
+    /// The file has a different description
+    DIFFERENT,
+    /// record() is the last complete record
+    FOUND
+  };
+
+  Checkpoint_file();
+
+  /// Reads the last complete record of filename, if its first line is
+  /// description. Reading stops at a line that is not a record.
+  Status read(const char *filename, const std::string &description);
+
+  const std::vector<int64_t> &record() const {
+    return record_;
+  }
+  /// Size of the file up to and including the last complete record (or
+  /// the description), the rest of the file should be truncated
+  int64_t valid_size() const {
+    return valid_size_;
+  }
+  /// The first line of the file
+  const std::string &description() const {
+    return description_;
+  }
+
+  /// Size of the record at data, or 0 if the len bytes at data don't
+  /// hold a complete record
+  typedef size_t (*Record_size)(const char *data, size_t len);
+  /// Time stamp of a record
+  typedef int64_t (*Record_time)(const char *record);
+
+  /// Resumes a file of records that arrive in any order at a checkpoint.
+  /// The file keeps its header_size bytes of header and the records with
+  /// a time stamp before time, the others are written again by the
+  /// resumed program. A torn record at the end is removed.
+  static bool resume_records(const char *filename, size_t header_size,
+                             Record_size record_size, Record_time record_time,
+                             int64_t time);
+
+#ifdef ENABLE_TEST_UNIT
+  class Test : public Test_aclass<Checkpoint_file> {
+  public:
+    void tests();
+  };
+#endif // ENABLE_TEST_UNIT
+
+private:
+  std::vector<int64_t> record_;
+  int64_t valid_size_;
+  std::string description_;
+};
+
+#endif // CHECKPOINT_FILE_H
@@ -14,6 +14,8 @@
 #ifndef CONDITION_H
 #define CONDITION_H
 
+#include <errno.h>
+#include <time.h>
 #include "mutex.h"
 
 /**************************************
@@ -44,6 +46,15 @@ public:
     pthread_cond_wait( &condition_, &mutex_ );
   }
 
+  /************************************
+  * Wait like wait(), but at most until
+  * the absolute time abstime. Returns
+  * false if the time passed.
+  *************************************/
+  inline bool timed_wait(const struct timespec &abstime) {
+    return pthread_cond_timedwait( &condition_, &mutex_, &abstime ) != ETIMEDOUT;
+  }
+
   /************************************
   * Signal one of the waiters that the
   * condition may have changed.
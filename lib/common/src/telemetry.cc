@@ -0,0 +1,516 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ * This file is part of:
+ *   - common library
+ * This file contains:
+ *   - the implementation of the telemetry metrics and of Telemetry
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <vector>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "telemetry.h"
+#include "mutex.h"
+#include "raiimutex.h"
+
+uint64_t telemetry_usec() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+namespace {
+
+// Created on first use, so that metrics in static objects can register
+struct Registry {
+  Mutex mutex;
+  std::vector<Telemetry_metric *> metrics;
+};
+
+Registry &registry() {
+  static Registry *registry = new Registry();
+  return *registry;
+}
+
+struct Writer_state {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool running;
+
+  Telemetry_output output;
+  Telemetry::Format format;
+  int interval_ms;
+  std::string labels;
+};
+
+Writer_state writer_state;
+volatile uint64_t unique_counter = 0;
+
+std::string json_string(const std::string &str) {
+  std::string result = "\"";
+  for (size_t i = 0; i < str.size(); i++) {
+    if ((str[i] == '"') || (str[i] == '\\'))
+      result += '\\';
+    if ((unsigned char)str[i] >= ' ')
+      result += str[i];
+  }
+  return result + "\"";
+}
+
+std::string prometheus_labels(const std::string &labels,
+                              const std::string &instance) {
+  std::string result = "{";
+  if (!labels.empty())
+    result += labels + ",";
+  return result + "instance=" + json_string(instance) + "}";
+}
+
+bool write_all(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t result = send(fd, data.data() + written, data.size() - written,
+                          MSG_NOSIGNAL);
+    if ((result < 0) && (errno == EINTR))
+      continue;
+    if (result <= 0)
+      return false;
+    written += result;
+  }
+  return true;
+}
+
+void write_dump() {
+  Writer_state &state = writer_state;
+  std::ostringstream out;
+  Telemetry::dump(out, state.format, state.labels);
+  // A JSON dump is one line that is appended, a Prometheus dump replaces
+  // the previous one
+  state.output.write(out.str(), state.format == Telemetry::PROMETHEUS);
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////
+//
+// Telemetry_metric
+//
+////////////////////////////////////////////////////////////////////////
+Telemetry_metric::Telemetry_metric(const char *family,
+                                   const std::string &instance)
+  : family_(family), instance_(instance) {
+  Telemetry::register_metric(this);
+}
+
+Telemetry_metric::Telemetry_metric(const Telemetry_metric &other)
+  : family_(other.family_), instance_(other.instance()) {
+  Telemetry::register_metric(this);
+}
+
+Telemetry_metric::~Telemetry_metric() {
+  Telemetry::unregister_metric(this);
+}
+
+std::string
+Telemetry_metric::instance() const {
+  RAIIMutex lock(registry().mutex);
+  return instance_;
+}
+
+void
+Telemetry_metric::set_instance(const std::string &instance) {
+  RAIIMutex lock(registry().mutex);
+  instance_ = instance;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Telemetry_counter, Telemetry_gauge and Telemetry_histogram
+//
+////////////////////////////////////////////////////////////////////////
+Telemetry_counter::Telemetry_counter(const char *family,
+                                     const std::string &instance)
+  : Telemetry_metric(family, instance), value_(0) {}
+
+void
+Telemetry_counter::write_json(std::ostream &out) {
+  out << "\"value\":" << value();
+}
+
+void
+Telemetry_counter::write_prometheus(std::ostream &out,
+                                    const std::string &labels) {
+  out << "sfxc_" << family() << labels << " " << value() << "\n";
+}
+
+Telemetry_gauge::Telemetry_gauge(const char *family,
+                                 const std::string &instance)
+  : Telemetry_metric(family, instance), value_(0), max_(0) {}
+
+void
+Telemetry_gauge::write_json(std::ostream &out) {
+  int64_t value = this->value();
+  // Start the next interval with the current value
+  int64_t max = __sync_lock_test_and_set(&max_, value);
+  out << "\"value\":" << value << ",\"max\":" << std::max(max, value);
+}
+
+void
+Telemetry_gauge::write_prometheus(std::ostream &out,
+                                  const std::string &labels) {
+  int64_t value = this->value();
+  int64_t max = __sync_lock_test_and_set(&max_, value);
+  out << "sfxc_" << family() << labels << " " << value << "\n"
+      << "sfxc_" << family() << "_max" << labels << " "
+      << std::max(max, value) << "\n";
+}
+
+Telemetry_histogram::Telemetry_histogram(const char *family,
+                                         const std::string &instance)
+  : Telemetry_metric(family, instance), sum_(0) {
+  for (int i = 0; i < NR_BUCKETS; i++)
+    buckets_[i] = 0;
+}
+
+uint64_t
+Telemetry_histogram::count() {
+  uint64_t result = 0;
+  for (int i = 0; i < NR_BUCKETS; i++)
+    result += load(buckets_[i]);
+  return result;
+}
+
+void
+Telemetry_histogram::write_json(std::ostream &out) {
+  uint64_t count = 0;
+  std::ostringstream buckets;
+  for (int i = 0; i < NR_BUCKETS; i++) {
+    uint64_t value = load(buckets_[i]);
+    count += value;
+    buckets << (i == 0 ? "" : ",") << value;
+  }
+  out << "\"count\":" << count << ",\"sum\":" << sum()
+      << ",\"buckets\":[" << buckets.str() << "]";
+}
+
+void
+Telemetry_histogram::write_prometheus(std::ostream &out,
+                                      const std::string &labels) {
+  // Prometheus buckets are cumulative, with an upper bound "le"
+  std::string bucket_labels = labels.substr(0, labels.size() - 1);
+  uint64_t count = 0;
+  for (int i = 0; i < NR_BUCKETS - 1; i++) {
+    count += load(buckets_[i]);
+    out << "sfxc_" << family() << "_bucket" << bucket_labels
+        << ",le=\"" << ((uint64_t)1 << i) - 1 << "\"} " << count << "\n";
+  }
+  count += load(buckets_[NR_BUCKETS - 1]);
+  out << "sfxc_" << family() << "_bucket" << bucket_labels
+      << ",le=\"+Inf\"} " << count << "\n"
+      << "sfxc_" << family() << "_sum" << labels << " " << sum() << "\n"
+      << "sfxc_" << family() << "_count" << labels << " " << count << "\n";
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Telemetry_thread_usage
+//
+////////////////////////////////////////////////////////////////////////
+Telemetry_thread_usage::Telemetry_thread_usage(const std::string &thread)
+  : busy_("thread_busy_usec", thread), idle_("thread_idle_usec", thread),
+    last_(telemetry_usec()) {}
+
+void
+Telemetry_thread_usage::set_name(const std::string &thread) {
+  busy_.set_instance(thread);
+  idle_.set_instance(thread);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Telemetry_output
+//
+////////////////////////////////////////////////////////////////////////
+Telemetry_output::Telemetry_output() : type_(FILE_OUTPUT), fd_(-1) {}
+
+Telemetry_output::~Telemetry_output() {
+  close();
+}
+
+bool
+Telemetry_output::open(const std::string &output) {
+  close();
+  if (output.compare(0, 7, "file://") == 0) {
+    type_ = FILE_OUTPUT;
+  } else if (output.compare(0, 7, "unix://") == 0) {
+    type_ = SOCKET_OUTPUT;
+  } else {
+    return false;
+  }
+  path_ = output.substr(7);
+  return !path_.empty();
+}
+
+void
+Telemetry_output::write(const std::string &data, bool replace) {
+  if (type_ == FILE_OUTPUT) {
+    if (!replace) {
+      std::ofstream file(path_.c_str(), std::ios::app);
+      file << data;
+    } else {
+      // Replace the file at once, readers never see a partial dump
+      std::string tmp_path = path_ + ".tmp";
+      std::ofstream file(tmp_path.c_str());
+      file << data;
+      file.close();
+      if (!file || (rename(tmp_path.c_str(), path_.c_str()) != 0))
+        unlink(tmp_path.c_str());
+    }
+    return;
+  }
+
+  // Connect again if the collector went away
+  if (fd_ < 0) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd_ >= 0) &&
+        (connect(fd_, (struct sockaddr *)&address, sizeof(address)) != 0)) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (fd_ < 0)
+      return;
+  }
+  if (!write_all(fd_, data))
+    close();
+}
+
+void
+Telemetry_output::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Telemetry
+//
+////////////////////////////////////////////////////////////////////////
+void
+Telemetry::register_metric(Telemetry_metric *metric) {
+  RAIIMutex lock(registry().mutex);
+  registry().metrics.push_back(metric);
+}
+
+void
+Telemetry::unregister_metric(Telemetry_metric *metric) {
+  RAIIMutex lock(registry().mutex);
+  std::vector<Telemetry_metric *> &metrics = registry().metrics;
+  for (size_t i = 0; i < metrics.size(); i++) {
+    if (metrics[i] == metric) {
+      metrics[i] = metrics.back();
+      metrics.pop_back();
+      return;
+    }
+  }
+}
+
+std::string
+Telemetry::unique_name(const char *prefix) {
+  std::ostringstream name;
+  name << prefix << __sync_fetch_and_add(&unique_counter, 1);
+  return name.str();
+}
+
+void
+Telemetry::dump(std::ostream &out, Format format, const std::string &labels) {
+  RAIIMutex lock(registry().mutex);
+
+  // Group the metrics by family, sorted by instance
+  typedef std::map<std::string, std::multimap<std::string, Telemetry_metric *> > Families;
+  Families families;
+  std::vector<Telemetry_metric *> &metrics = registry().metrics;
+  for (size_t i = 0; i < metrics.size(); i++) {
+    families[metrics[i]->family_].insert(std::make_pair(metrics[i]->instance_,
+                                                        metrics[i]));
+  }
+
+  if (format == JSON) {
+    uint64_t now = telemetry_usec();
+    out << "{\"time\":" << now / 1000000 << "." << std::setw(6)
+        << std::setfill('0') << now % 1000000 << std::setfill(' ');
+    // The labels are in Prometheus syntax: name="value",...
+    out << ",\"labels\":{";
+    std::string::size_type pos = 0;
+    while (pos < labels.size()) {
+      std::string::size_type end = labels.find("\",", pos);
+      end = (end == std::string::npos ? labels.size() : end + 1);
+      std::string label = labels.substr(pos, end - pos);
+      std::string::size_type equal = label.find('=');
+      if (equal != std::string::npos) {
+        out << (pos == 0 ? "" : ",") << json_string(label.substr(0, equal))
+            << ":" << label.substr(equal + 1);
+      }
+      pos = end + 1;
+    }
+    out << "},\"metrics\":[";
+    bool first = true;
+    for (Families::iterator family = families.begin();
+         family != families.end(); family++) {
+      for (std::multimap<std::string, Telemetry_metric *>::iterator it =
+             family->second.begin(); it != family->second.end(); it++) {
+        out << (first ? "" : ",") << "{\"name\":" << json_string(family->first)
+            << ",\"instance\":" << json_string(it->first) << ",";
+        it->second->write_json(out);
+        out << "}";
+        first = false;
+      }
+    }
+    out << "]}\n";
+  } else {
+    for (Families::iterator family = families.begin();
+         family != families.end(); family++) {
+      const char *type = family->second.begin()->second->type();
+      out << "# TYPE sfxc_" << family->first << " " << type << "\n";
+      for (std::multimap<std::string, Telemetry_metric *>::iterator it =
+             family->second.begin(); it != family->second.end(); it++) {
+        it->second->write_prometheus(out, prometheus_labels(labels, it->first));
+      }
+    }
+    out << "# EOF\n";
+  }
+}
+
+int64_t
+Telemetry::sum(const char *family, const std::string &prefix) {
+  RAIIMutex lock(registry().mutex);
+  int64_t result = 0;
+  std::vector<Telemetry_metric *> &metrics = registry().metrics;
+  for (size_t i = 0; i < metrics.size(); i++) {
+    if ((strcmp(metrics[i]->family_, family) == 0) &&
+        (metrics[i]->instance_.compare(0, prefix.size(), prefix) == 0))
+      result += metrics[i]->total();
+  }
+  return result;
+}
+
+bool
+Telemetry::start(const std::string &output, Format format, int interval_ms,
+                 const std::string &labels) {
+  Writer_state &state = writer_state;
+  if (state.running)
+    return false;
+  if (!state.output.open(output) || (interval_ms <= 0))
+    return false;
+
+  state.format = format;
+  state.interval_ms = interval_ms;
+  state.labels = labels;
+  state.running = true;
+  pthread_mutex_init(&state.mutex, NULL);
+  pthread_cond_init(&state.cond, NULL);
+  if (pthread_create(&state.thread, NULL, writer, NULL) != 0) {
+    state.running = false;
+    return false;
+  }
+  return true;
+}
+
+void
+Telemetry::stop() {
+  Writer_state &state = writer_state;
+  if (!state.running)
+    return;
+  pthread_mutex_lock(&state.mutex);
+  state.running = false;
+  pthread_cond_signal(&state.cond);
+  pthread_mutex_unlock(&state.mutex);
+  pthread_join(state.thread, NULL);
+
+  write_dump();
+  state.output.close();
+}
+
+void *
+Telemetry::writer(void *) {
+  Writer_state &state = writer_state;
+  pthread_mutex_lock(&state.mutex);
+  while (state.running) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t usec = now.tv_usec + (uint64_t)state.interval_ms * 1000;
+    struct timespec timeout;
+    timeout.tv_sec = now.tv_sec + usec / 1000000;
+    timeout.tv_nsec = (usec % 1000000) * 1000;
+    while (state.running &&
+           (pthread_cond_timedwait(&state.cond, &state.mutex, &timeout) != ETIMEDOUT))
+      ;
+    if (!state.running)
+      break;
+    pthread_mutex_unlock(&state.mutex);
+    write_dump();
+    pthread_mutex_lock(&state.mutex);
+  }
+  pthread_mutex_unlock(&state.mutex);
+  return NULL;
+}
+
+#ifdef ENABLE_TEST_UNIT
+void Telemetry::Test::tests() {
+  Telemetry_counter counter("test_counter", "test");
+  Telemetry_gauge gauge("test_gauge", "test");
+  Telemetry_histogram histogram("test_histogram", "test");
+
+  counter.add(3);
+  counter.add(4);
+  TEST_ASSERT( counter.value() == 7 );
+
+  gauge.set(10);
+  gauge.add(-7);
+  TEST_ASSERT( gauge.value() == 3 );
+
+  histogram.record(0);
+  histogram.record(1);
+  histogram.record(1000);
+  TEST_ASSERT( histogram.count() == 3 );
+  TEST_ASSERT( histogram.sum() == 1001 );
+
+  Telemetry_counter other("test_counter", "test_other");
+  other.add(5);
+  TEST_ASSERT( sum("test_counter", "test") == 12 );
+  TEST_ASSERT( sum("test_counter", "test_o") == 5 );
+  TEST_ASSERT( sum("test_histogram", "") == 1001 );
+
+  std::ostringstream json;
+  dump(json, JSON, "rank=\"0\"");
+  TEST_ASSERT( json.str().find("\"labels\":{\"rank\":\"0\"}") != std::string::npos );
+  TEST_ASSERT( json.str().find("{\"name\":\"test_gauge\",\"instance\":\"test\",\"value\":3,\"max\":10}") != std::string::npos );
+
+  std::ostringstream prometheus;
+  dump(prometheus, PROMETHEUS, "rank=\"0\"");
+  TEST_ASSERT( prometheus.str().find("sfxc_test_counter{rank=\"0\",instance=\"test\"} 7\n") != std::string::npos );
+  TEST_ASSERT( prometheus.str().find("sfxc_test_histogram_bucket{rank=\"0\",instance=\"test\",le=\"1\"} 2\n") != std::string::npos );
+}
+#endif // ENABLE_TEST_UNIT
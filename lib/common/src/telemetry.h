@@ -0,0 +1,271 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ * This file is part of:
+ *   - common library
+ * This file contains:
+ *   - the declaration of the telemetry counters, gauges and histograms
+ *     and of Telemetry, which periodically dumps them.
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <string>
+#include <iostream>
+
+#ifdef ENABLE_TEST_UNIT
+#include "Test_unit.h"
+#endif // ENABLE_TEST_UNIT
+
+/// Wall clock time in microseconds
+uint64_t telemetry_usec();
+
+/********************************************************
+* Base class of the metrics. A metric registers itself
+* at construction and is part of every dump until it is
+* destroyed. The metrics are identified by their family
+* (e.g. "queue_depth") and an instance name (e.g. the
+* name of the queue). Updating a metric doesn't take a
+* lock, only creating, renaming and dumping do.
+***/
+class Telemetry_metric {
+public:
+  virtual ~Telemetry_metric();
+
+  const char *family() const {
+    return family_;
+  }
+  std::string instance() const;
+  void set_instance(const std::string &instance);
+
+protected:
+  Telemetry_metric(const char *family, const std::string &instance);
+  /// A copy is a new metric with the same name
+  Telemetry_metric(const Telemetry_metric &other);
+  /// Assignment keeps the name of the metric
+  Telemetry_metric &operator=(const Telemetry_metric &) {
+    return *this;
+  }
+
+  static uint64_t load(volatile uint64_t &value) {
+    return __sync_fetch_and_add(&value, 0);
+  }
+  static int64_t load(volatile int64_t &value) {
+    return __sync_fetch_and_add(&value, 0);
+  }
+
+private:
+  friend class Telemetry;
+  virtual const char *type() const = 0;
+  /// The value that is added up by Telemetry::sum()
+  virtual int64_t total() = 0;
+  virtual void write_json(std::ostream &out) = 0;
+  virtual void write_prometheus(std::ostream &out, const std::string &labels) = 0;
+
+  const char *family_;
+  std::string instance_;
+};
+
+/// A monotonically increasing count, e.g. bytes or FFTs
+class Telemetry_counter : public Telemetry_metric {
+public:
+  Telemetry_counter(const char *family, const std::string &instance);
+
+  void add(uint64_t n) {
+    __sync_fetch_and_add(&value_, n);
+  }
+  uint64_t value() {
+    return load(value_);
+  }
+
+private:
+  const char *type() const {
+    return "counter";
+  }
+  int64_t total() {
+    return value();
+  }
+  void write_json(std::ostream &out);
+  void write_prometheus(std::ostream &out, const std::string &labels);
+
+  volatile uint64_t value_;
+};
+
+/// A value that goes up and down, e.g. the depth of a queue. The
+/// maximum is the highest value since the previous dump, so that
+/// short peaks between two dumps are not missed.
+class Telemetry_gauge : public Telemetry_metric {
+public:
+  Telemetry_gauge(const char *family, const std::string &instance);
+
+  void set(int64_t value) {
+    value_ = value;
+    update_max(value);
+  }
+  void add(int64_t n) {
+    update_max(__sync_add_and_fetch(&value_, n));
+  }
+  int64_t value() {
+    return load(value_);
+  }
+
+private:
+  void update_max(int64_t value) {
+    int64_t max = max_;
+    while (value > max) {
+      int64_t old = __sync_val_compare_and_swap(&max_, max, value);
+      if (old == max)
+        break;
+      max = old;
+    }
+  }
+
+  const char *type() const {
+    return "gauge";
+  }
+  int64_t total() {
+    return value();
+  }
+  void write_json(std::ostream &out);
+  void write_prometheus(std::ostream &out, const std::string &labels);
+
+  volatile int64_t value_;
+  volatile int64_t max_;
+};
+
+/// Distribution of durations in microseconds, with power of two
+/// buckets: bucket 0 counts the zeros and bucket i the values in
+/// [2^(i-1), 2^i).
+class Telemetry_histogram : public Telemetry_metric {
+public:
+  enum { NR_BUCKETS = 32 };
+
+  Telemetry_histogram(const char *family, const std::string &instance);
+
+  void record(uint64_t usec) {
+    int bucket = (usec == 0 ? 0 : 64 - __builtin_clzll(usec));
+    if (bucket >= NR_BUCKETS)
+      bucket = NR_BUCKETS - 1;
+    __sync_fetch_and_add(&buckets_[bucket], 1);
+    __sync_fetch_and_add(&sum_, usec);
+  }
+  uint64_t count();
+  uint64_t sum() {
+    return load(sum_);
+  }
+
+private:
+  const char *type() const {
+    return "histogram";
+  }
+  int64_t total() {
+    return sum();
+  }
+  void write_json(std::ostream &out);
+  void write_prometheus(std::ostream &out, const std::string &labels);
+
+  volatile uint64_t buckets_[NR_BUCKETS];
+  volatile uint64_t sum_;
+};
+
+/// Busy and idle time of a thread. The thread calls busy() after it
+/// did some work and idle() after it waited or slept, the time since
+/// the previous call is added to the corresponding counter.
+class Telemetry_thread_usage {
+public:
+  Telemetry_thread_usage(const std::string &thread);
+
+  void set_name(const std::string &thread);
+
+  void busy() {
+    uint64_t now = telemetry_usec();
+    busy_.add(now - last_);
+    last_ = now;
+  }
+  void idle() {
+    uint64_t now = telemetry_usec();
+    idle_.add(now - last_);
+    last_ = now;
+  }
+
+private:
+  Telemetry_counter busy_;
+  Telemetry_counter idle_;
+  uint64_t last_;
+};
+
+/// Destination of periodic dumps, "file://<path>" or "unix://<path>"
+/// (a stream socket that is connected to)
+class Telemetry_output {
+public:
+  Telemetry_output();
+  ~Telemetry_output();
+
+  /// \return false if the output is not valid
+  bool open(const std::string &output);
+  /// Appends data to the output, or replaces the contents of a file at
+  /// once if replace is set. A socket is connected again if the reader
+  /// went away.
+  void write(const std::string &data, bool replace);
+  void close();
+
+private:
+  Telemetry_output(const Telemetry_output &);
+  Telemetry_output &operator=(const Telemetry_output &);
+
+  enum { FILE_OUTPUT, SOCKET_OUTPUT } type_;
+  std::string path_;
+  int fd_;
+};
+
+/********************************************************
+* The registry of all metrics of the process, and the
+* thread that dumps them.
+***/
+class Telemetry {
+public:
+  enum Format {
+    JSON,        // One line per dump
+    PROMETHEUS   // Prometheus text format, a dump ends with "# EOF"
+  };
+
+  /// Starts dumping the metrics every interval_ms milliseconds to
+  /// output, which is "file://<path>" or "unix://<path>" (a stream
+  /// socket that is connected to). A JSON dump is appended to the
+  /// file, a Prometheus dump replaces it. The labels are added to
+  /// every dump, e.g. rank="3",host="node1".
+  /// \return false if the output is not valid
+  static bool start(const std::string &output, Format format,
+                    int interval_ms, const std::string &labels);
+
+  /// Writes a last dump and stops the thread
+  static void stop();
+
+  static void dump(std::ostream &out, Format format, const std::string &labels);
+
+  /// The sum of the values of the metrics of a family of which the
+  /// instance name starts with prefix, e.g. the busy time of all
+  /// threads named "input_writer..."
+  static int64_t sum(const char *family, const std::string &prefix);
+
+  /// A name that is unique in the process, prefix followed by a number
+  static std::string unique_name(const char *prefix);
+
+#ifdef ENABLE_TEST_UNIT
+  class Test : public Test_aclass<Telemetry> {
+  public:
+    void tests();
+  };
+#endif // ENABLE_TEST_UNIT
+
+private:
+  friend class Telemetry_metric;
+  static void register_metric(Telemetry_metric *metric);
+  static void unregister_metric(Telemetry_metric *metric);
+  static void *writer(void *);
+};
+
+#endif // TELEMETRY_H
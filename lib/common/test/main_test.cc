@@ -4,6 +4,8 @@
 #include "backtrace.h"
 #include "demangler.h"
 #include "monitor.h"
+#include "telemetry.h"
+#include "checkpoint_file.h"
 
 int main(int argc, char** argv) {
   std::cout << "Starting tests" << std::endl;
@@ -12,6 +14,8 @@ int main(int argc, char** argv) {
   Test_manager manager;
   //manager.add_test( new Backtrace::Test() );
   manager.add_test( new QOS_MonitorSpeed::Test() );
+  manager.add_test( new Telemetry::Test() );
+  manager.add_test( new Checkpoint_file::Test() );
   manager.do_test();
 #endif //
 
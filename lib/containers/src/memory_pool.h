@@ -27,6 +27,7 @@
 #include "default_allocator.h"
 
 #include "utils.h"
+#include "telemetry.h"
 
 #ifdef ENABLE_TEST_UNIT
 #include "Test_unit.h"
@@ -329,6 +330,13 @@ class NoResize_policy : public Resize_policy {
   *************************************/
   unsigned int size();
 
+  /************************************
+  * Name of the pool in the telemetry,
+  * which has the number of allocated elements
+  * and the time blocked in allocate()
+  *************************************/
+  void set_name(const std::string &name);
+
   /************************************
   * Do not use these they are for
   * for internal use.
@@ -345,7 +353,8 @@ class Test : public Test_aclass< Memory_pool<T> > {
   };
 #endif //ENABLE_TEST_UNIT
 private:
-  Memory_pool<T>() {}
+  Memory_pool<T>()
+    : used_("pool_used", ""), allocate_blocked_("allocate_blocked_usec", "") {}
   ;
 
   /************************************
@@ -378,6 +387,9 @@ private:
   Memory_pool(const Memory_pool<T>&);
   PolicyPtr policy_;
   AllocatorPtr allocator_;
+
+  Telemetry_gauge used_;
+  Telemetry_histogram allocate_blocked_;
 };
 
 ////////////////// IMPLEMENTATION (I Hate c++ template) ///////////////
@@ -388,7 +400,8 @@ template<class T>
 typename Memory_pool<T>::Element Memory_pool<T>::Element::None;
 
 template<class T>
-Memory_pool<T>::Memory_pool(const Memory_pool<T>&) {
+Memory_pool<T>::Memory_pool(const Memory_pool<T>&)
+  : used_("pool_used", ""), allocate_blocked_("allocate_blocked_usec", "") {
   MASSERT(false && "Not implemented");
 }
 
@@ -439,7 +452,9 @@ Memory_pool<T>::Memory_pool(unsigned int numelements,
 													  Resize_policy_type type,
 													  AllocatorPtr allocator) :
 	policy_( Resize_policy::create(type) ),
-	allocator_(allocator)
+	allocator_(allocator),
+	used_("pool_used", Telemetry::unique_name("pool")),
+	allocate_blocked_("allocate_blocked_usec", used_.instance())
 {
   mid = sid++;
   for (unsigned int i=0;i<numelements;i++) {
@@ -458,7 +473,9 @@ template<class T>
 Memory_pool<T>::Memory_pool(unsigned int numelements,
 													  AllocatorPtr allocator,
 														PolicyPtr policy) :
-policy_(policy), allocator_(allocator)
+policy_(policy), allocator_(allocator),
+used_("pool_used", Telemetry::unique_name("pool")),
+allocate_blocked_("allocate_blocked_usec", used_.instance())
 {
   mid = sid++;
   for (unsigned int i=0;i<numelements;i++) {
@@ -539,14 +556,21 @@ typename Memory_pool<T>::Element Memory_pool<T>::allocate() {
     //std::cout << "RESIZE TERMINATED:" << std::endl;
   }
 
-  // use a while loop instead of an if to avoid
-  // the spurious signal waking up.
-  while ( m_freequeue.size() == 0 ) {
-    m_freequeuecond.wait();
+  if ( m_freequeue.size() == 0 ) {
+    uint64_t start = telemetry_usec();
+    // use a while loop instead of an if to avoid
+    // the spurious signal waking up.
+    while ( m_freequeue.size() == 0 ) {
+      m_freequeuecond.wait();
+    }
+    allocate_blocked_.record(telemetry_usec() - start);
+  } else {
+    allocate_blocked_.record(0);
   }
 
   T* element = m_freequeue.top();
   m_freequeue.pop();
+  used_.set(m_vectorelements.size() - m_freequeue.size());
 
 	TS_Reference* ref = m_freerefqueue.top();
 	m_freerefqueue.pop();
@@ -560,6 +584,7 @@ void Memory_pool<T>::release(Element& element) {
   RAIIMutex rc(m_freequeuecond);
   m_freequeue.push(element.m_data);
   m_freerefqueue.push(element.m_reference_counter);
+  used_.set(m_vectorelements.size() - m_freequeue.size());
 
   MASSERT( m_freequeue.size() <= m_vectorelements.size() );
   MASSERT( m_freerefqueue.size() <= m_vectorreferences.size() );
@@ -592,6 +617,12 @@ unsigned int Memory_pool<T>::size() {
   return m_vectorelements.size();
 }
 
+template<class T>
+void Memory_pool<T>::set_name(const std::string &name) {
+  used_.set_instance(name);
+  allocate_blocked_.set_instance(name);
+}
+
 template<class T>
 unsigned int Memory_pool<T>::size_no_lock() {
   return m_vectorelements.size();
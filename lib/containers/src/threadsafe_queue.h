@@ -23,6 +23,7 @@
 #include "condition.h"
 #include "exception_common.h"
 #include "allocator.h"
+#include "telemetry.h"
 
 #ifdef ENABLE_TEST_UNIT
 #include "Test_unit.h"
@@ -56,14 +57,19 @@ public:
   typedef T     Type;
   typedef Type  value_type;
 
-  Threadsafe_queue() { isclose_ = false; }
+  Threadsafe_queue()
+    : depth_("queue_depth", Telemetry::unique_name("queue")) { isclose_ = false; }
   virtual ~Threadsafe_queue() { close(); }
 
+  /// Name of the queue in the telemetry
+  void set_name(const std::string &name) { depth_.set_instance(name); }
+
   void push( Type element ) {
 		if( isclose_ )throw QueueClosedException();
 
     RAIIMutex rc(m_queuecond);
     m_queue.push(element);
+    depth_.set(m_queue.size());
     if( m_queue.size() != 0 ) m_queuecond.signal();
   }
 
@@ -95,6 +101,7 @@ public:
 			 if( isclose_ )throw QueueClosedException();
     }
     m_queue.pop();
+    depth_.set(m_queue.size());
   }
 
   Type front_and_pop() {
@@ -106,6 +113,7 @@ public:
     }
     Type element = m_queue.front();
     m_queue.pop();
+    depth_.set(m_queue.size());
     return element;
   }
 
@@ -117,6 +125,7 @@ public:
     }
     Type element = m_queue.front();
     m_queue.pop();
+    depth_.set(m_queue.size());
     return element;
   }
 
@@ -155,6 +164,8 @@ private:
   Condition m_queuecond;
 
   bool isclose_;
+
+  Telemetry_gauge depth_;
 };
 
 /////////////////// IMPLEMENTATION (I hate c++ template) ///////////////
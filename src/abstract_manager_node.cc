@@ -21,7 +21,8 @@ Abstract_manager_node::
 Abstract_manager_node(int rank, int numtasks,
                       Log_writer *writer,
                       const Control_parameters &param)
-    : Node(rank, writer), control_parameters(param), numtasks(numtasks), pulsar_parameters(*writer) {
+    : Node(rank, writer), control_parameters(param), numtasks(numtasks), pulsar_parameters(*writer),
+      scan_tables_nr(0) {
   integration_time_ = Time(param.integration_time());
   }
 
@@ -231,14 +232,18 @@ set_data_writer_void(int writer_rank, int writer_stream_nr) {
 void
 Abstract_manager_node::
 set_data_writer(int rank, int stream_nr,
-                const std::string &filename) {
+                const std::string &filename, int64_t size) {
   //DEBUG_MSG(rank << "[" << stream_nr << "] => " << filename);
   SFXC_ASSERT(strncmp(filename.c_str(), "file://", 7) == 0);
   int len = sizeof(int32_t) + filename.size() +1; // for \0
+  if (size >= 0)
+    len += sizeof(int64_t);
   char msg[len];
   memcpy(msg,&stream_nr,sizeof(int32_t));
   memcpy(msg+sizeof(int32_t), filename.c_str(), filename.size()+1);
-  SFXC_ASSERT(msg[len-1] == '\0');
+  SFXC_ASSERT(msg[sizeof(int32_t) + filename.size()] == '\0');
+  if (size >= 0)
+    memcpy(msg + sizeof(int32_t) + filename.size() + 1, &size, sizeof(int64_t));
 
   MPI_Send(msg, len, MPI_CHAR,
            rank, MPI_TAG_ADD_DATA_WRITER_FILE2, MPI_COMM_WORLD);
@@ -246,6 +251,32 @@ set_data_writer(int rank, int stream_nr,
   wait_for_setting_up_channel(rank);
 }
 
+void
+Abstract_manager_node::
+set_output_index_file(int stream_nr, const std::string &filename) {
+  SFXC_ASSERT(strncmp(filename.c_str(), "file://", 7) == 0);
+  int len = sizeof(int32_t) + filename.size() +1; // for \0
+  char msg[len];
+  memcpy(msg,&stream_nr,sizeof(int32_t));
+  memcpy(msg+sizeof(int32_t), filename.c_str(), filename.size()+1);
+
+  MPI_Send(msg, len, MPI_CHAR,
+           RANK_OUTPUT_NODE, MPI_TAG_OUTPUT_NODE_SET_INDEX_FILE, MPI_COMM_WORLD);
+}
+
+void
+Abstract_manager_node::
+set_output_averaging(int stream_nr, int channels, int integrations) {
+  // The output node needs the averaging for the global header
+  int32_t msg[3] = {stream_nr, channels, integrations};
+  MPI_Send(msg, 3, MPI_INT32,
+           RANK_OUTPUT_NODE, MPI_TAG_SET_OUTPUT_AVERAGING, MPI_COMM_WORLD);
+  for (size_t i=0; i<correlator_node_rank.size(); i++) {
+    MPI_Send(msg, 3, MPI_INT32,
+             correlator_node_rank[i], MPI_TAG_SET_OUTPUT_AVERAGING, MPI_COMM_WORLD);
+  }
+}
+
 void
 Abstract_manager_node::set_TCP(int writer_rank, int writer_stream_nr,
                                int reader_rank, int reader_stream) {
@@ -349,6 +380,21 @@ input_node_set_time_slice(const std::string &station,
            MPI_TAG_INPUT_NODE_ADD_TIME_SLICE, MPI_COMM_WORLD);
 }
 
+void
+Abstract_manager_node::
+input_node_set_time_slices(const std::string &station, int32_t channel,
+                           int32_t stream_nr, Time start_time,
+                           Time slice_duration, int32_t nr_slices) {
+  int64_t message[] = {channel,
+                       stream_nr,
+                       start_time.get_clock_ticks(),
+                       slice_duration.get_clock_ticks(),
+                       nr_slices};
+  MPI_Send(&message, 5, MPI_INT64,
+           input_rank(station),
+           MPI_TAG_INPUT_NODE_ADD_TIME_SLICES, MPI_COMM_WORLD);
+}
+
 void
 Abstract_manager_node::
 wait_for_setting_up_channel(int rank) {
@@ -462,6 +508,13 @@ input_rank(const std::string &station_name) const {
   return input_rank(input_node(station_name));
 }
 
+int
+Abstract_manager_node::
+correlator_rank(int correlator) const {
+  SFXC_ASSERT((correlator >= 0) && (correlator < (int)correlator_node_rank.size()));
+  return correlator_node_rank[correlator];
+}
+
 void
 Abstract_manager_node::
 correlator_node_set(Correlation_parameters &parameters,
@@ -471,22 +524,62 @@ correlator_node_set(Correlation_parameters &parameters,
 
 void
 Abstract_manager_node::
-correlator_node_set_all(Delay_table &delay_table,
-                        const std::string &station_name) {
+correlator_node_clear_scan_tables() {
+  scan_tables.clear();
+  scan_tables_nr++;
+}
+
+void
+Abstract_manager_node::
+correlator_node_add_scan_table(Delay_table &delay_table,
+                               const std::string &station_name) {
   int sn[2] = {input_node(station_name), -1};
   if (control_parameters.cross_polarize()){
     int nStations = control_parameters.number_stations();
     sn[1] = sn[0] + nStations;
   }
 
-  MPI_Transfer::bcast_corr_nodes(delay_table, sn);
+  std::vector<char> buffer;
+  MPI_Transfer::pack(buffer, delay_table, sn);
+  scan_tables.resize(scan_tables.size() + 1);
+  scan_tables.back().tag = MPI_TAG_DELAY_TABLE;
+  MPI_Transfer::pack_message(buffer, scan_tables.back().message,
+                             control_parameters.compress_delay_tables());
+  get_log_writer()(2) << "delay table of " << station_name << ": "
+                      << buffer.size() << " bytes, "
+                      << scan_tables.back().message.size() << " bytes sent"
+                      << std::endl;
 }
 
 void
 Abstract_manager_node::
-correlator_node_set_all(Uvw_model &uvw_table,
-                        const std::string &station_name) {
-  MPI_Transfer::bcast_corr_nodes(uvw_table, input_node(station_name));
+correlator_node_add_scan_table(Uvw_model &uvw_table,
+                               const std::string &station_name) {
+  std::vector<char> buffer;
+  MPI_Transfer::pack(buffer, uvw_table, input_node(station_name));
+  scan_tables.resize(scan_tables.size() + 1);
+  scan_tables.back().tag = MPI_TAG_UVW_TABLE;
+  MPI_Transfer::pack_message(buffer, scan_tables.back().message,
+                             control_parameters.compress_delay_tables());
+  get_log_writer()(2) << "uvw table of " << station_name << ": "
+                      << buffer.size() << " bytes, "
+                      << scan_tables.back().message.size() << " bytes sent"
+                      << std::endl;
+}
+
+void
+Abstract_manager_node::
+correlator_node_send_scan_tables(int corr_node_nr) {
+  if (correlator_node_scan_tables_nr.size() <= (size_t)corr_node_nr)
+    correlator_node_scan_tables_nr.resize(corr_node_nr + 1, -1);
+  if (correlator_node_scan_tables_nr[corr_node_nr] == scan_tables_nr)
+    return;
+
+  // The tables arrive before the correlation parameters that use them
+  for (size_t i = 0; i < scan_tables.size(); i++)
+    MPI_Transfer::send_message(scan_tables[i].message, scan_tables[i].tag,
+                               correlator_node_rank[corr_node_nr]);
+  correlator_node_scan_tables_nr[corr_node_nr] = scan_tables_nr;
 }
 
 void
@@ -521,7 +614,7 @@ set_correlator_node_ready(size_t correlator_nr, bool ready) {
 #else
 
   if (ready) {
-    ready_correlator_nodes.push(correlator_nr);
+    correlator_node_scheduler.set_ready(correlator_nr);
   }
 #endif
 }
@@ -530,7 +623,8 @@ set_correlator_node_ready(size_t correlator_nr, bool ready) {
 void
 Abstract_manager_node::
 send(Delay_table &delay_table, int station, int to_rank) {
-  MPI_Transfer::send(delay_table, station, to_rank);
+  int sn[2] = {station, -1};
+  MPI_Transfer::send(delay_table, sn, to_rank);
 
 }
 const std::map<std::string, int> &
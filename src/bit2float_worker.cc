@@ -21,6 +21,8 @@ Bit2float_worker::Bit2float_worker(int stream_nr_, bit_statistics_ptr statistics
     /**/
 {
   SFXC_ASSERT(!memory_pool_.empty());
+  output_buffer_->set_name("bit2float" + itoa(stream_nr));
+  memory_pool_.set_name("bit2float" + itoa(stream_nr));
   // Lookup tables used in the bit2float conversion
   for (int i=0; i<256; i++) {
     lookup_table[i][0] = sample_value_ms[i & 3];
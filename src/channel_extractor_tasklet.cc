@@ -30,6 +30,7 @@ Channel_extractor_tasklet(Data_format_reader_ptr reader)
     N(0), samples_per_block(0),
     num_channel_extractor_threads(NUM_CHANNEL_EXTRACTOR_THREADS) {
   init_stats();
+  output_memory_pool_.set_name("channel_extractor");
   last_duration_=0;
 #ifdef USE_EXTRACTOR_5
   ch_extractor = new Channel_extractor_5();
@@ -317,6 +318,7 @@ Channel_extractor_tasklet::get_output_buffer(size_t stream) {
   }
   if (output_buffers_[stream] == Output_buffer_ptr()) {
     output_buffers_[stream] = Output_buffer_ptr(new Output_buffer());
+    output_buffers_[stream]->set_name("channel" + itoa(stream));
   }
   SFXC_ASSERT(output_buffers_[stream] != Output_buffer_ptr());
   return output_buffers_[stream];
@@ -13,14 +13,27 @@
 #include <json/json.h>
 #include <algorithm>
 
+namespace {
+// Key of the memoised vex lookups, vex names don't contain a '\0'
+std::string
+lookup_key(const std::string &a, const std::string &b,
+           const std::string &c = std::string()) {
+  std::string key(a);
+  key += '\0';
+  key += b;
+  key += '\0';
+  key += c;
+  return key;
+}
+}
 
 Control_parameters::Control_parameters()
-    : initialised(false) {}
+    : initialised(false), cross_polarize_value(-1) {}
 
 Control_parameters::Control_parameters(const char *ctrl_file,
                                        const char *vex_file,
                                        std::ostream& log_writer)
-    : initialised(false) {
+    : initialised(false), cross_polarize_value(-1) {
   if(!initialise(ctrl_file, vex_file, log_writer))
     sfxc_abort();
 }
@@ -32,6 +45,16 @@ initialise(const char *ctrl_file, const char *vex_file,
   ctrl_filename = ctrl_file;
   vex_filename = vex_file;
 
+  station_map.clear();
+  bits_per_sample_map.clear();
+  frequency_channel_map.clear();
+  cross_channel_map.clear();
+  polarisation_map.clear();
+  frequency_map.clear();
+  sideband_map.clear();
+  cross_polarize_value = -1;
+  scan_stop_times.clear();
+
   { // parse the control file
     Json::Reader reader;
     std::ifstream in(ctrl_file);
@@ -208,6 +231,37 @@ initialise(const char *ctrl_file, const char *vex_file,
   if(ctrl["exit_on_empty_datastream"] == Json::Value())
     ctrl["exit_on_empty_datastream"] = true;
 
+  // Don't write an index of the output files by default
+  if(ctrl["output_index"] == Json::Value())
+    ctrl["output_index"] = false;
+
+  // Write the visibilities as float by default
+  if(ctrl["output_precision"] == Json::Value())
+    ctrl["output_precision"] = "float32";
+
+  // By default every job is one integration of one channel and a
+  // correlator node gets a new job when the current one is almost done
+  if(ctrl["slices_per_job"] == Json::Value())
+    ctrl["slices_per_job"] = 1;
+  if(ctrl["scheduler_queue_depth"] == Json::Value())
+    ctrl["scheduler_queue_depth"] = 1;
+  if(ctrl["scheduler"] == Json::Value())
+    ctrl["scheduler"] = "fifo";
+  if(ctrl["compress_delay_tables"] == Json::Value())
+    ctrl["compress_delay_tables"] = false;
+
+  // The telemetry is dumped every second when it is enabled
+  if(ctrl["telemetry_format"] == Json::Value())
+    ctrl["telemetry_format"] = "json";
+  if(ctrl["telemetry_interval"] == Json::Value())
+    ctrl["telemetry_interval"] = 1;
+  if(ctrl["status_interval"] == Json::Value())
+    ctrl["status_interval"] = 1;
+  if(ctrl["checkpoint"] == Json::Value())
+    ctrl["checkpoint"] = false;
+  if(ctrl["checkpoint_interval"] == Json::Value())
+    ctrl["checkpoint_interval"] = 10;
+
   if (ctrl["start"].asString().compare("now") == 0) {
     char *now;
     time_t t;
@@ -361,7 +415,9 @@ Control_parameters::check(std::ostream &writer) const {
             std::string filename = create_path((*source_it).asString());
 
             if (filename.find("file://")  != 0 &&
-                filename.find("mk5://") != 0) {
+                filename.find("afile://")  != 0 &&
+                filename.find("mk5://") != 0 &&
+                filename.find("udp://") != 0) {
               ok = false;
               writer
               << "Ctrl-file: invalid data source '" << filename << "'"
@@ -456,6 +512,160 @@ Control_parameters::check(std::ostream &writer) const {
     }
   }
   
+  // Check output precision
+  {
+    std::string precision = ctrl["output_precision"].asString();
+    if ((precision != "float32") && (precision != "float16") &&
+        (precision != "int16")){
+      writer << "Invalid output precision " << precision
+             << ", valid choices are : float32, float16, and int16" << std::endl;
+      ok = false;
+    }
+  }
+
+  // Check the averaging of the output
+  if (ctrl["output_averaging"] != Json::Value()){
+    const Json::Value &averaging = ctrl["output_averaging"];
+    bool valid = averaging.isObject();
+    for (Json::Value::const_iterator it = averaging.begin(); valid && (it != averaging.end()); it++)
+      valid = (*it).isObject();
+    if (!valid){
+      writer << "ctrl-file : output_averaging should map output products to averaging factors" << std::endl;
+      ok = false;
+    } else {
+      int block = output_averaging_block();
+      bool averaged = (block > 1);
+      for (Json::Value::const_iterator it = averaging.begin(); it != averaging.end(); it++){
+        std::string product = it.key().asString();
+        int channels = output_averaging_channels(product);
+        int integrations = output_averaging_integrations(product);
+        if ((channels < 1) || (number_channels() % channels != 0)){
+          writer << "ctrl-file : The number of channels (" << number_channels()
+                 << ") is not a multiple of the channel averaging of " << product << std::endl;
+          ok = false;
+        }
+        if ((integrations < 1) || (block % integrations != 0)){
+          writer << "ctrl-file : The integration averaging of " << product
+                 << " should divide the largest integration averaging (" << block << ")" << std::endl;
+          ok = false;
+        }
+        if (channels > 1)
+          averaged = true;
+      }
+      if (averaged && (ctrl["pulsar_binning"].asBool() || ctrl["phased_array"].asBool())){
+        writer << "ctrl-file : output_averaging cannot be used with pulsar binning or in phased array mode" << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  // Check the scheduling parameters
+  if (!ctrl["slices_per_job"].isIntegral() || (ctrl["slices_per_job"].asInt() < 1)){
+    writer << "ctrl-file : slices_per_job should be a positive integer" << std::endl;
+    ok = false;
+  }
+  if (!ctrl["scheduler_queue_depth"].isIntegral() || (ctrl["scheduler_queue_depth"].asInt() < 1)){
+    writer << "ctrl-file : scheduler_queue_depth should be a positive integer" << std::endl;
+    ok = false;
+  }
+  {
+    std::string scheduler = ctrl["scheduler"].asString();
+    if ((scheduler != "fifo") && (scheduler != "throughput")){
+      writer << "ctrl-file : Invalid scheduler " << scheduler
+             << ", valid choices are : fifo and throughput" << std::endl;
+      ok = false;
+    }
+  }
+
+  // Check the telemetry parameters
+  if (ctrl["telemetry"] != Json::Value()){
+    std::string telemetry = ctrl["telemetry"].asString();
+    if ((telemetry.size() <= 7) ||
+        ((telemetry.compare(0, 7, "file://") != 0) &&
+         (telemetry.compare(0, 7, "unix://") != 0))){
+      writer << "ctrl-file : telemetry should be file://<path> or unix://<path>" << std::endl;
+      ok = false;
+    }
+    std::string format = ctrl["telemetry_format"].asString();
+    if ((format != "json") && (format != "prometheus")){
+      writer << "ctrl-file : Invalid telemetry_format " << format
+             << ", valid choices are : json and prometheus" << std::endl;
+      ok = false;
+    }
+    if (!ctrl["telemetry_interval"].isNumeric() ||
+        (ctrl["telemetry_interval"].asDouble() < 0.001)){
+      writer << "ctrl-file : telemetry_interval should be at least 1 ms" << std::endl;
+      ok = false;
+    }
+  }
+  if (ctrl["status"] != Json::Value()){
+    std::string status = ctrl["status"].asString();
+    if ((status.size() <= 7) ||
+        ((status.compare(0, 7, "file://") != 0) &&
+         (status.compare(0, 7, "unix://") != 0))){
+      writer << "ctrl-file : status should be file://<path> or unix://<path>" << std::endl;
+      ok = false;
+    }
+    if (!ctrl["status_interval"].isNumeric() ||
+        (ctrl["status_interval"].asDouble() < 0.1)){
+      writer << "ctrl-file : status_interval should be at least 0.1 s" << std::endl;
+      ok = false;
+    }
+  }
+  if (!ctrl["checkpoint"].isBool()){
+    writer << "ctrl-file : checkpoint should be true or false" << std::endl;
+    ok = false;
+  } else if (ctrl["checkpoint"].asBool() &&
+             (!ctrl["checkpoint_interval"].isNumeric() ||
+              (ctrl["checkpoint_interval"].asDouble() < 1))){
+    writer << "ctrl-file : checkpoint_interval should be at least 1 s" << std::endl;
+    ok = false;
+  }
+#ifndef HAVE_LIBZ
+  if (ctrl["compress_delay_tables"].asBool()){
+    writer << "ctrl-file : compress_delay_tables needs sfxc built with zlib" << std::endl;
+    ok = false;
+  }
+#endif
+
+  // Check the baseline dependent averaging
+  if (ctrl["baseline_averaging"] != Json::Value()){
+    const Json::Value &averaging = ctrl["baseline_averaging"];
+    if (!averaging.isObject() || !averaging["field_of_view"].isNumeric() ||
+        !averaging["max_integrations"].isIntegral() ||
+        ((averaging["max_smearing"] != Json::Value()) && !averaging["max_smearing"].isNumeric())){
+      writer << "ctrl-file : baseline_averaging should contain field_of_view, max_integrations and optionally max_smearing" << std::endl;
+      ok = false;
+    } else {
+      if (baseline_averaging_fov() <= 0){
+        writer << "ctrl-file : The field_of_view of baseline_averaging should be positive" << std::endl;
+        ok = false;
+      }
+      if (baseline_averaging_integrations() < 1){
+        writer << "ctrl-file : max_integrations of baseline_averaging should be at least 1" << std::endl;
+        ok = false;
+      }
+      if ((baseline_averaging_smearing() <= 0) || (baseline_averaging_smearing() >= 1)){
+        writer << "ctrl-file : max_smearing of baseline_averaging should be between 0 and 1" << std::endl;
+        ok = false;
+      }
+      bool time_averaging = (output_averaging_integrations("default") > 1);
+      const Json::Value &output_averaging = ctrl["output_averaging"];
+      for (Json::Value::const_iterator it = output_averaging.begin(); it != output_averaging.end(); it++){
+        if ((*it).isObject() && (output_averaging_integrations(it.key().asString()) > 1))
+          time_averaging = true;
+      }
+      if (time_averaging){
+        writer << "ctrl-file : baseline_averaging cannot be combined with integration averaging in output_averaging" << std::endl;
+        ok = false;
+      }
+      if (ctrl["pulsar_binning"].asBool() || ctrl["phased_array"].asBool()){
+        writer << "ctrl-file : baseline_averaging cannot be used with pulsar binning or in phased array mode" << std::endl;
+        ok = false;
+      }
+    }
+  }
+
   // Check pulsar binning
   if (ctrl["pulsar_binning"].asBool()){
     // use pulsar binning
@@ -604,6 +814,132 @@ Control_parameters::exit_on_empty_datastream() const{
   return ctrl["exit_on_empty_datastream"].asBool();
 }
 
+bool
+Control_parameters::output_index() const{
+  return ctrl["output_index"].asBool();
+}
+
+int
+Control_parameters::output_averaging_channels(const std::string &product) const{
+  const Json::Value &averaging = ctrl["output_averaging"];
+  if (averaging[product]["channels"] != Json::Value())
+    return averaging[product]["channels"].asInt();
+  if (averaging["default"]["channels"] != Json::Value())
+    return averaging["default"]["channels"].asInt();
+  return 1;
+}
+
+int
+Control_parameters::output_averaging_integrations(const std::string &product) const{
+  const Json::Value &averaging = ctrl["output_averaging"];
+  if (averaging[product]["integrations"] != Json::Value())
+    return averaging[product]["integrations"].asInt();
+  if (averaging["default"]["integrations"] != Json::Value())
+    return averaging["default"]["integrations"].asInt();
+  return 1;
+}
+
+int
+Control_parameters::output_averaging_block() const{
+  int block = output_averaging_integrations("default");
+  const Json::Value &averaging = ctrl["output_averaging"];
+  for (Json::Value::const_iterator it = averaging.begin(); it != averaging.end(); it++)
+    block = std::max(block, output_averaging_integrations(it.key().asString()));
+  return std::max(block, baseline_averaging_integrations());
+}
+
+int
+Control_parameters::slices_per_job() const{
+  // A job contains whole blocks of averaged integrations
+  int block = output_averaging_block();
+  int slices = std::max(ctrl["slices_per_job"].asInt(), 1);
+  return ((slices + block - 1) / block) * block;
+}
+
+int
+Control_parameters::scheduler_queue_depth() const{
+  return std::max(ctrl["scheduler_queue_depth"].asInt(), 1);
+}
+
+bool
+Control_parameters::throughput_scheduling() const{
+  return ctrl["scheduler"].asString() == "throughput";
+}
+
+bool
+Control_parameters::compress_delay_tables() const{
+  return ctrl["compress_delay_tables"].asBool();
+}
+
+std::string
+Control_parameters::telemetry() const{
+  if (ctrl["telemetry"] == Json::Value())
+    return std::string();
+  return ctrl["telemetry"].asString();
+}
+
+bool
+Control_parameters::telemetry_prometheus() const{
+  return ctrl["telemetry_format"].asString() == "prometheus";
+}
+
+int
+Control_parameters::telemetry_interval_ms() const{
+  return (int)round(ctrl["telemetry_interval"].asDouble() * 1000);
+}
+
+std::string
+Control_parameters::status() const{
+  if (ctrl["status"] == Json::Value())
+    return std::string();
+  return ctrl["status"].asString();
+}
+
+int
+Control_parameters::status_interval_ms() const{
+  return (int)round(ctrl["status_interval"].asDouble() * 1000);
+}
+
+bool
+Control_parameters::checkpoint() const{
+  return ctrl["checkpoint"].asBool();
+}
+
+int
+Control_parameters::checkpoint_interval_ms() const{
+  return (int)round(ctrl["checkpoint_interval"].asDouble() * 1000);
+}
+
+int
+Control_parameters::baseline_averaging_integrations() const{
+  if (ctrl["baseline_averaging"] == Json::Value())
+    return 0;
+  return ctrl["baseline_averaging"]["max_integrations"].asInt();
+}
+
+double
+Control_parameters::baseline_averaging_fov() const{
+  // The field of view is given in arc seconds
+  return ctrl["baseline_averaging"]["field_of_view"].asDouble() * M_PI / (180. * 3600.);
+}
+
+double
+Control_parameters::baseline_averaging_smearing() const{
+  if (ctrl["baseline_averaging"]["max_smearing"] == Json::Value())
+    return 0.01;
+  return ctrl["baseline_averaging"]["max_smearing"].asDouble();
+}
+
+int
+Control_parameters::output_format_version() const{
+  std::string precision = ctrl["output_precision"].asString();
+  if (precision == "float16")
+    return OUTPUT_FORMAT_VERSION_FLOAT16;
+  else if (precision == "int16")
+    return OUTPUT_FORMAT_VERSION_INT16;
+  return OUTPUT_FORMAT_VERSION;
+}
+
 int
 Control_parameters::number_channels() const {
   return ctrl["number_channels"].asInt();
@@ -772,6 +1108,17 @@ Control_parameters::get_mask_parameters(Mask_parameters &pars) const {
 int
 Control_parameters::bits_per_sample(const std::string &mode,
                                     const std::string &station) const
+{
+  const std::string key = lookup_key(mode, station);
+  std::map<std::string, int>::const_iterator it = bits_per_sample_map.find(key);
+  if (it != bits_per_sample_map.end())
+    return it->second;
+  return bits_per_sample_map[key] = find_bits_per_sample(mode, station);
+}
+
+int
+Control_parameters::find_bits_per_sample(const std::string &mode,
+                                         const std::string &station) const
 {
   if (data_format(station) == "VDIF") {
     const std::string threads_name = get_vex().get_section("THREADS", mode, station);
@@ -864,15 +1211,22 @@ Control_parameters::scan_source(const std::string &scan) const {
 }
 
 int Control_parameters::scan(const Time &time) const {
-  Vex::Date date(time.date_string());
-
-  int scannr = 0;
-  while (scannr < number_scans()) {
-    if (date < vex.stop_of_scan(scan(scannr)))
-      return scannr;
-    scannr++;
+  if (scan_stop_times.empty()) {
+    for (size_t i = 0; i < number_scans(); i++) {
+      Vex::Date stop = vex.stop_of_scan(scan(i));
+      if ((i > 0) && (stop < scan_stop_times.back()))
+        stop = scan_stop_times.back();
+      scan_stop_times.push_back(stop);
+    }
   }
-  return -1;
+
+  // The first scan that stops after time
+  Vex::Date date(time.date_string());
+  std::vector<Vex::Date>::const_iterator it =
+    std::upper_bound(scan_stop_times.begin(), scan_stop_times.end(), date);
+  if (it == scan_stop_times.end())
+    return -1;
+  return it - scan_stop_times.begin();
 }
 
 bool
@@ -942,6 +1296,18 @@ std::string
 Control_parameters::frequency_channel(size_t channel_nr, const std::string& mode_name, const std::string &station_name) const {
   SFXC_ASSERT(channel_nr < number_frequency_channels());
 
+  const std::string key = lookup_key(channel(channel_nr), mode_name, station_name);
+  std::map<std::string, std::string>::const_iterator it = frequency_channel_map.find(key);
+  if (it != frequency_channel_map.end())
+    return it->second;
+  return frequency_channel_map[key] =
+    find_frequency_channel(channel_nr, mode_name, station_name);
+}
+
+std::string
+Control_parameters::find_frequency_channel(size_t channel_nr, const std::string& mode_name,
+                                           const std::string &station_name) const {
+
   char pol = polarisation(channel(channel_nr), setup_station(), mode_name);
   if (pol == ' ')
     return std::string(); // Channel not present
@@ -1618,6 +1984,13 @@ Control_parameters::rack_type(const std::string &station) const {
 
 bool
 Control_parameters::cross_polarize() const {
+  if (cross_polarize_value < 0)
+    cross_polarize_value = find_cross_polarize();
+  return cross_polarize_value;
+}
+
+bool
+Control_parameters::find_cross_polarize() const {
   if (!ctrl["cross_polarize"].asBool())
     return false;
   for (Vex::Node::const_iterator mode_it =
@@ -1644,6 +2017,17 @@ int
 Control_parameters::
 cross_channel(const std::string &channel_name,
               const std::string &mode) const {
+  const std::string key = lookup_key(channel_name, mode);
+  std::map<std::string, int>::const_iterator it = cross_channel_map.find(key);
+  if (it != cross_channel_map.end())
+    return it->second;
+  return cross_channel_map[key] = find_cross_channel(channel_name, mode);
+}
+
+int
+Control_parameters::
+find_cross_channel(const std::string &channel_name,
+                   const std::string &mode) const {
   std::string freq = frequency(channel_name, setup_station(), mode);
   if (freq != std::string()){
     char side = sideband(channel_name, setup_station(), mode);
@@ -1668,6 +2052,19 @@ Control_parameters::
 polarisation(const std::string &channel_name,
              const std::string &station_name,
              const std::string &mode_name) const {
+  const std::string key = lookup_key(channel_name, station_name, mode_name);
+  std::map<std::string, char>::const_iterator it = polarisation_map.find(key);
+  if (it != polarisation_map.end())
+    return it->second;
+  return polarisation_map[key] =
+    find_polarisation(channel_name, station_name, mode_name);
+}
+
+char
+Control_parameters::
+find_polarisation(const std::string &channel_name,
+                  const std::string &station_name,
+                  const std::string &mode_name) const {
   const Vex::Node &root = vex.get_root_node();
   Vex::Node::const_iterator mode = root["MODE"][mode_name];
   if (mode == root["MODE"]->end()) {
@@ -1761,6 +2158,19 @@ Control_parameters::
 frequency(const std::string &channel_name,
           const std::string &station_name,
           const std::string &mode_name) const {
+  const std::string key = lookup_key(channel_name, station_name, mode_name);
+  std::map<std::string, std::string>::const_iterator it = frequency_map.find(key);
+  if (it != frequency_map.end())
+    return it->second;
+  return frequency_map[key] =
+    find_frequency(channel_name, station_name, mode_name);
+}
+
+std::string
+Control_parameters::
+find_frequency(const std::string &channel_name,
+               const std::string &station_name,
+               const std::string &mode_name) const {
   std::string freq_name;
 
   Vex::Node::const_iterator mode = vex.get_root_node()["MODE"][mode_name];
@@ -1792,6 +2202,18 @@ Control_parameters::
 sideband(const std::string &channel_name,
          const std::string &station_name,
          const std::string &mode) const {
+  const std::string key = lookup_key(channel_name, station_name, mode);
+  std::map<std::string, char>::const_iterator it = sideband_map.find(key);
+  if (it != sideband_map.end())
+    return it->second;
+  return sideband_map[key] = find_sideband(channel_name, station_name, mode);
+}
+
+char
+Control_parameters::
+find_sideband(const std::string &channel_name,
+              const std::string &station_name,
+              const std::string &mode) const {
 
   std::string if_mode_freq;
   std::string if_node_Node;
@@ -1893,6 +2315,12 @@ get_correlation_parameters(const std::string &scan_name,
   corr_param.fft_size_delaycor = fft_size_delaycor();
   corr_param.fft_size_correlation = fft_size_correlation();
   corr_param.window = window_function();  
+  corr_param.output_format_version = output_format_version();
+  corr_param.baseline_averaging_integrations = baseline_averaging_integrations();
+  if (corr_param.baseline_averaging_integrations > 0) {
+    corr_param.baseline_averaging_fov = baseline_averaging_fov();
+    corr_param.baseline_averaging_smearing = baseline_averaging_smearing();
+  }
   corr_param.slice_offset =
     number_correlation_cores_per_timeslice(mode_name);
   corr_param.sample_rate = sample_rate(mode_name, station_name);
@@ -2059,14 +2487,19 @@ generate_delay_table(const std::string &station_name,
 
 std::string
 Control_parameters::create_path(const std::string &path) const {
-  if (strncmp(path.c_str(), "file://", 7) == 0) {
-    if (path[7] != '/') {
-      std::string result = "file://";
+  size_t prefix_len = 0;
+  if (strncmp(path.c_str(), "file://", 7) == 0)
+    prefix_len = 7;
+  else if (strncmp(path.c_str(), "afile://", 8) == 0)
+    prefix_len = 8;
+  if (prefix_len > 0) {
+    if (path[prefix_len] != '/') {
+      std::string result = path.substr(0, prefix_len);
       char c_ctrl_filename[ctrl_filename.size()+1];
       strcpy(c_ctrl_filename, ctrl_filename.c_str());
       result += dirname(c_ctrl_filename);
       result += "/";
-      result += path.c_str()+7;
+      result += path.c_str()+prefix_len;
       return result;
     } else {
       return path;
@@ -2176,6 +2609,10 @@ Correlation_parameters::operator==(const Correlation_parameters& other) const {
     return false;
   if (window != other.window)
     return false;
+  if (output_format_version != other.output_format_version)
+    return false;
+  if (baseline_averaging_integrations != other.baseline_averaging_integrations)
+    return false;
   if (integration_nr != other.integration_nr)
     return false;
   if (slice_nr != other.slice_nr)
@@ -2208,6 +2645,8 @@ std::ostream &operator<<(std::ostream &out,
   out << "  \"fft_size_delaycor\": " << param.fft_size_delaycor << ", " << std::endl;
   out << "  \"fft_size_correlation\": " << param.fft_size_correlation << ", " << std::endl;
   out << "  \"window\": " << param.window << ", " << std::endl;
+  out << "  \"output_format_version\": " << param.output_format_version << ", " << std::endl;
+  out << "  \"baseline_averaging_integrations\": " << param.baseline_averaging_integrations << ", " << std::endl;
   out << "  \"slice_nr\": " << param.slice_nr << ", " << std::endl;
   out << "  \"slice_offset\": " << param.slice_offset << ", " << std::endl;
   out << "  \"sample_rate\": " << param.sample_rate << ", " << std::endl;
@@ -0,0 +1,114 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the definition of Cor_file.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+
+#include "cor_file.h"
+
+Cor_file::Cor_file()
+  : data_(NULL), map_size_(0), size_(0),
+    visibility_size_(sizeof(std::complex<float>)) {}
+
+Cor_file::~Cor_file() {
+  close();
+}
+
+bool
+Cor_file::open(const std::string &filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat sb;
+  if ((fstat(fd, &sb) != 0) || (sb.st_size < (off_t)sizeof(int32_t))) {
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  data_ = (const char *)map;
+  map_size_ = sb.st_size;
+
+  // Older files have a smaller global header
+  int32_t header_size;
+  memcpy(&header_size, data_, sizeof(header_size));
+  if ((header_size < (int32_t)sizeof(int32_t)) || ((size_t)header_size > map_size_)) {
+    close();
+    return false;
+  }
+  memcpy(&global_header_, data_,
+         std::min((size_t)header_size, sizeof(global_header_)));
+  visibility_size_ = output_visibility_size(global_header_.output_format_version);
+
+  // Walk over the time slice headers
+  uint64_t offset = header_size;
+  while (offset + sizeof(Output_header_timeslice) <= map_size_) {
+    Output_header_timeslice timeslice;
+    memcpy(&timeslice, data_ + offset, sizeof(timeslice));
+    if (timeslice.number_baselines <= 0)
+      break;
+    uint64_t end = offset + sizeof(Output_header_timeslice) +
+                   (uint64_t)timeslice.number_uvw_coordinates * sizeof(Output_uvw_coordinates) +
+                   (uint64_t)timeslice.number_statistics * sizeof(Output_header_bitstatistics) +
+                   (uint64_t)timeslice.number_baselines * baseline_size();
+    if (end > map_size_)
+      break;
+    timeslices_.push_back(offset);
+    offset = end;
+  }
+  size_ = offset;
+  return true;
+}
+
+void
+Cor_file::close() {
+  if (data_ != NULL)
+    munmap((void *)data_, map_size_);
+  data_ = NULL;
+  map_size_ = 0;
+  size_ = 0;
+  global_header_ = Output_header_global();
+  visibility_size_ = sizeof(std::complex<float>);
+  timeslices_.clear();
+}
+
+void
+Cor_file::get_visibilities(size_t i, int b, std::complex<float> *data) const {
+  decode_visibilities(global_header_.output_format_version, baseline(i, b),
+                      visibilities(i, b), number_channels() + 1, data);
+}
+
+int32_t
+Cor_file::first_integration_slice(size_t i) const {
+  const Output_header_timeslice &header = timeslice(i);
+  if (header.number_uvw_coordinates == 0)
+    return header.integration_slice;
+  int32_t averaged = uvw_coordinates(i)[0].averaged_integrations;
+  if (averaged <= 1)
+    return header.integration_slice;
+  return header.integration_slice - averaged + 1;
+}
+
+size_t
+Cor_file::next_integration(size_t i) const {
+  int32_t integration_slice = timeslice(i).integration_slice;
+  for (i++; i < timeslices_.size(); i++) {
+    if (timeslice(i).integration_slice != integration_slice)
+      break;
+  }
+  return i;
+}
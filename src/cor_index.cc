@@ -0,0 +1,377 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the definition of the Cor_index, Cor_index_writer and Cor_reader
+ *       objects.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "cor_index.h"
+
+/*
+ *  Cor_index
+ */
+
+Cor_index::Cor_index()
+  : map_(NULL), map_size_(0), entries_(NULL), nr_entries_(0),
+    number_channels_(0) {}
+
+Cor_index::~Cor_index() {
+  close();
+}
+
+bool
+Cor_index::open(const std::string &filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat sb;
+  if ((fstat(fd, &sb) != 0) || ((size_t)sb.st_size < sizeof(File_header))) {
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const File_header *header = (const File_header *)map;
+  if ((memcmp(header->magic, COR_INDEX_MAGIC, sizeof(header->magic)) != 0) ||
+      (header->version != COR_INDEX_VERSION)) {
+    munmap(map, sb.st_size);
+    return false;
+  }
+  map_ = map;
+  map_size_ = sb.st_size;
+  number_channels_ = header->number_channels;
+  entries_ = (const Entry *)((const char *)map + sizeof(File_header));
+  // An index that is being written can end in a partial entry
+  nr_entries_ = (map_size_ - sizeof(File_header)) / sizeof(Entry);
+  return true;
+}
+
+bool
+Cor_index::create(const std::string &cor_filename) {
+  close();
+  FILE *infile = fopen(cor_filename.c_str(), "rb");
+  if (infile == NULL)
+    return false;
+  Cor_index_writer writer;
+  std::vector<char> buffer(1024 * 1024);
+  size_t n;
+  while ((n = fread(&buffer[0], 1, buffer.size(), infile)) > 0)
+    writer.add_data(&buffer[0], n);
+  fclose(infile);
+
+  number_channels_ = writer.number_channels();
+  created_.swap(writer.entries());
+  entries_ = (created_.empty() ? NULL : &created_[0]);
+  nr_entries_ = created_.size();
+  return true;
+}
+
+void
+Cor_index::close() {
+  if (map_ != NULL)
+    munmap(map_, map_size_);
+  map_ = NULL;
+  map_size_ = 0;
+  created_.clear();
+  entries_ = NULL;
+  nr_entries_ = 0;
+}
+
+ssize_t
+Cor_index::find_timeslice(int32_t integration_slice) const {
+  // The time slices are written in order, binary search for the first
+  // entry of the slice
+  size_t lo = 0, hi = nr_entries_;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (entries_[mid].integration_slice < integration_slice)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if ((lo < nr_entries_) && (entries_[lo].integration_slice == integration_slice) &&
+      (entries_[lo].type == TIMESLICE))
+    return lo;
+  return -1;
+}
+
+ssize_t
+Cor_index::find_baseline(int32_t integration_slice,
+                         const Output_header_baseline &baseline) const {
+  ssize_t i = find_timeslice(integration_slice);
+  if (i < 0)
+    return -1;
+  // Every channel of an integration has its own time slice header
+  for (; ((size_t)i < nr_entries_) &&
+         (entries_[i].integration_slice == integration_slice); i++) {
+    const Entry &entry = entries_[i];
+    if ((entry.type == BASELINE) &&
+        (entry.station_nr1 == baseline.station_nr1) &&
+        (entry.station_nr2 == baseline.station_nr2) &&
+        (entry.polarisation1 == baseline.polarisation1) &&
+        (entry.polarisation2 == baseline.polarisation2) &&
+        (entry.sideband == baseline.sideband) &&
+        (entry.frequency_nr == baseline.frequency_nr))
+      return i;
+  }
+  return -1;
+}
+
+/*
+ *  Cor_index_writer
+ */
+
+Cor_index_writer::Cor_index_writer()
+  : file_(NULL), item_offset_(0), number_channels_(0),
+    visibility_size_(sizeof(std::complex<float>)), baselines_left_(0) {
+  start_item(GLOBAL_HEADER, sizeof(int32_t));
+}
+
+Cor_index_writer::~Cor_index_writer() {
+  close();
+}
+
+bool
+Cor_index_writer::open(const std::string &filename) {
+  file_ = fopen(filename.c_str(), "wb");
+  return (file_ != NULL);
+}
+
+void
+Cor_index_writer::close() {
+  if (file_ == NULL)
+    return;
+  write_header();
+  if (!entries_.empty())
+    fwrite(&entries_[0], sizeof(Cor_index::Entry), entries_.size(), file_);
+  entries_.clear();
+  fclose(file_);
+  file_ = NULL;
+}
+
+void
+Cor_index_writer::write_header() {
+  // The header is written when the number of channels is known
+  if ((file_ == NULL) || (ftell(file_) != 0) || (number_channels_ == 0))
+    return;
+  Cor_index::File_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COR_INDEX_MAGIC, sizeof(header.magic));
+  header.version = COR_INDEX_VERSION;
+  header.number_channels = number_channels_;
+  fwrite(&header, sizeof(header), 1, file_);
+}
+
+void
+Cor_index_writer::start_item(State state, size_t size) {
+  state_ = state;
+  item_size_ = size;
+  item_received_ = 0;
+  item_.clear();
+}
+
+void
+Cor_index_writer::add_data(const char *data, size_t size) {
+  while (size > 0) {
+    size_t n = std::min(size, item_size_ - item_received_);
+    // Only the headers are needed, the visibilities are skipped
+    if (state_ != BASELINE_DATA)
+      item_.insert(item_.end(), data, data + n);
+    item_received_ += n;
+    data += n;
+    size -= n;
+    if (item_received_ == item_size_)
+      end_of_item();
+  }
+}
+
+void
+Cor_index_writer::end_of_item() {
+  uint64_t offset = item_offset_ + item_size_;
+  switch (state_) {
+  case GLOBAL_HEADER: {
+      int32_t header_size;
+      memcpy(&header_size, &item_[0], sizeof(header_size));
+      if (item_size_ < (size_t)header_size) {
+        // Read the rest of the global header
+        item_size_ = header_size;
+        return;
+      }
+      Output_header_global global_header;
+      memcpy(&global_header, &item_[0],
+             std::min(sizeof(global_header), item_.size()));
+      number_channels_ = global_header.number_channels;
+      visibility_size_ = output_visibility_size(global_header.output_format_version);
+      write_header();
+      item_offset_ = offset;
+      start_item(TIMESLICE_HEADER, sizeof(Output_header_timeslice));
+      return;
+    }
+  case TIMESLICE_HEADER: {
+      memcpy(&timeslice_, &item_[0], sizeof(timeslice_));
+      // The previous time slice is complete
+      if ((file_ != NULL) && !entries_.empty()) {
+        fwrite(&entries_[0], sizeof(Cor_index::Entry), entries_.size(), file_);
+        fflush(file_);
+        entries_.clear();
+      }
+      Cor_index::Entry entry;
+      memset(&entry, 0, sizeof(entry));
+      entry.integration_slice = timeslice_.integration_slice;
+      entry.type = Cor_index::TIMESLICE;
+      entry.offset = item_offset_;
+      entries_.push_back(entry);
+
+      baselines_left_ = timeslice_.number_baselines;
+      item_offset_ = offset;
+      start_item(UVW_COORDINATES,
+                 timeslice_.number_uvw_coordinates * sizeof(Output_uvw_coordinates));
+      break;
+    }
+  case UVW_COORDINATES: {
+      item_offset_ = offset;
+      start_item(STATISTICS,
+                 timeslice_.number_statistics * sizeof(Output_header_bitstatistics));
+      break;
+    }
+  case STATISTICS: {
+      item_offset_ = offset;
+      start_item(BASELINE_HEADER, sizeof(Output_header_baseline));
+      break;
+    }
+  case BASELINE_HEADER: {
+      Output_header_baseline baseline;
+      memcpy(&baseline, &item_[0], sizeof(baseline));
+      Cor_index::Entry entry;
+      memset(&entry, 0, sizeof(entry));
+      entry.integration_slice = timeslice_.integration_slice;
+      entry.type = Cor_index::BASELINE;
+      entry.station_nr1 = baseline.station_nr1;
+      entry.station_nr2 = baseline.station_nr2;
+      entry.polarisation1 = baseline.polarisation1;
+      entry.polarisation2 = baseline.polarisation2;
+      entry.sideband = baseline.sideband;
+      entry.frequency_nr = baseline.frequency_nr;
+      entry.offset = item_offset_;
+      entries_.push_back(entry);
+
+      item_offset_ = offset;
+      start_item(BASELINE_DATA, (number_channels_ + 1) * visibility_size_);
+      break;
+    }
+  case BASELINE_DATA: {
+      baselines_left_--;
+      item_offset_ = offset;
+      start_item(BASELINE_HEADER, sizeof(Output_header_baseline));
+      break;
+    }
+  }
+
+  // Skip the empty parts of the time slice
+  if ((state_ == BASELINE_HEADER) && (baselines_left_ <= 0))
+    start_item(TIMESLICE_HEADER, sizeof(Output_header_timeslice));
+  else if (item_size_ == 0)
+    end_of_item();
+}
+
+/*
+ *  Cor_reader
+ */
+
+Cor_reader::Cor_reader() : file_(NULL), has_index_file_(false) {}
+
+Cor_reader::~Cor_reader() {
+  if (file_ != NULL)
+    fclose(file_);
+}
+
+bool
+Cor_reader::open(const std::string &filename) {
+  if (file_ != NULL)
+    fclose(file_);
+  file_ = fopen(filename.c_str(), "rb");
+  if (file_ == NULL)
+    return false;
+  global_header_ = Output_header_global();
+  int32_t header_size;
+  if (!read_at(0, &header_size, sizeof(header_size)) ||
+      !read_at(0, &global_header_,
+               std::min((size_t)header_size, sizeof(global_header_))))
+    return false;
+
+  has_index_file_ = index_.open(filename + COR_INDEX_EXTENSION);
+  if (!has_index_file_ && !index_.create(filename))
+    return false;
+  return (index_.number_channels() == global_header_.number_channels);
+}
+
+void
+Cor_reader::get_integration_slices(std::vector<int32_t> &slices) const {
+  slices.clear();
+  for (size_t i = 0; i < index_.size(); i++) {
+    if ((index_[i].type == Cor_index::TIMESLICE) &&
+        (slices.empty() || (slices.back() != index_[i].integration_slice)))
+      slices.push_back(index_[i].integration_slice);
+  }
+}
+
+bool
+Cor_reader::read_timeslice(int32_t integration_slice,
+                           Output_header_timeslice &timeslice,
+                           std::vector<Output_uvw_coordinates> &uvw,
+                           std::vector<Output_header_bitstatistics> &statistics) {
+  ssize_t i = index_.find_timeslice(integration_slice);
+  if (i < 0)
+    return false;
+  uint64_t offset = index_[i].offset;
+  if (!read_at(offset, &timeslice, sizeof(timeslice)))
+    return false;
+  offset += sizeof(timeslice);
+  uvw.resize(timeslice.number_uvw_coordinates);
+  statistics.resize(timeslice.number_statistics);
+  if (!uvw.empty() &&
+      !read_at(offset, &uvw[0], uvw.size() * sizeof(Output_uvw_coordinates)))
+    return false;
+  offset += uvw.size() * sizeof(Output_uvw_coordinates);
+  return (statistics.empty() ||
+          read_at(offset, &statistics[0],
+                  statistics.size() * sizeof(Output_header_bitstatistics)));
+}
+
+bool
+Cor_reader::read_baseline(int32_t integration_slice,
+                          Output_header_baseline &baseline,
+                          std::vector< std::complex<float> > &data) {
+  ssize_t i = index_.find_baseline(integration_slice, baseline);
+  if (i < 0)
+    return false;
+  uint64_t offset = index_[i].offset;
+  int32_t version = global_header_.output_format_version;
+  data.resize(global_header_.number_channels + 1);
+  buffer_.resize(data.size() * output_visibility_size(version));
+  if (!read_at(offset, &baseline, sizeof(baseline)) ||
+      !read_at(offset + sizeof(baseline), &buffer_[0], buffer_.size()))
+    return false;
+  decode_visibilities(version, baseline, &buffer_[0], data.size(), &data[0]);
+  return true;
+}
+
+bool
+Cor_reader::read_at(uint64_t offset, void *data, size_t size) {
+  return (fseeko(file_, offset, SEEK_SET) == 0) &&
+         (fread(data, 1, size, file_) == size);
+}
@@ -3,9 +3,11 @@
 #include <utils.h>
 #include <complex>
 #include <set>
+#include <limits>
 
 Correlation_core::Correlation_core()
-    : current_fft(0), total_ffts(0), split_output(false){
+    : current_fft(0), total_ffts(0), split_output(false),
+      baseline_averaging_block(-1), ffts_("ffts", "correlation"){
 }
 
 Correlation_core::~Correlation_core() {
@@ -40,6 +42,7 @@ void Correlation_core::do_task() {
   // Process the data of the current fft buffer
   integration_step(accumulation_buffers, nbuffer, stride);
   current_fft += nbuffer;
+  ffts_.add(nbuffer);
   for (size_t i = 0; i < number_input_streams(); i++) {
     int stream = station_stream(i);
     input_buffers[stream]->pop();
@@ -53,16 +56,7 @@ void Correlation_core::do_task() {
     find_invalid();
     for(int i = 0 ; i < phase_centers.size(); i++){
       integration_normalize(phase_centers[i]);
-      int source_nr;
-      if(split_output){
-        source_nr = sources[delay_tables[first_stream].get_source(i)]; // FIXME restore
-      }
-      else if(correlation_parameters.pulsar_binning){
-        source_nr = 1; // Source 0 is reserved for of-pulse data
-      }else{
-        source_nr = 0;
-      }
-      integration_write(phase_centers[i], i, source_nr);
+      integration_write(phase_centers[i], i, output_stream(i));
     }
     tsys_write();
     current_integration++;
@@ -72,6 +66,82 @@ void Correlation_core::do_task() {
   }
 }
 
+int Correlation_core::output_stream(int phase_center) {
+  if (split_output)
+    return sources[delay_tables[station_stream(0)].get_source(phase_center)];
+  if (correlation_parameters.pulsar_binning)
+    return 1; // Source 0 is reserved for of-pulse data
+  return 0;
+}
+
+void
+Correlation_core::set_output_averaging(int stream, int channels, int integrations) {
+  SFXC_ASSERT((stream >= 0) && (channels >= 1) && (integrations >= 1));
+  if (stream >= output_averaging.size())
+    output_averaging.resize(stream + 1);
+  output_averaging[stream].channels = channels;
+  output_averaging[stream].integrations = integrations;
+  averaged_outputs.erase(stream);
+}
+
+Correlation_core::Output_averaging
+Correlation_core::get_output_averaging(int stream) {
+  if ((stream >= 0) && (stream < output_averaging.size()))
+    return output_averaging[stream];
+  return Output_averaging();
+}
+
+bool
+Correlation_core::start_of_averaging(int stream) {
+  int integrations = get_output_averaging(stream).integrations;
+  int n = correlation_parameters.integration_nr + current_integration;
+  return ((integrations == 1) || (n % integrations == 0) ||
+          (n == correlation_parameters.first_integration_in_block));
+}
+
+bool
+Correlation_core::end_of_averaging(int stream) {
+  int integrations = get_output_averaging(stream).integrations;
+  int n = correlation_parameters.integration_nr + current_integration;
+  return ((integrations == 1) || ((n + 1) % integrations == 0) ||
+          (n == correlation_parameters.last_integration_in_block));
+}
+
+size_t
+Correlation_core::timeslice_header_size() {
+  std::set<int> stations_set;
+  for (size_t i = 0; i < number_input_streams(); i++)
+    stations_set.insert(station_number(i));
+  return sizeof(Output_header_timeslice) +
+         stations_set.size() * sizeof(Output_uvw_coordinates) +
+         number_input_streams() * sizeof(Output_header_bitstatistics);
+}
+
+size_t
+Correlation_core::baseline_size(int stream) {
+  size_t n_points = number_channels() / get_output_averaging(stream).channels + 1;
+  return sizeof(Output_header_baseline) +
+         n_points * output_visibility_size(correlation_parameters.output_format_version);
+}
+
+size_t
+Correlation_core::record_size(int stream) {
+  return timeslice_header_size() + baselines.size() * baseline_size(stream);
+}
+
+size_t
+Correlation_core::output_size(int bin) {
+  int stream = output_stream(bin);
+  if (correlation_parameters.baseline_averaging_integrations > 0) {
+    std::map<int, int> groups;
+    baseline_averaging_groups(groups);
+    return 2 * sizeof(int32_t) + baseline_averaged_size(stream, groups);
+  }
+  if (!end_of_averaging(stream))
+    return 2 * sizeof(int32_t);
+  return 2 * sizeof(int32_t) + record_size(stream);
+}
+
 bool Correlation_core::almost_finished() {
   return current_fft >= number_ffts_in_integration*9/10;
 }
@@ -321,158 +391,479 @@ void Correlation_core::integration_write(std::vector<Complex_buffer> &integratio
   SFXC_ASSERT(writer != boost::shared_ptr<Data_writer>());
   SFXC_ASSERT(integration_buffer.size() == baselines.size());
 
-  // Write the output file index
-  {
-    size_t nWrite = sizeof(sourcenr);
-    writer->put_bytes(nWrite, (char *)&sourcenr);
+  if (correlation_parameters.baseline_averaging_integrations > 0) {
+    integration_write_baseline_averaged(integration_buffer, phase_center, sourcenr);
+    return;
   }
 
-  int nstreams = number_input_streams();
-  std::set<int> stations_set;
+  Output_averaging averaging = get_output_averaging(sourcenr);
+  bool write = end_of_averaging(sourcenr);
+  Averaged_output *average = NULL;
+  if (averaging.integrations > 1) {
+    average = &averaged_outputs[sourcenr];
+    if (start_of_averaging(sourcenr))
+      average->nr_integrations = 0;
+  }
 
-  // Initialise with -1
-  stations_set.clear();
-  for (size_t i = 0; i < nstreams; i++) {
-    int station =
-      correlation_parameters.station_streams[i].station_number;
-    stations_set.insert(station);
+  // Write the output file index and the size of the data, which is zero
+  // while the integrations are averaged
+  {
+    int32_t record[2] = {sourcenr, write ? (int32_t)record_size(sourcenr) : 0};
+    writer->put_bytes(sizeof(record), (char *)&record[0]);
   }
 
+  int nstreams = number_input_streams();
   {
+    std::vector<Output_uvw_coordinates> uvw;
+    std::vector<Output_header_bitstatistics> stats;
+    integration_headers(phase_center, uvw, stats);
+
     // Timeslice header
     Output_header_timeslice htimeslice;
     htimeslice.number_baselines = baselines.size();
     htimeslice.integration_slice =
       correlation_parameters.integration_nr + current_integration;
-    htimeslice.number_uvw_coordinates = stations_set.size();
+    htimeslice.number_uvw_coordinates = uvw.size();
     htimeslice.number_statistics = nstreams;
 
-    // UVW coordinates
-    Output_uvw_coordinates uvw[htimeslice.number_uvw_coordinates];
-    stations_set.clear();
-    for (size_t i = 0, j = 0; i < nstreams; i++) {
-      int stream = station_stream(i);
-      int station = station_number(i);
-      if (stations_set.count(station) == 0) {
-	stations_set.insert(station);
-	uvw[j].station_nr = station;
-	uvw[j].u = uvw_table[stream][phase_center * 3];
-	uvw[j].v = uvw_table[stream][phase_center * 3 + 1];
-	uvw[j].w = uvw_table[stream][phase_center * 3 + 2];
-	uvw[j].reserved = 0;
-	j++;
+    if (average != NULL) {
+      // Sum the uvw coordinates and the statistics of the integrations, a
+      // change of the stations restarts the averaging
+      if ((average->uvw.size() != htimeslice.number_uvw_coordinates) ||
+          (average->statistics.size() != nstreams) ||
+          (average->visibilities.size() != baselines.size()))
+        average->nr_integrations = 0;
+      if (average->nr_integrations == 0) {
+        average->uvw = uvw;
+        average->statistics = stats;
+        average->visibilities.resize(baselines.size());
+        average->weights.resize(baselines.size());
+      } else {
+        for (size_t i = 0; i < average->uvw.size(); i++) {
+          average->uvw[i].u += uvw[i].u;
+          average->uvw[i].v += uvw[i].v;
+          average->uvw[i].w += uvw[i].w;
+        }
+        for (size_t i = 0; i < average->statistics.size(); i++)
+          add_statistics(average->statistics[i], stats[i]);
       }
+      average->nr_integrations++;
+      if (write) {
+        for (size_t i = 0; i < average->uvw.size(); i++) {
+          uvw[i] = average->uvw[i];
+          uvw[i].u /= average->nr_integrations;
+          uvw[i].v /= average->nr_integrations;
+          uvw[i].w /= average->nr_integrations;
+        }
+        stats = average->statistics;
+      }
+    }
+    // Averaged integrations are numbered in units of the averaged time
+    htimeslice.integration_slice /= averaging.integrations;
+
+    if (write) {
+      size_t nWrite = sizeof(htimeslice);
+      writer->put_bytes(nWrite, (char *)&htimeslice);
+      nWrite = uvw.size() * sizeof(Output_uvw_coordinates);
+      writer->put_bytes(nWrite, (char *)&uvw[0]);
+      nWrite = stats.size() * sizeof(Output_header_bitstatistics);
+      writer->put_bytes(nWrite, (char *)&stats[0]);
     }
+  }
 
-    // Bit statistics
-    Output_header_bitstatistics stats[nstreams];
-    for (size_t i = 0; i < nstreams; i++) {
-      int stream = station_stream(i);
-      int station = station_number(i);
-      int32_t *levels = statistics[stream]->get_statistics();
-      stats[i].station_nr = station;
-      stats[i].sideband = (correlation_parameters.sideband == 'L') ? 0 : 1;
-      stats[i].polarisation = (correlation_parameters.station_streams[i].polarisation == 'R') ? 0 : 1;
-      stats[i].frequency_nr = (unsigned char)correlation_parameters.frequency_nr;
-#ifndef SFXC_ZERO_STATS
-      if (statistics[stream]->bits_per_sample == 2) {
-	stats[i].levels[0] = levels[0];
-	stats[i].levels[1] = levels[1];
-	stats[i].levels[2] = levels[2];
-	stats[i].levels[3] = levels[3];
-	stats[i].n_invalid = levels[4];
-      } else {
-	stats[i].levels[0] = 0;
-	stats[i].levels[1] = levels[0];
-	stats[i].levels[2] = levels[1];
-	stats[i].levels[3] = 0;
-	stats[i].n_invalid = levels[4];
+  Output_header_baseline hbaseline;
+  for (size_t i = 0; i < baselines.size(); i++) {
+    size_t n_points;
+    std::complex<float> *data =
+      baseline_visibilities(integration_buffer, i, averaging.channels,
+                            hbaseline, n_points);
+
+    if (average != NULL) {
+      // Weighted sum of the visibilities of the integrations
+      std::vector< std::complex<float> > &sum = average->visibilities[i];
+      if (average->nr_integrations == 1) {
+        sum.assign(n_points, std::complex<float>(0, 0));
+        average->weights[i] = 0;
       }
-#else
-      stats[i].levels[0] = 0;
-      stats[i].levels[1] = 0;
-      stats[i].levels[2] = 0;
-      stats[i].levels[3] = 0;
-      stats[i].n_invalid = 0;
-#endif
+      SFXC_ASSERT(sum.size() == n_points);
+      for (size_t j = 0; j < n_points; j++)
+        sum[j] += data[j] * (float)hbaseline.weight;
+      average->weights[i] += hbaseline.weight;
+      if (!write)
+        continue;
+
+      data = average_visibilities(sum, average->weights[i], hbaseline);
     }
-
-    size_t nWrite = sizeof(htimeslice);
-    writer->put_bytes(nWrite, (char *)&htimeslice);
-    nWrite=sizeof(uvw);
-    writer->put_bytes(nWrite, (char *)&uvw[0]);
-    nWrite=sizeof(stats);
-    writer->put_bytes(nWrite, (char *)&stats[0]);
+    write_baseline(hbaseline, data, n_points);
   }
+}
 
-  SFXC_ASSERT(fft_size() >= number_channels());
-  integration_buffer_float.resize(number_channels() + 1);
+void
+Correlation_core::integration_write_baseline_averaged(std::vector<Complex_buffer> &integration_buffer,
+                                                      int phase_center, int sourcenr) {
+  const int n = correlation_parameters.integration_nr + current_integration;
+  const int first = correlation_parameters.first_integration_in_block;
+  SFXC_ASSERT(n >= first);
+
+  // Keep the uvw coordinates and statistics of the integrations in the block
+  Baseline_averaged_output &average = baseline_averaged_outputs[sourcenr];
+  if (n == first) {
+    average.uvw.clear();
+    average.statistics.clear();
+    average.visibilities.resize(baselines.size());
+    average.weights.resize(baselines.size());
+  }
+  SFXC_ASSERT(average.uvw.size() == n - first);
+  SFXC_ASSERT(average.visibilities.size() == baselines.size());
+  average.uvw.resize(average.uvw.size() + 1);
+  average.statistics.resize(average.statistics.size() + 1);
+  integration_headers(phase_center, average.uvw.back(), average.statistics.back());
+
+  std::map<int, int> groups;
+  baseline_averaging_groups(groups);
+  {
+    int32_t record[2] = {sourcenr, (int32_t)baseline_averaged_size(sourcenr, groups)};
+    writer->put_bytes(sizeof(record), (char *)&record[0]);
+  }
 
-  Output_header_baseline hbaseline;
+  // Weighted sum of the visibilities of every baseline
+  int channels = get_output_averaging(sourcenr).channels;
+  std::vector<Output_header_baseline> hbaselines(baselines.size());
+  std::vector<int> nr_integrations(baselines.size(), 0);
   for (size_t i = 0; i < baselines.size(); i++) {
-    std::pair<size_t, size_t> &baseline = baselines[i];
-    int stream1 = station_stream(baseline.first);
-    int stream2 = station_stream(baseline.second);
+    size_t n_points;
+    std::complex<float> *data =
+      baseline_visibilities(integration_buffer, i, channels, hbaselines[i], n_points);
+    int start, end;
+    baseline_averaging_interval(i, start, end);
+    std::vector< std::complex<float> > &sum = average.visibilities[i];
+    if (n == start) {
+      sum.assign(n_points, std::complex<float>(0, 0));
+      average.weights[i] = 0;
+    }
+    SFXC_ASSERT(sum.size() == n_points);
+    for (size_t j = 0; j < n_points; j++)
+      sum[j] += data[j] * (float)hbaselines[i].weight;
+    average.weights[i] += hbaselines[i].weight;
+    if (n == end)
+      nr_integrations[i] = end - start + 1;
+  }
 
-    if (fft_size() != number_channels()) {
-      if (mask_parameters.normalize) {
-	for (size_t j = 0; j < fft_size() + 1; j++) {
-	  if (abs(integration_buffer[i][j]) != 0.0)
-	    integration_buffer[i][j] /= abs(integration_buffer[i][j]);
-	}
+  // One time slice for every number of averaged integrations, with the
+  // uvw coordinates averaged over the same integrations
+  std::map<int, int>::const_iterator it;
+  for (it = groups.begin(); it != groups.end(); it++) {
+    const int nr = it->first;
+    const size_t last = average.uvw.size() - 1;
+    std::vector<Output_uvw_coordinates> uvw = average.uvw[last];
+    std::vector<Output_header_bitstatistics> stats = average.statistics[last];
+    for (size_t k = last - nr + 1; k < last; k++) {
+      for (size_t i = 0; i < uvw.size(); i++) {
+        uvw[i].u += average.uvw[k][i].u;
+        uvw[i].v += average.uvw[k][i].v;
+        uvw[i].w += average.uvw[k][i].w;
       }
-      SFXC_MUL_F_FC_I(&mask[0], &integration_buffer[i][0], fft_size() + 1);
-      fft_f2t.irfft(&integration_buffer[i][0], &real_buffer[0]);
-      real_buffer[number_channels()] =
-	(real_buffer[number_channels()] +
-	 real_buffer[2 * fft_size() - number_channels()]) / 2;
-      for (size_t j = 1; j < number_channels(); j++)
-	real_buffer[number_channels() + j] =
-	  real_buffer[2 * fft_size() - number_channels() + j];
-      SFXC_MUL_F(&real_buffer[0], &window[0], &real_buffer[0],
-		 2 * number_channels());
-      fft_t2f.rfft(&real_buffer[0], &temp_buffer[0]);
-      for (size_t j = 0; j < number_channels() + 1; j++) {
-	integration_buffer_float[j] = temp_buffer[j];
-	integration_buffer_float[j] /= (2 * fft_size());
-      }
-    } else {
-      for (size_t j = 0; j < number_channels() + 1; j++)
-	integration_buffer_float[j] = integration_buffer[i][j];
+      for (size_t i = 0; i < stats.size(); i++)
+        add_statistics(stats[i], average.statistics[k][i]);
+    }
+    for (size_t i = 0; i < uvw.size(); i++) {
+      uvw[i].u /= nr;
+      uvw[i].v /= nr;
+      uvw[i].w /= nr;
+      uvw[i].averaged_integrations = nr;
     }
 
-    const int64_t total_samples = number_ffts_in_integration * fft_size();
-    int32_t *levels = statistics[stream1]->get_statistics(); // We get the number of invalid samples from the bitstatistics
-    if (stream1 == stream2) {
-      hbaseline.weight = std::max(total_samples - levels[4], (int64_t) 0);       // The number of good samples
-    } else {
-      SFXC_ASSERT(levels[4] >= 0);
-      SFXC_ASSERT(n_flagged[i].first >= 0);
-      hbaseline.weight = std::max(total_samples - levels[4] - n_flagged[i].first, (int64_t)0);       // The number of good samples
+    // The time slice is numbered by the last integration of the interval,
+    // the interval itself follows from averaged_integrations in the uvw
+    // coordinates (see output_header.h)
+    Output_header_timeslice htimeslice;
+    htimeslice.number_baselines = it->second;
+    htimeslice.integration_slice = n;
+    htimeslice.number_uvw_coordinates = uvw.size();
+    htimeslice.number_statistics = stats.size();
+    writer->put_bytes(sizeof(htimeslice), (char *)&htimeslice);
+    writer->put_bytes(uvw.size() * sizeof(Output_uvw_coordinates), (char *)&uvw[0]);
+    writer->put_bytes(stats.size() * sizeof(Output_header_bitstatistics), (char *)&stats[0]);
+
+    for (size_t i = 0; i < baselines.size(); i++) {
+      if (nr_integrations[i] != nr)
+        continue;
+      std::complex<float> *data =
+        average_visibilities(average.visibilities[i], average.weights[i], hbaselines[i]);
+      write_baseline(hbaselines[i], data, average.visibilities[i].size());
     }
-    hbaseline.station_nr1 = station_number(baseline.first);
-    hbaseline.station_nr2 = station_number(baseline.second);
-
-    // Polarisation (RCP: 0, LCP: 1)
-    hbaseline.polarisation1 = (correlation_parameters.station_streams[baseline.first].polarisation == 'R') ? 0 : 1;
-    hbaseline.polarisation2 = (correlation_parameters.station_streams[baseline.second].polarisation == 'R') ? 0 : 1;
-    // Upper or lower sideband (LSB: 0, USB: 1)
-    if (correlation_parameters.sideband=='U') {
-      hbaseline.sideband = 1;
+  }
+}
+
+void
+Correlation_core::update_baseline_averaging() {
+  const int first = correlation_parameters.first_integration_in_block;
+  if ((baseline_averaging_block == first) &&
+      (baseline_averaging_factors.size() == baselines.size()))
+    return;
+  baseline_averaging_block = first;
+  baseline_averaging_factors.resize(baselines.size());
+
+  // The smearing is largest at the highest frequency in the band
+  double frequency = correlation_parameters.channel_freq;
+  if (correlation_parameters.sideband == 'U')
+    frequency += correlation_parameters.bandwidth;
+  const double wavelength = SPEED_OF_LIGHT / frequency;
+  const double integration_time = correlation_parameters.integration_time.get_time();
+  const int max_integrations = correlation_parameters.baseline_averaging_integrations;
+  // Averaging a fringe with rate f over a time T reduces the amplitude by
+  // 1 - sinc(f T), which is about (pi f T)^2 / 6
+  const double max_cycles =
+    sqrt(6 * correlation_parameters.baseline_averaging_smearing) / M_PI;
+
+  for (size_t i = 0; i < baselines.size(); i++) {
+    const std::vector<double> &uvw1 = uvw_table[station_stream(baselines[i].first)];
+    const std::vector<double> &uvw2 = uvw_table[station_stream(baselines[i].second)];
+    double length = sqrt((uvw1[0] - uvw2[0]) * (uvw1[0] - uvw2[0]) +
+                         (uvw1[1] - uvw2[1]) * (uvw1[1] - uvw2[1]) +
+                         (uvw1[2] - uvw2[2]) * (uvw1[2] - uvw2[2]));
+    // The highest fringe rate at the edge of the field of view
+    double fringe_rate = EARTH_ROTATION_RATE * length *
+      correlation_parameters.baseline_averaging_fov / wavelength;
+    int nr = max_integrations;
+    while ((nr > 1) && ((max_integrations % nr != 0) ||
+                        (nr * integration_time * fringe_rate > max_cycles)))
+      nr--;
+    baseline_averaging_factors[i] = nr;
+  }
+}
+
+void
+Correlation_core::baseline_averaging_interval(size_t baseline, int &start, int &end) {
+  update_baseline_averaging();
+  const int n = correlation_parameters.integration_nr + current_integration;
+  const int nr = baseline_averaging_factors[baseline];
+  start = std::max(n - n % nr, correlation_parameters.first_integration_in_block);
+  end = std::min(n - n % nr + nr - 1, correlation_parameters.last_integration_in_block);
+}
+
+void
+Correlation_core::baseline_averaging_groups(std::map<int, int> &groups) {
+  const int n = correlation_parameters.integration_nr + current_integration;
+  groups.clear();
+  for (size_t i = 0; i < baselines.size(); i++) {
+    int start, end;
+    baseline_averaging_interval(i, start, end);
+    if (n == end)
+      groups[end - start + 1]++;
+  }
+}
+
+size_t
+Correlation_core::baseline_averaged_size(int stream, const std::map<int, int> &groups) {
+  size_t size = 0;
+  std::map<int, int>::const_iterator it;
+  for (it = groups.begin(); it != groups.end(); it++)
+    size += timeslice_header_size() + it->second * baseline_size(stream);
+  return size;
+}
+
+void
+Correlation_core::integration_headers(int phase_center,
+                                      std::vector<Output_uvw_coordinates> &uvw,
+                                      std::vector<Output_header_bitstatistics> &stats) {
+  int nstreams = number_input_streams();
+
+  // UVW coordinates, one for every station
+  std::set<int> stations_set;
+  uvw.clear();
+  for (size_t i = 0; i < nstreams; i++) {
+    int stream = station_stream(i);
+    int station = station_number(i);
+    if (stations_set.count(station) == 0) {
+      stations_set.insert(station);
+      Output_uvw_coordinates coordinates;
+      coordinates.station_nr = station;
+      coordinates.u = uvw_table[stream][phase_center * 3];
+      coordinates.v = uvw_table[stream][phase_center * 3 + 1];
+      coordinates.w = uvw_table[stream][phase_center * 3 + 2];
+      coordinates.averaged_integrations = 0;
+      uvw.push_back(coordinates);
+    }
+  }
+
+  // Bit statistics
+  stats.resize(nstreams);
+  for (size_t i = 0; i < nstreams; i++) {
+    int stream = station_stream(i);
+    int station = station_number(i);
+    int32_t *levels = statistics[stream]->get_statistics();
+    stats[i].station_nr = station;
+    stats[i].sideband = (correlation_parameters.sideband == 'L') ? 0 : 1;
+    stats[i].polarisation = (correlation_parameters.station_streams[i].polarisation == 'R') ? 0 : 1;
+    stats[i].frequency_nr = (unsigned char)correlation_parameters.frequency_nr;
+#ifndef SFXC_ZERO_STATS
+    if (statistics[stream]->bits_per_sample == 2) {
+      stats[i].levels[0] = levels[0];
+      stats[i].levels[1] = levels[1];
+      stats[i].levels[2] = levels[2];
+      stats[i].levels[3] = levels[3];
+      stats[i].n_invalid = levels[4];
     } else {
-      SFXC_ASSERT(correlation_parameters.sideband == 'L');
-      hbaseline.sideband = 0;
+      stats[i].levels[0] = 0;
+      stats[i].levels[1] = levels[0];
+      stats[i].levels[2] = levels[1];
+      stats[i].levels[3] = 0;
+      stats[i].n_invalid = levels[4];
     }
-    // The number of the channel in the vex-file,
-    hbaseline.frequency_nr = (unsigned char)correlation_parameters.frequency_nr;
-    // sorted increasingly
-    // 1 byte left:
-    hbaseline.empty = ' ';
+#else
+    stats[i].levels[0] = 0;
+    stats[i].levels[1] = 0;
+    stats[i].levels[2] = 0;
+    stats[i].levels[3] = 0;
+    stats[i].n_invalid = 0;
+#endif
+  }
+}
+
+void
+Correlation_core::add_statistics(Output_header_bitstatistics &sum,
+                                 const Output_header_bitstatistics &stats) {
+  for (int j = 0; j < 4; j++)
+    sum.levels[j] += stats.levels[j];
+  sum.n_invalid += stats.n_invalid;
+}
+
+std::complex<float> *
+Correlation_core::baseline_visibilities(std::vector<Complex_buffer> &integration_buffer,
+                                        size_t i, int channels,
+                                        Output_header_baseline &hbaseline,
+                                        size_t &n_points) {
+  SFXC_ASSERT(fft_size() >= number_channels());
+  integration_buffer_float.resize(number_channels() + 1);
+
+  std::pair<size_t, size_t> &baseline = baselines[i];
+  int stream1 = station_stream(baseline.first);
+  int stream2 = station_stream(baseline.second);
+
+  if (fft_size() != number_channels()) {
+    if (mask_parameters.normalize) {
+      for (size_t j = 0; j < fft_size() + 1; j++) {
+	if (abs(integration_buffer[i][j]) != 0.0)
+	  integration_buffer[i][j] /= abs(integration_buffer[i][j]);
+      }
+    }
+    SFXC_MUL_F_FC_I(&mask[0], &integration_buffer[i][0], fft_size() + 1);
+    fft_f2t.irfft(&integration_buffer[i][0], &real_buffer[0]);
+    real_buffer[number_channels()] =
+      (real_buffer[number_channels()] +
+       real_buffer[2 * fft_size() - number_channels()]) / 2;
+    for (size_t j = 1; j < number_channels(); j++)
+      real_buffer[number_channels() + j] =
+	real_buffer[2 * fft_size() - number_channels() + j];
+    SFXC_MUL_F(&real_buffer[0], &window[0], &real_buffer[0],
+	       2 * number_channels());
+    fft_t2f.rfft(&real_buffer[0], &temp_buffer[0]);
+    for (size_t j = 0; j < number_channels() + 1; j++) {
+      integration_buffer_float[j] = temp_buffer[j];
+      integration_buffer_float[j] /= (2 * fft_size());
+    }
+  } else {
+    for (size_t j = 0; j < number_channels() + 1; j++)
+      integration_buffer_float[j] = integration_buffer[i][j];
+  }
+
+  const int64_t total_samples = number_ffts_in_integration * fft_size();
+  int32_t *levels = statistics[stream1]->get_statistics(); // We get the number of invalid samples from the bitstatistics
+  if (stream1 == stream2) {
+    hbaseline.weight = std::max(total_samples - levels[4], (int64_t) 0);       // The number of good samples
+  } else {
+    SFXC_ASSERT(levels[4] >= 0);
+    SFXC_ASSERT(n_flagged[i].first >= 0);
+    hbaseline.weight = std::max(total_samples - levels[4] - n_flagged[i].first, (int64_t)0);       // The number of good samples
+  }
+  hbaseline.station_nr1 = station_number(baseline.first);
+  hbaseline.station_nr2 = station_number(baseline.second);
+
+  // Polarisation (RCP: 0, LCP: 1)
+  hbaseline.polarisation1 = (correlation_parameters.station_streams[baseline.first].polarisation == 'R') ? 0 : 1;
+  hbaseline.polarisation2 = (correlation_parameters.station_streams[baseline.second].polarisation == 'R') ? 0 : 1;
+  // Upper or lower sideband (LSB: 0, USB: 1)
+  if (correlation_parameters.sideband=='U') {
+    hbaseline.sideband = 1;
+  } else {
+    SFXC_ASSERT(correlation_parameters.sideband == 'L');
+    hbaseline.sideband = 0;
+  }
+  // The number of the channel in the vex-file,
+  hbaseline.frequency_nr = (unsigned char)correlation_parameters.frequency_nr;
+  // sorted increasingly
+
+  if (channels > 1) {
+    average_channels(channels);
+    n_points = channel_average_buffer.size();
+    return &channel_average_buffer[0];
+  }
+  n_points = number_channels() + 1;
+  return &integration_buffer_float[0];
+}
+
+// Divides the weighted sum of the visibilities by the sum of the weights
+std::complex<float> *
+Correlation_core::average_visibilities(std::vector< std::complex<float> > &sum,
+                                       int64_t weight,
+                                       Output_header_baseline &hbaseline) {
+  if (weight > 0) {
+    for (size_t j = 0; j < sum.size(); j++)
+      sum[j] /= (float)weight;
+  }
+  hbaseline.weight = std::min(weight, (int64_t)std::numeric_limits<int32_t>::max());
+  return &sum[0];
+}
+
+void
+Correlation_core::write_baseline(Output_header_baseline &hbaseline,
+                                 const std::complex<float> *data, size_t size) {
+  int32_t version = correlation_parameters.output_format_version;
+  if (version == OUTPUT_FORMAT_VERSION) {
+    // Unused byte
+    hbaseline.scale_exponent = ' ';
 
     int nWrite = sizeof(hbaseline);
     writer->put_bytes(nWrite, (char *)&hbaseline);
-    writer->put_bytes((number_channels() + 1) * sizeof(std::complex<float>),
-                      ((char*)&integration_buffer_float[0]));
+    writer->put_bytes(size * sizeof(std::complex<float>), (char *)data);
+  } else {
+    // Reduced precision, encode_visibilities sets the scale exponent
+    size_t nbytes = size * output_visibility_size(version);
+    integration_buffer_output.resize(nbytes);
+    encode_visibilities(version, data, size, hbaseline,
+                        &integration_buffer_output[0]);
+
+    int nWrite = sizeof(hbaseline);
+    writer->put_bytes(nWrite, (char *)&hbaseline);
+    writer->put_bytes(nbytes, &integration_buffer_output[0]);
+  }
+}
+
+// Averages every factor channels with a boxcar that is centered on the
+// channel, which keeps the first (DC) and last (Nyquist) channel. For an
+// even factor the outer channels get half the weight. The boxcar is
+// truncated at the edges of the band.
+void
+Correlation_core::average_channels(int factor) {
+  const int nchan = number_channels();
+  SFXC_ASSERT(nchan % factor == 0);
+  const int n_points = nchan / factor + 1;
+  channel_average_buffer.resize(n_points);
+  for (int i = 0; i < n_points; i++) {
+    int center = i * factor;
+    std::complex<float> sum(0, 0);
+    float weight = 0;
+    for (int j = center - factor / 2; j <= center + factor / 2; j++) {
+      if ((j < 0) || (j > nchan))
+        continue;
+      float w = 1;
+      if ((factor % 2 == 0) && ((j == center - factor / 2) || (j == center + factor / 2)))
+        w = 0.5;
+      sum += integration_buffer_float[j] * w;
+      weight += w;
+    }
+    channel_average_buffer[i] = sum / weight;
   }
 }
 
@@ -34,6 +34,7 @@ Correlation_core_phased::do_task() {
     integration_step(accumulation_buffers, buf_idx);
     current_fft++;
   }
+  ffts_.add(nbuffer);
 
   for (size_t i = 0; i < number_input_streams(); i++) {
     int stream = station_stream(i);
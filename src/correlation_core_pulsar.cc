@@ -125,6 +125,7 @@ void Correlation_core_pulsar::do_task() {
     dedisperse_buffer();
     current_fft++;
   }
+  ffts_.add(nbuffer);
 
   for (size_t i = 0; i < number_input_streams(); i++) {
     int stream = station_stream(i);
@@ -0,0 +1,298 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the implementation of Node_status and Correlation_status.
+ */
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "correlation_status.h"
+#include "sfxc_mpi.h"
+#include "utils.h"
+
+namespace {
+const char *stage_names[Correlation_status::NR_STAGES] = {
+  "input", "F", "X", "output"
+};
+
+double seconds(const Time &time) {
+  return time / Time(1000000.);
+}
+
+// Writes a fraction, or null if it is unknown
+void write_fraction(std::ostream &out, double fraction) {
+  if (fraction < 0)
+    out << "null";
+  else
+    out << std::fixed << std::setprecision(3) << fraction;
+}
+} // namespace
+
+Node_status::Node_status() {
+  for (int i = 0; i < NR_FIELDS; i++)
+    value[i] = 0;
+}
+
+void
+Node_status::measure() {
+  value[TIME] = telemetry_usec();
+  value[INPUT_BUSY] = Telemetry::sum("thread_busy_usec", "input_reader");
+  value[INPUT_IDLE] = Telemetry::sum("thread_idle_usec", "input_reader");
+  value[BIT2FLOAT_BUSY] = Telemetry::sum("thread_busy_usec", "bit2float");
+  value[BIT2FLOAT_IDLE] = Telemetry::sum("thread_idle_usec", "bit2float");
+  value[CORRELATOR_BUSY] = Telemetry::sum("thread_busy_usec", "correlation");
+  value[CORRELATOR_IDLE] = Telemetry::sum("thread_idle_usec", "correlation");
+  value[DELAY_CORRECTION_BUSY] = Telemetry::sum("stage_busy_usec", "delay_correction");
+  value[CORRELATION_BUSY] = Telemetry::sum("stage_busy_usec", "correlation");
+  value[OUTPUT_BUSY] = Telemetry::sum("thread_busy_usec", "output");
+  value[OUTPUT_IDLE] = Telemetry::sum("thread_idle_usec", "output");
+  value[INPUT_BYTES] = Telemetry::sum("bytes_in", "input");
+  value[INTEGRATIONS] = Telemetry::sum("integrations", "correlator");
+}
+
+double
+Correlation_status::Node_state::usage(Node_status::Field busy,
+                                      Node_status::Field idle) const {
+  return share(busy, busy, idle);
+}
+
+double
+Correlation_status::Node_state::share(Node_status::Field busy,
+                                      Node_status::Field total_busy,
+                                      Node_status::Field total_idle) const {
+  if (nr_records < 2)
+    return -1;
+  int64_t total = (current.value[total_busy] - previous.value[total_busy]) +
+                  (current.value[total_idle] - previous.value[total_idle]);
+  if (total <= 0)
+    return -1;
+  return std::min(1., (double)(current.value[busy] - previous.value[busy]) / total);
+}
+
+double
+Correlation_status::Node_state::rate(Node_status::Field field) const {
+  if (nr_records < 2)
+    return 0;
+  int64_t usec = current.value[Node_status::TIME] - previous.value[Node_status::TIME];
+  if (usec <= 0)
+    return 0;
+  return (current.value[field] - previous.value[field]) * 1e6 / usec;
+}
+
+Correlation_status::Correlation_status()
+  : interval_usec_(0), last_publish_(0), wall_start_(0),
+    previous_correlated_sec_(0), previous_wall_(0) {}
+
+bool
+Correlation_status::initialise(const std::string &output, int interval_ms,
+                               const std::vector<std::string> &stations,
+                               const std::vector<int> &input_ranks,
+                               const std::vector<int> &correlator_ranks,
+                               Time start_time, Time stop_time,
+                               Time integration_time) {
+  SFXC_ASSERT(input_ranks.size() == stations.size());
+  if (!output_.open(output) || (interval_ms <= 0))
+    return false;
+  interval_usec_ = (int64_t)interval_ms * 1000;
+  stations_ = stations;
+  input_ranks_ = input_ranks;
+  correlator_ranks_ = correlator_ranks;
+  start_time_ = start_time;
+  stop_time_ = stop_time;
+  integration_time_ = integration_time;
+  frontier_ = start_time;
+  int nr_ranks = RANK_OUTPUT_NODE + 1;
+  for (size_t i = 0; i < input_ranks.size(); i++)
+    nr_ranks = std::max(nr_ranks, input_ranks[i] + 1);
+  for (size_t i = 0; i < correlator_ranks.size(); i++)
+    nr_ranks = std::max(nr_ranks, correlator_ranks[i] + 1);
+  nodes_.resize(nr_ranks);
+  rank_correlator_.assign(nr_ranks, -1);
+  for (size_t i = 0; i < correlator_ranks.size(); i++)
+    rank_correlator_[correlator_ranks[i]] = i;
+  correlators_.resize(correlator_ranks.size());
+  wall_start_ = previous_wall_ = last_publish_ = telemetry_usec();
+  return true;
+}
+
+void
+Correlation_status::add_job(int correlator_node, Time start, int nr_integrations,
+                            int jobs_per_integration) {
+  if (!enabled())
+    return;
+  SFXC_ASSERT((correlator_node >= 0) && (correlator_node < (int)correlators_.size()));
+  SFXC_ASSERT(jobs_per_integration > 0);
+  for (int i = 0; i < nr_integrations; i++) {
+    Integration integration;
+    integration.start = start + integration_time_ * i;
+    integration.seconds = seconds(integration_time_) / jobs_per_integration;
+    correlators_[correlator_node].pending.push_back(integration);
+  }
+  frontier_ = std::max(frontier_, start);
+}
+
+void
+Correlation_status::set_node_status(int rank, const Node_status &status) {
+  if (!enabled() || (rank < 0) || (rank >= (int)nodes_.size()))
+    return;
+  Node_state &node = nodes_[rank];
+  node.previous = (node.nr_records == 0 ? status : node.current);
+  node.current = status;
+  node.nr_records++;
+
+  // A correlator node finishes its integrations in the order it got them
+  int correlator = rank_correlator_[rank];
+  if (correlator >= 0) {
+    Correlator_state &state = correlators_[correlator];
+    int64_t done = status.value[Node_status::INTEGRATIONS];
+    while ((state.integrations_done < done) && !state.pending.empty()) {
+      state.correlated_sec += state.pending.front().seconds;
+      state.pending.pop_front();
+      state.integrations_done++;
+    }
+  }
+}
+
+void
+Correlation_status::publish_if_due() {
+  if (!enabled())
+    return;
+  uint64_t now = telemetry_usec();
+  if (now - last_publish_ < (uint64_t)interval_usec_)
+    return;
+  last_publish_ = now;
+
+  std::ostringstream out;
+  write(out);
+  // A file is replaced by the new status, a socket gets one line
+  output_.write(out.str(), true);
+}
+
+void
+Correlation_status::write(std::ostream &out) {
+  uint64_t now = telemetry_usec();
+
+  // The integrations are spread over the correlator nodes, the data is
+  // correlated up to the oldest unfinished integration
+  int64_t in_flight = 0;
+  double correlated_sec = 0;
+  Time correlated_until = frontier_;
+  for (size_t i = 0; i < correlators_.size(); i++) {
+    correlated_sec += correlators_[i].correlated_sec;
+    in_flight += correlators_[i].pending.size();
+    if (!correlators_[i].pending.empty())
+      correlated_until = std::min(correlated_until, correlators_[i].pending.front().start);
+  }
+  double real_time_factor = 0, average_real_time_factor = 0;
+  if (now > previous_wall_)
+    real_time_factor = (correlated_sec - previous_correlated_sec_) * 1e6 / (now - previous_wall_);
+  if (now > wall_start_)
+    average_real_time_factor = correlated_sec * 1e6 / (now - wall_start_);
+  previous_correlated_sec_ = correlated_sec;
+  previous_wall_ = now;
+  double progress = 0;
+  if (stop_time_ > start_time_)
+    progress = std::max(0., std::min(1., (correlated_until - start_time_) /
+                                         (stop_time_ - start_time_)));
+
+  // The utilisation of a stage is the highest utilisation of the input
+  // nodes, the average over the correlator nodes, which share the work,
+  // and the utilisation of the output node. The correlation thread does
+  // both the delay correction (F) and the correlation (X), if it is
+  // saturated the larger of the two is the limiting stage.
+  double stage_usage[NR_STAGES];
+  std::fill(stage_usage, stage_usage + NR_STAGES, -1.);
+  for (size_t station = 0; station < stations_.size(); station++) {
+    const Node_state &node = nodes_[input_rank(station)];
+    stage_usage[INPUT] = std::max(stage_usage[INPUT],
+                                  node.usage(Node_status::INPUT_BUSY, Node_status::INPUT_IDLE));
+  }
+  std::vector<double> correlator_f(correlators_.size(), -1);
+  std::vector<double> correlator_x(correlators_.size(), -1);
+  double sum_f = 0, sum_x = 0;
+  int nr_measured = 0;
+  for (size_t i = 0; i < correlators_.size(); i++) {
+    const Node_state &node = nodes_[correlator_rank(i)];
+    double thread = node.usage(Node_status::CORRELATOR_BUSY, Node_status::CORRELATOR_IDLE);
+    if (thread < 0)
+      continue;
+    double f = node.share(Node_status::DELAY_CORRECTION_BUSY,
+                          Node_status::CORRELATOR_BUSY, Node_status::CORRELATOR_IDLE);
+    double x = node.share(Node_status::CORRELATION_BUSY,
+                          Node_status::CORRELATOR_BUSY, Node_status::CORRELATOR_IDLE);
+    correlator_f[i] = std::max(node.usage(Node_status::BIT2FLOAT_BUSY, Node_status::BIT2FLOAT_IDLE),
+                               (f >= x ? thread : f));
+    correlator_x[i] = (x > f ? thread : x);
+    sum_f += correlator_f[i];
+    sum_x += correlator_x[i];
+    nr_measured++;
+  }
+  if (nr_measured > 0) {
+    stage_usage[F] = sum_f / nr_measured;
+    stage_usage[X] = sum_x / nr_measured;
+  }
+  stage_usage[OUTPUT] =
+    nodes_[RANK_OUTPUT_NODE].usage(Node_status::OUTPUT_BUSY, Node_status::OUTPUT_IDLE);
+  int limiting_stage = -1;
+  for (int stage = 0; stage < NR_STAGES; stage++) {
+    if ((stage_usage[stage] >= 0) &&
+        ((limiting_stage < 0) || (stage_usage[stage] > stage_usage[limiting_stage])))
+      limiting_stage = stage;
+  }
+
+  out << "{\"time\":" << now / 1000000
+      << ",\"start\":\"" << start_time_.date_string() << "\""
+      << ",\"stop\":\"" << stop_time_.date_string() << "\""
+      << ",\"correlated_until\":\"" << correlated_until.date_string() << "\""
+      << ",\"progress\":";
+  write_fraction(out, progress);
+  out << ",\"real_time_factor\":" << std::setprecision(3) << real_time_factor
+      << ",\"average_real_time_factor\":" << average_real_time_factor
+      << ",\"integrations_in_flight\":" << in_flight
+      << ",\"limiting_stage\":";
+  if (limiting_stage < 0)
+    out << "null";
+  else
+    out << "\"" << stage_names[limiting_stage] << "\"";
+
+  out << ",\"stages\":{";
+  for (int stage = 0; stage < NR_STAGES; stage++) {
+    out << (stage == 0 ? "" : ",") << "\"" << stage_names[stage] << "\":";
+    write_fraction(out, stage_usage[stage]);
+  }
+
+  out << "},\"stations\":[";
+  for (size_t station = 0; station < stations_.size(); station++) {
+    const Node_state &node = nodes_[input_rank(station)];
+    out << (station == 0 ? "" : ",") << "{\"name\":\"" << stations_[station]
+        << "\",\"rank\":" << input_rank(station)
+        << ",\"rate_mbit\":" << std::setprecision(3)
+        << node.rate(Node_status::INPUT_BYTES) * 8 / 1e6 << ",\"usage\":";
+    write_fraction(out, node.usage(Node_status::INPUT_BUSY, Node_status::INPUT_IDLE));
+    out << "}";
+  }
+
+  out << "],\"correlator_nodes\":[";
+  for (size_t i = 0; i < correlators_.size(); i++) {
+    // The lag is how far the oldest unfinished integration of the node is
+    // behind the last job that was handed out
+    double lag = 0;
+    if (!correlators_[i].pending.empty())
+      lag = seconds(frontier_ - correlators_[i].pending.front().start);
+    out << (i == 0 ? "" : ",") << "{\"node\":" << i
+        << ",\"rank\":" << correlator_rank(i)
+        << ",\"in_flight\":" << correlators_[i].pending.size()
+        << ",\"done\":" << correlators_[i].integrations_done
+        << ",\"lag_sec\":" << std::setprecision(3) << lag << ",\"F\":";
+    write_fraction(out, correlator_f[i]);
+    out << ",\"X\":";
+    write_fraction(out, correlator_x[i]);
+    out << "}";
+  }
+  out << "]}\n";
+}
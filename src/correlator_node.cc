@@ -29,7 +29,11 @@ Correlator_node::Correlator_node(int rank, int nr_corr_node, bool pulsar_binning
     nr_corr_node(nr_corr_node), 
     pulsar_parameters(get_log_writer()),
     pulsar_binning(pulsar_binning_),
-    phased_array(phased_array_), n_streams(0) {
+    phased_array(phased_array_), n_streams(0),
+    correlation_usage_("correlation"),
+    delay_busy_("stage_busy_usec", "delay_correction"),
+    correlation_busy_("stage_busy_usec", "correlation"),
+    integrations_("integrations", "correlator") {
   #ifdef USE_IPP
   ippSetNumThreads(1);
   #endif
@@ -172,6 +176,7 @@ void Correlator_node::main_loop() {
           ///DEBUG_MSG("CORRELATION CORE FINISHED !" << n_integration_slice_in_time_slice);
           n_integration_slice_in_time_slice--;
           if (n_integration_slice_in_time_slice==0) {
+            integrations_.add(1);
             // Notify manager node:
             status = STOPPED;
             // Try initialising a new integration slice
@@ -198,6 +203,8 @@ void Correlator_node::add_delay_table(Delay_table &table, int sn1, int sn2) {
   if(delay_index.size() <= sn2)
     delay_index.resize(sn2+1, -1);
 
+  // Only the scans from the current scan on are kept
+  delay_tables[sn1].remove_finished_scans();
   delay_tables[sn1].add_scans(table);
   delay_index[sn1] = sn1;
   delay_index[sn2] = sn1;
@@ -207,6 +214,7 @@ void Correlator_node::add_uvw_table(Uvw_model &table, int sn) {
   if(uvw_tables.size() <= sn){
     uvw_tables.resize(sn+1);
   }
+  uvw_tables[sn].remove_finished_scans();
   uvw_tables[sn].add_scans(table);
 }
 
@@ -219,6 +227,7 @@ void Correlator_node::hook_added_data_reader(size_t stream_nr) {
   reader_thread_.bit_sample_readers()[stream_nr] =
        Bit_sample_reader_ptr(new Correlator_node_data_reader_tasklet());
   reader_thread_.bit_sample_readers()[stream_nr]->connect_to(stream_nr, data_readers_ctrl.get_data_reader(stream_nr));
+  data_readers_ctrl.get_data_reader(stream_nr)->set_name("stream" + itoa(stream_nr));
 
   // connect reader to data stream worker
 
@@ -251,6 +260,7 @@ void Correlator_node::hook_added_data_reader(size_t stream_nr) {
 void Correlator_node::hook_added_data_writer(size_t i) {
   SFXC_ASSERT(i == 0);
 
+  data_writer_ctrl.get_data_writer(0)->set_name("output");
   correlation_core_normal->set_data_writer(data_writer_ctrl.get_data_writer(0));
   if(pulsar_binning)
     correlation_core_pulsar->set_data_writer(data_writer_ctrl.get_data_writer(0));
@@ -263,6 +273,7 @@ int Correlator_node::get_correlate_node_number() {
 void Correlator_node::correlate() {
   RT_STAT( dotask_state_.begin_measure() );
   bool done_work=false; 
+  uint64_t start = telemetry_usec();
   delay_timer_.resume();
   for (size_t i=0; i<delay_modules.size(); i++) {
     if (delay_modules[i] != Delay_correction_ptr()) {
@@ -275,6 +286,9 @@ void Correlator_node::correlate() {
     }
   }
   delay_timer_.stop();
+  uint64_t delay_done = telemetry_usec();
+  if (done_work)
+    delay_busy_.add(delay_done - start);
 
   correlation_timer_.resume();
   if (correlation_core->has_work()) {
@@ -284,23 +298,39 @@ void Correlator_node::correlate() {
     done_work=true;
 
     RT_STAT( correlation_state_.end_measure(1) );
+    correlation_busy_.add(telemetry_usec() - delay_done);
   }
 
   correlation_timer_.stop();
 
   RT_STAT( dotask_state_.end_measure(1) );
 
-  if (!done_work)
+  if (done_work) {
+    correlation_usage_.busy();
+  } else {
     usleep(1000);
+    correlation_usage_.idle();
+  }
 
 }
 
 void
-Correlator_node::receive_parameters(const Correlation_parameters &parameters) {
-  integration_slices_queue.push(parameters);
-
-  /// We add the new timeslice to the readers.
-  reader_thread_.add_time_slice_to_read(parameters);
+Correlator_node::receive_parameters(const Correlation_parameters &job) {
+  // A job contains consecutive integrations of one channel, which are
+  // correlated one by one
+  int nr_integrations = (int)((job.stop_time - job.start_time) / job.integration_time + 0.5);
+  SFXC_ASSERT(nr_integrations >= 1);
+  for (int i = 0; i < nr_integrations; i++) {
+    Correlation_parameters parameters = job;
+    parameters.start_time = job.start_time + job.integration_time * i;
+    parameters.stop_time = parameters.start_time + job.integration_time;
+    parameters.integration_nr = job.integration_nr + i;
+    parameters.slice_nr = job.slice_nr + i * job.slice_offset;
+    integration_slices_queue.push(parameters);
+
+    /// We add the new timeslice to the readers.
+    reader_thread_.add_time_slice_to_read(parameters);
+  }
 
   if (status == STOPPED)
     set_parameters();
@@ -373,37 +403,32 @@ Correlator_node::set_parameters() {
   }
   bit2float_thread_.set_parameters(parameters, akima_tables);
 
-  has_requested=false;
   status = CORRELATING;
 
   n_integration_slice_in_time_slice =
     (parameters.stop_time-parameters.start_time) / parameters.integration_time;
-  // set the output stream
-  int nstreams = parameters.station_streams.size();
-  std::set<int> stations_set;
-  for (int i = 0; i < nstreams; i++) {
-    int station = parameters.station_streams[i].station_number;
-    stations_set.insert(station);
-  }
-  int nstations = stations_set.size();
-  int nBaselines = correlation_core->number_of_baselines();
-  int size_of_one_baseline = sizeof(std::complex<float>) * (parameters.number_channels + 1);
-
-  int size_uvw = nstations*sizeof(Output_uvw_coordinates);
-  // when the cross_polarize flag is set then the correlator node receives 2 polarizations
-  int size_stats = nstreams * sizeof(Output_header_bitstatistics);
-
-  int slice_size;
-  slice_size = nBins * ( sizeof(int32_t) + sizeof(Output_header_timeslice) + size_uvw + size_stats +
-               nBaselines * ( size_of_one_baseline + sizeof(Output_header_baseline)));
+  // set the output stream, the size depends on the averaging of the
+  // output products
   SFXC_ASSERT(nBins >= 1);
+  int slice_size = 0;
+  for (int bin = 0; bin < nBins; bin++)
+    slice_size += correlation_core->output_size(bin);
   output_node_set_timeslice(parameters.slice_nr,
                             parameters.slice_offset,
                             n_integration_slice_in_time_slice,
                             get_correlate_node_number(),slice_size, nBins);
+  // New work is requested once per job, during its last integration
+  has_requested = (parameters.integration_nr != parameters.last_integration_in_block);
   integration_slices_queue.pop();
 }
 
+void
+Correlator_node::set_output_averaging(int stream, int channels, int integrations) {
+  correlation_core_normal->set_output_averaging(stream, channels, integrations);
+  if (pulsar_binning)
+    correlation_core_pulsar->set_output_averaging(stream, channels, integrations);
+}
+
 void
 Correlator_node::
 output_node_set_timeslice(int slice_nr, int slice_offset, int n_slices,
@@ -4,7 +4,8 @@
 
 #define MINIMUM_PROCESSED_SAMPLES 1024
 
-Correlator_node_bit2float_tasklet::Correlator_node_bit2float_tasklet() {}
+Correlator_node_bit2float_tasklet::Correlator_node_bit2float_tasklet()
+  : usage_("bit2float") {}
 
 Correlator_node_bit2float_tasklet::~Correlator_node_bit2float_tasklet() {}
 
@@ -33,6 +34,9 @@ void Correlator_node_bit2float_tasklet::do_execute(){
     if ( processed_samples < MINIMUM_PROCESSED_SAMPLES ){
       //sched_yield();
       usleep(1000);
+      usage_.idle();
+    } else {
+      usage_.busy();
     }
   }
   timer_.stop();
@@ -36,7 +36,7 @@ Correlator_node_controller::process_event(MPI_Status &status) {
       get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
       Delay_table table;
       int sn[2];
-      MPI_Transfer::receive_bcast(status, table, sn);
+      MPI_Transfer::receive(status, table, sn);
       if(sn[1] >= 0)
         node.add_delay_table(table, sn[0], sn[1]);
       else
@@ -47,7 +47,7 @@ Correlator_node_controller::process_event(MPI_Status &status) {
       get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
       Uvw_model table;
       int sn;
-      MPI_Transfer::receive_bcast(status, table, sn);
+      MPI_Transfer::receive(status, table, sn);
       node.add_uvw_table(table, sn);
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
@@ -80,6 +80,16 @@ Correlator_node_controller::process_event(MPI_Status &status) {
       MPI_Transfer::receive(status, sources);
       node.correlation_core_normal->add_source_list(sources);
 
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
+  case MPI_TAG_SET_OUTPUT_AVERAGING: {
+      get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
+      MPI_Status status2;
+      int32_t msg[3];
+      MPI_Recv(msg, 3, MPI_INT32, status.MPI_SOURCE,
+               status.MPI_TAG, MPI_COMM_WORLD, &status2);
+      node.set_output_averaging(msg[0], msg[1], msg[2]);
+
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
   }
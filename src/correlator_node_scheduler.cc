@@ -0,0 +1,158 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the implementation of Correlator_node_scheduler
+ */
+
+#include <sys/time.h>
+#include <algorithm>
+#include <iomanip>
+
+#include "correlator_node_scheduler.h"
+#include "utils.h"
+
+Correlator_node_scheduler::Correlator_node_scheduler()
+  : throughput_scheduling_(false), start_time_(0) {
+  start_time_ = now();
+}
+
+double
+Correlator_node_scheduler::now() const {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6 - start_time_;
+}
+
+Correlator_node_scheduler::Node_state &
+Correlator_node_scheduler::state(int node) {
+  SFXC_ASSERT(node >= 0);
+  if (node >= (int)nodes_.size())
+    nodes_.resize(node + 1);
+  return nodes_[node];
+}
+
+void
+Correlator_node_scheduler::set_ready(int node) {
+  Node_state &s = state(node);
+  // The first request of a node doesn't end a job
+  if (!s.jobs.empty()) {
+    double t = now();
+    Job &job = s.jobs.front();
+    // With several jobs queued on the node, a job starts when the
+    // previous one ends
+    double duration = t - std::max(job.assign_time, s.last_end);
+    if (duration > 0) {
+      double rate = job.cost / duration;
+      if (s.throughput == 0)
+        s.throughput = rate;
+      else
+        s.throughput = SCHEDULER_THROUGHPUT_WEIGHT * rate +
+                       (1 - SCHEDULER_THROUGHPUT_WEIGHT) * s.throughput;
+      s.busy_time += duration;
+    }
+    s.total_cost += job.cost;
+    s.nr_jobs++;
+    s.last_end = t;
+    s.jobs.pop_front();
+  }
+  ready_.push_back(node);
+}
+
+double
+Correlator_node_scheduler::throughput(int node) const {
+  if (node >= (int)nodes_.size())
+    return 0;
+  return nodes_[node].throughput;
+}
+
+double
+Correlator_node_scheduler::expected_throughput(int node) const {
+  double tp = throughput(node);
+  if (tp > 0)
+    return tp;
+  double sum = 0;
+  int n = 0;
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    if (nodes_[i].throughput > 0) {
+      sum += nodes_[i].throughput;
+      n++;
+    }
+  }
+  return (n > 0 ? sum / n : 0);
+}
+
+double
+Correlator_node_scheduler::expected_free_time(int node, double t) const {
+  const Node_state &s = nodes_[node];
+  double tp = expected_throughput(node);
+  double free_time = t;
+  for (size_t i = 0; i < s.jobs.size(); i++) {
+    double start = std::max(free_time, s.jobs[i].assign_time);
+    free_time = start + s.jobs[i].cost / tp;
+  }
+  return free_time;
+}
+
+int
+Correlator_node_scheduler::select_node(double cost, int jobs_left) {
+  if (ready_.empty())
+    return -1;
+
+  if ((!throughput_scheduling_) || (expected_throughput(ready_.front()) <= 0)) {
+    // First in, first out, also while no throughput is known
+    int node = ready_.front();
+    ready_.pop_front();
+    return node;
+  }
+
+  // The fastest ready node
+  std::deque<int>::iterator best = ready_.begin();
+  for (std::deque<int>::iterator it = ready_.begin(); it != ready_.end(); it++) {
+    if (expected_throughput(*it) > expected_throughput(*best))
+      best = it;
+  }
+  int node = *best;
+
+  // Near the end of the scan every job can delay the end of the scan, wait
+  // if a busy node would finish this job clearly earlier
+  if (jobs_left <= (int)nodes_.size()) {
+    double t = now();
+    double finish = t + cost / expected_throughput(node);
+    for (size_t i = 0; i < nodes_.size(); i++) {
+      if (nodes_[i].jobs.empty() ||
+          (std::find(ready_.begin(), ready_.end(), (int)i) != ready_.end()))
+        continue;
+      double busy_finish = expected_free_time(i, t) + cost / expected_throughput(i);
+      if ((busy_finish - t) * SCHEDULER_WAIT_MARGIN < finish - t)
+        return -1;
+    }
+  }
+
+  ready_.erase(best);
+  return node;
+}
+
+void
+Correlator_node_scheduler::assign(int node, double cost) {
+  Job job;
+  job.assign_time = now();
+  job.cost = cost;
+  state(node).jobs.push_back(job);
+}
+
+void
+Correlator_node_scheduler::print_statistics(std::ostream &out) const {
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    const Node_state &s = nodes_[i];
+    out << "correlator node " << i << ": " << s.nr_jobs << " jobs, busy "
+        << std::fixed << std::setprecision(1) << s.busy_time << " s";
+    if (s.busy_time > 0)
+      out << ", throughput " << std::setprecision(2)
+          << s.total_cost / s.busy_time << " (current "
+          << s.throughput << ")";
+    out << std::endl;
+  }
+}
@@ -0,0 +1,141 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the definition of the Data_index object.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits>
+
+#include "data_index.h"
+
+Data_index::Data_index() : period_(0), interval_(0) {}
+
+bool
+Data_index::load(const std::string &filename, uint64_t start,
+                 uint64_t data_size) {
+  FILE *infile = fopen(filename.c_str(), "rb");
+  if (infile == NULL)
+    return false;
+
+  File_header header;
+  bool ok = (fread(&header, sizeof(header), 1, infile) == 1) &&
+            (memcmp(header.magic, DATA_INDEX_MAGIC, sizeof(header.magic)) == 0) &&
+            (header.version == DATA_INDEX_VERSION) &&
+            (header.data_size == data_size);
+  if (ok && !entries_.empty())
+    ok = (header.period == period_);
+
+  if (ok) {
+    size_t old_size = entries_.size();
+    entries_.resize(old_size + header.nr_entries);
+    ok = (header.nr_entries == 0) ||
+         (fread(&entries_[old_size], sizeof(Entry), header.nr_entries, infile) ==
+          header.nr_entries);
+    if (ok) {
+      for (size_t i = old_size; i < entries_.size(); i++)
+        entries_[i].position += start;
+      period_ = header.period;
+      interval_ = header.interval;
+      header.format[sizeof(header.format) - 1] = '\0';
+      format_ = header.format;
+    } else {
+      entries_.resize(old_size);
+    }
+  }
+  fclose(infile);
+  return ok;
+}
+
+bool
+Data_index::save(const std::string &filename, uint64_t data_size) const {
+  FILE *outfile = fopen(filename.c_str(), "wb");
+  if (outfile == NULL)
+    return false;
+
+  File_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DATA_INDEX_MAGIC, sizeof(header.magic));
+  header.version = DATA_INDEX_VERSION;
+  header.interval = interval_;
+  header.period = period_;
+  strncpy(header.format, format_.c_str(), sizeof(header.format) - 1);
+  header.nr_entries = entries_.size();
+  header.data_size = data_size;
+
+  bool ok = (fwrite(&header, sizeof(header), 1, outfile) == 1) &&
+            (entries_.empty() ||
+             (fwrite(&entries_[0], sizeof(Entry), entries_.size(), outfile) ==
+              entries_.size()));
+  return (fclose(outfile) == 0) && ok;
+}
+
+void
+Data_index::add(int64_t ticks, uint64_t position, uint32_t flags) {
+  Entry entry;
+  entry.ticks = ticks;
+  if (period_ > 0) {
+    entry.ticks %= period_;
+    if (entry.ticks < 0)
+      entry.ticks += period_;
+  }
+  entry.position = position;
+  entry.flags = flags;
+  entry.reserved = 0;
+  entries_.push_back(entry);
+}
+
+void
+Data_index::set_period(int64_t period) {
+  period_ = period;
+}
+
+void
+Data_index::set_format(const std::string &format, int interval) {
+  format_ = format;
+  interval_ = interval;
+}
+
+int64_t
+Data_index::relative_ticks(int64_t ticks) const {
+  int64_t delta = ticks - entries_[0].ticks;
+  if (period_ > 0) {
+    delta %= period_;
+    if (delta < 0)
+      delta += period_;
+  }
+  return delta;
+}
+
+bool
+Data_index::lookup(const Time &time, uint64_t &begin, uint64_t &end) const {
+  if (entries_.empty())
+    return false;
+  const int64_t ticks = relative_ticks(time.get_clock_ticks());
+
+  // Binary search for the first entry after time
+  size_t lo = 0, hi = entries_.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (relative_ticks(entries_[mid].ticks) <= ticks)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  end = (lo < entries_.size() ? entries_[lo].position :
+                                std::numeric_limits<uint64_t>::max());
+
+  // Find the last entry before time that is followed by valid data
+  while (lo > 0) {
+    lo--;
+    if ((entries_[lo].flags & (INVALID | END)) == 0) {
+      begin = entries_[lo].position;
+      return true;
+    }
+  }
+  return false;
+}
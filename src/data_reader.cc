@@ -13,7 +13,10 @@
 #include <string.h>
 #include <limits>
 
-Data_reader::Data_reader() : _data_counter(0), data_slice(-1), is_seekable_(false) {}
+Data_reader::Data_reader() :
+  _data_counter(0), position_(0), data_slice(-1),
+  bytes_in_("bytes_in", Telemetry::unique_name("reader")),
+  is_seekable_(false) {}
 
 Data_reader::~Data_reader() {}
 
@@ -27,10 +30,27 @@ Data_reader::get_bytes(size_t nBytes, char *buff) {
 
   size_t result = do_get_bytes(nBytes, buff);
   _data_counter += result;
+  if (result != (size_t)-1) {
+    position_ += result;
+    bytes_in_.add(result);
+  }
   if (data_slice != -1) data_slice -= result;
   return result;
 }
 
+bool
+Data_reader::seek(uint64_t position) {
+  SFXC_ASSERT(data_slice == -1);
+  if (!is_seekable_)
+    return false;
+  if (position == position_)
+    return true;
+  if (!do_seek(position))
+    return false;
+  position_ = position;
+  return true;
+}
+
 uint64_t
 Data_reader::data_counter() {
   return _data_counter;
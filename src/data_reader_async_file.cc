@@ -0,0 +1,379 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the definition of the Data_reader_async_file object.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <cstdlib>
+
+#include "data_reader_async_file.h"
+#include "raiimutex.h"
+#include "utils.h"
+
+Data_reader_async_file::
+Data_reader_async_file(const std::vector<std::string> &sources) :
+  Data_reader(), total_size_(0), current_block_(NULL), stream_position_(0),
+  read_error_(false), generation_(0), request_position_(0),
+  read_ahead_position_(0), read_ahead_thread_(*this) {
+  for (size_t i = 0; i < sources.size(); i++) {
+    SFXC_ASSERT(sources[i].compare(0, 8, "afile://") == 0);
+    Input_file file;
+    file.filename = sources[i].substr(8);
+    struct stat sb;
+    if ((::stat(file.filename.c_str(), &sb) != 0) ||
+        (::access(file.filename.c_str(), R_OK) != 0)) {
+      std::cerr << RANK_OF_NODE << " : Warning : Cannot open "
+                << file.filename << "\n";
+      continue;
+    }
+    if (sb.st_size == 0)
+      continue;
+    file.start = total_size_;
+    file.size = sb.st_size;
+    total_size_ += file.size;
+    files_.push_back(file);
+
+    std::string index_file = file.filename + DATA_INDEX_EXTENSION;
+    if (index_.load(index_file, file.start, file.size))
+      LOG_MSG("Using time index " << index_file);
+  }
+  if (files_.empty())
+    sfxc_abort("Could not open any input files");
+
+  buffers_.resize(ASYNC_FILE_NR_BLOCKS);
+  blocks_.resize(ASYNC_FILE_NR_BLOCKS);
+  for (size_t i = 0; i < buffers_.size(); i++) {
+    void *buffer;
+    if (posix_memalign(&buffer, ASYNC_FILE_ALIGNMENT, ASYNC_FILE_BLOCK_SIZE) != 0)
+      sfxc_abort("Could not allocate the read-ahead buffers");
+    buffers_[i] = (char *)buffer;
+    blocks_[i].data = buffers_[i];
+    free_blocks_.push(&blocks_[i]);
+  }
+
+  is_seekable_ = true;
+  timer_.start();
+  read_ahead_thread_.start();
+}
+
+Data_reader_async_file::~Data_reader_async_file() {
+  {
+    RAIIMutex lock(request_cond_);
+    read_ahead_thread_.stop();
+    request_cond_.signal();
+  }
+  free_blocks_.close();
+  full_blocks_.close();
+  wait(read_ahead_thread_);
+
+  timer_.stop();
+  double mb = toMB(read_ahead_thread_.bytes_read());
+  double time = timer_.measured_time();
+  LOG_MSG("Read " << mb << " MB of " << files_[0].filename
+          << (files_.size() > 1 ? " ..." : "") << " from disk in " << time << " s ("
+          << (time > 0 ? mb / time : 0) << " MB/s), "
+          << toMB(data_counter()) << " MB used");
+
+  for (size_t i = 0; i < buffers_.size(); i++)
+    free(buffers_[i]);
+}
+
+size_t
+Data_reader_async_file::do_get_bytes(size_t nbytes, char *out) {
+  if (eof())
+    return 0;
+
+  if (out == NULL) {
+    uint64_t target = std::min(stream_position_ + (uint64_t)nbytes, total_size_);
+    size_t skipped = target - stream_position_;
+    if ((current_block_ != NULL) &&
+        (target < current_block_->position +
+                  (current_block_->end - current_block_->begin))) {
+      stream_position_ = target;
+      return skipped;
+    }
+    release_block();
+
+    uint64_t read_ahead_position;
+    {
+      RAIIMutex lock(request_cond_);
+      read_ahead_position = read_ahead_position_;
+    }
+    if (target > read_ahead_position + ASYNC_FILE_BLOCK_SIZE) {
+      // Don't read the data in between
+      do_seek(target);
+    } else {
+      // The data is (almost) read already, get_block() skips it
+      stream_position_ = target;
+    }
+    return skipped;
+  }
+
+  size_t done = 0;
+  while ((done < nbytes) && !eof()) {
+    if (!get_block())
+      break;
+    size_t offset = stream_position_ - current_block_->position;
+    size_t size = current_block_->end - current_block_->begin;
+    size_t n = std::min(nbytes - done, size - offset);
+    memcpy(out + done, current_block_->data + current_block_->begin + offset, n);
+    done += n;
+    stream_position_ += n;
+    if (offset + n == size)
+      release_block();
+  }
+  return done;
+}
+
+bool
+Data_reader_async_file::get_block() {
+  while ((current_block_ == NULL) && !read_error_) {
+    Block *block;
+    try {
+      block = full_blocks_.front_and_pop();
+    } catch (QueueClosedException &e) {
+      return false;
+    }
+
+    if (block->error) {
+      read_error_ = true;
+      free_blocks_.push(block);
+      return false;
+    }
+
+    uint64_t block_end = block->position + (block->end - block->begin);
+    if ((block->generation != generation_) || (block_end <= stream_position_)) {
+      // Read before a seek or skipped over
+      free_blocks_.push(block);
+    } else {
+      SFXC_ASSERT(block->position <= stream_position_);
+      current_block_ = block;
+    }
+  }
+  return (current_block_ != NULL);
+}
+
+void
+Data_reader_async_file::release_block() {
+  if (current_block_ != NULL) {
+    free_blocks_.push(current_block_);
+    current_block_ = NULL;
+  }
+}
+
+bool
+Data_reader_async_file::do_seek(uint64_t position) {
+  if (position > total_size_)
+    return false;
+  if ((current_block_ != NULL) && (position >= current_block_->position) &&
+      (position < current_block_->position +
+                  (current_block_->end - current_block_->begin))) {
+    stream_position_ = position;
+    return true;
+  }
+  release_block();
+  stream_position_ = position;
+  read_error_ = false;
+
+  RAIIMutex lock(request_cond_);
+  generation_++;
+  request_position_ = position;
+  read_ahead_position_ = position;
+  request_cond_.signal();
+  return true;
+}
+
+bool
+Data_reader_async_file::eof() {
+  return (stream_position_ >= total_size_) || read_error_;
+}
+
+const Data_index *
+Data_reader_async_file::get_index() {
+  return (index_.empty() ? NULL : &index_);
+}
+
+bool
+Data_reader_async_file::can_read() {
+  return !full_blocks_.empty() || (current_block_ != NULL);
+}
+
+Data_reader_async_file::Read_ahead_thread::
+Read_ahead_thread(Data_reader_async_file &reader)
+  : reader_(reader), position_(0), generation_(0),
+    file_nr_(0), next_file_nr_(0), fd_(-1), next_fd_(-1), bytes_read_(0) {}
+
+Data_reader_async_file::Read_ahead_thread::~Read_ahead_thread() {
+  close_files();
+}
+
+void
+Data_reader_async_file::Read_ahead_thread::do_execute() {
+  try {
+    while (isrunning_) {
+      Block *block = reader_.free_blocks_.front_and_pop();
+      {
+        // Wait for a seek request if all data has been read
+        RAIIMutex lock(reader_.request_cond_);
+        while (isrunning_ && (generation_ == reader_.generation_) &&
+               (position_ >= reader_.total_size_))
+          reader_.request_cond_.wait();
+        if (!isrunning_)
+          break;
+        if (generation_ != reader_.generation_) {
+          generation_ = reader_.generation_;
+          position_ = reader_.request_position_;
+        }
+      }
+      if (position_ >= reader_.total_size_) {
+        // Seek to the end of the data, wait for the next request
+        reader_.free_blocks_.push(block);
+        continue;
+      }
+
+      block->generation = generation_;
+      fill_block(block);
+      if (!block->error)
+        position_ += block->end - block->begin;
+
+      {
+        RAIIMutex lock(reader_.request_cond_);
+        if (generation_ == reader_.generation_)
+          reader_.read_ahead_position_ = position_;
+      }
+      reader_.full_blocks_.push(block);
+    }
+  } catch (QueueClosedException &e) {
+    // The reader is destroyed
+  }
+  close_files();
+}
+
+void
+Data_reader_async_file::Read_ahead_thread::fill_block(Block *block) {
+  const std::vector<Input_file> &files = reader_.files_;
+  block->error = false;
+  block->position = position_;
+  block->begin = block->end = 0;
+
+  // Find the file containing position_
+  SFXC_ASSERT(position_ < reader_.total_size_);
+  size_t file_nr = file_nr_;
+  if ((fd_ < 0) || (position_ < files[file_nr].start))
+    file_nr = 0;
+  while ((file_nr < files.size()) &&
+         (position_ >= files[file_nr].start + files[file_nr].size))
+    file_nr++;
+  SFXC_ASSERT(file_nr < files.size());
+  if (!open_file(file_nr)) {
+    block->error = true;
+    return;
+  }
+
+  const Input_file &file = files[file_nr];
+  uint64_t offset = position_ - file.start;
+  uint64_t aligned_offset = offset & ~((uint64_t)ASYNC_FILE_ALIGNMENT - 1);
+  size_t to_read = std::min((uint64_t)ASYNC_FILE_BLOCK_SIZE,
+                            file.size - aligned_offset);
+  to_read = (to_read + ASYNC_FILE_ALIGNMENT - 1) & ~(ASYNC_FILE_ALIGNMENT - 1);
+  to_read = std::min(to_read, (size_t)ASYNC_FILE_BLOCK_SIZE);
+
+  // A short read ends the block, continuing in the same block would
+  // read to an unaligned buffer and offset. The next block starts at
+  // the preceding aligned offset again.
+  ssize_t result;
+  do {
+    result = ::pread(fd_, block->data, to_read, aligned_offset);
+  } while ((result < 0) && (errno == EINTR));
+  if (result < 0) {
+    LOG_MSG_ERR("Error reading " << file.filename << ": " << strerror(errno));
+    block->error = true;
+    return;
+  }
+  size_t done = result;
+  block->begin = offset - aligned_offset;
+  block->end = std::min((uint64_t)done, file.size - aligned_offset);
+  if (block->end <= block->begin) {
+    LOG_MSG_ERR("Unexpected end of file " << file.filename);
+    block->error = true;
+    return;
+  }
+  bytes_read_ += done;
+
+  uint64_t file_left = file.size - (aligned_offset + block->end);
+  if (file_left == 0) {
+    file_timer_.stop();
+    double mb = toMB(file.size);
+    double time = file_timer_.measured_time();
+    LOG_MSG("Finished reading " << file.filename << ", " << mb << " MB at "
+            << (time > 0 ? mb / time : 0) << " MB/s");
+  } else if (file_left < 2 * ASYNC_FILE_BLOCK_SIZE) {
+    prefetch_file(file_nr + 1);
+  }
+}
+
+bool
+Data_reader_async_file::Read_ahead_thread::open_file(size_t file_nr) {
+  if ((fd_ >= 0) && (file_nr == file_nr_))
+    return true;
+
+  if (fd_ >= 0)
+    ::close(fd_);
+  if ((next_fd_ >= 0) && (file_nr == next_file_nr_)) {
+    fd_ = next_fd_;
+    next_fd_ = -1;
+  } else {
+    fd_ = open_fd(reader_.files_[file_nr].filename);
+  }
+  file_nr_ = file_nr;
+  file_timer_.restart();
+  return (fd_ >= 0);
+}
+
+void
+Data_reader_async_file::Read_ahead_thread::prefetch_file(size_t file_nr) {
+  if ((file_nr >= reader_.files_.size()) ||
+      ((next_fd_ >= 0) && (next_file_nr_ == file_nr)))
+    return;
+
+  if (next_fd_ >= 0)
+    ::close(next_fd_);
+  next_fd_ = open_fd(reader_.files_[file_nr].filename);
+  next_file_nr_ = file_nr;
+}
+
+int
+Data_reader_async_file::Read_ahead_thread::open_fd(const std::string &filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+  if ((fd < 0) && (errno == EINVAL)) {
+    // File system does not support O_DIRECT, use the page cache. Advice
+    // on the page cache is only useful here, O_DIRECT reads bypass it.
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd >= 0)
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  if (fd < 0) {
+    LOG_MSG_ERR("Cannot open " << filename << ": " << strerror(errno));
+    return -1;
+  }
+  return fd;
+}
+
+void
+Data_reader_async_file::Read_ahead_thread::close_files() {
+  if (fd_ >= 0)
+    ::close(fd_);
+  if (next_fd_ >= 0)
+    ::close(next_fd_);
+  fd_ = next_fd_ = -1;
+}
@@ -13,13 +13,19 @@
 
 #include "data_reader_factory.h"
 #include "data_reader_file.h"
+#include "data_reader_async_file.h"
 #include "data_reader_mk5.h"
+#include "data_reader_udp.h"
 
 Data_reader* Data_reader_factory::get_reader(const std::vector<std::string>& sources) {
   if (sources[0].find("file://") == 0)
     return new Data_reader_file(sources);
+  if (sources[0].find("afile://") == 0)
+    return new Data_reader_async_file(sources);
   if (sources[0].find("mk5://") == 0)
     return new Data_reader_mk5(sources[0]);
+  if (sources[0].find("udp://") == 0)
+    return new Data_reader_udp(sources[0]);
 
   MTHROW("No data reader to handle :" + sources[0]);
 }
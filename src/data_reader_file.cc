@@ -9,6 +9,8 @@
 
 #include "data_reader_file.h"
 #include "utils.h"
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string>
 #include <iostream>
 
@@ -28,29 +30,86 @@ Data_reader_file::init(const std::vector<std::string> &sources)
 {
   for (int i = 0; i < sources.size(); i++) {
     SFXC_ASSERT(sources[i].compare(0, 7, "file://") == 0);
-    filenames.push(sources[i].substr(7));
+    filenames.push_back(sources[i].substr(7));
   }
-  if(!open_next_file()){
+  load_index();
+  file_start = file_size = 0;
+  if(!open_file(0) && !open_next_file()){
     sfxc_abort("Could not open any input files");
   }
   is_seekable_ = true;
 }
 
+void
+Data_reader_file::load_index(){
+  uint64_t start = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    struct stat sb;
+    if (::stat(filenames[i].c_str(), &sb) != 0)
+      continue;
+    std::string index_file = filenames[i] + DATA_INDEX_EXTENSION;
+    if (index.load(index_file, start, sb.st_size))
+      LOG_MSG("Using time index " << index_file);
+    start += sb.st_size;
+  }
+}
+
+bool
+Data_reader_file::open_file(size_t file_nr){
+  if (file.is_open())
+    file.close();
+  file.clear();
+  current_file = file_nr;
+  file_size = 0;
+
+  file.open(filenames[file_nr].c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << RANK_OF_NODE << " : Warning : Cannot open " <<  filenames[file_nr] << "\n";
+    return false;
+  }
+  file.seekg(0, std::ios::end);
+  file_size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  return true;
+}
+
 bool
 Data_reader_file::open_next_file(){
-  bool opened_file = false;
+  while (current_file + 1 < filenames.size()) {
+    file_start += file_size;
+    if (open_file(current_file + 1))
+      return true;
+  }
   if (file.is_open())
     file.close();
+  return false;
+}
+
+bool
+Data_reader_file::do_seek(uint64_t position){
+  const size_t old_file = current_file;
+  const uint64_t old_file_start = file_start;
+  const uint64_t old_offset = (file.good() ? (uint64_t)file.tellg() : file_size);
+
+  bool found = true;
+  if ((position < file_start) || !file.is_open()) {
+    // Start searching from the first file
+    file_start = file_size = 0;
+    found = open_file(0) || open_next_file();
+  }
+  while (found && (position >= file_start + file_size))
+    found = open_next_file();
 
-  while ((!opened_file) && (filenames.size() > 0)) {
-    file.open(filenames.front().c_str(), std::ios::in | std::ios::binary);
-    if (file.is_open()) 
-      opened_file = true;
-    else
-      std::cerr << RANK_OF_NODE << " : Warning : Cannot open " <<  filenames.front() << "\n";
-    filenames.pop();
+  if (!found) {
+    // Position is beyond the end of the data, restore the old position
+    file_start = old_file_start;
+    if (open_file(old_file))
+      file.seekg(old_offset, std::ios::beg);
+    return false;
   }
-  return opened_file;
+  file.clear();
+  file.seekg(position - file_start, std::ios::beg);
+  return file.good();
 }
 
 Data_reader_file::~Data_reader_file() {
@@ -84,6 +143,10 @@ bool Data_reader_file::eof() {
   return file.eof() || !file.good();
 }
 
+const Data_index *Data_reader_file::get_index() {
+  return (index.empty() ? NULL : &index);
+}
+
 bool Data_reader_file::can_read() {
   DEBUG_MSG("Data_reader_file: can read not implemented");
   return true;
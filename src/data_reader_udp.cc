@@ -8,301 +8,282 @@
  *  This file contains:
  *     - the definition of the Data_reader_udp object.
  */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <poll.h>
-#include "data_reader_udp.h"
-#include "memory_pool.h"
-
-void Data_reader_udp::Reading_thread::add_packet(int i, pool_element p)
-{
-    //std::cout << "Adding: " << i << " value:" << p.data().get_counter() << std::endl;
-
-    //value +=base_;
-    if ( i < packet_base_ )
-    {
-        packet_dropped_++;
-        //std::cout << "Packet dropped: " << i << std::endl;
-        return;
-    }
-
-		static int largest=0;
-		if(i>largest){
-				largest=i;
-		}else{
-				std::cout << "incoming packet: " << i << std::endl;
-				packet_outoforder_++;
-		}
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
 
-    //std::cout << "\n";
-    unsigned int ii = i-packet_base_;
-
-    if ( ii < size_ )
-    {
-        //std::cout << "setting value: " << ii << "("<< ii%size_ << ") value:" << value << std::endl;
-        //printf("Received: %p\n", p);
-        if ( ringbuffer_[i] != NULL )
-        {
-            packet_duplicated_++;
-            //std::cout << "Duplicate ?: " << ringbuffer_[i]->get_counter() << std::endl;
-        }
-        else
-        {
-				    ringbuffer_[i]= p;
-        }
-    }
-    else
-    {
-        int zero=0;
-        unsigned int nb = i - size_;
-        //value -=base_;
-        //if ( packet_base_ % 1000 == 0)
-        //std::cout << "SUCETTE:" << packet_base_ << ":" <<nb << " lost packet: " << packet_lost_  << " vs " << packet_received_  << " so: " << packet_received_*100.0/( packet_received_+packet_lost_) << std::endl;
-
-        for (packet_base_;packet_base_<=nb;packet_base_++)
-        {
-            if ( ringbuffer_[packet_base_] != NULL )
-            {
-                //std::cout << "packet emited: " << base_ << std::endl;
-                //std::cout << "packet emited: " << packet_base_ << " real cpt:" << ringbuffer_[packet_base_]->get_counter()  << "omg: " << nb << std::endl;
-                parent_queue_.push( ringbuffer_[packet_base_] );
-
-                ringbuffer_[packet_base_] = NULL;
-                packet_received_++;
-            }
-            else
-            {
-                parent_queue_.push( NULL );
-                packet_lost_++;
-                //std::cout << "packet emited: " << packet_base_  << "(BUT LOST)" << std::endl;
-            }
-            //packet_base_++;
-        }
-        //value += base_;
-				//std::cout << "incoming packet_b: " << i << std::endl;
-        ringbuffer_[i] = p;
+#include "data_reader_udp.h"
+#include "raiimutex.h"
+#include "utils.h"
 
-    }
+Data_reader_udp::Data_reader_udp(int socket, size_t ring_size) :
+  socket_(socket), own_socket_(false), ring_size_(ring_size),
+  reading_thread_(*this) {
+  init();
 }
 
-
-
-Data_reader_udp::Data_reader_udp(int socket) :
-        psize_(1400), size_(1000),
-        pool_(size_+1, NO_RESIZE, Packet_fixed_size::PAllocator::create(psize_) ),
-        reading_thread_(pool_, queue_, psize_, size_, socket)
-{
-    socket_=socket;
-    isfirst = true;
-    reading_thread_.start();
-    old_current_idx_=0;
+Data_reader_udp::Data_reader_udp(const std::string &source, size_t ring_size) :
+  socket_(-1), own_socket_(true), ring_size_(ring_size),
+  reading_thread_(*this) {
+  SFXC_ASSERT(source.compare(0, 6, "udp://") == 0);
+  std::string address = source.substr(6);
+  std::string port = address;
+  size_t colon = address.rfind(':');
+  if (colon != std::string::npos) {
+    port = address.substr(colon + 1);
+    address = address.substr(0, colon);
+  } else {
+    address = "";
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(port.c_str()));
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (!address.empty() && (inet_aton(address.c_str(), &addr.sin_addr) == 0))
+    sfxc_abort(("Invalid address in " + source).c_str());
+
+  socket_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+  int reuse = 1;
+  if ((socket_ < 0) ||
+      (setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0) ||
+      (bind(socket_, (struct sockaddr *)&addr, sizeof(addr)) != 0)) {
+    LOG_MSG_ERR("Cannot open " << source << ": " << strerror(errno));
+    sfxc_abort("Could not open UDP socket");
+  }
+  init();
 }
 
-Data_reader_udp::~Data_reader_udp()
-{
-	wait( reading_thread_ );
+void
+Data_reader_udp::init() {
+  payload_size_ = nr_slots_ = 0;
+  read_seq_ = max_seq_ = 0;
+  first_packet_ = true;
+  error_ = false;
+  memset(&stats_, 0, sizeof(stats_));
+  read_offset_ = 0;
+  last_log_ = time(NULL);
+
+  // Use a large receive buffer to survive short stalls of the reading
+  // thread, SO_RCVBUFFORCE ignores the system limit but needs privileges
+  int size = UDP_RCVBUF_SIZE;
+  if (setsockopt(socket_, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  socklen_t len = sizeof(size);
+  if (getsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &size, &len) == 0) {
+    LOG_MSG("UDP receive buffer is " << toMB(size) << " MB");
+    if (size < UDP_RCVBUF_SIZE)
+      LOG_MSG("Warning: increase net.core.rmem_max to get a receive buffer of "
+              << toMB(UDP_RCVBUF_SIZE) << " MB");
+  }
+
+  // Wake up regularly to check whether the reader is stopped
+  struct timeval timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 100000;
+  setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  reading_thread_.start();
 }
 
-bool Data_reader_udp::eof()
-{
-    return false;
+Data_reader_udp::~Data_reader_udp() {
+  reading_thread_.stop();
+  wait(reading_thread_);
+  log_statistics();
+  if (own_socket_)
+    close(socket_);
 }
 
-
-
-bool Data_reader_udp::can_read()
-{
-    //     int fd;           /* file descriptor */
-    //     short events;     /* requested events */
-    //     short revents;    /* returned events */
-    //   };
-
-    pollfd fds[1];
-    fds[0].fd = socket_;
-    fds[0].events = POLLIN;
-
-    int ret = poll(fds, 1, /*timeout in miliseconds*/ 0);
-    if (ret > 0)
-    {
-        return ((fds[0].revents & POLLIN) != 0);
-    }
-
-    return false;
+bool Data_reader_udp::eof() {
+  RAIIMutex lock(read_cond_);
+  return error_;
 }
 
-void Data_reader_udp::Reading_thread::do_execute()
-{
-		int sbuf = 1024*1024;
-		int  dbuf = 0;
-		socklen_t olen = sizeof(sbuf);
-		//CHECK_ZERO( setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &sbuf, olen) );
-		//CHECK_ZERO( getsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &dbuf, &olen) );
-		std::cout << "Sending buffer will be: " <<  (1.0*dbuf)/(1024*1024) << "MB" <<std::endl;
-
-		pool_element el=parent_pool_.allocate();
-		recvmsg(socket_, &(el->get_message()), 0 );
-
-		packet_base_ = el->get_counter();
-		prev_packet_ = el->get_counter();
-
-		std::cout << "PACKET_BASE: " << packet_base_ << std::endl;
-		add_packet( el->get_counter(), el );
-
-		while(isrunning_)
-		{
-			//if( parent_pool_.empty()){
-			//		std::cout << "The memory_pool is not big enough !" << std::endl;
-			//}
-			pool_element el=parent_pool_.allocate();
-			recvmsg(socket_, &(el->get_message()), 0 );
-			add_packet( el->get_counter(), el );
-		}
+bool Data_reader_udp::can_read() {
+  RAIIMutex lock(read_cond_);
+  return !first_packet_ && packet_ready();
 }
 
-size_t Data_reader_udp::do_get_bytes(size_t readb, char *buffer)
-{
-		static int old_p;
-		static int prev_pack=-1;
+bool
+Data_reader_udp::packet_ready() {
+  // The packet is received, or so many later packets are received that
+  // it is considered lost
+  return present_[read_seq_ % nr_slots_] ||
+         (max_seq_ >= read_seq_ + UDP_REORDER_WINDOW);
+}
 
-    if ( reading_thread_.packet_base_-old_p > 1000)
+size_t
+Data_reader_udp::do_get_bytes(size_t nbytes, char *buffer) {
+  size_t done = 0;
+  while (done < nbytes) {
+    bool present;
     {
-				old_p = reading_thread_.packet_base_;
-        std::cout << "Reading info:  " << std::endl;
-        std::cout << " packet received:"<< reading_thread_.packet_received_ ;
-        std::cout << " packet lost: "<< reading_thread_.packet_lost_ << std::endl;
-				std::cout << " packet ooo:"<< reading_thread_.packet_outoforder_ ;
-        std::cout << " packet duplicated: "<< reading_thread_.packet_duplicated_;
-        double total = (reading_thread_.packet_received_+reading_thread_.packet_lost_);
-        double percentage= (100.0*reading_thread_.packet_lost_)/total;
-        std::cout << " ( " << percentage <<  "%)" << std::endl;
+      RAIIMutex lock(read_cond_);
+      if (error_ || first_packet_ || !packet_ready()) {
+        if (error_ || (done > 0))
+          break;
+        // Wait for data, the reading thread signals at least every 100 ms
+        read_cond_.wait();
+        if (error_ || first_packet_ || !packet_ready())
+          break;
+      }
+      present = present_[read_seq_ % nr_slots_];
     }
 
-
-    if (buffer == NULL)
-    {
-        size_t buff_size = 1000000;
-        readb = (readb < buff_size ? readb : buff_size);
-        char buff[(int)readb];
-        //int ret = datareader_->get_bytes(readb, buff);
-        return readb;
+    // The reading thread doesn't write to the slot of read_seq_ while it is
+    // present, so it can be copied without holding the lock
+    size_t n = std::min(nbytes - done, payload_size_ - read_offset_);
+    if (buffer != NULL) {
+      if (present) {
+        memcpy(buffer + done,
+               &ring_[(read_seq_ % nr_slots_) * payload_size_ + read_offset_], n);
+      } else {
+        const uint32_t fill = MARK5_FILLPATTERN;
+        for (size_t i = 0; i < n; i++)
+          buffer[done + i] = ((const char *)&fill)[(read_offset_ + i) % 4];
+      }
     }
-
-		//std::cout << " COINCOIN! "<< queue_.size() << std::endl;
-		if( queue_.empty() ) return 0;
-
-    uint64_t current_idx=0;
-		//std::cout << " Let's go ! " << " total size to read: " <<  readb << " previous p: " << old_current_idx_  << std::endl;
-
-    // We first have to check if there is some datas that remains from
-    // the previous call to this function.
-    if ( old_current_idx_ != 0 )
-    {
-        //std::cout << " SECTION 1! "<< queue_.size() << " old_current_idx " << old_current_idx_ << std::endl;
-
-        // If this is the case we copy the "saved amount of byte
-        // to the new given buffer.
-        uint64_t s=MIN( (old_current_idx_), readb );
-				//std::cout << " SECTION 1! "<< queue_.size() << " soo read: " << s << std::endl;
-
-        // retreive from the waiting queue.
-        pool_element element=queue_.front();
-
-        if ( element != NULL )
-        {
-						assert( element->get_counter() == reading_thread_.prev_packet_ );
-
-            // we can copy to the buffer the available byte in this
-            // packet.
-            memcpy( buffer, element->buffer(), s );
-
-            // increase the amount of byte_read;
-            current_idx += s;
-
-            // decrease the amount of remaining bytes
-            old_current_idx_ -= s;
-
-            // if all the byte in this packed have been processed
-            // we can remove this paquet from the queue.
-            if ( old_current_idx_==0 )
-            {
-                queue_.pop();
-                pool_.release( element );
-								reading_thread_.prev_packet_++;
-            }
-        }
-        else
-        {
-            // increase the amount of byte_read;
-            current_idx += s;
-
-            // decrease the amount of remaining bytes
-            old_current_idx_ -= s;
-
-						memset( buffer, 0, s);
-
-            // if all the byte in this packed have been processed
-            // we can remove this paquet from the queue.
-            if ( old_current_idx_ )
-            {
-                queue_.pop();
- 								reading_thread_.prev_packet_++;
-            }
-        }
-
+    done += n;
+    read_offset_ += n;
+
+    if (read_offset_ == payload_size_) {
+      RAIIMutex lock(read_cond_);
+      // A lost packet may have arrived while the fill pattern was copied
+      present_[read_seq_ % nr_slots_] = false;
+      if (!present)
+        stats_.lost++;
+      read_seq_++;
+      read_offset_ = 0;
     }
+  }
 
+  if (time(NULL) >= last_log_ + UDP_LOG_INTERVAL)
+    log_statistics();
+  return done;
+}
 
-    // we loop as long as we have not received a complete packet
-    // and as long as we have something to read.
-		//std::cout << " BON ET ALORS:"  << readb << "-current_idx["<< current_idx << "] psize[" << psize_ << "]" << std::endl;
-
-    int iter = (readb-current_idx)/psize_;
-    iter = MIN(iter, queue_.size());
-
-    for (int i=0;i<iter;i++)
-    {
-        //std::cout << " SECTION 2! "<< queue_.size() << " iter:" << iter << std::endl;
-
-        // retreive from the waiting queue.
-        pool_element element=queue_.front();
-
-        if ( element != NULL )
-        {
-						assert(reading_thread_.prev_packet_ == element->get_counter() );
-
-            // we copy the complete packet to the destination buffer
-            // this copy is a pity but I have no idea how to remove it
-            // without screwing the design of the data_reader.
-            memcpy( &(buffer[current_idx]), element->buffer(), psize_ );
-
-            pool_.release( element );
-        }
-        else
-        {
-            //std::cout << "SHOULD randomize the data" << std::endl;
-						memset( &(buffer[current_idx]), 0, psize_);
-        }
+void
+Data_reader_udp::log_statistics() {
+  Statistics stats;
+  size_t payload_size;
+  {
+    RAIIMutex lock(read_cond_);
+    stats = stats_;
+    payload_size = payload_size_;
+  }
+  last_log_ = time(NULL);
+  if (payload_size == 0)
+    return;
+
+  uint64_t total = stats.received + stats.lost;
+  LOG_MSG("UDP packets of " << payload_size << " bytes: received " << stats.received
+          << ", lost " << stats.lost << " ("
+          << (total > 0 ? (100. * stats.lost) / total : 0.) << "%)"
+          << ", duplicated " << stats.duplicated
+          << ", reordered " << stats.reordered
+          << ", late " << stats.late
+          << ", ring overflow " << stats.overflow
+          << ", wrong size " << stats.bad_size);
+}
 
-        // advance the pointer by the size of the packet.
-        current_idx += psize_;
-        queue_.pop();
-				reading_thread_.prev_packet_++;
+Data_reader_udp::Reading_thread::Reading_thread(Data_reader_udp &reader)
+  : reader_(reader) {}
+
+void
+Data_reader_udp::Reading_thread::do_execute() {
+  std::vector<char> buffer(UDP_BATCH_SIZE * UDP_MAX_PACKET_SIZE);
+  struct mmsghdr msgs[UDP_BATCH_SIZE];
+  struct iovec iovecs[UDP_BATCH_SIZE];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+    iovecs[i].iov_base = &buffer[i * UDP_MAX_PACKET_SIZE];
+    iovecs[i].iov_len = UDP_MAX_PACKET_SIZE;
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (isrunning_) {
+    int n = recvmmsg(reader_.socket_, msgs, UDP_BATCH_SIZE, MSG_WAITFORONE, NULL);
+    if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      LOG_MSG_ERR("Error receiving UDP packets: " << strerror(errno));
+      RAIIMutex lock(reader_.read_cond_);
+      reader_.error_ = true;
+      reader_.read_cond_.signal();
+      break;
     }
 
-    //std::cout << " ENFIN: "<< queue_.size() << " remaining: "<< current_idx << " vs " << readb << std::endl;
-
-    // some bytes remains in the packet that cannot be stored
-    // in the user provided buffer. These are saved
-    if ( current_idx < psize_ )
-    {
-				//std::cout << " mais c'est des chaussures: " << readb << std::endl;
-
-        old_current_idx_ = psize_-current_idx;
-    }
-    else
-    {
-        // reseting the "memory" to indcate half-processed
-        // packet.
-        old_current_idx_ = 0;
+    RAIIMutex lock(reader_.read_cond_);
+    for (int i = 0; i < n; i++) {
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+        reader_.stats_.bad_size++;
+      else
+        add_packet(&buffer[i * UDP_MAX_PACKET_SIZE], msgs[i].msg_len);
     }
+    reader_.read_cond_.signal();
+  }
+}
 
-    return current_idx;
+void
+Data_reader_udp::Reading_thread::add_packet(const char *packet, size_t size) {
+  Data_reader_udp &r = reader_;
+  if (size <= sizeof(uint32_t)) {
+    r.stats_.bad_size++;
+    return;
+  }
+  uint32_t counter;
+  memcpy(&counter, packet, sizeof(counter));
+  counter = ntohl(counter);
+  size_t payload_size = size - sizeof(uint32_t);
+
+  if (r.first_packet_) {
+    r.payload_size_ = payload_size;
+    r.nr_slots_ = std::max(r.ring_size_ / payload_size, (size_t)2 * UDP_REORDER_WINDOW);
+    r.ring_.resize(r.nr_slots_ * payload_size);
+    r.present_.assign(r.nr_slots_, false);
+    r.read_seq_ = r.max_seq_ = counter;
+    r.first_packet_ = false;
+    LOG_MSG("Receiving UDP packets of " << payload_size << " bytes, reordering ring of "
+            << r.nr_slots_ << " packets");
+  }
+  if (payload_size != r.payload_size_) {
+    r.stats_.bad_size++;
+    return;
+  }
+
+  // Extend the 32 bit packet counter to 64 bits
+  int32_t delta = (int32_t)(counter - (uint32_t)r.max_seq_);
+  if ((delta < 0) && ((uint64_t)-(int64_t)delta > r.max_seq_)) {
+    r.stats_.late++;
+    return;
+  }
+  uint64_t seq = r.max_seq_ + delta;
+
+  if (seq < r.read_seq_) {
+    // Arrived after the packet was replaced by fill pattern
+    r.stats_.late++;
+    return;
+  }
+  if (seq >= r.read_seq_ + r.nr_slots_) {
+    // The reader can't keep up with the data
+    r.stats_.overflow++;
+    return;
+  }
+  size_t slot = seq % r.nr_slots_;
+  if (r.present_[slot]) {
+    r.stats_.duplicated++;
+    return;
+  }
+  if (seq < r.max_seq_)
+    r.stats_.reordered++;
+  memcpy(&r.ring_[slot * payload_size], packet + sizeof(uint32_t), payload_size);
+  r.present_[slot] = true;
+  r.stats_.received++;
+  r.max_seq_ = std::max(r.max_seq_, seq + 1);
 }
@@ -12,7 +12,9 @@
 
 #include <netinet/in.h>
 
-Data_writer::Data_writer() : _data_counter(0), data_slice(-1), active(false) {}
+Data_writer::Data_writer()
+  : _data_counter(0), data_slice(-1), active(false),
+    bytes_out_("bytes_out", Telemetry::unique_name("writer")) {}
 
 Data_writer::~Data_writer() {}
 
@@ -21,6 +23,7 @@ Data_writer::put_bytes(size_t nBytes, const char *buff) {
   //SFXC_ASSERT((data_slice==-1) || (nBytes <= (size_t)data_slice));
   size_t result = do_put_bytes(nBytes, buff);
   _data_counter += (int64_t)result;
+  bytes_out_.add(result);
   data_slice -= result;
   return result;
 }
@@ -0,0 +1,281 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the definition of the Data_writer_async_file object.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <cstdlib>
+
+#include "data_writer_async_file.h"
+#include "raiimutex.h"
+#include "utils.h"
+
+Data_writer_async_file::Data_writer_async_file(const char *filename,
+                                               int64_t size) :
+  Data_writer(), fd_direct_(-1), fd_(-1), write_error_(false),
+  stop_(false), writing_(false), current_block_(NULL), file_position_(0), block_start_(0),
+  max_queue_depth_(0), nr_waits_(0), writer_thread_(*this) {
+  SFXC_ASSERT(strncmp(filename, "file://", 7) == 0);
+  filename_ = filename + 7;
+  fd_ = ::open(filename_.c_str(),
+               (size < 0 ? O_WRONLY | O_CREAT | O_TRUNC : O_RDWR), 0644);
+  if (fd_ < 0) {
+    LOG_MSG_ERR("Cannot open " << filename_ << ": " << strerror(errno));
+    sfxc_abort("Could not open output file");
+  }
+  if (size >= 0) {
+    // Drop the data after the checkpoint, the first block rewrites the
+    // unaligned end of the file like after an early flush
+    struct stat sb;
+    if ((fstat(fd_, &sb) != 0) || (sb.st_size < size)) {
+      LOG_MSG_ERR(filename_ << " is shorter than its checkpoint of " << size << " bytes");
+      sfxc_abort("Could not resume the output file");
+    }
+    if (ftruncate(fd_, size) != 0) {
+      LOG_MSG_ERR("Cannot truncate " << filename_ << ": " << strerror(errno));
+      sfxc_abort("Could not resume the output file");
+    }
+    file_position_ = size;
+    tail_.resize(size % ASYNC_WRITE_ALIGNMENT);
+    if (!tail_.empty() &&
+        (pread(fd_, &tail_[0], tail_.size(), size - tail_.size()) != (ssize_t)tail_.size())) {
+      LOG_MSG_ERR("Cannot read " << filename_ << ": " << strerror(errno));
+      sfxc_abort("Could not resume the output file");
+    }
+  }
+  // Full blocks bypass the page cache, if the file system supports it
+  fd_direct_ = ::open(filename_.c_str(), O_WRONLY | O_DIRECT);
+
+  // The blocks are allocated when they are needed, because there can
+  // be many output files
+  buffers_.reserve(ASYNC_WRITE_NR_BLOCKS);
+  blocks_.reserve(ASYNC_WRITE_NR_BLOCKS);
+
+  last_log_ = time(NULL);
+  timer_.start();
+  writer_thread_.start();
+}
+
+Data_writer_async_file::~Data_writer_async_file() {
+  {
+    // Stop the writer thread after the last block
+    RAIIMutex lock(cond_);
+    flush_block();
+    stop_ = true;
+    cond_.broadcast();
+  }
+  wait(writer_thread_);
+  timer_.stop();
+  log_statistics();
+
+  if (fd_direct_ >= 0)
+    ::close(fd_direct_);
+  if (::close(fd_) != 0)
+    LOG_MSG_ERR("Error closing " << filename_ << ": " << strerror(errno));
+  for (size_t i = 0; i < buffers_.size(); i++)
+    free(buffers_[i]);
+}
+
+size_t
+Data_writer_async_file::do_put_bytes(size_t nBytes, const char *buff) {
+  {
+    RAIIMutex lock(cond_);
+    if (write_error_)
+      return 0;
+
+    size_t done = 0;
+    while (done < nBytes) {
+      if (current_block_ == NULL) {
+        Block *block = get_free_block();
+        // Start at an aligned offset, the tail of the previous block is
+        // written again
+        size_t tail = tail_.size();
+        block->position = file_position_ - tail;
+        SFXC_ASSERT(block->position % ASYNC_WRITE_ALIGNMENT == 0);
+        if (tail > 0)
+          memcpy(block->data, &tail_[0], tail);
+        block->size = tail;
+        tail_.clear();
+        current_block_ = block;
+        block_start_ = time(NULL);
+        // The writer thread flushes the block after the flush interval
+        cond_.broadcast();
+      }
+      size_t n = std::min(nBytes - done,
+                          (size_t)ASYNC_WRITE_BLOCK_SIZE - current_block_->size);
+      memcpy(current_block_->data + current_block_->size, buff + done, n);
+      current_block_->size += n;
+      file_position_ += n;
+      done += n;
+      if (current_block_->size == ASYNC_WRITE_BLOCK_SIZE)
+        flush_block();
+    }
+  }
+
+  if (time(NULL) >= last_log_ + ASYNC_WRITE_LOG_INTERVAL)
+    log_statistics();
+  return nBytes;
+}
+
+void
+Data_writer_async_file::flush_block() {
+  if (current_block_ == NULL)
+    return;
+  size_t tail = current_block_->size % ASYNC_WRITE_ALIGNMENT;
+  if (tail > 0) {
+    tail_.resize(tail);
+    memcpy(&tail_[0], current_block_->data + current_block_->size - tail, tail);
+  }
+  full_blocks_.push_back(current_block_);
+  current_block_ = NULL;
+  max_queue_depth_ = std::max(max_queue_depth_, full_blocks_.size());
+  cond_.broadcast();
+}
+
+Data_writer_async_file::Block *
+Data_writer_async_file::get_free_block() {
+  if (free_blocks_.empty() && (blocks_.size() < ASYNC_WRITE_NR_BLOCKS)) {
+    void *buffer;
+    if (posix_memalign(&buffer, ASYNC_WRITE_ALIGNMENT, ASYNC_WRITE_BLOCK_SIZE) != 0)
+      sfxc_abort("Could not allocate the output buffers");
+    buffers_.push_back((char *)buffer);
+    Block block;
+    block.data = buffers_.back();
+    blocks_.push_back(block);
+    return &blocks_.back();
+  }
+  if (free_blocks_.empty())
+    nr_waits_++;
+  while (free_blocks_.empty())
+    cond_.wait();
+  Block *block = free_blocks_.front();
+  free_blocks_.pop_front();
+  return block;
+}
+
+void
+Data_writer_async_file::log_statistics() {
+  size_t queue_depth;
+  uint64_t bytes_written;
+  {
+    RAIIMutex lock(cond_);
+    queue_depth = full_blocks_.size();
+    bytes_written = writer_thread_.bytes_written();
+  }
+  last_log_ = time(NULL);
+  double mb = toMB(bytes_written);
+  double time = timer_.measured_time();
+  LOG_MSG("Wrote " << mb << " MB to " << filename_ << " in " << time << " s ("
+          << (time > 0 ? mb / time : 0) << " MB/s), queue depth "
+          << queue_depth << " (max " << max_queue_depth_ << " of "
+          << ASYNC_WRITE_NR_BLOCKS << " blocks), waited for the disk "
+          << nr_waits_ << " times");
+}
+
+bool
+Data_writer_async_file::can_write() {
+  RAIIMutex lock(cond_);
+  return !write_error_;
+}
+
+bool
+Data_writer_async_file::sync() {
+  {
+    RAIIMutex lock(cond_);
+    flush_block();
+    while (!full_blocks_.empty() || writing_)
+      cond_.wait();
+    if (write_error_)
+      return false;
+  }
+  if (fdatasync(fd_) != 0) {
+    LOG_MSG_ERR("Cannot sync " << filename_ << ": " << strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+Data_writer_async_file::Writer_thread::
+Writer_thread(Data_writer_async_file &writer)
+  : writer_(writer), bytes_written_(0) {}
+
+void
+Data_writer_async_file::Writer_thread::do_execute() {
+  RAIIMutex lock(writer_.cond_);
+  for (;;) {
+    if (writer_.full_blocks_.empty()) {
+      if (writer_.stop_)
+        break;
+      if (writer_.current_block_ == NULL) {
+        writer_.cond_.wait();
+        continue;
+      }
+      // Write a partially filled block when it is ASYNC_WRITE_FLUSH_INTERVAL
+      // seconds old, also if no more data arrives
+      struct timespec flush_time;
+      flush_time.tv_sec = writer_.block_start_ + ASYNC_WRITE_FLUSH_INTERVAL;
+      flush_time.tv_nsec = 0;
+      if (!writer_.cond_.timed_wait(flush_time) &&
+          (writer_.current_block_ != NULL) &&
+          (time(NULL) >= writer_.block_start_ + ASYNC_WRITE_FLUSH_INTERVAL))
+        writer_.flush_block();
+      continue;
+    }
+
+    Block *block = writer_.full_blocks_.front();
+    writer_.full_blocks_.pop_front();
+    // The disk is written without the lock, so that put_bytes can fill
+    // the next block
+    bool write = !writer_.write_error_;
+    writer_.writing_ = true;
+    writer_.cond_.unlock();
+    bool ok = write && write_block(block);
+    writer_.cond_.lock();
+    writer_.writing_ = false;
+    if (ok)
+      bytes_written_ += block->size;
+    else if (write)
+      writer_.write_error_ = true;
+    writer_.free_blocks_.push_back(block);
+    writer_.cond_.broadcast();
+  }
+}
+
+bool
+Data_writer_async_file::Writer_thread::write_block(Block *block) {
+  size_t done = 0;
+  while (done < block->size) {
+    // O_DIRECT needs aligned sizes, the last part of a block that is
+    // flushed early goes through the page cache
+    size_t left = block->size - done;
+    size_t aligned = left & ~((size_t)ASYNC_WRITE_ALIGNMENT - 1);
+    bool direct = (writer_.fd_direct_ >= 0) && (aligned > 0);
+    ssize_t result = ::pwrite(direct ? writer_.fd_direct_ : writer_.fd_,
+                              block->data + done, direct ? aligned : left,
+                              block->position + done);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      if (direct && (errno == EINVAL)) {
+        // The file system does not support O_DIRECT writes
+        ::close(writer_.fd_direct_);
+        writer_.fd_direct_ = -1;
+        continue;
+      }
+      LOG_MSG_ERR("Error writing " << writer_.filename_ << ": " << strerror(errno));
+      return false;
+    }
+    done += result;
+  }
+  return true;
+}
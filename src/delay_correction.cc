@@ -5,8 +5,11 @@
 Delay_correction::Delay_correction(int stream_nr_)
     : output_buffer(Output_buffer_ptr(new Output_buffer())),
       output_memory_pool(32),current_time(-1),
-      stream_nr(stream_nr_), stream_idx(-1)
+      stream_nr(stream_nr_), stream_idx(-1),
+      ffts_("ffts", "delay_correction" + itoa(stream_nr_))
 {
+  output_buffer->set_name("delay_correction" + itoa(stream_nr));
+  output_memory_pool.set_name("delay_correction" + itoa(stream_nr));
 }
 
 Delay_correction::~Delay_correction() {
@@ -23,6 +26,7 @@ void Delay_correction::do_task() {
   Input_buffer_element input = input_buffer->front_and_pop();
   int nbuffer=input->nfft;
   current_fft+=nbuffer;
+  ffts_.add(nbuffer);
   // Allocate output buffer
   int output_stride =  fft_cor_size()/2 + 4; // there are fft_size+1 points and each fft should be 16 bytes alligned
   Output_buffer_element cur_output = output_memory_pool.allocate();
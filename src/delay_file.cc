@@ -0,0 +1,238 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - the implementation of Delay_file
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "delay_file.h"
+#include "utils.h"
+
+// Size of the source name and mjd at the start of a scan
+#define DELAY_SCAN_HEADER_SIZE   (81 * sizeof(char) + sizeof(int32_t))
+#define DELAY_RECORD_SIZE        (Delay_file::NR_FIELDS * sizeof(double))
+
+std::map<std::string, Delay_file *> Delay_file::files_;
+
+// Copies the source name at the start of a scan, without trailing spaces
+static void
+read_source(const char *scan_header, char *source) {
+  memcpy(source, scan_header, 81);
+  source[80] = 0;
+  for (int i = 79; i >= 0; i--) {
+    if (source[i] != ' ') {
+      source[i + 1] = 0;
+      break;
+    }
+  }
+}
+
+const Delay_file &
+Delay_file::get(const std::string &filename) {
+  struct stat sb;
+  if (stat(filename.c_str(), &sb) != 0)
+    sfxc_abort((std::string("Could not open delay table ") + filename).c_str());
+
+  std::map<std::string, Delay_file *>::iterator it = files_.find(filename);
+  if (it != files_.end()) {
+    if ((it->second->map_size_ == (size_t)sb.st_size) &&
+        (it->second->mtime_ == sb.st_mtime) &&
+        (it->second->mtime_nsec_ == sb.st_mtim.tv_nsec))
+      return *it->second;
+    // The delay file was generated again
+    delete it->second;
+    files_.erase(it);
+  }
+
+  Delay_file *file = new Delay_file();
+  if (!file->open(filename)) {
+    delete file;
+    sfxc_abort((std::string("Could not open delay table ") + filename).c_str());
+  }
+  files_[filename] = file;
+  return *file;
+}
+
+Delay_file::Delay_file()
+  : map_(NULL), map_size_(0), mtime_(0), mtime_nsec_(0) {}
+
+Delay_file::~Delay_file() {
+  if (map_ != NULL)
+    munmap((void *)map_, map_size_);
+}
+
+bool
+Delay_file::open(const std::string &filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat sb;
+  if (fstat(fd, &sb) != 0) {
+    ::close(fd);
+    return false;
+  }
+  map_size_ = sb.st_size;
+  mtime_ = sb.st_mtime;
+  mtime_nsec_ = sb.st_mtim.tv_nsec;
+  if (map_size_ > 0) {
+    void *map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+    map_ = (const char *)map;
+  }
+  ::close(fd);
+
+  std::string index_file = filename + DELAY_INDEX_EXTENSION;
+  if (!read_index(index_file)) {
+    create_index();
+    write_index(index_file);
+  }
+  return true;
+}
+
+bool
+Delay_file::read_index(const std::string &filename) {
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (file == NULL)
+    return false;
+  struct stat sb;
+  Index_header header;
+  bool ok = ((fstat(fileno(file), &sb) == 0) &&
+             (fread(&header, sizeof(header), 1, file) == 1) &&
+             (memcmp(header.magic, DELAY_INDEX_MAGIC, sizeof(header.magic)) == 0) &&
+             (header.version == DELAY_INDEX_VERSION) &&
+             (header.file_size == map_size_) &&
+             (header.file_mtime == mtime_) &&
+             (header.file_mtime_nsec == mtime_nsec_) &&
+             (header.nr_scans >= 0) &&
+             ((uint64_t)sb.st_size ==
+              sizeof(header) + (uint64_t)header.nr_scans * sizeof(Scan)));
+  if (ok) {
+    scans_.resize(header.nr_scans);
+    if (header.nr_scans > 0)
+      ok = (fread(&scans_[0], sizeof(Scan), header.nr_scans, file) ==
+            (size_t)header.nr_scans);
+  }
+  fclose(file);
+  // The delay file might have been generated again within the resolution
+  // of the modification time, check the scans against its contents
+  for (size_t i = 0; ok && (i < scans_.size()); i++) {
+    scans_[i].source[80] = 0;
+    ok = valid_scan(scans_[i]);
+  }
+  if (!ok)
+    scans_.clear();
+  return ok;
+}
+
+bool
+Delay_file::valid_scan(const Scan &scan) const {
+  if ((scan.nr_records < 0) || (scan.offset < DELAY_SCAN_HEADER_SIZE) ||
+      (scan.offset + (uint64_t)scan.nr_records * DELAY_RECORD_SIZE > map_size_))
+    return false;
+  // The source name and mjd precede the first record
+  const char *scan_header = map_ + scan.offset - DELAY_SCAN_HEADER_SIZE;
+  char source[81];
+  read_source(scan_header, source);
+  int32_t mjd;
+  memcpy(&mjd, scan_header + 81, sizeof(int32_t));
+  if ((mjd != scan.mjd) || (strcmp(source, scan.source) != 0))
+    return false;
+  // A record with time and delay 0 ends the scan, unless the file ends
+  uint64_t end = scan.offset + (uint64_t)scan.nr_records * DELAY_RECORD_SIZE;
+  if (end + DELAY_RECORD_SIZE <= map_size_) {
+    double line[NR_FIELDS];
+    memcpy(line, map_ + end, DELAY_RECORD_SIZE);
+    if ((line[TIME] != 0) || (line[DELAY] != 0))
+      return false;
+  }
+  return true;
+}
+
+void
+Delay_file::create_index() {
+  scans_.clear();
+  if (map_size_ < sizeof(int32_t))
+    return;
+  int32_t header_size;
+  memcpy(&header_size, map_, sizeof(int32_t));
+  size_t position = sizeof(int32_t) + header_size;
+
+  while (position + DELAY_SCAN_HEADER_SIZE + DELAY_RECORD_SIZE <= map_size_) {
+    Scan scan;
+    read_source(map_ + position, scan.source);
+    memcpy(&scan.mjd, map_ + position + 81, sizeof(int32_t));
+    scan.offset = position + DELAY_SCAN_HEADER_SIZE;
+    scan.nr_records = 0;
+
+    position = scan.offset;
+    while (position + DELAY_RECORD_SIZE <= map_size_) {
+      double line[NR_FIELDS];
+      memcpy(line, map_ + position, DELAY_RECORD_SIZE);
+      position += DELAY_RECORD_SIZE;
+      if ((line[TIME] == 0) && (line[DELAY] == 0))
+        break;
+      scan.nr_records++;
+    }
+    scans_.push_back(scan);
+  }
+}
+
+void
+Delay_file::write_index(const std::string &filename) {
+  // The index is only a cache, it is not an error if it can't be written
+  std::string tmp_file = filename + ".tmp";
+  FILE *file = fopen(tmp_file.c_str(), "wb");
+  if (file == NULL)
+    return;
+  Index_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DELAY_INDEX_MAGIC, sizeof(header.magic));
+  header.version = DELAY_INDEX_VERSION;
+  header.nr_scans = scans_.size();
+  header.file_size = map_size_;
+  header.file_mtime = mtime_;
+  header.file_mtime_nsec = mtime_nsec_;
+  bool ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+  if (ok && !scans_.empty())
+    ok = (fwrite(&scans_[0], sizeof(Scan), scans_.size(), file) == scans_.size());
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || (rename(tmp_file.c_str(), filename.c_str()) != 0))
+    unlink(tmp_file.c_str());
+}
+
+double
+Delay_file::value(const Scan &scan, int record, Field field) const {
+  SFXC_ASSERT((record >= 0) && (record < scan.nr_records));
+  // The records are not aligned in the file
+  double result;
+  memcpy(&result, map_ + scan.offset + record * DELAY_RECORD_SIZE +
+         field * sizeof(double), sizeof(double));
+  return result;
+}
+
+int
+Delay_file::find_record(const Scan &scan, const Time &t) const {
+  // The times in a scan are increasing
+  int begin = 0, end = scan.nr_records;
+  while (begin < end) {
+    int middle = (begin + end) / 2;
+    if (time(scan, middle) < t)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+  return begin;
+}
@@ -1,4 +1,6 @@
+#include <limits>
 #include "input_data_format_reader.h"
+#include "data_index.h"
 
 Input_data_format_reader::
 Input_data_format_reader(boost::shared_ptr<Data_reader> data_reader)
@@ -12,6 +14,93 @@ bool Input_data_format_reader::eof() {
   return data_reader_->eof();
 }
 
+bool
+Input_data_format_reader::seek_to_time(Data_frame &data, Time time,
+                                       size_t block_size, Time block_time) {
+  if (!is_open_ || !data_reader_->is_seekable() || (block_size == 0))
+    return false;
+
+  Time current_time = get_current_time();
+  if (time <= current_time + block_time)
+    return true;
+
+  const uint64_t none = std::numeric_limits<uint64_t>::max();
+  const uint64_t start_pos = data_reader_->position();
+  // lo_pos is the position just after the last block found before time,
+  // which was read from position lo_probe. hi is the first position known
+  // to be past time.
+  uint64_t lo_pos = start_pos, lo_probe = none, last_probe = none;
+  uint64_t hi = none;
+  Time lo_time = current_time;
+  bool found = false;
+
+  // The time index gives a position close before time and bounds the search
+  uint64_t index_pos = none, index_end = none;
+  const Data_index *index = data_reader_->get_index();
+  if ((index != NULL) && index->lookup(time + offset, index_pos, index_end) &&
+      (index_pos <= start_pos))
+    index_pos = none;
+
+  for (int probe = 0; probe < SEEK_MAX_PROBES; probe++) {
+    uint64_t pos;
+    if (index_pos != none) {
+      pos = index_pos;
+      index_pos = none;
+    } else if (hi == none) {
+      // Extrapolate using the nominal data rate
+      int64_t n_blocks = (int64_t)((time - lo_time) / block_time) - 1;
+      pos = lo_pos + std::max(n_blocks, (int64_t)0) * block_size;
+    } else {
+      if (hi - lo_pos < 2 * block_size) {
+        found = true;
+        break;
+      }
+      pos = lo_pos + ((hi - lo_pos) / block_size / 2) * block_size;
+    }
+
+    data.invalid.resize(0);
+    reset_after_seek();
+    last_probe = pos;
+    if (!data_reader_->seek(pos) || !read_new_block(data)) {
+      // Past the end of the data
+      hi = pos;
+      continue;
+    }
+
+    Time t = get_current_time();
+    if (t < lo_time)
+      break; // Time stamps are not monotonic
+    if (t > time) {
+      hi = pos;
+    } else {
+      lo_pos = data_reader_->position();
+      lo_probe = pos;
+      lo_time = t;
+      if ((index_end != none) && (hi == none))
+        hi = std::max(index_end, lo_pos);
+      if (time < t + block_time) {
+        found = true;
+        break;
+      }
+    }
+  }
+
+  if (!found)
+    LOG_MSG("Irregular data, could not seek to " << time);
+
+  if (!found || (last_probe != lo_probe)) {
+    // Go back to the last good block
+    data.invalid.resize(0);
+    reset_after_seek();
+    if (found && (lo_probe != none)) {
+      found = data_reader_->seek(lo_probe) && read_new_block(data);
+    } else {
+      found = data_reader_->seek(start_pos) && read_new_block(data) && found;
+    }
+  }
+  return found;
+}
+
 void Input_data_format_reader::find_fill_pattern(Data_frame &data){
   int buffer_size = data.buffer->data.size() / 4; // number of 32 bit words in buffer
   uint32_t *buffer = (uint32_t *)&data.buffer->data[0];
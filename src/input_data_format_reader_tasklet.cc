@@ -7,10 +7,11 @@ Input_data_format_reader_tasklet(
   Data_format_reader_ptr reader,
   Input_memory_pool_ptr memory_pool)
     : memory_pool_(memory_pool),
-      data_modulation(false), seqno(0) {
+      data_modulation(false), seqno(0), usage_("input_reader") {
 
   SFXC_ASSERT(sizeof(value_type) == 1);
   output_buffer_ = Output_buffer_ptr(new Output_buffer());
+  output_buffer_->set_name("input_frames");
   reader_ = reader;
   nr_skew = 0;
   nr_read_error = 0; 
@@ -39,8 +40,10 @@ void Input_data_format_reader_tasklet::do_execute() {
     // As long as there still is data to process, do so
     if (*(std::min_element(current_time.begin(), current_time.end())) < current_interval_.stop_time_) {
       do_task();
+      usage_.busy();
     } else {
       fetch_next_time_interval();
+      usage_.idle();
     }
   }
   DEBUG_MSG(" INPUT READER WILL EXIT ITS LOOP ");
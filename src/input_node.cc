@@ -114,13 +114,17 @@ void Input_node::terminate() {
 void Input_node::hook_added_data_reader(size_t stream_nr) {
   SFXC_ASSERT(stream_nr == 0);
 
+  data_reader_ctrl.get_data_reader(stream_nr)->set_name("input");
   input_node_tasklet =
     get_input_node_tasklet(data_reader_ctrl.get_data_reader(stream_nr),
                            transport_type, ref_date);
   SFXC_ASSERT(input_node_tasklet != NULL);
 }
 
-void Input_node::hook_added_data_writer(size_t writer) {}
+void Input_node::hook_added_data_writer(size_t writer) {
+  // The writers are connected to the correlator nodes
+  data_writers_ctrl.get_data_writer(writer)->set_name("correlator" + itoa(writer));
+}
 
 void Input_node::add_time_interval(Time start_time, Time stop_time,
 				   Time leave_time) {
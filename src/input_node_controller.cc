@@ -63,6 +63,20 @@ Input_node_controller::process_event(MPI_Status &status) {
       node.add_time_slice_to_stream(message[0],message[1],slice_start,slice_stop);
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
+  case MPI_TAG_INPUT_NODE_ADD_TIME_SLICES: {
+      int64_t message[5];
+      MPI_Recv(&message, 5, MPI_INT64, status.MPI_SOURCE,
+               status.MPI_TAG, MPI_COMM_WORLD, &status2);
+      Time slice_start, slice_duration;
+      slice_start.set_clock_ticks(message[2]);
+      slice_duration.set_clock_ticks(message[3]);
+      for (int64_t i = 0; i < message[4]; i++) {
+        node.add_time_slice_to_stream(message[0], message[1], slice_start,
+                                      slice_start + slice_duration);
+        slice_start += slice_duration;
+      }
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
   case MPI_TAG_GET_STATUS: {
       int32_t node_status;
       MPI_Recv(&node_status, 1, MPI_INT32, status.MPI_SOURCE,
@@ -74,8 +88,8 @@ Input_node_controller::process_event(MPI_Status &status) {
     }
   case MPI_TAG_DELAY_TABLE: {
       Delay_table delay_table;
-      int station;
-      MPI_Transfer::receive(status, delay_table, station);
+      int sn[2];
+      MPI_Transfer::receive(status, delay_table, sn);
       node.set_delay_table(delay_table);
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
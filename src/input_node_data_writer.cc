@@ -5,7 +5,8 @@
 #include "sfxc_mpi.h"
 #include "input_node_data_writer.h"
 
-Input_node_data_writer::Input_node_data_writer() {
+Input_node_data_writer::Input_node_data_writer()
+  : usage_(Telemetry::unique_name("input_writer")) {
   last_duration_ = 0;
   total_data_written_ = 0;
   delay_index=0;
@@ -55,9 +56,12 @@ void Input_node_data_writer::do_execute()
     if (has_work()){
       total_data_written_ += do_task();
       did_work=true;
+      usage_.busy();
     }
-    if( !did_work )
+    if( !did_work ) {
       usleep(1000);
+      usage_.idle();
+    }
   }
 }
 
@@ -73,6 +73,7 @@ void Input_node_data_writer_tasklet::connect_to(int nr_stream,
 {
   SFXC_ASSERT( nr_stream < data_writers_.size() );
   data_writers_[nr_stream]->connect_to(buffer);
+  data_writers_[nr_stream]->set_name("input_writer" + itoa(nr_stream));
   data_writer_thread_pool.register_thread(data_writers_[nr_stream]->start());
 }
 
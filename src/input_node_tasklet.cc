@@ -71,6 +71,7 @@ get_input_node_tasklet(boost::shared_ptr<Data_reader> reader,
                        TRANSPORT_TYPE type, Time ref_date) {
   SFXC_ASSERT(type != UNINITIALISED);
   boost::shared_ptr<Data_memory_pool> memory_pool_(new Data_memory_pool(2 * 32 * 64));
+  memory_pool_->set_name("input_data");
 
   if (type == MARK5A) {
     return get_input_node_tasklet_mark5a(reader, memory_pool_, ref_date);
@@ -95,6 +96,7 @@ Input_node_tasklet(Input_reader_ptr_ reader_ptr, Data_memory_pool_ptr memory_poo
 {
   last_duration_ = 0;
   initialized = false;
+  delay_pool.set_name("input_delays");
 }
 
 
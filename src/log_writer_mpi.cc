@@ -15,6 +15,336 @@
 #include <time.h>
 #include <sys/time.h>
 #include <cstring>
+#include <pthread.h>
+#include <errno.h>
+#include <vector>
+#include <map>
+
+// Number of messages a thread can queue, more messages are dropped
+#define LOG_RING_SIZE           1024
+// Time between two batches sent to the log node
+#define LOG_FLUSH_INTERVAL_MS   50
+// Maximal size of a batch of messages
+#define LOG_MAX_BATCH_SIZE      65536
+// Messages that only differ in their numbers are sent at most
+// LOG_REPEAT_LIMIT times per LOG_REPEAT_WINDOW seconds
+#define LOG_REPEAT_LIMIT        50
+#define LOG_REPEAT_WINDOW       10
+// Length of the time and rank prefix of a message
+#define LOG_PREFIX_SIZE         19
+
+namespace {
+
+// Writes the time and rank prefix of a message, buffer has room for
+// LOG_PREFIX_SIZE+1 characters
+void format_prefix(char *buffer, int rank) {
+  struct timeval time_struct;
+  gettimeofday(&time_struct,NULL);
+  struct tm tm_struct;
+  localtime_r(&time_struct.tv_sec, &tm_struct);
+  snprintf(buffer, LOG_PREFIX_SIZE + 1, "%02dh%02dm%02d.%03ds, %02d, ",
+           tm_struct.tm_hour, tm_struct.tm_min, tm_struct.tm_sec,
+           (int)(time_struct.tv_usec+500)/1000, rank);
+}
+
+void send_to_log_node(const std::string &messages) {
+  // If MT_MPI is defined then acquire  the mutex.
+  // otherwise do nothing.
+  IF_MT_MPI_ENABLED( RAIIMutex mutex(g_mpi_thebig_mutex) );
+
+  MPI_Send((void *)messages.c_str(), messages.size() + 1, MPI_CHAR,
+           RANK_LOG_NODE, MPI_TAG_LOG_MESSAGE, MPI_COMM_WORLD);
+}
+
+/// The messages of one thread. Only that thread pushes and only the
+/// flusher pops, so no lock is needed.
+class Log_ring {
+public:
+  Log_ring() : head(0), tail(0), thread_ended(false) {}
+
+  bool push(std::string *message) {
+    unsigned int h = head;
+    if (h - tail == LOG_RING_SIZE)
+      return false;
+    slots[h % LOG_RING_SIZE] = message;
+    // The message is stored before the flusher sees the new head
+    __sync_synchronize();
+    head = h + 1;
+    return true;
+  }
+  std::string *pop() {
+    unsigned int t = tail;
+    if (t == head)
+      return NULL;
+    __sync_synchronize();
+    std::string *message = slots[t % LOG_RING_SIZE];
+    // The slot is read before the thread can reuse it
+    __sync_synchronize();
+    tail = t + 1;
+    return message;
+  }
+
+  volatile unsigned int head, tail;
+  std::string *slots[LOG_RING_SIZE];
+  volatile bool thread_ended;
+};
+
+/// Collects the messages of all threads of the process and sends them in
+/// batches to the log node, so that the threads never wait for MPI.
+/// Repeated messages are rate limited, messages that don't fit in the
+/// ring of a thread are dropped and counted.
+class Log_flusher {
+public:
+  static Log_flusher &instance();
+
+  /// Queues a message of the calling thread. Returns false after stop(),
+  /// the message should then be sent directly.
+  bool queue(int rank, const std::string &message);
+  /// Sends all queued messages and stops the thread
+  void stop();
+
+private:
+  Log_flusher();
+
+  struct Repeat {
+    time_t window_start;
+    int count;
+    int suppressed;
+    std::string last;
+  };
+
+  static void create();
+  static void *run(void *self);
+  static void thread_ended(void *ring);
+  Log_ring *thread_ring();
+  /// Sends the queued messages, with final set all repeats are reported
+  void flush(bool final = false);
+  bool rate_limited(const std::string &message, time_t now);
+  void add(std::string &batch, const std::string &message);
+
+  pthread_key_t key;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t thread;
+  volatile bool stopped;
+  volatile int rank;
+  volatile unsigned int dropped;
+
+  // Protected by mutex
+  std::vector<Log_ring *> rings;
+  // Only used by the flushing thread
+  std::map<std::string, Repeat> repeats;
+};
+
+pthread_once_t flusher_once = PTHREAD_ONCE_INIT;
+Log_flusher *flusher = NULL;
+
+void
+Log_flusher::create() {
+  flusher = new Log_flusher();
+}
+
+Log_flusher &
+Log_flusher::instance() {
+  pthread_once(&flusher_once, create);
+  return *flusher;
+}
+
+Log_flusher::Log_flusher()
+  : stopped(false), rank(0), dropped(0) {
+  pthread_key_create(&key, thread_ended);
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+  // Without the thread the messages are sent directly
+  stopped = (pthread_create(&thread, NULL, run, this) != 0);
+}
+
+Log_ring *
+Log_flusher::thread_ring() {
+  Log_ring *ring = (Log_ring *)pthread_getspecific(key);
+  if (ring == NULL) {
+    // Once per thread
+    ring = new Log_ring();
+    pthread_setspecific(key, ring);
+    pthread_mutex_lock(&mutex);
+    rings.push_back(ring);
+    pthread_mutex_unlock(&mutex);
+  }
+  return ring;
+}
+
+void
+Log_flusher::thread_ended(void *ring) {
+  // The flusher deletes the ring when it is empty
+  ((Log_ring *)ring)->thread_ended = true;
+}
+
+bool
+Log_flusher::queue(int rank_, const std::string &message) {
+  if (stopped)
+    return false;
+  Log_ring *ring = thread_ring();
+  std::string *copy = new std::string(message);
+  // stop() sets stopped under the mutex and then empties the rings for
+  // the last time, a message pushed after that would never be sent
+  pthread_mutex_lock(&mutex);
+  bool queued = !stopped;
+  if (queued) {
+    rank = rank_;
+    if (!ring->push(copy)) {
+      delete copy;
+      __sync_fetch_and_add(&dropped, 1);
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+  if (!queued)
+    delete copy;
+  return queued;
+}
+
+void
+Log_flusher::stop() {
+  pthread_mutex_lock(&mutex);
+  if (stopped) {
+    pthread_mutex_unlock(&mutex);
+    return;
+  }
+  stopped = true;
+  pthread_cond_signal(&cond);
+  pthread_mutex_unlock(&mutex);
+  pthread_join(thread, NULL);
+  // Messages that were queued while the thread stopped and the repeats
+  // that were suppressed
+  flush(true);
+}
+
+void *
+Log_flusher::run(void *self_) {
+  Log_flusher &self = *(Log_flusher *)self_;
+  pthread_mutex_lock(&self.mutex);
+  while (!self.stopped) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t usec = now.tv_usec + LOG_FLUSH_INTERVAL_MS * 1000;
+    struct timespec timeout;
+    timeout.tv_sec = now.tv_sec + usec / 1000000;
+    timeout.tv_nsec = (usec % 1000000) * 1000;
+    while (!self.stopped &&
+           (pthread_cond_timedwait(&self.cond, &self.mutex, &timeout) != ETIMEDOUT))
+      ;
+    pthread_mutex_unlock(&self.mutex);
+    self.flush();
+    pthread_mutex_lock(&self.mutex);
+  }
+  pthread_mutex_unlock(&self.mutex);
+  return NULL;
+}
+
+bool
+Log_flusher::rate_limited(const std::string &message, time_t now) {
+  // Messages that only differ in their numbers (e.g. a time stamp or the
+  // number of missing samples) count as repeats
+  std::string key;
+  for (size_t i = std::min(message.size(), (size_t)LOG_PREFIX_SIZE);
+       i < message.size(); i++) {
+    if ((message[i] < '0') || (message[i] > '9'))
+      key += message[i];
+    else if (key.empty() || (key[key.size() - 1] != '#'))
+      key += '#';
+  }
+  std::map<std::string, Repeat>::iterator it = repeats.find(key);
+  if (it == repeats.end()) {
+    Repeat repeat;
+    repeat.window_start = now;
+    repeat.count = 1;
+    repeat.suppressed = 0;
+    repeats[key] = repeat;
+    return false;
+  }
+  Repeat &repeat = it->second;
+  if (repeat.count < LOG_REPEAT_LIMIT) {
+    repeat.count++;
+    return false;
+  }
+  repeat.suppressed++;
+  repeat.last = message;
+  return true;
+}
+
+void
+Log_flusher::add(std::string &batch, const std::string &message) {
+  if (batch.size() + message.size() > LOG_MAX_BATCH_SIZE) {
+    send_to_log_node(batch);
+    batch.clear();
+  }
+  batch += message;
+}
+
+void
+Log_flusher::flush(bool final) {
+  std::vector<Log_ring *> current_rings;
+  pthread_mutex_lock(&mutex);
+  current_rings = rings;
+  pthread_mutex_unlock(&mutex);
+
+  time_t now = time(NULL);
+  std::string batch;
+  for (size_t i = 0; i < current_rings.size(); i++) {
+    std::string *message;
+    while ((message = current_rings[i]->pop()) != NULL) {
+      if (!rate_limited(*message, now))
+        add(batch, *message);
+      delete message;
+    }
+  }
+
+  // Report the repeats of the messages of which the window ended
+  std::map<std::string, Repeat>::iterator it = repeats.begin();
+  while (it != repeats.end()) {
+    Repeat &repeat = it->second;
+    if (!final && (now - repeat.window_start < LOG_REPEAT_WINDOW)) {
+      it++;
+      continue;
+    }
+    if (repeat.suppressed > 0) {
+      char prefix[LOG_PREFIX_SIZE + 1];
+      format_prefix(prefix, rank);
+      std::string last = repeat.last.substr(std::min(repeat.last.size(),
+                                                     (size_t)LOG_PREFIX_SIZE));
+      add(batch, std::string(prefix) + "suppressed " + itoa(repeat.suppressed) +
+                 " similar messages, the last one was: " + last);
+      if (last.empty() || (last[last.size() - 1] != '\n'))
+        batch += '\n';
+    }
+    repeats.erase(it++);
+  }
+
+  unsigned int nr_dropped = __sync_lock_test_and_set(&dropped, 0);
+  if (nr_dropped > 0) {
+    char prefix[LOG_PREFIX_SIZE + 1];
+    format_prefix(prefix, rank);
+    add(batch, std::string(prefix) + "dropped " + itoa(nr_dropped) +
+               " log messages, the log queue was full\n");
+  }
+
+  if (!batch.empty())
+    send_to_log_node(batch);
+
+  // Remove the rings of the threads that ended
+  pthread_mutex_lock(&mutex);
+  for (size_t i = 0; i < rings.size(); ) {
+    if (rings[i]->thread_ended && (rings[i]->head == rings[i]->tail)) {
+      delete rings[i];
+      rings[i] = rings.back();
+      rings.pop_back();
+    } else {
+      i++;
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+} // namespace
 
 class Log_writer_mpi_buffer : public Log_writer_buffer {
 public:
@@ -38,6 +368,11 @@ Log_writer_mpi::Log_writer_mpi(int rank,
                                int messagelevel)
     : Log_writer(new Log_writer_mpi_buffer(rank, messagelevel)) {}
 
+void
+Log_writer_mpi::flush_and_stop() {
+  Log_flusher::instance().stop();
+}
+
 // Buffer
 Log_writer_mpi_buffer::Log_writer_mpi_buffer(int rank,
     int message_level,
@@ -77,27 +412,19 @@ void Log_writer_mpi_buffer::put_buffer() {
   if (pbase() != pptr()) {
     int     len = (pptr() - pbase());
     SFXC_ASSERT(len > 0);
-    char    *buffer = new char[len + 19 + 1];
 
     if (current_level <= max_level) {
-      struct timeval time_struct;
-      gettimeofday(&time_struct,NULL);
-      struct tm *tm_struct = localtime(&time_struct.tv_sec);
-      snprintf(buffer, 20, "%02dh%02dm%02d.%03ds, %02d, ",
-               tm_struct->tm_hour, tm_struct->tm_min, tm_struct->tm_sec,
-               (time_struct.tv_usec+500)/1000, rank);
-      SFXC_ASSERT(strlen(buffer) == 19);
-      strncpy(buffer + 19, pbase(), len);
-      buffer[len + 19] = '\0';
-
-      // If MT_MPI is defined then acquire  the mutex.
-      // otherwise do nothing.
-      IF_MT_MPI_ENABLED( RAIIMutex mutex(g_mpi_thebig_mutex) );
-
-      MPI_Send(buffer, len+20+1, MPI_CHAR, RANK_LOG_NODE, MPI_TAG_LOG_MESSAGE, MPI_COMM_WORLD);
+      char prefix[LOG_PREFIX_SIZE + 1];
+      format_prefix(prefix, rank);
+      SFXC_ASSERT(strlen(prefix) == LOG_PREFIX_SIZE);
+      std::string message(prefix);
+      message.append(pbase(), len);
+
+      // The message is sent by the flusher, directly once it stopped
+      if (!Log_flusher::instance().queue(rank, message))
+        send_to_log_node(message);
     }
 
     setp(pbase(), epptr());
-    delete [] buffer;
   }
 }
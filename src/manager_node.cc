@@ -14,6 +14,8 @@
 #include "log_writer_cout.h"
 #include "uvw_model.h"
 #include "svn_version.h"
+#include "cor_index.h"
+#include "telemetry.h"
 
 #include <iostream>
 #include <iomanip>
@@ -21,17 +23,20 @@
 #include <stdlib.h>
 #include <cstring>
 #include <set>
+#include <sstream>
 
 Manager_node::
 Manager_node(int rank, int numtasks,
              Log_writer *log_writer,
-             const Control_parameters &control_parameters)
+             const Control_parameters &control_parameters,
+             bool resume)
     : Abstract_manager_node(rank, numtasks,
                             log_writer,
                             control_parameters),
     manager_controller(*this),
-    integration_slice_nr(0),
-    current_scan(0)
+    integration_slice_nr(0), integrations_in_block(1),
+    current_scan(0), resume(resume), resume_integration_slice(-1),
+    resume_at_stop(false), last_checkpoint(0)
 /**/ {
   SFXC_ASSERT(rank == RANK_MANAGER_NODE);
 
@@ -124,6 +129,18 @@ Manager_node(int rank, int numtasks,
 
   MPI_Waitall(currreq, &pending_requests[0], &pending_status[0]);
   std::cout << "All the connexion are established!" << std::endl;
+
+#ifndef SFXC_DETERMINISTIC
+  correlator_node_scheduler.set_throughput_scheduling(control_parameters.throughput_scheduling());
+
+  // Every correlator node asks for its first job itself. With a deeper
+  // scheduler queue the nodes get more jobs in advance, so that they
+  // can read the data of the next job while correlating the current one
+  for (int i = 1; i < control_parameters.scheduler_queue_depth(); i++) {
+    for (int correlator_nr = 0; correlator_nr < n_corr_nodes; correlator_nr++)
+      set_correlator_node_ready(correlator_nr);
+  }
+#endif
 }
 
 Manager_node::~Manager_node() {
@@ -141,9 +158,10 @@ void Manager_node::start() {
   PROGRESS_MSG("start correlating");
   initialise();
   current_correlator_node = 0;
-  status = START_NEW_SCAN;
+  status = (resume_at_stop ? STOP_CORRELATING : START_NEW_SCAN);
   while (status != END_NODE) {
     process_all_waiting_messages();
+    correlation_status.publish_if_due();
 
     switch (status) {
       case START_NEW_SCAN: {
@@ -200,6 +218,15 @@ void Manager_node::start() {
       }
       case START_CORRELATION_TIME_SLICE: {
         current_channel = 0;
+        // A job contains several integrations of a channel, which
+        // includes all integrations that are averaged in the output. The
+        // blocks are aligned to the averaging and end at the end of the scan.
+        int block = control_parameters.slices_per_job();
+        integrations_in_block = 1;
+        while ((integrations_in_block < block - integration_slice_nr % block) &&
+               (start_time + integration_time() * (integration_slice_nr + integrations_in_block + 1) <=
+                std::min(stop_time, stop_time_scan)))
+          integrations_in_block++;
         status = START_CORRELATOR_NODES_FOR_TIME_SLICE;
         break;
       }
@@ -214,9 +241,15 @@ void Manager_node::start() {
           added_correlator_node = true;
         }
 #else
-        if (!ready_correlator_nodes.empty()) {
-          start_next_timeslice_on_node(ready_correlator_nodes.front());
-          ready_correlator_nodes.pop();
+        double cost = job_cost();
+        int node = correlator_node_scheduler.select_node(cost, jobs_left_in_scan());
+        if (node >= 0) {
+          get_log_writer()(2) << "job of cost " << cost << " to correlator node "
+                              << node << " (throughput "
+                              << correlator_node_scheduler.throughput(node)
+                              << ")" << std::endl;
+          correlator_node_scheduler.assign(node, cost);
+          start_next_timeslice_on_node(node);
           added_correlator_node = true;
         }
 #endif
@@ -233,7 +266,10 @@ void Manager_node::start() {
         break;
       }
       case GOTO_NEXT_TIMESLICE: {
-        integration_slice_nr += 1;
+        integration_slice_nr += integrations_in_block;
+        // The output slices of the other integrations of the block
+        output_slice_nr += (integrations_in_block - 1) *
+          control_parameters.number_correlation_cores_per_timeslice(get_current_mode());
         PROGRESS_MSG("starting timeslice " << start_time+integration_time()*integration_slice_nr);
         // Check whether the integration slice continues past the stop time
         if (start_time + integration_time() * (integration_slice_nr + 1) >
@@ -253,10 +289,17 @@ void Manager_node::start() {
           // Just process the next time slice
           status = START_CORRELATION_TIME_SLICE;
         }
+        if (control_parameters.checkpoint() &&
+            (telemetry_usec() - last_checkpoint >=
+             (uint64_t)control_parameters.checkpoint_interval_ms() * 1000) &&
+            can_checkpoint())
+          send_checkpoint_mark();
         break;
       }
       case STOP_CORRELATING: {
         // The status is set to END_NODE as soon as the output_node is ready
+        if (control_parameters.checkpoint())
+          send_checkpoint_mark();
         MPI_Send(&output_slice_nr, 1, MPI_INT32,
                  RANK_OUTPUT_NODE, MPI_TAG_OUTPUT_NODE_CORRELATION_READY,
                  MPI_COMM_WORLD);
@@ -274,8 +317,14 @@ void Manager_node::start() {
       }
     }
   }
+  stop_node_status();
   PROGRESS_MSG("terminating nodes");
 
+#ifndef SFXC_DETERMINISTIC
+  std::stringstream statistics;
+  correlator_node_scheduler.print_statistics(statistics);
+  get_log_writer()(1) << statistics.str();
+#endif
   get_log_writer()(1) << "Terminating nodes" << std::endl;
 }
 
@@ -285,6 +334,40 @@ void Manager_node::terminate()
 		status = END_NODE;
 }
 
+double
+Manager_node::job_cost() const {
+  // The number of baselines, including the auto correlations, of the
+  // current channel times the number of integrations
+  int cross_channel = -1;
+  if (control_parameters.cross_polarize())
+    cross_channel = control_parameters.cross_channel(current_channel,
+                    get_current_mode());
+  int nstreams = 0;
+  for (size_t station = 0; station < control_parameters.number_stations(); station++) {
+    if (ch_number_in_scan[current_channel][station] >= 0)
+      nstreams++;
+    if ((cross_channel >= 0) && (ch_number_in_scan[cross_channel][station] >= 0))
+      nstreams++;
+  }
+  int n_phase_centers = 1;
+  if (control_parameters.multi_phase_center())
+    n_phase_centers = n_sources_in_current_scan;
+  return integrations_in_block * nstreams * (nstreams + 1) / 2. * n_phase_centers;
+}
+
+int
+Manager_node::jobs_left_in_scan() const {
+  // The remaining channels of this block plus the following full blocks
+  int nr_channels = control_parameters.number_frequency_channels();
+  Time stop = std::min(stop_time, stop_time_scan);
+  Time next_block = start_time + integration_time() * (integration_slice_nr + integrations_in_block);
+  int blocks = 0;
+  if (next_block < stop)
+    blocks = (int)((stop - next_block) /
+                   (integration_time() * control_parameters.slices_per_job()));
+  return (nr_channels - current_channel) + blocks * nr_channels;
+}
+
 void Manager_node::start_next_timeslice_on_node(int corr_node_nr) {
   int cross_channel = -1;
   if (control_parameters.cross_polarize()) {
@@ -329,20 +412,31 @@ void Manager_node::start_next_timeslice_on_node(int corr_node_nr) {
     get_correlation_parameters(scan_name,
                                current_channel,
                                get_input_node_map());
-  correlation_parameters.start_time =
-    start_time + integration_time() * integration_slice_nr;
-  correlation_parameters.stop_time  =
-    start_time + integration_time() * (integration_slice_nr+1);
-  correlation_parameters.integration_nr = integration_slice_nr;
-  correlation_parameters.slice_nr = output_slice_nr;
   strncpy(correlation_parameters.source, control_parameters.scan_source(scan_name).c_str(), 11);
   correlation_parameters.pulsar_binning = control_parameters.pulsar_binning();
   if (control_parameters.multi_phase_center())
     correlation_parameters.n_phase_centers = n_sources_in_current_scan;
   else
     correlation_parameters.n_phase_centers = 1;
+  correlation_parameters.first_integration_in_block = integration_slice_nr;
+  correlation_parameters.last_integration_in_block =
+    integration_slice_nr + integrations_in_block - 1;
+
+  // All integrations of the block go to the same correlator node in one
+  // message, the correlator node splits them into integrations. The
+  // output slices of the integrations are slice_offset apart.
+  correlation_parameters.start_time =
+    start_time + integration_time() * integration_slice_nr;
+  correlation_parameters.stop_time  =
+    start_time + integration_time() * (integration_slice_nr + integrations_in_block);
+  correlation_parameters.integration_nr = integration_slice_nr;
+  correlation_parameters.slice_nr = output_slice_nr;
 
+  correlator_node_send_scan_tables(corr_node_nr);
   correlator_node_set(correlation_parameters, corr_node_nr);
+  correlation_status.add_job(corr_node_nr, correlation_parameters.start_time,
+                             integrations_in_block,
+                             control_parameters.number_correlation_cores_per_timeslice(get_current_mode()));
 
   // set the input streams
   size_t nStations = control_parameters.number_stations();
@@ -351,21 +445,21 @@ void Manager_node::start_next_timeslice_on_node(int corr_node_nr) {
        station_nr++) {
     int stream = corr_node_nr;
     if (ch_number_in_scan[current_channel][station_nr] >= 0) {
-      input_node_set_time_slice(control_parameters.station(station_nr),
-                                ch_number_in_scan[current_channel][station_nr],
-				stream,
-                                correlation_parameters.start_time,
-                                correlation_parameters.stop_time);
+      input_node_set_time_slices(control_parameters.station(station_nr),
+                                 ch_number_in_scan[current_channel][station_nr],
+                                 stream,
+                                 correlation_parameters.start_time,
+                                 integration_time(), integrations_in_block);
       stream += n_corr_nodes;
     }
 
     if (cross_channel != -1 &&
-	ch_number_in_scan[cross_channel][station_nr] >= 0) {
-      input_node_set_time_slice(control_parameters.station(station_nr),
-				ch_number_in_scan[cross_channel][station_nr],
-				stream,
-				correlation_parameters.start_time,
-				correlation_parameters.stop_time);
+        ch_number_in_scan[cross_channel][station_nr] >= 0) {
+      input_node_set_time_slices(control_parameters.station(station_nr),
+                                 ch_number_in_scan[cross_channel][station_nr],
+                                 stream,
+                                 correlation_parameters.start_time,
+                                 integration_time(), integrations_in_block);
     }
   }
 
@@ -413,6 +507,13 @@ Manager_node::initialise() {
   }
   SFXC_ASSERT(current_scan < control_parameters.number_scans());
 
+  // The checkpoint comes before the output files, which are appended to
+  // when the correlation is resumed
+  if (control_parameters.checkpoint())
+    set_checkpoint_file();
+  else if (resume)
+    sfxc_abort("Resuming needs \"checkpoint\": true in the control file");
+
   if (control_parameters.get_mask_parameters(mask_parameters))
     correlator_node_set_all(mask_parameters);
 
@@ -432,7 +533,7 @@ Manager_node::initialise() {
     for(int bin=0;bin<max_nbins;bin++){
       std::ostringstream outfile;
       outfile << base_filename << ".bin" << bin;
-      set_data_writer(RANK_OUTPUT_NODE, bin, outfile.str());
+      set_output_file(bin, outfile.str());
     }
   }else if(control_parameters.multi_phase_center()){
     SFXC_ASSERT(!control_parameters.pulsar_binning());
@@ -463,12 +564,12 @@ Manager_node::initialise() {
     std::set<std::string>::iterator sources_it = sources.begin();
     int source_nr=0;
     while(sources_it != sources.end()){
-      set_data_writer(RANK_OUTPUT_NODE, source_nr, base_filename + "_" + *sources_it);
+      set_output_file(source_nr, base_filename + "_" + *sources_it, *sources_it);
       sources_it++;
       source_nr++;
     }
   }else
-    set_data_writer(RANK_OUTPUT_NODE, 0, control_parameters.get_output_file());
+    set_output_file(0, control_parameters.get_output_file());
 
   {
     std::string filename = control_parameters.get_phasecal_file();
@@ -492,14 +593,47 @@ Manager_node::initialise() {
     }
   }
 
-  // Write the global header in the outpul file
-  send_global_header();
+  // Write the global header in the outpul file, a resumed file has it
+  if (resume_integration_slice < 0)
+    send_global_header();
 
   output_slice_nr = 0;
 
+  if (resume_integration_slice >= 0) {
+    // Continue with the first integration that is not in the output
+    integration_slice_nr = resume_integration_slice;
+    Time time = start_time + integration_time() * integration_slice_nr;
+    int scan = control_parameters.scan(time);
+    if ((scan < 0) ||
+        (start_time + integration_time() * (integration_slice_nr + 1) > stop_time)) {
+      get_log_writer()(0) << "The checkpoint is at the end of the correlation" << std::endl;
+      resume_at_stop = true;
+    } else {
+      get_log_writer()(0) << "Resuming the correlation at " << time.date_string() << std::endl;
+      current_scan = scan;
+    }
+  }
+
   PROGRESS_MSG("start_time: " << start_time.date_string());
   PROGRESS_MSG("stop_time: " << stop_time.date_string());
 
+  if (!control_parameters.status().empty()) {
+    std::vector<std::string> stations;
+    std::vector<int> input_ranks, correlator_ranks;
+    for (size_t i = 0; i < control_parameters.number_stations(); i++) {
+      stations.push_back(control_parameters.station(i));
+      input_ranks.push_back(input_rank(control_parameters.station(i)));
+    }
+    for (size_t i = 0; i < number_correlator_nodes(); i++)
+      correlator_ranks.push_back(correlator_rank(i));
+    if (!correlation_status.initialise(control_parameters.status(),
+                                       control_parameters.status_interval_ms(),
+                                       stations, input_ranks, correlator_ranks,
+                                       start_time, stop_time, integration_time()))
+      get_log_writer()(0) << "Could not publish the status to "
+                          << control_parameters.status() << std::endl;
+  }
+
   get_log_writer()(1) << "Starting correlation" << std::endl;
 }
 
@@ -533,6 +667,7 @@ void Manager_node::initialise_scan(const std::string &scan) {
 
   // Send the delay tables:
   get_log_writer() << "Set delay_table" << std::endl;
+  correlator_node_clear_scan_tables();
   for (size_t station = 0;
        station < control_parameters.number_stations();
        station++) {
@@ -603,7 +738,7 @@ void Manager_node::initialise_scan(const std::string &scan) {
     delay_table.set_clock_offset(offset, start, rate, epoch);
     send(delay_table, /* station_nr */ 0, input_rank(station));
     control_parameters.set_reader_offset(station_name, Time(reader_offset*1e6));
-    correlator_node_set_all(delay_table, station_name);
+    correlator_node_add_scan_table(delay_table, station_name);
   }
 
   // Send the UVW tables:
@@ -619,7 +754,7 @@ void Manager_node::initialise_scan(const std::string &scan) {
       control_parameters.get_delay_table_name(station_name);
     uvw_table.open(delay_file.c_str(), scan_start, stop_time_scan, source);
 
-    correlator_node_set_all(uvw_table, station_name);
+    correlator_node_add_scan_table(uvw_table, station_name);
   }
 
   get_log_writer() << "Set track parameters" << std::endl;
@@ -657,6 +792,22 @@ void Manager_node::initialise_scan(const std::string &scan) {
   }
 }
 
+void
+Manager_node::stop_node_status() {
+  if (control_parameters.status().empty())
+    return;
+  // The output node sent its last status before MPI_TAG_OUTPUT_NODE_FINISHED
+  status_ranks.insert(input_node_rank.begin(), input_node_rank.end());
+  status_ranks.insert(correlator_node_rank.begin(), correlator_node_rank.end());
+  for (std::set<int>::iterator it = status_ranks.begin();
+       it != status_ranks.end(); it++) {
+    int32_t msg = 0;
+    MPI_Send(&msg, 1, MPI_INT32, *it, MPI_TAG_STOP_NODE_STATUS, MPI_COMM_WORLD);
+  }
+  while (!status_ranks.empty())
+    check_and_process_message();
+}
+
 void Manager_node::end_correlation() {
   SFXC_ASSERT(status == WAIT_FOR_OUTPUT_NODE);
   status = END_NODE;
@@ -667,6 +818,87 @@ std::string Manager_node::get_current_mode() const {
   return control_parameters.get_vex().get_mode(scan_name);
 }
 
+void
+Manager_node::set_output_file(int stream_nr, const std::string &filename,
+                              const std::string &product) {
+  // A resumed file is appended to from its size at the checkpoint
+  int64_t size = -1;
+  if (resume_integration_slice >= 0) {
+    if (stream_nr >= (int)resume_file_sizes.size())
+      sfxc_abort("The checkpoint doesn't contain all output files");
+    size = resume_file_sizes[stream_nr];
+  }
+  // The index is requested first, so that the global header is indexed
+  if (control_parameters.output_index()) {
+    if (size < 0)
+      set_output_index_file(stream_nr, filename + COR_INDEX_EXTENSION);
+    else
+      get_log_writer()(0) << "The index of " << filename
+                          << " is not resumed, recreate it with corfile_index" << std::endl;
+  }
+  int channels = control_parameters.output_averaging_channels(product);
+  int integrations = control_parameters.output_averaging_integrations(product);
+  if ((channels != 1) || (integrations != 1))
+    set_output_averaging(stream_nr, channels, integrations);
+  set_data_writer(RANK_OUTPUT_NODE, stream_nr, filename, size);
+}
+
+void
+Manager_node::set_checkpoint_file() {
+  // A checkpoint only applies to a correlation with the same output
+  std::ostringstream description;
+  description << "sfxc checkpoint " << control_parameters.get_exper_name()
+              << " start " << start_time.date_string()
+              << " integration_time " << (int64_t)integration_time().get_time_usec()
+              << " channels " << control_parameters.number_channels()
+              << " format " << control_parameters.output_format_version()
+              << " phasecal " << !control_parameters.get_phasecal_file().empty()
+              << " tsys " << !control_parameters.get_tsys_file().empty();
+  std::string filename = control_parameters.get_output_file() + ".checkpoint";
+
+  std::vector<char> msg(sizeof(int32_t));
+  int32_t resume_flag = (resume ? 1 : 0);
+  memcpy(&msg[0], &resume_flag, sizeof(int32_t));
+  const std::string &text = description.str();
+  msg.insert(msg.end(), text.c_str(), text.c_str() + text.size() + 1);
+  msg.insert(msg.end(), filename.c_str(), filename.c_str() + filename.size() + 1);
+  MPI_Send(&msg[0], msg.size(), MPI_CHAR, RANK_OUTPUT_NODE,
+           MPI_TAG_OUTPUT_NODE_SET_CHECKPOINT_FILE, MPI_COMM_WORLD);
+
+  MPI_Status mpi_status;
+  MPI_Probe(RANK_OUTPUT_NODE, MPI_TAG_OUTPUT_NODE_CHECKPOINT, MPI_COMM_WORLD,
+            &mpi_status);
+  int len;
+  MPI_Get_elements(&mpi_status, MPI_INT64, &len);
+  SFXC_ASSERT(len >= 1);
+  std::vector<int64_t> checkpoint(len);
+  MPI_Recv(&checkpoint[0], len, MPI_INT64, RANK_OUTPUT_NODE,
+           MPI_TAG_OUTPUT_NODE_CHECKPOINT, MPI_COMM_WORLD, &mpi_status);
+  resume_integration_slice = checkpoint[0];
+  resume_file_sizes.assign(checkpoint.begin() + 1, checkpoint.end());
+  last_checkpoint = telemetry_usec();
+}
+
+void
+Manager_node::send_checkpoint_mark() {
+  Time time = start_time + integration_time() * integration_slice_nr;
+  int64_t msg[3] = {output_slice_nr, integration_slice_nr, time.get_clock_ticks()};
+  MPI_Send(msg, 3, MPI_INT64, RANK_OUTPUT_NODE,
+           MPI_TAG_OUTPUT_NODE_CHECKPOINT_MARK, MPI_COMM_WORLD);
+  last_checkpoint = telemetry_usec();
+}
+
+bool
+Manager_node::can_checkpoint() const {
+  // A resumed correlation keeps the phase-cal and Tsys records before the
+  // checkpoint, which have a time stamp in whole seconds
+  if (control_parameters.get_phasecal_file().empty() &&
+      control_parameters.get_tsys_file().empty())
+    return true;
+  Time time = start_time + integration_time() * integration_slice_nr;
+  return (time % Time(1000000.)).get_clock_ticks() == 0;
+}
+
 void Manager_node::send_global_header(){ 
     // Send the global header
     Output_header_global output_header;
@@ -685,7 +917,8 @@ void Manager_node::send_global_header(){
     output_header.number_channels = control_parameters.number_channels();  // Number of frequency channels
     Time int_time = control_parameters.integration_time();// Integration time: microseconds
     output_header.integration_time = (int)int_time.get_time_usec();
-    output_header.output_format_version = OUTPUT_FORMAT_VERSION;
+    output_header.output_format_version =
+      control_parameters.output_format_version();
     
     const char *svn_version = SVN_VERSION;
     if (strchr(svn_version, ':'))
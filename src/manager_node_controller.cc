@@ -45,6 +45,23 @@ Manager_node_controller::process_event(MPI_Status &status) {
 
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
+    case MPI_TAG_NODE_STATUS: {
+      int size;
+      MPI_Get_count(&status, MPI_INT64, &size);
+      Node_status node_status;
+      MPI_Recv(node_status.value, Node_status::NR_FIELDS, MPI_INT64,
+               status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, &status2);
+
+      SFXC_ASSERT(status.MPI_SOURCE == status2.MPI_SOURCE);
+      SFXC_ASSERT(status.MPI_TAG == status2.MPI_TAG);
+
+      if (size == 0)
+        node.node_status_stopped(status.MPI_SOURCE);
+      else
+        node.set_node_status(status.MPI_SOURCE, node_status);
+
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
     case MPI_TAG_OUTPUT_NODE_FINISHED: {
       int32_t msg;
       MPI_Recv(&msg, 1, MPI_INT32, status.MPI_SOURCE,
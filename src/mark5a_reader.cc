@@ -25,9 +25,12 @@ Mark5a_reader::goto_time(Data_frame &data, Time time) {
         break;
     }
   } else if (time > get_current_time()){
-    // Skip through data stream with 1 second steps
     const Time one_sec(1000000.);
     const Time t_one_frame(8*N*SIZE_MK5A_FRAME / (data_rate() / 1000000.));
+    // Jump close to the requested time
+    seek_to_time(data, time, SIZE_MK5A_FRAME*N, t_one_frame);
+
+    // Skip through the remaining data with 1 second steps
     Time delta_time = time - get_current_time();
     while(delta_time>=one_sec){
       // Read an integer number of frames
@@ -143,9 +146,15 @@ bool Mark5a_reader::read_new_block(Data_frame &data) {
       return false;
   }
 
-  // check if we are crossing a day boundary
+  // check if we are crossing a day boundary (in either direction,
+  // seek_to_time can move backwards)
   if(header.day(track) != current_day_){
-    current_mjd_++;
+    int delta = header.day(track) - current_day_;
+    if (delta < -180)
+      delta = 1; // new year
+    else if (delta > 180)
+      delta = -1;
+    current_mjd_ += delta;
     current_day_ = header.day(track);
   }
   current_time_.set_time_usec(current_mjd_, header.get_time_in_us(track));
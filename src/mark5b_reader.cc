@@ -49,9 +49,13 @@ Mark5b_reader::goto_time(Data_frame &data, Time time) {
         break;
     }
   } else if (time > get_current_time()){
-    // Search data with 1 second steps
     const size_t size_mk5b_block =
       (SIZE_MK5B_HEADER+SIZE_MK5B_FRAME)*SIZE_MK5B_WORD;
+    // Jump close to the requested time
+    seek_to_time(data, time, N_MK5B_BLOCKS_TO_READ*size_mk5b_block,
+                 time_between_headers_);
+
+    // Search the remaining data with 1 second steps
 
     // first search until we are within 1 sec from requested time
     const Time one_sec(1000000.);
@@ -143,8 +147,7 @@ bool Mark5b_reader::read_new_block(Data_frame &data) {
     mark5b_block += SIZE_MK5B_FRAME*SIZE_MK5B_WORD;
   }
   if (data_reader_->eof()) return false;
-  if(current_header.julian_day() != current_jday % 1000)
-    current_jday++;
+  update_current_jday();
   current_time_ = get_current_time();
   if (floor(current_time_.get_time_usec() / 1000000) != floor(old_time_.get_time_usec() / 1000000)) {
     if (nr_resync > 0) {
@@ -161,6 +164,22 @@ bool Mark5b_reader::read_new_block(Data_frame &data) {
   return true;
 }
 
+void Mark5b_reader::update_current_jday() {
+  // The header only contains the julian day modulo 1000, take the day
+  // closest to the current day so that we can also seek backwards.
+  int delta = current_header.julian_day() - current_jday % 1000;
+  if (delta > 500)
+    delta -= 1000;
+  else if (delta < -500)
+    delta += 1000;
+  current_jday += delta;
+}
+
+void Mark5b_reader::reset_after_seek() {
+  // Don't use the previous frame number to detect a wrap
+  frame_nr = -1;
+}
+
 bool Mark5b_reader::eof() {
   return data_reader_->eof();
 }
@@ -308,8 +327,7 @@ bool Mark5b_reader::resync_header(Data_frame &data) {
           total_bytes_read += Data_reader_blocking::get_bytes_s( data_reader_.get(), frame_size, &buffer[i * frame_size]);
         }
 
-        if(current_header.julian_day() != current_jday % 1000)
-          current_jday++;
+        update_current_jday();
         // in case of 4Gb/s data frame_nr wraps
         if ((nr_of_bitstreams == 64) && (current_header.seconds() == previous_header.seconds()) 
             && (frame_nr > current_header.frame_nr))
@@ -13,6 +13,9 @@
 #include "exception_common.h"
 
 #include <iostream>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 MPI_Transfer::MPI_Transfer() {}
 
@@ -155,6 +158,69 @@ recv_connect_writer_to_msg(uint32_t info[4], std::vector<uint64_t>& params, std:
   SFXC_ASSERT(position == size);
 }
 
+void
+MPI_Transfer::
+pack_message(std::vector<char> &buffer, std::vector<char> &message, bool compress) {
+  // The message starts with the size of the packed data and the size of
+  // the data in the message, which is smaller if the data is compressed
+  int32_t header[2] = {(int32_t)buffer.size(), (int32_t)buffer.size()};
+#ifdef HAVE_LIBZ
+  if (compress) {
+    uLongf size = compressBound(buffer.size());
+    message.resize(sizeof(header) + size);
+    if ((compress2((Bytef *)&message[sizeof(header)], &size,
+                   (const Bytef *)&buffer[0], buffer.size(),
+                   Z_BEST_SPEED) == Z_OK) &&
+        (size < buffer.size())) {
+      header[1] = size;
+      message.resize(sizeof(header) + size);
+      memcpy(&message[0], header, sizeof(header));
+      return;
+    }
+  }
+#endif
+  message.resize(sizeof(header) + buffer.size());
+  memcpy(&message[0], header, sizeof(header));
+  memcpy(&message[sizeof(header)], &buffer[0], buffer.size());
+}
+
+void
+MPI_Transfer::
+send_message(std::vector<char> &message, int tag, int rank) {
+  MPI_Send(&message[0], message.size(), MPI_CHAR, rank, tag, MPI_COMM_WORLD);
+}
+
+void
+MPI_Transfer::
+receive_message(MPI_Status &status, std::vector<char> &buffer) {
+  MPI_Status status2;
+
+  int size;
+  MPI_Get_elements(&status, MPI_CHAR, &size);
+  SFXC_ASSERT(size > (int)(2 * sizeof(int32_t)));
+  std::vector<char> message(size);
+  MPI_Recv(&message[0], size, MPI_CHAR, status.MPI_SOURCE,
+           status.MPI_TAG, MPI_COMM_WORLD, &status2);
+
+  int32_t header[2];
+  memcpy(header, &message[0], sizeof(header));
+  SFXC_ASSERT(header[1] == size - (int)sizeof(header));
+  buffer.resize(header[0]);
+  if (header[0] == header[1]) {
+    memcpy(&buffer[0], &message[sizeof(header)], header[0]);
+    return;
+  }
+#ifdef HAVE_LIBZ
+  uLongf buffer_size = header[0];
+  if ((uncompress((Bytef *)&buffer[0], &buffer_size,
+                  (const Bytef *)&message[sizeof(header)], header[1]) != Z_OK) ||
+      (buffer_size != (uLongf)header[0]))
+    sfxc_abort("Could not uncompress an MPI message");
+#else
+  sfxc_abort("Received a compressed MPI message, but sfxc was built without zlib");
+#endif
+}
+
 void
 MPI_Transfer::
 pack(std::vector<char> &buffer, Delay_table &table, int sn[2]) {
@@ -222,29 +288,11 @@ pack(std::vector<char> &buffer, Delay_table &table, int sn[2]) {
 
 void
 MPI_Transfer::
-send(Delay_table &table, int station_nr, int rank) {
-  int sn[2] = {station_nr, -1};
-  std::vector<char> buffer;
+send(Delay_table &table, int sn[2], int rank, bool compress) {
+  std::vector<char> buffer, message;
   pack(buffer, table, sn);
-  int size = buffer.size();
-  MPI_Send(&buffer[0], size, MPI_PACKED, rank, MPI_TAG_DELAY_TABLE, MPI_COMM_WORLD);
-}
-
-void
-MPI_Transfer::
-bcast_corr_nodes(Delay_table &table, int sn[2]){
-  std::vector<char> buffer;
-  pack(buffer, table, sn);
-  int n_ranks, n_corr_nodes;
-  MPI_Comm_size(MPI_COMM_WORLD, &n_ranks);
-  MPI_Comm_size(MPI_COMM_CORR_NODES, &n_corr_nodes);
-  // NB:: MPI_COMM_CORR_NODES includes the management node
-  n_corr_nodes -= 1;
-
-  int size = buffer.size();
-  for(int rank=n_ranks-n_corr_nodes; rank<n_ranks; rank++)
-    MPI_Send(&size, 1, MPI_INT32, rank, MPI_TAG_DELAY_TABLE, MPI_COMM_WORLD);
-  MPI_Bcast(&buffer[0], size, MPI_PACKED, RANK_MANAGER_NODE, MPI_COMM_CORR_NODES);
+  pack_message(buffer, message, compress);
+  send_message(message, MPI_TAG_DELAY_TABLE, rank);
 }
 
 void
@@ -329,30 +377,9 @@ unpack(std::vector<char> &buffer, Delay_table &table, int sn[2]) {
 
 void
 MPI_Transfer::
-receive(MPI_Status &status, Delay_table &table, int &station_nr) {
-  MPI_Status status2;
-
-  int size, sn[2];
-  MPI_Get_elements(&status, MPI_CHAR, &size);
-  SFXC_ASSERT(size > 0);
-  std::vector<char> buffer(size);
-
-  MPI_Recv(&buffer[0], size, MPI_CHAR, status.MPI_SOURCE,
-           status.MPI_TAG, MPI_COMM_WORLD, &status2);
-  unpack(buffer, table, sn);
-  station_nr = sn[0];
-}
-
-void
-MPI_Transfer::
-receive_bcast(MPI_Status &status, Delay_table &table, int sn[2]) {
-  MPI_Status status2;
-
-  int size;
-  MPI_Recv(&size, 1, MPI_INT32, status.MPI_SOURCE,
-           status.MPI_TAG, MPI_COMM_WORLD, &status2);
-  std::vector<char> buffer(size);
-  MPI_Bcast(&buffer[0], size, MPI_PACKED, RANK_MANAGER_NODE, MPI_COMM_CORR_NODES);
+receive(MPI_Status &status, Delay_table &table, int sn[2]) {
+  std::vector<char> buffer;
+  receive_message(status, buffer);
   unpack(buffer, table, sn);
 }
 
@@ -407,28 +434,11 @@ pack(std::vector<char> &buffer, Uvw_model &table, int sn) {
 
 void
 MPI_Transfer::
-send(Uvw_model &table, int sn, int rank) {
-  std::vector<char> buffer;
-  pack(buffer, table, sn);
-  int size = buffer.size();
-  MPI_Send(&buffer[0], size, MPI_PACKED, rank, MPI_TAG_UVW_TABLE, MPI_COMM_WORLD);
-}
-
-void
-MPI_Transfer::
-bcast_corr_nodes(Uvw_model &table, int sn) {
-  std::vector<char> buffer;
+send(Uvw_model &table, int sn, int rank, bool compress) {
+  std::vector<char> buffer, message;
   pack(buffer, table, sn);
-  int n_ranks, n_corr_nodes;
-  MPI_Comm_size(MPI_COMM_WORLD, &n_ranks);
-  MPI_Comm_size(MPI_COMM_CORR_NODES, &n_corr_nodes);
-  // NB:: MPI_COMM_CORR_NODES includes the management node
-  n_corr_nodes -= 1;
-
-  int size = buffer.size();
-  for(int rank=n_ranks-n_corr_nodes; rank<n_ranks; rank++)
-    MPI_Send(&size, 1, MPI_INT32, rank, MPI_TAG_UVW_TABLE, MPI_COMM_WORLD);
-  MPI_Bcast(&buffer[0], size, MPI_PACKED, RANK_MANAGER_NODE, MPI_COMM_CORR_NODES);
+  pack_message(buffer, message, compress);
+  send_message(message, MPI_TAG_UVW_TABLE, rank);
 }
 
 void
@@ -500,27 +510,8 @@ unpack(std::vector<char> &buffer, Uvw_model &table, int &sn) {
 void
 MPI_Transfer::
 receive(MPI_Status &status, Uvw_model &table, int &sn) {
-  MPI_Status status2;
-
-  int size;
-  MPI_Get_elements(&status, MPI_CHAR, &size);
-  SFXC_ASSERT(size > 0);
-  std::vector<char> buffer(size);
-
-  MPI_Recv(&buffer[0], size, MPI_CHAR, status.MPI_SOURCE,
-           status.MPI_TAG, MPI_COMM_WORLD, &status2);
-  unpack(buffer, table, sn);
-}
-
-void
-MPI_Transfer::
-receive_bcast(MPI_Status &status, Uvw_model &table, int &sn) {
-  MPI_Status status2;
-  int size;
-  MPI_Recv(&size, 1, MPI_INT32, status.MPI_SOURCE,
-           status.MPI_TAG, MPI_COMM_WORLD, &status2);
-  std::vector<char> buffer(size);
-  MPI_Bcast(&buffer[0], size, MPI_PACKED, RANK_MANAGER_NODE, MPI_COMM_CORR_NODES);
+  std::vector<char> buffer;
+  receive_message(status, buffer);
   unpack(buffer, table, sn);
 }
 
@@ -852,7 +843,7 @@ void
 MPI_Transfer::send(Correlation_parameters &corr_param, int rank) {
   int size = 0;
   size =
-    5*sizeof(int64_t) + 13*sizeof(int32_t) + sizeof(int64_t) +
+    5*sizeof(int64_t) + 17*sizeof(int32_t) + sizeof(int64_t) + 2*sizeof(double) +
     3*sizeof(char) + corr_param.station_streams.size() * (6 * sizeof(int32_t) + 3 * sizeof(int64_t) + 2 * sizeof(char) + sizeof(double)) +
     11*sizeof(char);
   int position = 0;
@@ -881,6 +872,18 @@ MPI_Transfer::send(Correlation_parameters &corr_param, int rank) {
            message_buffer, size, &position, MPI_COMM_WORLD);
   MPI_Pack(&corr_param.window, 1, MPI_INT32,
            message_buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&corr_param.output_format_version, 1, MPI_INT32,
+           message_buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&corr_param.first_integration_in_block, 1, MPI_INT32,
+           message_buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&corr_param.last_integration_in_block, 1, MPI_INT32,
+           message_buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&corr_param.baseline_averaging_integrations, 1, MPI_INT32,
+           message_buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&corr_param.baseline_averaging_fov, 1, MPI_DOUBLE,
+           message_buffer, size, &position, MPI_COMM_WORLD);
+  MPI_Pack(&corr_param.baseline_averaging_smearing, 1, MPI_DOUBLE,
+           message_buffer, size, &position, MPI_COMM_WORLD);
   MPI_Pack(&corr_param.integration_nr, 1, MPI_INT32,
            message_buffer, size, &position, MPI_COMM_WORLD);
   MPI_Pack(&corr_param.slice_nr, 1, MPI_INT32,
@@ -1002,6 +1005,24 @@ MPI_Transfer::receive(MPI_Status &status, Correlation_parameters &corr_param) {
   MPI_Unpack(buffer, size, &position,
              &corr_param.window, 1, MPI_INT32,
              MPI_COMM_WORLD);
+  MPI_Unpack(buffer, size, &position,
+             &corr_param.output_format_version, 1, MPI_INT32,
+             MPI_COMM_WORLD);
+  MPI_Unpack(buffer, size, &position,
+             &corr_param.first_integration_in_block, 1, MPI_INT32,
+             MPI_COMM_WORLD);
+  MPI_Unpack(buffer, size, &position,
+             &corr_param.last_integration_in_block, 1, MPI_INT32,
+             MPI_COMM_WORLD);
+  MPI_Unpack(buffer, size, &position,
+             &corr_param.baseline_averaging_integrations, 1, MPI_INT32,
+             MPI_COMM_WORLD);
+  MPI_Unpack(buffer, size, &position,
+             &corr_param.baseline_averaging_fov, 1, MPI_DOUBLE,
+             MPI_COMM_WORLD);
+  MPI_Unpack(buffer, size, &position,
+             &corr_param.baseline_averaging_smearing, 1, MPI_DOUBLE,
+             MPI_COMM_WORLD);
   MPI_Unpack(buffer, size, &position,
              &corr_param.integration_nr, 1, MPI_INT32,
              MPI_COMM_WORLD);
@@ -11,6 +11,7 @@
 
 #include "multiple_data_writers_controller.h"
 #include "data_writer_file.h"
+#include "data_writer_async_file.h"
 #include "data_writer_tcp.h"
 #include "data_writer_socket.h"
 
@@ -197,9 +198,16 @@ Multiple_data_writers_controller::process_event(MPI_Status &status) {
       char *filename = msg + sizeof(int32_t);
       SFXC_ASSERT(status.MPI_SOURCE == status2.MPI_SOURCE);
       SFXC_ASSERT(status.MPI_TAG == status2.MPI_TAG);
-
+      // A resumed correlation appends to the file from the given size
+      int64_t file_size = -1;
+      int end = sizeof(int32_t) + strlen(filename) + 1;
+      SFXC_ASSERT(end <= size);
+      if (size == end + (int)sizeof(int64_t))
+        memcpy(&file_size, msg + end, sizeof(int64_t));
+
+      // The correlator output is written from a separate thread
       boost::shared_ptr<Data_writer>
-	writer(new Data_writer_file(filename));
+	writer(new Data_writer_async_file(filename, file_size));
       add_data_writer(stream_nr, writer);
 
       MPI_Send(&stream_nr, 1, MPI_INT32,
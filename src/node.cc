@@ -10,15 +10,21 @@
 #include <stdio.h>
 #include "node.h"
 #include "utils.h"
+#include "correlation_status.h"
+
+int64_t Node::status_interval_usec = 0;
 
 Node::Node(int rank)
-    : rank(rank), log_writer(new Log_writer_mpi(rank, 0)), assertion_raised(false) {}
+    : rank(rank), log_writer(new Log_writer_mpi(rank, 0)), assertion_raised(false),
+      last_status(0) {}
 
 Node::Node(int rank, Log_writer *writer)
-    : rank(rank), log_writer(writer), assertion_raised(false) {}
+    : rank(rank), log_writer(writer), assertion_raised(false), last_status(0) {}
 
 Node::~Node() {
   int rank = get_rank();
+  // All messages have to arrive before the log node hears that we ended
+  Log_writer_mpi::flush_and_stop();
   if (rank != RANK_LOG_NODE) {
     MPI_Send(&rank, 1, MPI_INT,
              RANK_LOG_NODE, MPI_TAG_LOG_MESSAGES_ENDED, MPI_COMM_WORLD);
@@ -65,8 +71,30 @@ void Node::terminate()
 	state_ = TERMINATED;
 }
 
+void
+Node::set_status_interval(int interval_ms) {
+  status_interval_usec = (int64_t)interval_ms * 1000;
+}
+
+void
+Node::send_status_if_due() {
+  if ((status_interval_usec <= 0) ||
+      (rank == RANK_MANAGER_NODE) || (rank == RANK_LOG_NODE))
+    return;
+  uint64_t now = telemetry_usec();
+  if (now - last_status < (uint64_t)status_interval_usec)
+    return;
+  last_status = now;
+
+  Node_status status;
+  status.measure();
+  MPI_Send(status.value, Node_status::NR_FIELDS, MPI_INT64,
+           RANK_MANAGER_NODE, MPI_TAG_NODE_STATUS, MPI_COMM_WORLD);
+}
+
 Node::MESSAGE_RESULT
 Node::check_and_process_waiting_message() {
+  send_status_if_due();
   MPI_Status status;
   int result;
   MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &result, &status);
@@ -87,6 +115,7 @@ Node::process_all_waiting_messages() {
 
 Node::MESSAGE_RESULT
 Node::check_and_process_message() {
+  send_status_if_due();
   MPI_Status status;
   MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
   MESSAGE_RESULT result = process_event(status);
@@ -102,6 +131,8 @@ Node::process_event(MPI_Status &status) {
     MPI_Recv(&msg, 1, MPI_INT32, status.MPI_SOURCE,
              status.MPI_TAG, MPI_COMM_WORLD, &status2);
     assertion_raised = (msg == 1);
+    // The manager node doesn't receive the status anymore
+    status_interval_usec = 0;
 
 		terminate();
     return MESSAGE_PROCESSED;
@@ -113,6 +144,16 @@ Node::process_event(MPI_Status &status) {
 
     get_log_writer().set_maxlevel(msg);
     return MESSAGE_PROCESSED;
+  } else if (status.MPI_TAG == MPI_TAG_STOP_NODE_STATUS) {
+    MPI_Status status2;
+    int32_t msg;
+    MPI_Recv(&msg, 1, MPI_INT32, status.MPI_SOURCE,
+             status.MPI_TAG, MPI_COMM_WORLD, &status2);
+    // The empty record is received after all records sent before it
+    status_interval_usec = 0;
+    MPI_Send(&msg, 0, MPI_INT64, status.MPI_SOURCE,
+             MPI_TAG_NODE_STATUS, MPI_COMM_WORLD);
+    return MESSAGE_PROCESSED;
   }
 
   for (Controller_iterator it = controllers.begin();
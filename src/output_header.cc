@@ -1,3 +1,8 @@
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
 #include "output_header.h"
 #include "utils.h"
 
@@ -19,6 +24,8 @@ operator<<(std::ostream &out,
   << "  \"integration_time\": " << (int)global_header.integration_time
   << "," << std::endl
   << "  \"polarisation_type\": " << (int)global_header.polarisation_type
+  << "," << std::endl
+  << "  \"output_format_version\": " << global_header.output_format_version
   << " }"
   << std::endl;
 
@@ -44,6 +51,8 @@ operator<<(std::ostream &out,
            const Output_uvw_coordinates &uvw_header) {
   out << "{ \"station_nr\": " << uvw_header.station_nr
   << "," << std::endl
+  << "  \"averaged_integrations\": " << uvw_header.averaged_integrations
+  << "," << std::endl
   << "  \"u\": " << uvw_header.u
   << "," << std::endl
   << "  \"v\": " << uvw_header.v
@@ -72,6 +81,8 @@ operator<<(std::ostream &out,
   << "\"polarisation2\": " << (int)baseline_header.polarisation2
   << "," << std::endl << "  "
   << "\"weight\": " << (int)baseline_header.weight
+  << "," << std::endl << "  "
+  << "\"scale_exponent\": " << (int)baseline_header.scale_exponent
   << " }"
   << std::endl;
 
@@ -142,3 +153,143 @@ operator==(const Output_header_baseline &h1,
           (h1.station_nr2 == h2.station_nr2) &&
           (h1.polarisation2 == h2.polarisation2));
 }
+
+// Conversion between float and IEEE half precision, rounding to nearest even
+static uint16_t
+float_to_half(float value) {
+  uint32_t f;
+  memcpy(&f, &value, sizeof(f));
+  uint32_t sign = (f >> 16) & 0x8000;
+  uint32_t abs = f & 0x7fffffff;
+  if (abs >= 0x7f800000) // Inf or NaN
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  if (abs >= 0x477ff000) // Rounds to more than 65504
+    return sign | 0x7c00;
+  if (abs < 0x38800000) {
+    // Subnormal in half precision, in units of 2^-24
+    if (abs < 0x33000000)
+      return sign;
+    uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    int shift = 126 - (abs >> 23);
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if ((rest > halfway) || ((rest == halfway) && (half & 1)))
+      half++;
+    return sign | half;
+  }
+  uint32_t half = (abs - 0x38000000) >> 13;
+  uint32_t rest = abs & 0x1fff;
+  if ((rest > 0x1000) || ((rest == 0x1000) && (half & 1)))
+    half++;
+  return sign | half;
+}
+
+static float
+half_to_float(uint16_t half) {
+  uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  if (exponent == 0) {
+    float value = ldexpf(mantissa, -24);
+    return (sign ? -value : value);
+  }
+  uint32_t f;
+  if (exponent == 31)
+    f = sign | 0x7f800000 | (mantissa << 13);
+  else
+    f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  float value;
+  memcpy(&value, &f, sizeof(value));
+  return value;
+}
+
+// Exponent that scales the largest real or imaginary part to [2^14, 2^15)
+static int8_t
+scale_exponent(const std::complex<float> *data, size_t n) {
+  float max = 0;
+  for (size_t i = 0; i < n; i++) {
+    float re = fabsf(data[i].real()), im = fabsf(data[i].imag());
+    if ((re > max) && (re <= FLT_MAX))
+      max = re;
+    if ((im > max) && (im <= FLT_MAX))
+      max = im;
+  }
+  if (max == 0)
+    return 0;
+  int exponent;
+  frexpf(max, &exponent);
+  return std::max(-128, std::min(127, exponent - 15));
+}
+
+static int16_t
+float_to_int16(float value) {
+  if (!(value == value))
+    return 0;
+  if (value >= 32767)
+    return 32767;
+  if (value <= -32767)
+    return -32767;
+  return (int16_t)lrintf(value);
+}
+
+size_t
+output_visibility_size(int32_t output_format_version) {
+  switch (output_format_version) {
+  case OUTPUT_FORMAT_VERSION_FLOAT16:
+  case OUTPUT_FORMAT_VERSION_INT16:
+    return 2 * sizeof(int16_t);
+  default:
+    return sizeof(std::complex<float>);
+  }
+}
+
+void
+encode_visibilities(int32_t output_format_version,
+                    const std::complex<float> *data, size_t n,
+                    Output_header_baseline &baseline_header, char *output) {
+  switch (output_format_version) {
+  case OUTPUT_FORMAT_VERSION_FLOAT16:
+  case OUTPUT_FORMAT_VERSION_INT16: {
+      baseline_header.scale_exponent = scale_exponent(data, n);
+      int exponent = -baseline_header.scale_exponent;
+      int16_t *out = (int16_t *)output;
+      for (size_t i = 0; i < n; i++) {
+        float re = ldexpf(data[i].real(), exponent);
+        float im = ldexpf(data[i].imag(), exponent);
+        if (output_format_version == OUTPUT_FORMAT_VERSION_FLOAT16) {
+          out[2 * i] = float_to_half(re);
+          out[2 * i + 1] = float_to_half(im);
+        } else {
+          out[2 * i] = float_to_int16(re);
+          out[2 * i + 1] = float_to_int16(im);
+        }
+      }
+      break;
+    }
+  default:
+    memcpy(output, data, n * sizeof(std::complex<float>));
+  }
+}
+
+void
+decode_visibilities(int32_t output_format_version,
+                    const Output_header_baseline &baseline_header,
+                    const char *input, size_t n, std::complex<float> *data) {
+  const int16_t *in = (const int16_t *)input;
+  int exponent = baseline_header.scale_exponent;
+  switch (output_format_version) {
+  case OUTPUT_FORMAT_VERSION_FLOAT16:
+    for (size_t i = 0; i < n; i++)
+      data[i] = std::complex<float>(ldexpf(half_to_float(in[2 * i]), exponent),
+                                    ldexpf(half_to_float(in[2 * i + 1]), exponent));
+    break;
+  case OUTPUT_FORMAT_VERSION_INT16:
+    for (size_t i = 0; i < n; i++)
+      data[i] = std::complex<float>(ldexpf(in[2 * i], exponent),
+                                    ldexpf(in[2 * i + 1], exponent));
+    break;
+  default:
+    memcpy(data, input, n * sizeof(std::complex<float>));
+  }
+}
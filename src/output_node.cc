@@ -11,14 +11,23 @@
 #include "utils.h"
 
 #include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sstream>
 
 Output_node::Output_node(int rank, int size)
     : Node(rank),
     output_node_ctrl(*this),
     data_readers_ctrl(*this),
     data_writer_ctrl(*this),
-    status(STOPPED), n_data_writers(0), output_file_index(0),
-    curr_slice(0), number_of_time_slices(-1), curr_stream(-1), current_output_file(-1) {
+    status(STOPPED), n_data_writers(0), buffered_bytes(0), spill_fd(-1),
+    spill_size(0), nr_spilled_slices(0), total_spilled_slices(0),
+    curr_slice(0), number_of_time_slices(-1),
+    record_header_index(0), record_bytes_left(0), checkpoint_fd(-1),
+    resumed_(false),
+    usage_("output") {
   initialise();
 }
 
@@ -27,8 +36,12 @@ Output_node::Output_node(int rank, Log_writer *writer, int size)
     output_node_ctrl(*this),
     data_readers_ctrl(*this),
     data_writer_ctrl(*this),
-    status(STOPPED), n_data_writers(0), output_file_index(0),
-    curr_slice(0), number_of_time_slices(-1), curr_stream(-1), current_output_file(-1) {
+    status(STOPPED), n_data_writers(0), buffered_bytes(0), spill_fd(-1),
+    spill_size(0), nr_spilled_slices(0), total_spilled_slices(0),
+    curr_slice(0), number_of_time_slices(-1),
+    record_header_index(0), record_bytes_left(0), checkpoint_fd(-1),
+    resumed_(false),
+    usage_("output") {
   initialise();
 }
 
@@ -57,7 +70,16 @@ Output_node::~Output_node() {
     // empty the input buffers to the output
     SFXC_ASSERT(status == END_NODE);
     SFXC_ASSERT(input_streams_order.empty());
+    SFXC_ASSERT(buffered_slices.empty());
   }
+  for (size_t i = 0; i < output_indices.size(); i++)
+    delete output_indices[i];
+  if (total_spilled_slices > 0)
+    LOG_MSG("Output node spilled " << total_spilled_slices << " time slices to disk");
+  if (spill_fd >= 0)
+    close(spill_fd);
+  if (checkpoint_fd >= 0)
+    close(checkpoint_fd);
 }
 
 void Output_node::terminate() {
@@ -66,75 +88,45 @@ void Output_node::terminate() {
 }
 
 void Output_node::start() {
+  input_buffer.resize(OUTPUT_NODE_READ_SIZE);
   while (status != END_NODE) {
-    switch (status) {
-
-    case STOPPED: {
-        SFXC_ASSERT(curr_stream == -1);
-        // blocking:
-        check_and_process_message();
-
-        if (curr_slice == number_of_time_slices) {
-          status = END_NODE;
-        } else if (!input_streams_order.empty()) {
-          if (input_streams_order.begin()->first == curr_slice) {
-            status = START_NEW_SLICE;
-          }
-        }
-        break;
-      }
-    case START_NEW_SLICE: {
-        SFXC_ASSERT(curr_stream == -1);
-
-        SFXC_ASSERT(!input_streams_order.empty());
-        SFXC_ASSERT(input_streams_order.begin()->first == curr_slice);
-        curr_stream = input_streams_order.begin()->second;
-        SFXC_ASSERT(curr_stream >= 0);
-        input_streams_order.erase(input_streams_order.begin());
-        input_streams[curr_stream]->goto_next_slice(curr_slice_size, number_of_bins);
-        total_bytes_written = 0;
-        if(input_buffer.size()<curr_slice_size)
-          input_buffer.resize(curr_slice_size);
-        status = WRITE_OUTPUT;
-        break;
-      }
-    case WRITE_OUTPUT: {
-        process_all_waiting_messages();
-
-        int bytes_read = input_streams[curr_stream]->read_bytes(input_buffer);
-        if (bytes_read<=0) {
-          usleep(100);
-        }else{
-          write_output(bytes_read);
-          total_bytes_written+=bytes_read;
-       }
-
-        // Check whether we arrived at the end of the slice
-        if (input_streams[curr_stream]->end_of_slice()) {
-          status = END_SLICE;
-          break;
-        }
+    if (curr_slice == number_of_time_slices) {
+      status = END_NODE;
+      break;
+    }
 
-        break;
-      }
-    case END_SLICE: {
-        curr_stream = -1;
-        curr_slice ++;
-        if (curr_slice == number_of_time_slices) {
-          status = END_NODE;
-        } else if (input_streams_order.empty()) {
-          status = STOPPED;
-        } else if (input_streams_order.begin()->first != curr_slice) {
-          status = STOPPED;
-        } else {
-          status = START_NEW_SLICE;
-        }
-        break;
-      }
-    case END_NODE: {
-        // For completeness sake
-        break;
-      }
+    // Receive from all correlator nodes at the same time, so that a slow
+    // node doesn't block the nodes that finished later time slices
+    bool receiving = false;
+    for (size_t i = 0; i < input_streams.size(); i++) {
+      if ((input_streams[i] != NULL) && !input_streams[i]->active &&
+          input_streams[i]->has_next_slice())
+        start_slice(i);
+      receiving |= ((input_streams[i] != NULL) && input_streams[i]->active);
+    }
+    status = (receiving ? WRITE_OUTPUT : STOPPED);
+
+    if (status == STOPPED) {
+      // blocking:
+      check_and_process_message();
+      usage_.idle();
+      continue;
+    }
+
+    process_all_waiting_messages();
+    if (status == END_NODE)
+      break;
+    bool progress = false;
+    for (size_t i = 0; i < input_streams.size(); i++) {
+      if ((input_streams[i] != NULL) && input_streams[i]->active)
+        progress |= receive_slice_data(i);
+    }
+    progress |= write_buffered_slices();
+    if (progress) {
+      usage_.busy();
+    } else {
+      usleep(100);
+      usage_.idle();
     }
   }
 
@@ -148,12 +140,342 @@ void Output_node::start() {
            RANK_MANAGER_NODE, MPI_TAG_OUTPUT_NODE_FINISHED, MPI_COMM_WORLD);
 }
 
+void
+Output_node::start_slice(int stream) {
+  Input_stream &input = *input_streams[stream];
+  input.goto_next_slice(input.current);
+  input.active = true;
+
+  // The next slice in the output is written while it is received,
+  // other slices are buffered until it is their turn
+  input.direct = (input.current.weight == curr_slice);
+  if (input.direct) {
+    curr_slice_size = input.current.nBytes;
+    number_of_bins = input.current.nBins;
+    total_bytes_written = 0;
+    return;
+  }
+
+  Buffered_slice *slice = new Buffered_slice();
+  slice->nBytes = input.current.nBytes;
+  slice->nBins = input.current.nBins;
+  slice->bytes_received = 0;
+  slice->spill_offset = -1;
+  if (buffered_bytes + slice->nBytes <= OUTPUT_NODE_REORDER_BUFFER_SIZE) {
+    slice->data.resize(slice->nBytes);
+    buffered_bytes += slice->nBytes;
+  } else {
+    if (spill_fd < 0) {
+      const char *tmpdir = getenv("TMPDIR");
+      std::string filename = std::string(tmpdir != NULL ? tmpdir : "/tmp") +
+                             "/sfxc_output_XXXXXX";
+      spill_fd = mkstemp(&filename[0]);
+      if (spill_fd < 0) {
+        LOG_MSG_ERR("Cannot create " << filename << ": " << strerror(errno));
+        sfxc_abort("Could not create a file for the reorder buffer");
+      }
+      // The file is removed when it is closed
+      unlink(filename.c_str());
+    }
+    if (total_spilled_slices == 0)
+      LOG_MSG("Reorder buffer of the output node is full, spilling time slices to disk");
+    slice->spill_offset = spill_size;
+    spill_size += slice->nBytes;
+    nr_spilled_slices++;
+    total_spilled_slices++;
+  }
+  SFXC_ASSERT(buffered_slices.find(input.current.weight) == buffered_slices.end());
+  buffered_slices[input.current.weight] = slice;
+}
+
+bool
+Output_node::receive_slice_data(int stream) {
+  Input_stream &input = *input_streams[stream];
+  SFXC_ASSERT(input.active);
+  // A correlator node that sends slowly must not hold up the others
+  if (!input.end_of_slice() && !input.can_read())
+    return false;
+  int bytes_read;
+  if (input.direct) {
+    bytes_read = input.read_bytes(&input_buffer[0], input_buffer.size());
+    if (bytes_read > 0) {
+      write_output(&input_buffer[0], bytes_read);
+      total_bytes_written += bytes_read;
+    }
+  } else {
+    Buffered_slice &slice = *buffered_slices[input.current.weight];
+    if (slice.spill_offset < 0) {
+      bytes_read = input.read_bytes(&slice.data[slice.bytes_received],
+                                    slice.nBytes - slice.bytes_received);
+    } else {
+      bytes_read = input.read_bytes(&input_buffer[0], input_buffer.size());
+      if (bytes_read > 0)
+        spill(slice, &input_buffer[0], slice.bytes_received, bytes_read);
+    }
+    if (bytes_read > 0)
+      slice.bytes_received += bytes_read;
+  }
+
+  if (input.end_of_slice()) {
+    input.active = false;
+    if (input.direct) {
+      SFXC_ASSERT(total_bytes_written == curr_slice_size);
+      end_slice();
+    }
+  }
+  return (bytes_read > 0);
+}
+
+bool
+Output_node::write_buffered_slices() {
+  bool written = false;
+  Buffered_slice_map::iterator it = buffered_slices.begin();
+  while ((it != buffered_slices.end()) && (it->first == curr_slice) &&
+         (it->second->bytes_received == it->second->nBytes)) {
+    Buffered_slice *slice = it->second;
+    curr_slice_size = slice->nBytes;
+    number_of_bins = slice->nBins;
+    total_bytes_written = 0;
+    while (total_bytes_written < slice->nBytes) {
+      int nbytes = std::min((int64_t)input_buffer.size(),
+                            slice->nBytes - total_bytes_written);
+      if (slice->spill_offset < 0) {
+        write_output(&slice->data[total_bytes_written], nbytes);
+      } else {
+        unspill(*slice, &input_buffer[0], total_bytes_written, nbytes);
+        write_output(&input_buffer[0], nbytes);
+      }
+      total_bytes_written += nbytes;
+    }
+
+    if (slice->spill_offset < 0) {
+      buffered_bytes -= slice->nBytes;
+    } else {
+      nr_spilled_slices--;
+      if (nr_spilled_slices == 0) {
+        // Reuse the spill file from the start
+        spill_size = 0;
+        if (ftruncate(spill_fd, 0) != 0)
+          LOG_MSG_ERR("Cannot truncate the spill file: " << strerror(errno));
+      }
+    }
+    delete slice;
+    buffered_slices.erase(it);
+    end_slice();
+    written = true;
+    it = buffered_slices.begin();
+  }
+  return written;
+}
+
+void
+Output_node::end_slice() {
+  SFXC_ASSERT(!input_streams_order.empty());
+  SFXC_ASSERT(input_streams_order.begin()->first == curr_slice);
+  input_streams_order.erase(input_streams_order.begin());
+  curr_slice++;
+  if (checkpoint_fd >= 0) {
+    slice_start_sizes = output_file_sizes;
+    write_checkpoint();
+  }
+
+  // The next slice might be in the process of being received
+  for (size_t i = 0; i < input_streams.size(); i++) {
+    Input_stream *input = input_streams[i];
+    if ((input != NULL) && input->active && !input->direct &&
+        (input->current.weight == curr_slice)) {
+      Buffered_slice_map::iterator it = buffered_slices.find(curr_slice);
+      SFXC_ASSERT(it != buffered_slices.end());
+      Buffered_slice *slice = it->second;
+      if (slice->spill_offset >= 0)
+        break;
+      // Write the part that is already received and continue directly
+      curr_slice_size = slice->nBytes;
+      number_of_bins = slice->nBins;
+      total_bytes_written = 0;
+      if (slice->bytes_received > 0)
+        write_output(&slice->data[0], slice->bytes_received);
+      total_bytes_written = slice->bytes_received;
+      buffered_bytes -= slice->nBytes;
+      delete slice;
+      buffered_slices.erase(it);
+      input->direct = true;
+      break;
+    }
+  }
+}
+
+void
+Output_node::spill(Buffered_slice &slice, const char *buffer, int64_t offset,
+                   size_t nBytes) {
+  ssize_t result = pwrite(spill_fd, buffer, nBytes, slice.spill_offset + offset);
+  if (result != (ssize_t)nBytes) {
+    LOG_MSG_ERR("Cannot write to the spill file: " << strerror(errno));
+    sfxc_abort("Could not spill a time slice to disk");
+  }
+}
+
+void
+Output_node::unspill(const Buffered_slice &slice, char *buffer, int64_t offset,
+                     size_t nBytes) {
+  ssize_t result = pread(spill_fd, buffer, nBytes, slice.spill_offset + offset);
+  if (result != (ssize_t)nBytes) {
+    LOG_MSG_ERR("Cannot read from the spill file: " << strerror(errno));
+    sfxc_abort("Could not read a time slice from disk");
+  }
+}
+
 void
 Output_node::
 write_global_header(const Output_header_global &global_header) {
   int nbytes = sizeof(Output_header_global);
-  for(int i=0;i<n_data_writers;i++)
-    data_writer_ctrl.get_data_writer(i)->put_bytes(nbytes, (char *)&global_header);
+  for(int i=0;i<n_data_writers;i++){
+    // Averaged output files have fewer channels and a longer integration time
+    Output_header_global header = global_header;
+    std::map<int, std::pair<int32_t, int32_t> >::iterator it =
+      output_averaging.find(i);
+    if (it != output_averaging.end()) {
+      header.number_channels /= it->second.first;
+      header.integration_time *= it->second.second;
+    }
+    data_writer_ctrl.get_data_writer(i)->put_bytes(nbytes, (char *)&header);
+    if ((i < (int)output_indices.size()) && (output_indices[i] != NULL))
+      output_indices[i]->add_data((char *)&header, nbytes);
+    output_file_sizes[i] += nbytes;
+  }
+  slice_start_sizes = output_file_sizes;
+}
+
+void
+Output_node::set_output_averaging(int stream, int32_t channels,
+                                  int32_t integrations) {
+  SFXC_ASSERT((stream >= 0) && (channels >= 1) && (integrations >= 1));
+  output_averaging[stream] = std::make_pair(channels, integrations);
+}
+
+int64_t
+Output_node::set_checkpoint_file(const char *filename,
+                                 const std::string &description, bool resume,
+                                 std::vector<int64_t> &sizes) {
+  SFXC_ASSERT(checkpoint_fd < 0);
+  int64_t integration_slice = -1;
+  sizes.clear();
+  if (resume) {
+    // Find the last complete checkpoint, the correlation might have
+    // stopped while it was written
+    Checkpoint_file checkpoint;
+    switch (checkpoint.read(filename, description)) {
+    case Checkpoint_file::MISSING:
+      LOG_MSG("No checkpoint " << filename << ", starting from the beginning");
+      break;
+    case Checkpoint_file::DIFFERENT:
+      LOG_MSG_ERR("Checkpoint " << filename << " is of a different correlation: "
+                  << checkpoint.description());
+      sfxc_abort("Could not resume the correlation");
+      break;
+    case Checkpoint_file::EMPTY:
+      break;
+    case Checkpoint_file::FOUND: {
+      // integration slice, its start time, output file sizes
+      const std::vector<int64_t> &record = checkpoint.record();
+      if ((record.size() < 3) || (record[0] < 0)) {
+        LOG_MSG_ERR("Invalid checkpoint in " << filename);
+        sfxc_abort("Could not resume the correlation");
+      }
+      integration_slice = record[0];
+      resumed_time_.set_clock_ticks(record[1]);
+      sizes.assign(record.begin() + 2, record.end());
+      break;
+    }
+    }
+    if (integration_slice >= 0) {
+      checkpoint_fd = open(filename, O_WRONLY | O_APPEND);
+      if ((checkpoint_fd >= 0) && (ftruncate(checkpoint_fd, checkpoint.valid_size()) != 0)) {
+        close(checkpoint_fd);
+        checkpoint_fd = -1;
+      }
+    }
+  }
+
+  if (integration_slice < 0) {
+    checkpoint_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    std::string line = description + "\n";
+    if ((checkpoint_fd >= 0) &&
+        (write(checkpoint_fd, line.c_str(), line.size()) != (ssize_t)line.size())) {
+      close(checkpoint_fd);
+      checkpoint_fd = -1;
+    }
+  }
+  if (checkpoint_fd < 0) {
+    LOG_MSG_ERR("Cannot write checkpoint " << filename << ": " << strerror(errno));
+    sfxc_abort("Could not create the checkpoint file");
+  }
+
+  resumed_ = (integration_slice >= 0);
+  output_file_sizes = sizes;
+  slice_start_sizes = sizes;
+  return integration_slice;
+}
+
+void
+Output_node::add_checkpoint_mark(int32_t slice, int32_t integration_slice, int64_t time) {
+  SFXC_ASSERT(checkpoint_fd >= 0);
+  Checkpoint_mark mark = {slice, integration_slice, time};
+  checkpoint_marks.push(mark);
+  write_checkpoint();
+}
+
+void
+Output_node::write_checkpoint() {
+  // The data of curr_slice might already be partly written, so a
+  // checkpoint can only be written for a mark at curr_slice
+  while (!checkpoint_marks.empty() && (checkpoint_marks.front().slice < curr_slice))
+    checkpoint_marks.pop();
+  if (checkpoint_marks.empty() || (checkpoint_marks.front().slice > curr_slice))
+    return;
+  const Checkpoint_mark mark = checkpoint_marks.front();
+  int32_t integration_slice = mark.integration_slice;
+  checkpoint_marks.pop();
+
+  // The output files hold at least slice_start_sizes bytes after the sync
+  for (int i = 0; i < n_data_writers; i++) {
+    if (!data_writer_ctrl.get_data_writer(i)->sync()) {
+      LOG_MSG_ERR("Output file " << i << " is not on disk, no checkpoint at integration "
+                  << integration_slice);
+      return;
+    }
+  }
+  // The phase-cal and Tsys records arrive separately from the output, a
+  // resumed correlation keeps the ones before the time of the checkpoint
+  // and writes the others again. The sync keeps the ones that arrived.
+  if (!output_node_ctrl.sync_files()) {
+    LOG_MSG_ERR("Phase-cal or Tsys file is not on disk, no checkpoint at integration "
+                << integration_slice);
+    return;
+  }
+  std::ostringstream record;
+  record << integration_slice << " " << mark.time;
+  for (size_t i = 0; i < slice_start_sizes.size(); i++)
+    record << " " << slice_start_sizes[i];
+  record << "\n";
+  const std::string &line = record.str();
+  if ((write(checkpoint_fd, line.c_str(), line.size()) != (ssize_t)line.size()) ||
+      (fdatasync(checkpoint_fd) != 0))
+    LOG_MSG_ERR("Cannot write the checkpoint: " << strerror(errno));
+}
+
+void
+Output_node::set_index_file(int stream, const char *filename) {
+  SFXC_ASSERT(stream >= 0);
+  if (output_indices.size() <= (size_t)stream)
+    output_indices.resize(stream + 1, NULL);
+  SFXC_ASSERT(output_indices[stream] == NULL);
+  output_indices[stream] = new Cor_index_writer();
+  if (!output_indices[stream]->open(filename)) {
+    LOG_MSG_ERR("Cannot create index file " << filename << ": " << strerror(errno));
+    delete output_indices[stream];
+    output_indices[stream] = NULL;
+  }
 }
 
 void
@@ -165,49 +487,51 @@ set_weight_of_input_stream(int stream, int64_t weight, size_t size, int nbins) {
   // Check that the weight does not exist yet:
   SFXC_ASSERT(input_streams_order.find(weight) == input_streams_order.end());
   // Check that the ordering is right (not before the current element):
-  if (!input_streams_order.empty()) {
-    SFXC_ASSERT(weight >= curr_slice);
-  }
+  SFXC_ASSERT(weight >= curr_slice);
 
   // Add the weight to the priority queue:
   input_streams_order.insert(Input_stream_priority_map_value(weight,stream));
 
-  // Add the weight to the priority queue:
-  input_streams[stream]->set_length_time_slice(size, nbins);
+  // Add the slice to the input stream, it is received when the stream
+  // finished its previous slices:
+  input_streams[stream]->set_length_time_slice(weight, size, nbins);
 
   SFXC_ASSERT(status != END_NODE);
 }
 
-bool Output_node::write_output(int nBytes) {
+bool Output_node::write_output(const char *buffer, int nBytes) {
   if (nBytes <= 0)
     return false;
 
-  SFXC_ASSERT(curr_stream >= 0);
-  SFXC_ASSERT(input_streams[curr_stream] != NULL);
-
-  int nbytes_per_file = curr_slice_size/number_of_bins; 
   int bytes_written=0;
-  int index_in_file = total_bytes_written%nbytes_per_file;
   while(bytes_written<nBytes){
-    // Get index of next output file
-    if(output_file_index < 4){
-      char *current_output_file_ptr = (char *)&current_output_file;
-      int to_read = std::min(4 - output_file_index, nBytes - bytes_written);
-      memcpy(&current_output_file_ptr[output_file_index], &input_buffer[bytes_written], to_read);
-      output_file_index += to_read;
+    // Get the output file and size of the next record
+    if(record_header_index < (int)sizeof(record_header)){
+      char *record_header_ptr = (char *)&record_header[0];
+      int to_read = std::min((int)sizeof(record_header) - record_header_index,
+                             nBytes - bytes_written);
+      memcpy(&record_header_ptr[record_header_index], &buffer[bytes_written], to_read);
+      record_header_index += to_read;
       bytes_written += to_read;
-      index_in_file += to_read;
+      if (record_header_index < (int)sizeof(record_header))
+        continue;
+      record_bytes_left = record_header[1];
+      SFXC_ASSERT(record_bytes_left >= 0);
     }
-    // Write the data
-    int to_write = std::min(nbytes_per_file-index_in_file, nBytes-bytes_written);
-//    std::cout << "current_output_file = " << current_output_file <<"\n";
-    data_writer_ctrl.get_data_writer(current_output_file)->put_bytes(to_write, &input_buffer[bytes_written]);
-    bytes_written += to_write;
-    index_in_file += to_write;
-    if(index_in_file >= nbytes_per_file){
-      output_file_index = 0;
-      index_in_file=0;
+    // Write the data, a record is empty while the output is averaged
+    int current_output_file = record_header[0];
+    int to_write = std::min((int)record_bytes_left, nBytes-bytes_written);
+    if (to_write > 0) {
+      data_writer_ctrl.get_data_writer(current_output_file)->put_bytes(to_write, &buffer[bytes_written]);
+      output_file_sizes[current_output_file] += to_write;
+      if ((current_output_file < (int)output_indices.size()) &&
+          (output_indices[current_output_file] != NULL))
+        output_indices[current_output_file]->add_data(&buffer[bytes_written], to_write);
     }
+    bytes_written += to_write;
+    record_bytes_left -= to_write;
+    if(record_bytes_left == 0)
+      record_header_index = 0;
   }
   SFXC_ASSERT(bytes_written==nBytes);
   return true;
@@ -224,10 +548,17 @@ void Output_node::hook_added_data_reader(size_t reader) {
 
   input_streams[reader] =
     new Input_stream(data_readers_ctrl.get_data_reader(reader));
+  data_readers_ctrl.get_data_reader(reader)->set_name("correlator" + itoa(reader));
 }
 
 void Output_node::hook_added_data_writer(size_t writer) {
   n_data_writers++;
+  // A resumed output file starts at its checkpoint
+  if (output_file_sizes.size() <= writer) {
+    output_file_sizes.resize(writer + 1, 0);
+    slice_start_sizes.resize(writer + 1, 0);
+  }
+  data_writer_ctrl.get_data_writer(writer)->set_name("output" + itoa(writer));
 }
 
 void
@@ -241,16 +572,17 @@ Output_node::set_number_of_time_slices(int n_time_slices) {
  */
 
 Output_node::Input_stream::Input_stream(boost::shared_ptr<Data_reader> reader)
-    : reader(reader) {
+    : active(false), direct(false), reader(reader) {
   reader->set_size_dataslice(0);
 }
 
 int
-Output_node::Input_stream::read_bytes(std::vector<char> &buffer) {
+Output_node::Input_stream::read_bytes(char *buffer, size_t nBytes) {
   SFXC_ASSERT(reader != boost::shared_ptr<Data_reader>());
-  size_t nBytes = std::min(buffer.size(),
-                           (size_t)reader->get_size_dataslice());
-  return reader->get_bytes(nBytes, &buffer[0]);
+  nBytes = std::min(nBytes, (size_t)reader->get_size_dataslice());
+  if (nBytes == 0)
+    return 0;
+  return reader->get_bytes(nBytes, buffer);
 }
 
 
@@ -259,21 +591,30 @@ Output_node::Input_stream::end_of_slice() {
   return reader->end_of_dataslice();
 }
 
+bool
+Output_node::Input_stream::can_read() {
+  return reader->can_read();
+}
+
 void
-Output_node::Input_stream::set_length_time_slice(int64_t nBytes, int nBins) {
-  Slice new_slice={nBytes,nBins};
+Output_node::Input_stream::set_length_time_slice(int64_t weight, int64_t nBytes, int nBins) {
+  Slice new_slice={weight,nBytes,nBins};
   slice_size.push(new_slice);
 }
 
+bool
+Output_node::Input_stream::has_next_slice() {
+  return !slice_size.empty();
+}
+
 void
-Output_node::Input_stream::goto_next_slice(int &new_slice_size, int &new_nbins) {
+Output_node::Input_stream::goto_next_slice(Slice &new_slice) {
   SFXC_ASSERT(!slice_size.empty());
   SFXC_ASSERT(slice_size.front().nBytes > 0);
   SFXC_ASSERT(slice_size.front().nBins > 0);
   SFXC_ASSERT(reader->end_of_dataslice());
-  new_slice_size = slice_size.front().nBytes;
-  new_nbins = slice_size.front().nBins;
-  reader->set_size_dataslice(new_slice_size);
+  new_slice = slice_size.front();
+  reader->set_size_dataslice(new_slice.nBytes);
 
   SFXC_ASSERT(reader->get_size_dataslice() > 0);
   slice_size.pop();
@@ -17,8 +17,40 @@
 #include "correlator_time.h"
 
 #include <iostream>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 
+// Size of the phase-cal record at data, the record starts with the
+// station, frequency, sideband, polarisation, mjd, seconds, integration
+// time and the number of samples
+static size_t phasecal_record_size(const char *data, size_t len) {
+  const size_t size = 4 * sizeof(uint8_t) + 4 * sizeof(uint32_t);
+  if (len < size)
+    return 0;
+  uint32_t num_samples;
+  memcpy(&num_samples, data + size - sizeof(uint32_t), sizeof(uint32_t));
+  if ((len - size) / sizeof(int32_t) < num_samples)
+    return 0;
+  return size + num_samples * sizeof(int32_t);
+}
+
+// Size of the Tsys record at data, the same fields as a phase-cal record
+// up to the seconds, followed by four 64 bit values
+static size_t tsys_record_size(const char * /*data*/, size_t len) {
+  const size_t size = 4 * sizeof(uint8_t) + 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t);
+  return (len < size ? 0 : size);
+}
+
+// Start of a phase-cal or Tsys record in seconds
+static int64_t record_time(const char *record) {
+  uint32_t mjd, secs;
+  memcpy(&mjd, record + 4 * sizeof(uint8_t), sizeof(mjd));
+  memcpy(&secs, record + 4 * sizeof(uint8_t) + sizeof(mjd), sizeof(secs));
+  return (int64_t)mjd * SECONDS_PER_DAY + secs;
+}
+
 Output_node_controller::Output_node_controller(Output_node &node)
   : Controller(node), node(node)
 {
@@ -41,8 +73,8 @@ Output_node_controller::process_event(MPI_Status &status) {
       phasecal_header.header_size = sizeof(phasecal_header);
       memcpy(&phasecal_header.experiment, global_header.experiment,
 	     sizeof(phasecal_header.experiment));
-      phasecal_header.output_format_version =
-	global_header.output_format_version;
+      // The visibility type doesn't apply to the phase-cal file
+      phasecal_header.output_format_version = OUTPUT_FORMAT_VERSION;
       phasecal_header.correlator_version = global_header.correlator_version;
       memcpy(&phasecal_header.correlator_branch,
 	     global_header.correlator_branch,
@@ -56,8 +88,7 @@ Output_node_controller::process_event(MPI_Status &status) {
 	tsys_header.header_size = sizeof(tsys_header);
 	memcpy(&tsys_header.experiment, global_header.experiment,
 	       sizeof(tsys_header.experiment));
-	tsys_header.output_format_version =
-	  global_header.output_format_version;
+	tsys_header.output_format_version = OUTPUT_FORMAT_VERSION;
 	tsys_header.correlator_version = global_header.correlator_version;
 	memcpy(&tsys_header.correlator_branch,
 	       global_header.correlator_branch,
@@ -103,7 +134,8 @@ Output_node_controller::process_event(MPI_Status &status) {
 	       status.MPI_TAG, MPI_COMM_WORLD, &status2);
       SFXC_ASSERT(filename[len - 1] == 0);
       SFXC_ASSERT(strncmp(filename, "file://", 7) == 0);
-      phasecal_file.open(filename + 7, std::ios::out | std::ios::trunc | std::ios::binary);
+      open_file(phasecal_file, phasecal_filename, filename + 7,
+                phasecal_record_size, sizeof(Output_header_phasecal));
 
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
@@ -152,6 +184,70 @@ Output_node_controller::process_event(MPI_Status &status) {
       phasecal_file.write((char *)&num_samples, sizeof(num_samples));
       phasecal_file.write((char *)&samples[0], num_samples * sizeof(samples[0]));
 
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
+  case MPI_TAG_OUTPUT_NODE_SET_INDEX_FILE: {
+      get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
+      int len;
+      MPI_Get_elements(&status, MPI_CHAR, &len);
+      SFXC_ASSERT(len > (int)sizeof(int32_t));
+
+      char msg[len];
+      MPI_Recv(&msg, len, MPI_CHAR, status.MPI_SOURCE,
+	       status.MPI_TAG, MPI_COMM_WORLD, &status2);
+      SFXC_ASSERT(msg[len - 1] == 0);
+      int32_t stream_nr;
+      memcpy(&stream_nr, msg, sizeof(int32_t));
+      char *filename = msg + sizeof(int32_t);
+      SFXC_ASSERT(strncmp(filename, "file://", 7) == 0);
+      node.set_index_file(stream_nr, filename + 7);
+
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
+  case MPI_TAG_SET_OUTPUT_AVERAGING: {
+      get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
+      int32_t msg[3];
+      MPI_Recv(msg, 3, MPI_INT32, status.MPI_SOURCE,
+               status.MPI_TAG, MPI_COMM_WORLD, &status2);
+      node.set_output_averaging(msg[0], msg[1], msg[2]);
+
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
+  case MPI_TAG_OUTPUT_NODE_SET_CHECKPOINT_FILE: {
+      get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
+      int len;
+      MPI_Get_elements(&status, MPI_CHAR, &len);
+      SFXC_ASSERT(len > (int)sizeof(int32_t));
+
+      char msg[len];
+      MPI_Recv(&msg, len, MPI_CHAR, status.MPI_SOURCE,
+	       status.MPI_TAG, MPI_COMM_WORLD, &status2);
+      SFXC_ASSERT(msg[len - 1] == 0);
+      int32_t resume;
+      memcpy(&resume, msg, sizeof(int32_t));
+      char *description = msg + sizeof(int32_t);
+      char *filename = description + strlen(description) + 1;
+      SFXC_ASSERT(filename < msg + len);
+      SFXC_ASSERT(strncmp(filename, "file://", 7) == 0);
+
+      // Reply with the integration slice and the sizes of the output files
+      std::vector<int64_t> sizes;
+      std::vector<int64_t> checkpoint(1);
+      checkpoint[0] = node.set_checkpoint_file(filename + 7, description,
+                                               resume != 0, sizes);
+      checkpoint.insert(checkpoint.end(), sizes.begin(), sizes.end());
+      MPI_Send(&checkpoint[0], checkpoint.size(), MPI_INT64, status.MPI_SOURCE,
+               MPI_TAG_OUTPUT_NODE_CHECKPOINT, MPI_COMM_WORLD);
+
+      return PROCESS_EVENT_STATUS_SUCCEEDED;
+    }
+  case MPI_TAG_OUTPUT_NODE_CHECKPOINT_MARK: {
+      get_log_writer()(3) << print_MPI_TAG(status.MPI_TAG) << std::endl;
+      int64_t msg[3];
+      MPI_Recv(msg, 3, MPI_INT64, status.MPI_SOURCE,
+               status.MPI_TAG, MPI_COMM_WORLD, &status2);
+      node.add_checkpoint_mark(msg[0], msg[1], msg[2]);
+
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
   case MPI_TAG_OUTPUT_NODE_SET_TSYS_FILE: {
@@ -164,7 +260,8 @@ Output_node_controller::process_event(MPI_Status &status) {
 	       status.MPI_TAG, MPI_COMM_WORLD, &status2);
       SFXC_ASSERT(filename[len - 1] == 0);
       SFXC_ASSERT(strncmp(filename, "file://", 7) == 0);
-      tsys_file.open(filename + 7, std::ios::out | std::ios::trunc | std::ios::binary);
+      open_file(tsys_file, tsys_filename, filename + 7,
+                tsys_record_size, sizeof(Output_header_tsys));
 
       return PROCESS_EVENT_STATUS_SUCCEEDED;
     }
@@ -208,3 +305,45 @@ Output_node_controller::process_event(MPI_Status &status) {
   }
   return PROCESS_EVENT_STATUS_UNKNOWN;
 }
+
+void
+Output_node_controller::open_file(std::ofstream &file, std::string &name, const char *filename,
+                                  Checkpoint_file::Record_size record_size, size_t header_size) {
+  name = filename;
+  if (!node.resumed()) {
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    return;
+  }
+  // The records are not in the order of their time, records after the
+  // checkpoint can be in the file before records that arrived late. The
+  // records are stamped in whole seconds, the checkpoints of a correlation
+  // with phase-cal or Tsys records are at whole seconds.
+  const Time &time = node.resumed_time();
+  int64_t seconds = (int64_t)time.get_mjd() * SECONDS_PER_DAY + (int64_t)ceil(time.get_time());
+  if (!Checkpoint_file::resume_records(filename, header_size, record_size,
+                                       record_time, seconds)) {
+    LOG_MSG_ERR("Cannot resume " << filename);
+    sfxc_abort("Could not resume the correlation");
+  }
+  file.open(filename, std::ios::out | std::ios::binary | std::ios::app);
+}
+
+bool
+Output_node_controller::sync_files() {
+  std::ofstream *files[] = {&phasecal_file, &tsys_file};
+  const std::string *names[] = {&phasecal_filename, &tsys_filename};
+  for (int i = 0; i < 2; i++) {
+    if (!files[i]->is_open())
+      continue;
+    if (!files[i]->flush())
+      return false;
+    int fd = open(names[i]->c_str(), O_WRONLY);
+    if (fd < 0)
+      return false;
+    bool ok = (fdatasync(fd) == 0);
+    close(fd);
+    if (!ok)
+      return false;
+  }
+  return true;
+}
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
 
 #include "types.h"
 #include "input_node.h"
@@ -33,6 +34,7 @@
 #include "data_reader_file.h"
 #include "data_reader_tcp.h"
 #include "utils.h"
+#include "telemetry.h"
 
 #include "manager_node.h"
 
@@ -120,14 +122,23 @@ int main(int argc, char *argv[]) {
   park_miller_set_seed(RANK_OF_NODE+1);
 
   char *ctrl_file, *vex_file;
-  if ( argc == 3 ){
-    ctrl_file = argv[1];
-    vex_file = argv[2];
+  // With --resume the correlation continues at the last checkpoint of
+  // the output files
+  bool resume = false;
+  int arg = 1;
+  if ((argc > 1) &&
+      ((strcmp(argv[1], "-r") == 0) || (strcmp(argv[1], "--resume") == 0))) {
+    resume = true;
+    arg++;
+  }
+  if ( argc == arg + 2 ){
+    ctrl_file = argv[arg];
+    vex_file = argv[arg + 1];
   }
   else{
     if ( RANK_OF_NODE == 0 ) {
       std::cerr << "ERROR: invalid number of parameter." << std::endl;
-      std::cerr << "usage: sfxc <controlfile> <vexfile>" << std::endl;
+      std::cerr << "usage: sfxc [-r|--resume] <controlfile> <vexfile>" << std::endl;
     }
     MPI_Abort(MPI_COMM_WORLD, stat);
   }
@@ -152,6 +163,11 @@ int main(int argc, char *argv[]) {
       // collective communications. Note that ALL mpi processes must create 
       // the communicator not only the correlator nodes.
       create_correlator_node_comm(nr_corr_nodes);
+      start_telemetry(control_parameters.telemetry(),
+                      control_parameters.telemetry_prometheus(),
+                      control_parameters.telemetry_interval_ms(),
+                      (control_parameters.status().empty() ? 0 :
+                       control_parameters.status_interval_ms()));
 
       if (PRINT_PID) {
         DEBUG_MSG("Manager node, pid = " << getpid());
@@ -160,7 +176,8 @@ int main(int argc, char *argv[]) {
         DEBUG_MSG("Manager node, hostname = " << HOSTNAME_OF_NODE);
       }
       ID_OF_NODE = "Managernode";
-      Manager_node node(RANK_OF_NODE, numtasks, &log_writer, control_parameters);
+      Manager_node node(RANK_OF_NODE, numtasks, &log_writer, control_parameters,
+                        resume);
       node.start();
     }
   } else {
@@ -172,11 +189,15 @@ int main(int argc, char *argv[]) {
       // collective communications. Note that ALL mpi processes must create 
       // the communicator not only the correlator nodes.
       create_correlator_node_comm(nr_corr_nodes);
- 
+      start_telemetry(std::string(), false, 0, 0);
+
       start_node();
     }
   }
 
+  Telemetry::stop();
+  Log_writer_mpi::flush_and_stop();
+
   //close the mpi stuff
   MPI_Barrier( MPI_COMM_WORLD );
   MPI_Finalize();
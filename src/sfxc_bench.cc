@@ -0,0 +1,716 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - sfxc_bench, which runs the stages of the correlator data path on
+ *       synthetic data and reports their throughput.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <set>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <json/json.h>
+
+#include "utils.h"
+#include "control_parameters.h"
+#include "delay_table_akima.h"
+#include "delay_file.h"
+#include "channel_extractor_5.h"
+#include "channel_extractor_dynamic.h"
+#include "bit2float_worker.h"
+#include "delay_correction.h"
+#include "correlation_core.h"
+#include "correlation_core_pulsar.h"
+#include "data_writer.h"
+
+// Start of the synthetic scan
+#define BENCH_MJD             56000
+#define BENCH_SCAN_START      3600
+// Seconds of delay model before and after the correlated data
+#define BENCH_SCAN_MARGIN     10
+// Size of the channel extractor input, as in one Mark5A frame with 32 tracks
+#define BENCH_EXTRACTOR_WORD  4
+#define BENCH_EXTRACTOR_BLOCK 20000
+// Size of the circular input buffer of the bit2float conversion
+#define BENCH_BIT2FLOAT_INPUT (1 << 20)
+
+typedef Correlator_node_types Types;
+
+struct Bench_config {
+  Bench_config()
+    : stations(4), channels(1024), bits_per_sample(2),
+      bandwidth(16000000), integration_time(1), integrations(2),
+      pulsar_bins(10) {}
+
+  int stations;
+  int channels;
+  int bits_per_sample;
+  int bandwidth;
+  double integration_time;
+  int integrations;
+  int pulsar_bins;
+
+  int sample_rate() const {
+    return 2 * bandwidth;
+  }
+  int fft_size_correlation() const {
+    return channels;
+  }
+  int fft_size_delaycor() const {
+    return std::min(256, channels);
+  }
+  // Samples of one station that are processed by every stage
+  int64_t samples_per_station() const {
+    return (int64_t)(integrations * integration_time * sample_rate());
+  }
+};
+
+/**
+ * Accumulates the wall clock time of a stage and the amount of data that
+ * it processed.
+ **/
+class Stage_timer {
+public:
+  Stage_timer(const std::string &name)
+    : name_(name), time_(0), samples_(0), bytes_(0), start_(0) {}
+
+  void start() {
+    start_ = now();
+  }
+  void stop(int64_t samples, int64_t bytes) {
+    time_ += now() - start_;
+    samples_ += samples;
+    bytes_ += bytes;
+  }
+  void set_details(const std::string &details) {
+    details_ = details;
+  }
+
+  const std::string &name() const {
+    return name_;
+  }
+  // Elapsed time in seconds
+  double time() const {
+    return time_ / 1e6;
+  }
+  double samples_per_second() const {
+    return (time_ > 0 ? samples_ / time() : 0);
+  }
+  double bytes_per_second() const {
+    return (time_ > 0 ? bytes_ / time() : 0);
+  }
+
+  Json::Value json() const;
+
+private:
+  // Wall clock time in microseconds
+  static int64_t now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+
+  std::string name_, details_;
+  int64_t time_, samples_, bytes_;
+  int64_t start_;
+};
+
+Json::Value
+Stage_timer::json() const {
+  Json::Value result;
+  result["name"] = name_;
+  result["time"] = time();
+  result["samples"] = (double)samples_;
+  result["bytes"] = (double)bytes_;
+  result["samples_per_second"] = samples_per_second();
+  result["bytes_per_second"] = bytes_per_second();
+  if (!details_.empty())
+    result["details"] = details_;
+  return result;
+}
+
+/// Data writer that discards the output of the correlation
+class Data_writer_null : public Data_writer {
+public:
+  bool can_write() {
+    return true;
+  }
+protected:
+  size_t do_put_bytes(size_t nBytes, const char * /*buff*/) {
+    return nBytes;
+  }
+};
+
+/**
+ * Correlation core that times the processing of the input buffers and
+ * integration_write with the do_task of the base class. It doesn't send
+ * the system temperatures to the output node, so that it runs without
+ * MPI.
+ **/
+template <class Core>
+class Bench_core : public Core {
+public:
+  Bench_core(Stage_timer &step, Stage_timer &write)
+    : step_timer(step), write_timer(write) {}
+
+  void do_task() {
+    SFXC_ASSERT(this->has_work());
+    const int first_stream = this->station_stream(0);
+    const int nbuffer = this->input_buffers[first_stream]->front()->data.size() /
+                        this->input_buffers[first_stream]->front()->stride;
+    const int64_t samples = (int64_t)nbuffer * this->fft_size() * this->number_input_streams();
+
+    step_timer.start();
+    Core::do_task();
+    step_timer.stop(samples, (int64_t)nbuffer * (this->fft_size() + 1) *
+                    this->number_input_streams() * sizeof(std::complex<FLOAT>));
+  }
+
+protected:
+  // The writing is timed separately from the processing
+  void integration_write(std::vector<typename Core::Complex_buffer> &integration_buffer,
+                         int phase_center, int bin) {
+    step_timer.stop(0, 0);
+    uint64_t written = this->writer->data_counter();
+    write_timer.start();
+    Core::integration_write(integration_buffer, phase_center, bin);
+    write_timer.stop((int64_t)this->baselines.size() * (this->number_channels() + 1),
+                     this->writer->data_counter() - written);
+    step_timer.start();
+  }
+
+  void tsys_write() {}
+
+private:
+  Stage_timer &step_timer, &write_timer;
+};
+
+typedef Bench_core<Correlation_core> Bench_correlation_core;
+typedef Bench_core<Correlation_core_pulsar> Bench_correlation_core_pulsar;
+
+// Random sample values, the same for every run
+static unsigned int bench_seed = 1;
+static inline int
+bench_random() {
+  return rand_r(&bench_seed);
+}
+
+static void
+fill_random(unsigned char *data, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    data[i] = bench_random() & 0xff;
+}
+
+static void
+fill_random(FLOAT *data, size_t size) {
+  // The values of the bit2float lookup table
+  const FLOAT values[] = {-7, -2, 2, 7};
+  for (size_t i = 0; i < size; i++)
+    data[i] = values[bench_random() & 3];
+}
+
+static Time
+bench_start_time() {
+  return Time(BENCH_MJD, BENCH_SCAN_START + BENCH_SCAN_MARGIN);
+}
+
+/// Writes a delay file with one scan, with a delay that changes linearly
+static void
+write_delay_file(const std::string &filename, int station, const Bench_config &config) {
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out)
+    sfxc_abort(("Could not create " + filename).c_str());
+  char header[3] = {'B', (char)('a' + station), 0};
+  int32_t header_size = sizeof(header);
+  out.write((char *)&header_size, sizeof(header_size));
+  out.write(header, header_size);
+
+  char source[81];
+  memset(source, ' ', sizeof(source));
+  memcpy(source, "BENCH", 5);
+  source[80] = 0;
+  int32_t mjd = BENCH_MJD;
+  out.write(source, sizeof(source));
+  out.write((char *)&mjd, sizeof(mjd));
+  int length = (int)ceil(config.integrations * config.integration_time) +
+               2 * BENCH_SCAN_MARGIN;
+  for (int i = 0; i <= length; i++) {
+    double record[Delay_file::NR_FIELDS];
+    record[Delay_file::TIME] = BENCH_SCAN_START + i;
+    record[Delay_file::U] = 1e6 * station;
+    record[Delay_file::V] = -5e5 * station;
+    record[Delay_file::W] = 1e5 * station;
+    record[Delay_file::DELAY] = 1e-3 * (station + 1) + 1e-7 * station * i;
+    record[Delay_file::PHASE] = 0;
+    record[Delay_file::AMPLITUDE] = 1;
+    out.write((char *)record, sizeof(record));
+  }
+  double end[Delay_file::NR_FIELDS] = {0, 0, 0, 0, 0, 0, 0};
+  out.write((char *)end, sizeof(end));
+}
+
+static Correlation_parameters
+correlation_parameters(const Bench_config &config, int integration) {
+  Correlation_parameters param;
+  Time integration_time(config.integration_time * 1e6);
+  param.experiment_start = bench_start_time();
+  param.start_time = bench_start_time() + integration_time * integration;
+  param.stop_time = param.start_time + integration_time;
+  param.integration_time = integration_time;
+  param.sub_integration_time = integration_time;
+  param.number_channels = config.channels;
+  param.fft_size_delaycor = config.fft_size_delaycor();
+  param.fft_size_correlation = config.fft_size_correlation();
+  param.integration_nr = integration;
+  param.slice_nr = integration;
+  param.slice_offset = 1;
+  param.sample_rate = config.sample_rate();
+  param.channel_freq = 5000000000LL;
+  param.bandwidth = config.bandwidth;
+  param.sideband = 'U';
+  param.frequency_nr = 0;
+  param.polarisation = 'R';
+  param.cross_polarize = false;
+  param.reference_station = -1;
+  param.first_integration_in_block = 0;
+  param.last_integration_in_block = config.integrations - 1;
+  strcpy(param.source, "BENCH");
+  param.n_phase_centers = 1;
+  param.pulsar_binning = false;
+  param.pulsar_parameters = NULL;
+  param.mask_parameters = NULL;
+  for (int i = 0; i < config.stations; i++) {
+    Correlation_parameters::Station_parameters station;
+    station.station_number = i;
+    station.station_stream = i;
+    station.start_time = param.start_time;
+    station.stop_time = param.stop_time;
+    station.sample_rate = config.sample_rate();
+    station.channel_freq = param.channel_freq;
+    station.bandwidth = config.bandwidth;
+    station.sideband = 'U';
+    station.polarisation = 'R';
+    station.bits_per_sample = config.bits_per_sample;
+    station.LO_offset = 0;
+    station.tsys_freq = 80;
+    param.station_streams.push_back(station);
+  }
+  return param;
+}
+
+static void
+bench_fft(const Bench_config &config, std::vector<Stage_timer> &results) {
+  int sizes[2] = {config.fft_size_delaycor(), 2 * config.fft_size_correlation()};
+  for (int s = 0; s < 2; s++) {
+    const int n = sizes[s];
+    const int64_t iterations = config.stations * config.samples_per_station() / n;
+    Memory_pool_vector_element<FLOAT> real_buffer;
+    Memory_pool_vector_element< std::complex<FLOAT> > complex_buffer, output;
+    real_buffer.resize(n);
+    complex_buffer.resize(n);
+    output.resize(n);
+    fill_random(&real_buffer[0], n);
+    for (int i = 0; i < n; i++)
+      complex_buffer[i] = std::complex<FLOAT>(real_buffer[i], real_buffer[(i + 1) % n]);
+
+    SFXC_FFT fft;
+    fft.resize(n);
+    std::stringstream name;
+    name << "fft_rfft_" << n;
+    Stage_timer rfft(name.str());
+    rfft.start();
+    for (int64_t i = 0; i < iterations; i++)
+      fft.rfft(&real_buffer[0], &output[0]);
+    rfft.stop(iterations * n, iterations * n * sizeof(FLOAT));
+    results.push_back(rfft);
+
+    name.str("");
+    name << "fft_c2c_" << n;
+    Stage_timer c2c(name.str());
+    c2c.start();
+    for (int64_t i = 0; i < iterations; i++)
+      fft.fft(&complex_buffer[0], &output[0]);
+    c2c.stop(iterations * n, iterations * n * sizeof(std::complex<FLOAT>));
+    results.push_back(c2c);
+  }
+}
+
+static void
+bench_channel_extractor(const Bench_config &config, bool dynamic,
+                        std::vector<Stage_timer> &results) {
+  // 32 tracks, every subband uses bits_per_sample consecutive tracks
+  const int fan_out = config.bits_per_sample;
+  const int n_subbands = 8 * BENCH_EXTRACTOR_WORD / fan_out;
+  std::vector< std::vector<int> > track_positions(n_subbands);
+  for (int i = 0; i < n_subbands; i++) {
+    for (int j = 0; j < fan_out; j++)
+      track_positions[i].push_back(i * fan_out + j);
+  }
+
+  Channel_extractor_interface *extractor;
+  if (dynamic)
+    extractor = new Channel_extractor_dynamic();
+  else
+    extractor = new Channel_extractor_5();
+  extractor->initialise(track_positions, BENCH_EXTRACTOR_WORD,
+                        BENCH_EXTRACTOR_BLOCK, config.bits_per_sample);
+
+  std::vector<unsigned char> input(BENCH_EXTRACTOR_WORD * BENCH_EXTRACTOR_BLOCK);
+  fill_random(&input[0], input.size());
+  const int output_size = BENCH_EXTRACTOR_BLOCK * fan_out / 8;
+  std::vector< std::vector<unsigned char> > output(n_subbands,
+                                                   std::vector<unsigned char>(output_size));
+  std::vector<unsigned char *> output_positions(n_subbands);
+  for (int i = 0; i < n_subbands; i++)
+    output_positions[i] = &output[i][0];
+
+  // Extract the data of all stations, every subband is a station channel
+  const int64_t blocks = config.stations * config.samples_per_station() / BENCH_EXTRACTOR_BLOCK;
+  Stage_timer timer(dynamic ? "channel_extractor_dynamic" : "channel_extractor_5");
+  timer.start();
+  for (int64_t i = 0; i < blocks; i++)
+    extractor->extract(&input[0], &output_positions[0]);
+  timer.stop(blocks * BENCH_EXTRACTOR_BLOCK * n_subbands, blocks * input.size());
+  timer.set_details(extractor->name());
+  results.push_back(timer);
+  delete extractor;
+}
+
+static void
+bench_bit2float(const Bench_config &config, std::vector<Delay_table_akima> &delays,
+                std::vector<Stage_timer> &results) {
+  Correlation_parameters param = correlation_parameters(config, 0);
+  Types::Channel_circular_input_buffer input(BENCH_BIT2FLOAT_INPUT);
+  fill_random(&input.data[0], input.data.size());
+  input.write = input.data.size();
+
+  bit_statistics_ptr statistics(new bit_statistics());
+  Bit2float_worker worker(0, statistics);
+  worker.connect_to(&input);
+  worker.set_new_parameters(param, delays[0]);
+  // Applies the parameters
+  worker.has_work();
+
+  const int nsamples = CORRELATOR_BUFFER_SIZE;
+  Memory_pool_vector_element<FLOAT> output;
+  output.resize(nsamples);
+  const int64_t iterations = config.stations * config.samples_per_station() / nsamples;
+  Stage_timer timer("bit2float");
+  timer.start();
+  uint64_t read = 0;
+  int sample_in_byte = 0;
+  for (int64_t i = 0; i < iterations; i++)
+    sample_in_byte = worker.bit2float(&output[0], sample_in_byte, nsamples, &read);
+  timer.stop(iterations * nsamples, iterations * nsamples * config.bits_per_sample / 8);
+  results.push_back(timer);
+}
+
+/// Runs the delay correction and the correlation of all integrations,
+/// with or without pulsar binning
+static void
+bench_correlation(const Bench_config &config, std::vector<Delay_table> &delay_tables,
+                  bool pulsar, bool report_delay_correction,
+                  std::vector<Stage_timer> &results) {
+  const int nstations = config.stations;
+  Stage_timer delay_timer("delay_correction");
+  Stage_timer step_timer(pulsar ? "correlation_core_pulsar" : "integration_step");
+  Stage_timer write_timer(pulsar ? "correlation_core_pulsar_write" : "integration_write");
+
+  Types::Channel_memory_pool input_pool(2 * nstations);
+  std::vector<Types::Channel_queue_ptr> input_queues(nstations);
+  std::vector<bit_statistics_ptr> statistics(nstations);
+  std::vector< std::vector<Correlation_core::Invalid> > invalid(nstations);
+  std::vector< boost::shared_ptr<Delay_correction> > delay_correction(nstations);
+  std::vector< std::vector<double> > uvw(nstations, std::vector<double>(3));
+
+  Correlation_core *core;
+  if (pulsar)
+    core = new Bench_correlation_core_pulsar(step_timer, write_timer);
+  else
+    core = new Bench_correlation_core(step_timer, write_timer);
+  core->set_data_writer(boost::shared_ptr<Data_writer>(new Data_writer_null()));
+  for (int i = 0; i < nstations; i++) {
+    input_queues[i] = Types::Channel_queue_ptr(new Types::Channel_queue());
+    statistics[i] = bit_statistics_ptr(new bit_statistics());
+    statistics[i]->reset_statistics(config.bits_per_sample, config.sample_rate(),
+                                    config.sample_rate());
+    delay_correction[i] = boost::shared_ptr<Delay_correction>(new Delay_correction(i));
+    delay_correction[i]->connect_to(input_queues[i]);
+    core->connect_to(i, statistics[i], delay_correction[i]->get_output_buffer());
+    core->connect_to(i, &invalid[i]);
+    uvw[i][0] = 1e6 * i;
+    uvw[i][1] = -5e5 * i;
+    uvw[i][2] = 1e5 * i;
+  }
+
+  // A pulsar with a period of one second and a constant phase model
+  Pulsar_parameters::Pulsar psr;
+  strcpy(psr.name, "BENCH");
+  psr.nbins = config.pulsar_bins;
+  psr.interval.start = 0;
+  psr.interval.stop = 1;
+  psr.polyco_params.resize(1);
+  Pulsar_parameters::Polyco_params &polyco = psr.polyco_params[0];
+  strcpy(polyco.name, "BENCH");
+  strcpy(polyco.date, "");
+  polyco.utc = 0;
+  polyco.tmid = bench_start_time().get_mjd();
+  polyco.DM = 10;
+  polyco.doppler = 0;
+  polyco.residual = 0;
+  polyco.ref_phase = 0;
+  polyco.ref_freq = 1;
+  strcpy(polyco.site, "");
+  polyco.data_span = 0;
+  polyco.n_coef = 3;
+  polyco.obs_freq = 5000;
+  polyco.bin_phase[0] = polyco.bin_phase[1] = 0;
+  polyco.coef.resize(polyco.n_coef, 0);
+
+  const int nfft_delaycor = config.fft_size_delaycor();
+  const int nfft_per_buffer =
+    std::max(CORRELATOR_BUFFER_SIZE / nfft_delaycor,
+             std::max(config.fft_size_correlation() / nfft_delaycor, 1));
+  for (int integration = 0; integration < config.integrations; integration++) {
+    Correlation_parameters param = correlation_parameters(config, integration);
+    param.pulsar_binning = pulsar;
+    std::vector<Delay_table_akima> delays(nstations);
+    for (int i = 0; i < nstations; i++) {
+      delays[i] = delay_tables[i].create_akima_spline(param.start_time, param.integration_time);
+      delay_correction[i]->set_parameters(param, delays[i]);
+      invalid[i].clear();
+    }
+    if (pulsar)
+      ((Correlation_core_pulsar *)core)->set_parameters(param, psr, delays, uvw, 0);
+    else
+      core->set_parameters(param, delays, uvw, 0);
+
+    const int nfft_per_integration =
+      (config.fft_size_correlation() / nfft_delaycor) *
+      Control_parameters::nr_ffts_per_integration_slice(
+        (int)param.integration_time.get_time_usec(), param.sample_rate,
+        param.fft_size_correlation);
+    std::vector<int> nfft_left(nstations, nfft_per_integration);
+    while (!core->finished()) {
+      bool progress = false;
+      for (int i = 0; i < nstations; i++) {
+        if ((nfft_left[i] > 0) && input_queues[i]->empty()) {
+          // Output of the bit2float conversion
+          Types::Channel_memory_pool_element element = input_pool.allocate();
+          int nfft = std::min(nfft_per_buffer, nfft_left[i]);
+          if (element.data().data.size() != (size_t)(nfft * nfft_delaycor)) {
+            element.data().data.resize(nfft * nfft_delaycor);
+            fill_random(&element.data().data[0], nfft * nfft_delaycor);
+          }
+          element.data().nfft = nfft;
+          nfft_left[i] -= nfft;
+          input_queues[i]->push(element);
+        }
+        while (delay_correction[i]->has_work()) {
+          int64_t samples = (int64_t)input_queues[i]->front().data().nfft * nfft_delaycor;
+          delay_timer.start();
+          delay_correction[i]->do_task();
+          delay_timer.stop(samples, samples * sizeof(FLOAT));
+          progress = true;
+        }
+      }
+      while (core->has_work() && !core->finished()) {
+        core->do_task();
+        progress = true;
+      }
+      if (!progress)
+        sfxc_abort("The correlation benchmark didn't receive enough data");
+    }
+  }
+  delete core;
+
+  if (report_delay_correction)
+    results.push_back(delay_timer);
+  results.push_back(step_timer);
+  results.push_back(write_timer);
+}
+
+static void
+usage(const char *name) {
+  std::cout << "Usage: " << name << " [options] [stage ...]\n";
+  std::cout << "Runs the stages of the correlator on synthetic data, the stages are\n"
+            << "  fft, channel_extractor_5, channel_extractor_dynamic, bit2float,\n"
+            << "  delay_correction, correlation and pulsar (all stages by default)\n";
+  std::cout << "Options : -h, --help                  Print this help message\n"
+            << "          -s, --stations <nr>         Number of stations (4)\n"
+            << "          -c, --channels <nr>         Number of frequency channels (1024)\n"
+            << "          -b, --bits <nr>             Bits per sample, 1 or 2 (2)\n"
+            << "          -w, --bandwidth <MHz>       Bandwidth of a channel (16)\n"
+            << "          -t, --integration-time <s>  Integration time (1)\n"
+            << "          -n, --integrations <nr>     Number of integrations (2)\n"
+            << "          -j, --json <file>           Write the results as JSON\n";
+}
+
+int
+main(int argc, char *argv[]) {
+  RANK_OF_NODE = 0;
+  Bench_config config;
+  std::string json_file;
+  int c;
+
+  while (1) {
+    static struct option long_options[] = {
+      {"help",             no_argument,       0, 'h'},
+      {"stations",         required_argument, 0, 's'},
+      {"channels",         required_argument, 0, 'c'},
+      {"bits",             required_argument, 0, 'b'},
+      {"bandwidth",        required_argument, 0, 'w'},
+      {"integration-time", required_argument, 0, 't'},
+      {"integrations",     required_argument, 0, 'n'},
+      {"json",             required_argument, 0, 'j'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hs:c:b:w:t:n:j:", long_options, &option_index);
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 's':
+      config.stations = atoi(optarg);
+      break;
+    case 'c':
+      config.channels = atoi(optarg);
+      break;
+    case 'b':
+      config.bits_per_sample = atoi(optarg);
+      break;
+    case 'w':
+      config.bandwidth = (int)(atof(optarg) * 1e6);
+      break;
+    case 't':
+      config.integration_time = atof(optarg);
+      break;
+    case 'n':
+      config.integrations = atoi(optarg);
+      break;
+    case 'j':
+      json_file = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(0);
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if ((config.stations < 2) || (config.channels < 16) || !isPower2(config.channels) ||
+      ((config.bits_per_sample != 1) && (config.bits_per_sample != 2)) ||
+      (config.bandwidth <= 0) || (config.integration_time <= 0) ||
+      (config.integrations < 1)) {
+    std::cerr << "Invalid benchmark parameters\n";
+    usage(argv[0]);
+    exit(1);
+  }
+
+  const char *stage_names[] = {"fft", "channel_extractor_5", "channel_extractor_dynamic",
+                               "bit2float", "delay_correction", "correlation", "pulsar"};
+  const int nr_stages = sizeof(stage_names) / sizeof(stage_names[0]);
+  std::set<std::string> stages;
+  for (int i = optind; i < argc; i++) {
+    int j = 0;
+    while ((j < nr_stages) && (argv[i] != std::string(stage_names[j])))
+      j++;
+    if (j == nr_stages) {
+      std::cerr << "Unknown stage " << argv[i] << "\n";
+      usage(argv[0]);
+      exit(1);
+    }
+    stages.insert(argv[i]);
+  }
+  if (stages.empty())
+    stages.insert(stage_names, stage_names + nr_stages);
+
+  // Delay model of every station, in a temporary directory
+  char dirname[] = "/tmp/sfxc_bench.XXXXXX";
+  if (mkdtemp(dirname) == NULL)
+    sfxc_abort("Could not create a temporary directory");
+  std::vector<Delay_table> delay_tables(config.stations);
+  std::vector<Delay_table_akima> delays(config.stations);
+  std::vector<std::string> delay_files(config.stations);
+  for (int i = 0; i < config.stations; i++) {
+    std::stringstream filename;
+    filename << dirname << "/station" << i << ".del";
+    delay_files[i] = filename.str();
+    write_delay_file(delay_files[i], i, config);
+    delay_tables[i].open(delay_files[i].c_str());
+    Delay_table table = delay_tables[i];
+    Correlation_parameters param = correlation_parameters(config, 0);
+    delays[i] = table.create_akima_spline(param.start_time, param.integration_time);
+  }
+
+  std::vector<Stage_timer> results;
+  if (stages.count("fft"))
+    bench_fft(config, results);
+  if (stages.count("channel_extractor_5"))
+    bench_channel_extractor(config, false, results);
+  if (stages.count("channel_extractor_dynamic"))
+    bench_channel_extractor(config, true, results);
+  if (stages.count("bit2float"))
+    bench_bit2float(config, delays, results);
+  // The delay correction provides the input of the correlation
+  bool delay_correction = stages.count("delay_correction");
+  if (delay_correction || stages.count("correlation"))
+    bench_correlation(config, delay_tables, false, delay_correction, results);
+  if (stages.count("pulsar"))
+    bench_correlation(config, delay_tables, true,
+                      delay_correction && !stages.count("correlation"), results);
+
+  for (int i = 0; i < config.stations; i++) {
+    unlink(delay_files[i].c_str());
+    unlink((delay_files[i] + DELAY_INDEX_EXTENSION).c_str());
+  }
+  rmdir(dirname);
+
+  std::cout << std::left << std::setw(32) << "stage" << std::right
+            << std::setw(10) << "time [s]" << std::setw(16) << "Msamples/s"
+            << std::setw(16) << "MB/s" << "\n";
+  std::cout << std::fixed;
+  for (size_t i = 0; i < results.size(); i++) {
+    std::cout << std::left << std::setw(32) << results[i].name() << std::right
+              << std::setprecision(3) << std::setw(10) << results[i].time()
+              << std::setprecision(2) << std::setw(16) << results[i].samples_per_second() / 1e6
+              << std::setw(16) << results[i].bytes_per_second() / 1e6 << "\n";
+  }
+
+  if (!json_file.empty()) {
+    Json::Value json;
+    json["parameters"]["stations"] = config.stations;
+    json["parameters"]["channels"] = config.channels;
+    json["parameters"]["bits_per_sample"] = config.bits_per_sample;
+    json["parameters"]["sample_rate"] = config.sample_rate();
+    json["parameters"]["fft_size_delaycor"] = config.fft_size_delaycor();
+    json["parameters"]["fft_size_correlation"] = config.fft_size_correlation();
+    json["parameters"]["integration_time"] = config.integration_time;
+    json["parameters"]["integrations"] = config.integrations;
+    json["stages"] = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < results.size(); i++)
+      json["stages"].append(results[i].json());
+
+    std::ofstream out(json_file.c_str());
+    Json::StyledWriter writer;
+    out << writer.write(json);
+    if (!out) {
+      std::cerr << "Could not write " << json_file << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
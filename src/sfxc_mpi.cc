@@ -14,6 +14,7 @@
 #include "input_node.h"
 #include "output_node.h"
 #include "correlator_node.h"
+#include "telemetry.h"
 
 IF_MT_MPI_ENABLED( Mutex g_mpi_thebig_mutex );
 MPI_Group MPI_GROUP_CORR_NODES;
@@ -167,3 +168,26 @@ void create_correlator_node_comm(int nr_corr_nodes){
   MPI_Group_incl(global_group, nr_corr_nodes+1, nodes, &MPI_GROUP_CORR_NODES);
   MPI_Comm_create(MPI_COMM_WORLD, MPI_GROUP_CORR_NODES, &MPI_COMM_CORR_NODES);
 }
+
+void start_telemetry(const std::string &output, bool prometheus, int interval_ms,
+                     int status_interval_ms){
+  int32_t settings[4] = {(int32_t)output.size(), prometheus, interval_ms,
+                         status_interval_ms};
+  MPI_Bcast(settings, 4, MPI_INT32, RANK_MANAGER_NODE, MPI_COMM_WORLD);
+  Node::set_status_interval(settings[3]);
+  if (settings[0] == 0)
+    return;
+  std::vector<char> buffer(output.begin(), output.end());
+  buffer.resize(settings[0]);
+  MPI_Bcast(&buffer[0], settings[0], MPI_CHAR, RANK_MANAGER_NODE, MPI_COMM_WORLD);
+
+  // Every node writes its own file
+  std::string node_output(buffer.begin(), buffer.end());
+  if (node_output.compare(0, 7, "file://") == 0)
+    node_output += "." + itoa(RANK_OF_NODE);
+  std::string labels = "rank=\"" + itoa(RANK_OF_NODE) + "\",host=\"" +
+                       HOSTNAME_OF_NODE + "\"";
+  if (!Telemetry::start(node_output, (settings[1] ? Telemetry::PROMETHEUS : Telemetry::JSON),
+                        settings[2], labels))
+    std::cerr << RANK_OF_NODE << " : Could not start the telemetry to " << node_output << std::endl;
+}
@@ -13,6 +13,7 @@
 //the class definitions and function definitions
 #include "utils.h"
 #include "uvw_model.h"
+#include "delay_file.h"
 
 //standard c includes
 #include <stdio.h>
@@ -29,11 +30,7 @@
 #include <iomanip>
 #include <fstream>
 #include <string>
-
-#define READ_SCAN_HEADER  	0
-#define SKIP_SCAN		1
-#define FIND_TSTART		2
-#define READ_NEW_SCAN		3
+#include <algorithm>
 
 //*****************************************************************************
 //function definitions
@@ -77,129 +74,65 @@ int Uvw_model::open(const char *delayTableName) {
 }
 
 int Uvw_model::open(const char *delayTableName, Time tstart, Time tstop, const std::string &source) {
-  std::ifstream in(delayTableName);
-  if(!in.is_open())
-    sfxc_abort((std::string("Could not open delay table ")+std::string(delayTableName)).c_str());
-  int32_t header_size;
-
-  // Read the header
-  in.read(reinterpret_cast < char * > (&header_size), sizeof(int32_t));
-  if (in.eof()) return 0;
-
-  char header[header_size];
-  in.read(reinterpret_cast < char * > (header), header_size*sizeof(char));
-  if (in.eof()) return 0;
-
-  double line[7], scan_start, scan_end;
-  int32_t current_mjd;
-  char current_source[81];
-  int state = READ_SCAN_HEADER;
-  bool done_reading = false;
-  while((!done_reading) && (in.good())){
-    switch(state){
-    case READ_SCAN_HEADER:{
-      if(in.read(current_source, sizeof(char) * 81)){
-        in.read(reinterpret_cast < char * > (&current_mjd), sizeof(int32_t));
-        in.read(reinterpret_cast < char * > (line), 7*sizeof(double));
-        Time start_time_scan(current_mjd, line[0]);
-        // strip whitespace from end of source string
-        for(int i = 79; i >=0 ; i--){
-          if(current_source[i] != ' '){
-            current_source[i + 1] = 0;
-            break;
-          }
-        }
-	if (source != std::string() && source != current_source) {
-	  state = SKIP_SCAN;
-	} else if (start_time_scan < tstart) {
-          state = FIND_TSTART;
-        } else if (start_time_scan >= tstop) {
-          done_reading = true;
-        } else {
-          state = READ_NEW_SCAN;
-        }
-      }
-      break;
-    }
-    case SKIP_SCAN:{
-      while (in.read(reinterpret_cast < char * > (line), 7*sizeof(double))) {
-        Time time(current_mjd, line[0]);
-
-        if(line[0] == 0 && line[4] == 0){
-          state = READ_SCAN_HEADER;
-          break;
-        }
-      }
+  const Delay_file &file = Delay_file::get(delayTableName);
+
+  for (size_t i = 0; i < file.number_scans(); i++) {
+    const Delay_file::Scan &file_scan = file.scan(i);
+    if (file_scan.nr_records == 0)
+      continue;
+    if (source != std::string() && source != file_scan.source)
+      continue;
+    if (file.time(file_scan, 0) >= tstop)
       break;
+
+    int first = 0;
+    if (file.time(file_scan, 0) < tstart)
+      first = file.find_record(file_scan, tstart);
+    // At least two points are needed, a single point is the last point
+    // of a scan that ends at the start time
+    if (file_scan.nr_records - first < 2)
+      continue;
+
+    double scan_start = file.value(file_scan, first, Delay_file::TIME);
+    Time start_time_scan(file_scan.mjd, scan_start);
+    // look up the current source in the list of sources and append it to the list if needed
+    int source_index;
+    for(source_index = 0; source_index < sources.size() ; source_index++){
+      if(sources[source_index] == file_scan.source)
+        break;
     }
-    case FIND_TSTART:{
-      while (in.read(reinterpret_cast < char * > (line), 7*sizeof(double))) {
-        Time time(current_mjd, line[0]);
-
-        if(line[0] == 0 && line[4] == 0){
-          state = READ_SCAN_HEADER;
-          break;
-        }else if(time >= tstart){
-          state = READ_NEW_SCAN;
-          break;
-        }
-      }
-      break;
+    if(source_index == sources.size())
+      sources.push_back(file_scan.source);
+
+    // Create the new scan
+    scans.resize(scans.size() + 1);
+    Scan &scan = scans.back();
+    scan.begin = start_time_scan;
+    scan.source = source_index;
+    scan.model_index = u.size();
+    // Check if we are correlating an additional phase center to the current scan
+    int n_scans = scans.size();
+    if((n_scans > 1) && (scans[n_scans - 2].begin == start_time_scan)){
+      // We found an additional phace center to the current scan
+      scan.times = scans[n_scans - 2].times;
+      times.resize(scan.times);
+    }else{
+      // We are staring a new scan
+      scan.times = times.size();
     }
-    case READ_NEW_SCAN:
-      scan_start = line[0];
-      Time start_time_scan(current_mjd, scan_start);
-      // look up the current source in the list of sources and append it to the list if needed
-      int source_index;
-      for(source_index = 0; source_index < sources.size() ; source_index++){
-        if(sources[source_index] == current_source)
-          break;
-      }
-      if(source_index == sources.size())
-        sources.push_back(current_source);
-
-      // Create the new scan
-      scans.resize(scans.size() + 1);
-      Scan &scan = scans.back();
-      scan.begin = start_time_scan;
-      scan.source = source_index;
-      scan.model_index = u.size();
-      // Check if we are correlating an additional phase center to the current scan
-      int n_scans = scans.size();
-      if((n_scans > 1) && (scans[n_scans - 2].begin == start_time_scan)){
-        // We found an additional phace center to the current scan
-        scan.times = scans[n_scans - 2].times;
-        times.resize(scan.times);
-      }else{
-        // We are staring a new scan
-        scan.times = times.size();
-      }
-      // Read the data
-      do {
-        if (line[0] == 0 && line[4] == 0) {
-          if(times.size() == 1){
-            // Instead of the first point of the desired scan, we got the
-            // last point of the previous scan.  Get rid of it.
-            scans.resize(0);
-            times.resize(0);
-          }else{
-            SFXC_ASSERT(scan_end > scan_start);
-            scan.end.set_time(current_mjd, scan_end);
-          }
-          state = READ_SCAN_HEADER;
-          break;
-        } else {
-          times.push_back(line[0] - scan_start);
-          u.push_back(line[1]);
-          v.push_back(line[2]);
-          w.push_back(line[3]);
-          scan_end = line[0];
-        }
-      } while(in.read(reinterpret_cast < char * > (line), 7*sizeof(double)));
-      if((n_scans > 1) && (scans[n_scans - 2].begin == scan.begin) && 
-         (scans[n_scans - 2].end != scan.end))
-        sfxc_abort("Premature ending of phase center\n");
+    // Read the data
+    for (int j = first; j < file_scan.nr_records; j++) {
+      times.push_back(file.value(file_scan, j, Delay_file::TIME) - scan_start);
+      u.push_back(file.value(file_scan, j, Delay_file::U));
+      v.push_back(file.value(file_scan, j, Delay_file::V));
+      w.push_back(file.value(file_scan, j, Delay_file::W));
     }
+    double scan_end = file.value(file_scan, file_scan.nr_records - 1, Delay_file::TIME);
+    SFXC_ASSERT(scan_end > scan_start);
+    scan.end.set_time(file_scan.mjd, scan_end);
+    if((n_scans > 1) && (scans[n_scans - 2].begin == scan.begin) && 
+       (scans[n_scans - 2].end != scan.end))
+      sfxc_abort("Premature ending of phase center\n");
   }
 
   // Initialise
@@ -235,6 +168,34 @@ Uvw_model::add_scans(const Uvw_model &other)
   w.insert(w.end(), other.w.begin(), other.w.end());
 }
 
+void
+Uvw_model::remove_finished_scans()
+{
+  if (scan_nr == 0)
+    return;
+
+  // The data of a scan is stored after the data of the preceding scans
+  int first_source = scans[scan_nr].source, first_time = scans[scan_nr].times;
+  int first_model = scans[scan_nr].model_index;
+  for (size_t i = scan_nr; i < scans.size(); i++) {
+    first_source = std::min(first_source, scans[i].source);
+    first_time = std::min(first_time, scans[i].times);
+    first_model = std::min(first_model, scans[i].model_index);
+  }
+  scans.erase(scans.begin(), scans.begin() + scan_nr);
+  for (size_t i = 0; i < scans.size(); i++) {
+    scans[i].source -= first_source;
+    scans[i].times -= first_time;
+    scans[i].model_index -= first_model;
+  }
+  sources.erase(sources.begin(), sources.begin() + first_source);
+  times.erase(times.begin(), times.begin() + first_time);
+  u.erase(u.begin(), u.begin() + first_model);
+  v.erase(v.begin(), v.begin() + first_model);
+  w.erase(w.begin(), w.begin() + first_model);
+  scan_nr = 0;
+}
+
 bool Uvw_model::initialise_next_scan() {
   // Check if we are at the last scan
   if (scan_nr >= (scans.size() - n_sources_in_scan))
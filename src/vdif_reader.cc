@@ -6,12 +6,16 @@ VDIF_reader::VDIF_reader(boost::shared_ptr<Data_reader> data_reader,
   : Input_data_format_reader(data_reader),
     debug_level_(CHECK_PERIODIC_HEADERS),
     sample_rate(0), first_header_seen(false),
-    frame_size(0)
+    frame_size(0), seeking_(false), demux_active_(false),
+    demux_buffer_size_(0), demux_nr_queued_(0), demux_nr_dropped_(0)
 {
   ref_jday = (int)ref_time.get_mjd();
 }
 
-VDIF_reader::~VDIF_reader() {}
+VDIF_reader::~VDIF_reader() {
+  if (demux_nr_dropped_ > 0)
+    LOG_MSG("Dropped " << demux_nr_dropped_ << " VDIF frames that were out of order");
+}
 
 bool 
 VDIF_reader::open_input_stream(Data_frame &data) {
@@ -49,6 +53,18 @@ VDIF_reader::print_header() {
 
 Time
 VDIF_reader::goto_time(Data_frame &data, Time time) {
+  bool buffered = (demux_nr_queued_ > 0) && (time <= demux_last_time_ - offset);
+  if (data_reader_->is_seekable() && (time > get_current_time()) && !buffered) {
+    // Jump close to the requested time, the frames of all threads
+    // are interleaved in the data stream
+    size_t frame_bytes = first_header.header_size() + frame_size;
+    size_t nthreads = std::max((size_t)1, thread_map.size());
+    reset_demux();
+    seeking_ = true;
+    seek_to_time(data, time, vdif_frames_per_block * nthreads * frame_bytes,
+                 time_between_headers_);
+    seeking_ = false;
+  }
   while (time > get_current_time()) {
     if (!read_new_block(data))
       break;
@@ -60,21 +76,30 @@ Time
 VDIF_reader::get_current_time() {
   Time time;
 
-  if (is_open_) {
-    double seconds_since_reference = (double)current_header.sec_from_epoch - (ref_jday - current_header.jday_epoch()) * 24 * 60 * 60;
-    double subsec = 0;
-    if (sample_rate > 0) {
-      int samples_per_frame = 8 * frame_size / ((first_header.bits_per_sample + 1) * (1 << first_header.log2_nchan));
-      subsec = (double)current_header.dataframe_in_second * samples_per_frame / sample_rate;
-    }
-    time.set_time(ref_jday, seconds_since_reference + subsec);
-  }
+  if (is_open_)
+    time = (demux_active_ ? demux_time_ : header_time(current_header));
 
   return time - offset;
 }
 
+Time
+VDIF_reader::header_time(const Header &header) {
+  Time time;
+  double seconds_since_reference = (double)header.sec_from_epoch - (ref_jday - header.jday_epoch()) * 24 * 60 * 60;
+  double subsec = 0;
+  if (sample_rate > 0) {
+    int samples_per_frame = 8 * frame_size / ((first_header.bits_per_sample + 1) * (1 << first_header.log2_nchan));
+    subsec = (double)header.dataframe_in_second * samples_per_frame / sample_rate;
+  }
+  time.set_time(ref_jday, seconds_since_reference + subsec);
+  return time;
+}
+
 bool
 VDIF_reader::read_new_block(Data_frame &data) {
+  if (use_demux())
+    return read_new_block_demux(data);
+
   std::vector<value_type> &buffer = data.buffer->data;
   const int max_restarts = 256;
   int restarts = 0;
@@ -190,7 +215,178 @@ VDIF_reader::read_new_block(Data_frame &data) {
 }
 
 bool VDIF_reader::eof() {
-  return data_reader_->eof();
+  return data_reader_->eof() && (demux_nr_queued_ == 0);
+}
+
+bool
+VDIF_reader::use_demux() {
+  // Only streams with one frame per thread per block are demultiplexed,
+  // the first block is read by read_new_block to find the frame layout
+  return is_open_ && first_header_seen && !seeking_ &&
+         (thread_map.size() > 1) && (vdif_frames_per_block == 1) &&
+         (sample_rate > 0);
+}
+
+bool
+VDIF_reader::read_new_block_demux(Data_frame &data) {
+  const size_t nchannels = demux_queues_.size();
+  for (;;) {
+    // Make sure every thread has a frame queued, so that the next frame
+    // in time can be found
+    bool empty_queue = true;
+    while (empty_queue && (demux_nr_queued_ < VDIF_DEMUX_MAX_FRAMES)) {
+      empty_queue = false;
+      for (size_t i = 0; i < nchannels; i++)
+        empty_queue |= demux_queues_[i].empty();
+      if (empty_queue && !read_demux_chunk())
+        break;
+    }
+
+    // Find the channel with the earliest block
+    int channel = -1;
+    Time next;
+    for (size_t i = 0; i < nchannels; i++) {
+      if (demux_queues_[i].empty())
+        continue;
+      Time t = demux_queues_[i].front().time;
+      if (demux_started_[i] && (demux_next_time_[i] < t))
+        t = demux_next_time_[i];
+      if ((channel < 0) || (t < next)) {
+        channel = i;
+        next = t;
+      }
+    }
+    if (channel < 0)
+      return false;
+
+    std::deque<Demux_frame> &queue = demux_queues_[channel];
+    Demux_frame &frame = queue.front();
+    std::vector<value_type> &buffer = data.buffer->data;
+    if (buffer.size() != size_data_block())
+      buffer.resize(size_data_block());
+    data.invalid.resize(0);
+    data.channel = channel;
+
+    if (demux_started_[channel] && (next < frame.time) &&
+        (frame.time - next < Time(1e6))) {
+      // Gap in this thread, fill it with invalid data without waiting
+      // for the other threads
+      Input_node_types::Invalid_block invalid;
+      invalid.invalid_begin = 0;
+      invalid.nr_invalid = buffer.size();
+      data.invalid.push_back(invalid);
+    } else {
+      bool late = demux_started_[channel] && (frame.time < demux_next_time_[channel]);
+      if (!late) {
+        next = frame.time;
+        buffer.swap(frame.data);
+        current_header = frame.header;
+        if (current_header.invalid > 0) {
+          Input_node_types::Invalid_block invalid;
+          invalid.invalid_begin = 0;
+          invalid.nr_invalid = buffer.size();
+          data.invalid.push_back(invalid);
+        }
+      }
+      demux_free_buffers_.push_back(std::vector<value_type>());
+      demux_free_buffers_.back().swap(frame.data);
+      queue.pop_front();
+      demux_nr_queued_--;
+      if (late) {
+        // Duplicated frame, or a frame after a gap that was filled already
+        demux_nr_dropped_++;
+        continue;
+      }
+    }
+
+    demux_started_[channel] = true;
+    demux_next_time_[channel] = next + time_between_headers_;
+    demux_time_ = next;
+    demux_active_ = true;
+    data.start_time = get_current_time();
+    return true;
+  }
+}
+
+bool
+VDIF_reader::read_demux_chunk() {
+  const size_t header_size = first_header.header_size();
+  const size_t frame_bytes = header_size + frame_size;
+  const size_t chunk_size = VDIF_DEMUX_CHUNK_FRAMES * frame_bytes;
+  if (demux_buffer_.size() < chunk_size + frame_bytes)
+    demux_buffer_.resize(chunk_size + frame_bytes);
+
+  size_t nread = Data_reader_blocking::get_bytes_s(data_reader_.get(), chunk_size,
+                                                   &demux_buffer_[demux_buffer_size_]);
+  if ((nread == 0) || (nread == (size_t)-1))
+    return false;
+  demux_buffer_size_ += nread;
+
+  size_t pos = 0;
+  while (pos + frame_bytes <= demux_buffer_size_) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(&header, &demux_buffer_[pos], header_size);
+    const uint32_t *words = (const uint32_t *)&header;
+    if ((words[0] == MARK5_FILLPATTERN) || (words[1] == MARK5_FILLPATTERN) ||
+        (words[2] == MARK5_FILLPATTERN) || (words[3] == MARK5_FILLPATTERN)) {
+      pos += frame_bytes;
+      continue;
+    }
+    if ((header.dataframe_length != first_header.dataframe_length) ||
+        (header.legacy_mode != first_header.legacy_mode) ||
+        (header.station_id != first_header.station_id)) {
+      // Lost sync, search for the next header
+      pos += 8;
+      continue;
+    }
+    std::map<int, int>::iterator it = thread_map.find(header.thread_id);
+    if (it == thread_map.end()) {
+      pos += frame_bytes;
+      continue;
+    }
+
+    // Frames of a thread are usually in order, insert from the back
+    std::deque<Demux_frame> &queue = demux_queues_[it->second];
+    Time time = header_time(header);
+    std::deque<Demux_frame>::iterator pos_in_queue = queue.end();
+    while ((pos_in_queue != queue.begin()) && (time < (pos_in_queue - 1)->time))
+      pos_in_queue--;
+    Demux_frame &frame = *queue.insert(pos_in_queue, Demux_frame());
+    if (!demux_free_buffers_.empty()) {
+      frame.data.swap(demux_free_buffers_.back());
+      demux_free_buffers_.pop_back();
+    }
+    frame.data.resize(frame_size);
+    memcpy(&frame.data[0], &demux_buffer_[pos + header_size], frame_size);
+    frame.header = header;
+    frame.time = time;
+    if ((demux_nr_queued_ == 0) || (demux_last_time_ < frame.time))
+      demux_last_time_ = frame.time;
+    demux_nr_queued_++;
+    pos += frame_bytes;
+  }
+
+  // Keep the incomplete frame at the end for the next chunk
+  memmove(&demux_buffer_[0], &demux_buffer_[pos], demux_buffer_size_ - pos);
+  demux_buffer_size_ -= pos;
+  return true;
+}
+
+void
+VDIF_reader::reset_demux() {
+  for (size_t i = 0; i < demux_queues_.size(); i++) {
+    while (!demux_queues_[i].empty()) {
+      demux_free_buffers_.push_back(std::vector<value_type>());
+      demux_free_buffers_.back().swap(demux_queues_[i].front().data);
+      demux_queues_[i].pop_front();
+    }
+  }
+  demux_nr_queued_ = 0;
+  demux_buffer_size_ = 0;
+  demux_started_.assign(demux_queues_.size(), false);
+  demux_next_time_.assign(demux_queues_.size(), Time());
+  demux_active_ = false;
 }
 
 int32_t VDIF_reader::Header::jday_epoch() const {
@@ -200,6 +396,8 @@ int32_t VDIF_reader::Header::jday_epoch() const {
 }
 
 void VDIF_reader::set_parameters(const Input_node_parameters &param) {
+  Time old_time_between_headers = time_between_headers_;
+  std::map<int, int> old_thread_map = thread_map;
   sample_rate = param.sample_rate();
   SFXC_ASSERT(((int)sample_rate % 1000000) == 0);
   offset = param.offset;
@@ -221,4 +419,14 @@ void VDIF_reader::set_parameters(const Input_node_parameters &param) {
     bits_per_complete_sample = param.n_tracks;
   }
   SFXC_ASSERT(time_between_headers_.get_time_usec() > 0);
+
+  // Frames that are already queued stay valid for the next scan, unless
+  // the threads in the data changed
+  size_t nqueues = (param.n_tracks == 0 ? param.channels.size() : 0);
+  if ((demux_queues_.size() != nqueues) || (thread_map != old_thread_map) ||
+      (time_between_headers_ != old_time_between_headers)) {
+    reset_demux();
+    demux_queues_.resize(nqueues);
+    reset_demux();
+  }
 }
@@ -0,0 +1,135 @@
+# Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+# All rights reserved.
+#
+# $Id$
+#
+# Reads correlator output (.cor) files in python, with the same interface
+# as the CorFile of the sfxc_cor module. The sfxc_cor module is only built
+# with ./configure --enable-python, the scripts that read .cor files fall
+# back on this module when it is not installed:
+#
+#   try:
+#     import sfxc_cor
+#   except ImportError:
+#     import cor_file as sfxc_cor
+#
+# The file is read with numpy.memmap, the headers are record arrays with
+# the same fields as those of sfxc_cor.
+
+import struct
+import numpy
+
+# The layout of the headers in output_header.h, the flags of a baseline
+# are polarisation1 (bit 0), polarisation2 (bit 1), sideband (bit 2) and
+# frequency_nr (bits 3-7)
+timeslice_dtype = numpy.dtype([("integration_slice", "<i4"), ("number_baselines", "<i4"),
+                               ("number_uvw_coordinates", "<i4"), ("number_statistics", "<i4")])
+uvw_dtype = numpy.dtype([("station_nr", "<i4"), ("averaged_integrations", "<i4"),
+                         ("u", "<f8"), ("v", "<f8"), ("w", "<f8")])
+statistics_dtype = numpy.dtype([("station_nr", "u1"), ("frequency_nr", "u1"),
+                                ("sideband", "u1"), ("polarisation", "u1"),
+                                ("levels", "<i4", (4,)), ("n_invalid", "<i4")])
+baseline_dtype = numpy.dtype([("weight", "<i4"), ("station1", "u1"), ("station2", "u1"),
+                              ("flags", "u1"), ("scale_exponent", "i1")])
+
+global_header_format = '<i32s2h5ib15s2i'
+global_header_fields = ["header_size", "experiment", "start_year", "start_day", "start_time",
+                        "number_channels", "integration_time", "output_format_version",
+                        "correlator_version", "polarisation_type", "correlator_branch",
+                        "job_nr", "subjob_nr"]
+
+class CorFile:
+  def __init__(self, filename):
+    self.filename = filename
+    self.update()
+
+  def update(self):
+    # Reads the file again to see the time slices that were written since
+    try:
+      data = numpy.memmap(self.filename, dtype=numpy.uint8, mode='r')
+    except ValueError:
+      raise IOError("Empty correlator file : " + self.filename)
+    header_size = int(data[:4].view("<i4")[0])
+    if (header_size < 4) or (header_size > data.size):
+      raise IOError("Invalid global header in " + self.filename)
+    # Older files have a smaller global header, the missing fields are 0
+    size = struct.calcsize(global_header_format)
+    buf = data[:min(header_size, size)].tobytes() + b'\0' * max(0, size - header_size)
+    header = dict(zip(global_header_fields, struct.unpack(global_header_format, buf)))
+    for key in ["experiment", "correlator_branch"]:
+      header[key] = header[key].split(b'\0')[0]
+    self.data = data
+    self.header = header
+    self.nchan = header["number_channels"]
+    if header["output_format_version"] in [2, 3]:
+      self.vis_dtype = numpy.float16 if header["output_format_version"] == 2 else numpy.int16
+    else:
+      self.vis_dtype = numpy.float32
+    self.baseline_size = baseline_dtype.itemsize + \
+                         (self.nchan + 1) * 2 * numpy.dtype(self.vis_dtype).itemsize
+
+    # Walk over the time slice headers, a partly written time slice at
+    # the end is left out
+    self.timeslices = []
+    offset = header_size
+    while offset + timeslice_dtype.itemsize <= data.size:
+      ts = data[offset:offset + timeslice_dtype.itemsize].view(timeslice_dtype)[0]
+      if ts["number_baselines"] <= 0:
+        break
+      end = offset + timeslice_dtype.itemsize + \
+            ts["number_uvw_coordinates"] * uvw_dtype.itemsize + \
+            ts["number_statistics"] * statistics_dtype.itemsize + \
+            ts["number_baselines"] * self.baseline_size
+      if end > data.size:
+        break
+      self.timeslices.append(offset)
+      offset = end
+    return len(self.timeslices)
+
+  def __len__(self):
+    return len(self.timeslices)
+
+  def timeslice(self, i):
+    offset = self.timeslices[i]
+    data = self.data
+    ts = data[offset:offset + timeslice_dtype.itemsize].view(timeslice_dtype)[0]
+    offset += timeslice_dtype.itemsize
+    n = ts["number_uvw_coordinates"]
+    uvw = data[offset:offset + n * uvw_dtype.itemsize].view(uvw_dtype)
+    offset += n * uvw_dtype.itemsize
+    n = ts["number_statistics"]
+    statistics = data[offset:offset + n * statistics_dtype.itemsize].view(statistics_dtype)
+    offset += n * statistics_dtype.itemsize
+
+    nbaselines = ts["number_baselines"]
+    block = data[offset:offset + nbaselines * self.baseline_size].reshape(nbaselines, self.baseline_size)
+    baselines = block[:, :baseline_dtype.itemsize].copy().view(baseline_dtype).reshape(nbaselines)
+    vis = block[:, baseline_dtype.itemsize:].copy().view(self.vis_dtype)
+    if self.vis_dtype == numpy.float32:
+      visibilities = vis.view(numpy.complex64)
+    else:
+      exponent = baselines["scale_exponent"].astype(numpy.int32)[:, numpy.newaxis]
+      vis = numpy.ldexp(vis.astype(numpy.float32), exponent)
+      visibilities = (vis[:, 0::2] + 1j * vis[:, 1::2]).astype(numpy.complex64)
+
+    # With baseline dependent averaging the time slice covers the
+    # integrations first_integration_slice to integration_slice
+    first = int(ts["integration_slice"])
+    if (uvw.size > 0) and (uvw["averaged_integrations"][0] > 1):
+      first -= int(uvw["averaged_integrations"][0]) - 1
+    return {"integration_slice": int(ts["integration_slice"]),
+            "first_integration_slice": first,
+            "uvw": uvw, "statistics": statistics,
+            "baselines": baselines, "visibilities": visibilities}
+
+  def next_integration(self, i):
+    integration_slice = self.timeslice_header(i)["integration_slice"]
+    i += 1
+    while (i < len(self.timeslices)) and \
+          (self.timeslice_header(i)["integration_slice"] == integration_slice):
+      i += 1
+    return i
+
+  def timeslice_header(self, i):
+    offset = self.timeslices[i]
+    return self.data[offset:offset + timeslice_dtype.itemsize].view(timeslice_dtype)[0]
@@ -0,0 +1,116 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * Creates the index (<file>.coridx) of correlator output files, or
+ * prints one baseline of an output file using the index.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cor_index.h"
+
+void usage(char *name) {
+  std::cout << "Usage : " << name << " <cor-file> [<cor-file> ...]\n"
+            << "        " << name << " -b <station1>,<station2>,<frequency_nr>,<sideband>,"
+            << "<polarisation1>,<polarisation2> <cor-file>\n"
+            << "The first form creates the index of the output files, the second form\n"
+            << "prints the visibilities of one baseline in every time slice.\n";
+}
+
+bool create_index(const char *filename) {
+  FILE *infile = fopen(filename, "rb");
+  if (infile == NULL) {
+    std::cerr << "Could not open " << filename << " for reading.\n";
+    return false;
+  }
+  std::string index_file = std::string(filename) + COR_INDEX_EXTENSION;
+  Cor_index_writer writer;
+  if (!writer.open(index_file)) {
+    std::cerr << "Could not create " << index_file << "\n";
+    fclose(infile);
+    return false;
+  }
+  std::vector<char> buffer(4 * 1024 * 1024);
+  size_t n;
+  while ((n = fread(&buffer[0], 1, buffer.size(), infile)) > 0)
+    writer.add_data(&buffer[0], n);
+  fclose(infile);
+  writer.close();
+
+  Cor_index index;
+  if (!index.open(index_file)) {
+    std::cerr << "Could not read " << index_file << "\n";
+    return false;
+  }
+  std::cout << filename << ": " << index.size() << " index entries\n";
+  return true;
+}
+
+int print_baseline(const char *filename, const char *selection) {
+  int station1, station2, frequency_nr, sideband, polarisation1, polarisation2;
+  if (sscanf(selection, "%d,%d,%d,%d,%d,%d", &station1, &station2, &frequency_nr,
+             &sideband, &polarisation1, &polarisation2) != 6) {
+    std::cerr << "Invalid baseline " << selection << "\n";
+    return 1;
+  }
+  Cor_reader reader;
+  if (!reader.open(filename)) {
+    std::cerr << "Could not read " << filename << "\n";
+    return 1;
+  }
+  if (!reader.has_index_file())
+    std::cerr << "No index found for " << filename << ", the file was scanned\n";
+
+  std::vector<int32_t> slices;
+  reader.get_integration_slices(slices);
+  std::vector< std::complex<float> > data;
+  for (size_t i = 0; i < slices.size(); i++) {
+    Output_header_baseline baseline;
+    baseline.station_nr1 = station1;
+    baseline.station_nr2 = station2;
+    baseline.frequency_nr = frequency_nr;
+    baseline.sideband = sideband;
+    baseline.polarisation1 = polarisation1;
+    baseline.polarisation2 = polarisation2;
+    if (!reader.read_baseline(slices[i], baseline, data))
+      continue;
+    std::cout << "slice " << slices[i] << " weight " << baseline.weight << "\n";
+    for (size_t j = 0; j < data.size(); j++)
+      std::cout << data[j].real() << " " << data[j].imag() << "\n";
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *selection = NULL;
+  int c;
+  while ((c = getopt(argc, argv, "b:")) != -1) {
+    switch (c) {
+    case 'b':
+      selection = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((optind >= argc) || ((selection != NULL) && (argc - optind != 1))) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (selection != NULL)
+    return print_baseline(argv[optind], selection);
+
+  int result = 0;
+  for (int i = optind; i < argc; i++) {
+    if (!create_index(argv[i]))
+      result = 1;
+  }
+  return result;
+}
@@ -24,6 +24,12 @@
 #include <time.h>
 #include <math.h>
 #include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <string>
+#include <map>
 
 #include "generate_delay_model.h"
 #include "vex/Vex++.h"
@@ -35,6 +41,8 @@
 
 extern "C" void generate_delay_tables(FILE *output, char *stationname,
 		    double start, double stop);
+extern "C" void write_delay_header(FILE *output, char *stationname);
+extern "C" void generate_delay_scan(FILE *output, int scan);
 
 // Time between sample points
 const double delta_time = 1; // in seconds
@@ -49,6 +57,13 @@ struct Source_data *source_data;
 // Reads the data from the vex-file
 int initialise_data(const char *vex_file,
                     const std::string &station_name);
+int initialise_data(const Vex &vex,
+                    const std::string &station_name);
+
+// Generates the delay tables of all stations with a pool of processes
+int generate_all_delay_tables(const char *vex_file, const char *prefix,
+                              const std::vector<std::string> &stations,
+                              int nr_processes, const char *cache_dir);
 
 
 double vex2time(std::string str);
@@ -59,6 +74,8 @@ usage(void)
   extern char *__progname;
 
   fprintf(stderr, "usage: %s: [-a] vexfile station outfile [start stop]\n", __progname);
+  fprintf(stderr, "       %s: -o prefix [-j processes] [-c cache_dir] vexfile station...\n",
+          __progname);
   exit(EXIT_FAILURE);
 }
 
@@ -67,12 +84,23 @@ main(int argc, char *argv[])
 {
   int ch, append = 0;
   double start, stop;
+  const char *prefix = NULL, *cache_dir = NULL;
+  int nr_processes = sysconf(_SC_NPROCESSORS_ONLN);
 
-  while ((ch = getopt(argc, argv, "a")) != -1) {
+  while ((ch = getopt(argc, argv, "ao:j:c:")) != -1) {
     switch(ch) {
     case 'a':
       append = 1;
       break;
+    case 'o':
+      prefix = optarg;
+      break;
+    case 'j':
+      nr_processes = atoi(optarg);
+      break;
+    case 'c':
+      cache_dir = optarg;
+      break;
     default:
       usage();
       break;
@@ -82,6 +110,15 @@ main(int argc, char *argv[])
   argc -= optind;
   argv += optind;
 
+  if (prefix != NULL) {
+    // All stations in one run, writes <prefix>_<station>.del
+    if (argc < 2 || append || nr_processes < 1)
+      usage();
+    std::vector<std::string> stations(argv + 1, argv + argc);
+    return generate_all_delay_tables(argv[0], prefix, stations,
+                                     nr_processes, cache_dir);
+  }
+
   if (argc != 3 && argc != 5)
     usage();
 
@@ -273,9 +310,20 @@ check_eop(Vex::Node& root, const std::string& eop) {
 int initialise_data(const char *vex_filename,
                     const std::string &station_name) {
   Vex vex(vex_filename);
+  return initialise_data(vex, station_name);
+}
 
+int initialise_data(const Vex &vex,
+                    const std::string &station_name) {
   Vex::Node root = vex.get_root_node();
 
+  // Free the data of a previous station
+  for (int i = 0; i < n_scans; i++)
+    delete[] scan_data[i].sources;
+  delete[] scan_data;
+  delete[] source_data;
+  memset(&station_data, 0, sizeof(station_data));
+
   if (root["STATION"][station_name] == root["STATION"]->end()) {
     std::cerr << "station " << station_name << " not found" << std::endl;
     exit(EXIT_FAILURE);
@@ -510,3 +558,245 @@ int initialise_data(const char *vex_filename,
   }
   return 0;
 }
+
+/*******************************************/
+/**  Generation of all stations at once   **/
+/*******************************************/
+
+// Increase when the format of the cached scans changes
+#define DELAY_CACHE_VERSION 1
+
+// FNV-1a hash of the data that determines the delay table of a scan
+class Scan_hash {
+public:
+  Scan_hash() : value(14695981039346656037ULL) {}
+  void add(const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+      value ^= bytes[i];
+      value *= 1099511628211ULL;
+    }
+  }
+  template <class T> void add(const T &data) {
+    add(&data, sizeof(T));
+  }
+  unsigned long long value;
+};
+
+// The scans of a station are cached under the hash of the station, scan
+// and source data, a scan is only computed again if one of them changed
+unsigned long long
+scan_hash(int scan_nr) {
+  Scan_hash hash;
+  hash.add(DELAY_CACHE_VERSION);
+  hash.add(delta_time);
+  hash.add(station_data.site_name, sizeof(station_data.site_name));
+  hash.add(station_data.site_position, sizeof(station_data.site_position));
+  hash.add(station_data.axis_type);
+  hash.add(station_data.axis_offset);
+  hash.add(station_data.tai_utc);
+  hash.add(station_data.eop_ref_epoch);
+  hash.add(station_data.num_eop_points);
+  hash.add(station_data.ut1_utc, station_data.num_eop_points * sizeof(double));
+  hash.add(station_data.x_wobble, station_data.num_eop_points * sizeof(double));
+  hash.add(station_data.y_wobble, station_data.num_eop_points * sizeof(double));
+
+  const Scan_data &scan = scan_data[scan_nr];
+  hash.add(scan.year);
+  hash.add(scan.month);
+  hash.add(scan.day);
+  hash.add(scan.hour);
+  hash.add(scan.min);
+  hash.add(scan.scan_start);
+  hash.add(scan.scan_stop);
+  hash.add(scan.nr_of_intervals);
+  hash.add(scan.n_sources);
+  for (int i = 0; i < scan.n_sources; i++) {
+    hash.add(scan.sources[i]->source_name, sizeof(scan.sources[i]->source_name));
+    hash.add(scan.sources[i]->ra);
+    hash.add(scan.sources[i]->dec);
+  }
+  return hash.value;
+}
+
+std::string
+absolute_path(const std::string &path) {
+  if (path.empty() || path[0] == '/')
+    return path;
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    std::cout << "Error: Could not get the current directory" << std::endl;
+    exit(1);
+  }
+  return std::string(cwd) + "/" + path;
+}
+
+// Waits for one of the processes, returns false if it failed
+bool
+wait_for_process(std::map<pid_t, std::string> &running) {
+  int status;
+  pid_t pid = wait(&status);
+  if (pid < 0)
+    return false;
+  std::map<pid_t, std::string>::iterator it = running.find(pid);
+  if (it == running.end())
+    return true;
+  bool ok = WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+  if (!ok)
+    std::cout << "Error: Generating the delay table of " << it->second
+              << " failed" << std::endl;
+  running.erase(it);
+  return ok;
+}
+
+bool
+append_file(FILE *output, const std::string &filename) {
+  FILE *input = fopen(filename.c_str(), "r");
+  if (input == NULL)
+    return false;
+  char buffer[65536];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0)
+    fwrite(buffer, 1, size, output);
+  bool ok = !ferror(input);
+  fclose(input);
+  return ok;
+}
+
+// CALC keeps its state in global variables, so the scans are computed in
+// parallel by forked processes. Every process writes the delay table of
+// one scan to the cache directory, afterwards the scans are concatenated
+// in order, which gives the same delay file as generating it per station.
+int
+generate_all_delay_tables(const char *vex_file, const char *prefix,
+                          const std::vector<std::string> &stations,
+                          int nr_processes, const char *cache_dir) {
+  Vex vex;
+  if (!vex.open(vex_file)) {
+    std::cout << "Could not parse vex file [" << vex_file << "]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Without a cache directory the scans go to a temporary directory
+  std::string cache;
+  bool temporary_cache = (cache_dir == NULL);
+  if (temporary_cache) {
+    const char *tmpdir = getenv("TMPDIR");
+    std::string name = std::string(tmpdir != NULL ? tmpdir : "/tmp") +
+                       "/generate_delay_model.XXXXXX";
+    std::vector<char> tmp_name(name.begin(), name.end());
+    tmp_name.push_back('\0');
+    if (mkdtemp(&tmp_name[0]) == NULL) {
+      std::cout << "Error: Could not create a temporary directory" << std::endl;
+      return EXIT_FAILURE;
+    }
+    cache = &tmp_name[0];
+  } else {
+    if ((mkdir(cache_dir, 0777) != 0) && (errno != EEXIST)) {
+      std::cout << "Error: Could not create cache directory \"" << cache_dir << "\"\n";
+      return EXIT_FAILURE;
+    }
+    cache = absolute_path(cache_dir);
+  }
+  std::string output_prefix = absolute_path(prefix);
+
+  // Goto the location of calc-10 files ocean.dat, tilt.dat and DE405_le.jpl
+  char *dir = getenv("CALC_DIR");
+  if (dir != NULL) {
+    int err = chdir(dir);
+    if (err != 0) {
+      printf("Error : Invalid CALC_DIR = %s\n", dir);
+      exit(1);
+    }
+  }
+
+  // The cached scan files of every station, in the order of the scans
+  std::vector< std::vector<std::string> > scan_files(stations.size());
+  std::map<pid_t, std::string> running;
+  bool ok = true;
+  for (size_t station = 0; ok && (station < stations.size()); station++) {
+    if (initialise_data(vex, stations[station]) != 0) {
+      std::cout << "Could not initialise the delay model of station "
+                << stations[station] << std::endl;
+      ok = false;
+      break;
+    }
+    int nr_cached = 0;
+    for (int scan = 0; scan < n_scans; scan++) {
+      char hash[17];
+      snprintf(hash, sizeof(hash), "%016llx", scan_hash(scan));
+      std::string filename = cache + "/" + stations[station] + "_" + hash + ".del";
+      scan_files[station].push_back(filename);
+      struct stat info;
+      if (stat(filename.c_str(), &info) == 0) {
+        nr_cached++;
+        continue;
+      }
+
+      while ((int)running.size() >= nr_processes)
+        ok &= wait_for_process(running);
+      if (!ok)
+        break;
+
+      // Don't let the child write the buffered output of the parent
+      fflush(NULL);
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::cout << "Error: Could not start a process" << std::endl;
+        ok = false;
+        break;
+      }
+      if (pid == 0) {
+        // Write to a temporary file, a cached scan is always complete
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%d", (int)getpid());
+        std::string tmp_filename = filename + suffix;
+        FILE *output = fopen(tmp_filename.c_str(), "w");
+        if (output == NULL)
+          _exit(1);
+        generate_delay_scan(output, scan);
+        bool written = (fclose(output) == 0) &&
+                       (rename(tmp_filename.c_str(), filename.c_str()) == 0);
+        fflush(NULL);
+        _exit(written ? 0 : 1);
+      }
+      char description[64];
+      snprintf(description, sizeof(description), "scan %d of station ", scan);
+      running[pid] = description + stations[station];
+    }
+    std::cout << "Generating delay model for station " << stations[station]
+              << ", " << nr_cached << " of " << n_scans << " scans cached"
+              << std::endl;
+  }
+  while (!running.empty())
+    ok &= wait_for_process(running);
+
+  // Concatenate the scans
+  for (size_t station = 0; ok && (station < stations.size()); station++) {
+    std::string filename = output_prefix + "_" + stations[station] + ".del";
+    FILE *output = fopen(filename.c_str(), "w");
+    if (output == NULL) {
+      std::cout << "Error: Could not open delay file \"" << filename << "\" for writing\n";
+      ok = false;
+      break;
+    }
+    write_delay_header(output, (char *)stations[station].c_str());
+    for (size_t scan = 0; ok && (scan < scan_files[station].size()); scan++) {
+      if (!append_file(output, scan_files[station][scan])) {
+        std::cout << "Error: Could not read " << scan_files[station][scan] << std::endl;
+        ok = false;
+      }
+    }
+    if (fclose(output) != 0)
+      ok = false;
+  }
+
+  if (temporary_cache) {
+    for (size_t station = 0; station < scan_files.size(); station++) {
+      for (size_t scan = 0; scan < scan_files[station].size(); scan++)
+        unlink(scan_files[station][scan].c_str());
+    }
+    rmdir(cache.c_str());
+  }
+  return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
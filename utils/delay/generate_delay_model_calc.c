@@ -622,37 +622,51 @@ finis(short *status)
 }
 
 void
-generate_delay_tables(FILE *output, char *stationname, double start,
-		      double stop)
+write_delay_header(FILE *output, char *stationname)
 {
-  output_file = output;
+  int32_t header_size = 3;
+  char name[3];
 
   assert(strlen(stationname) > 0);
   assert(strlen(stationname) < 3);
 
-  if (ftell(output) == 0) {
-    int32_t header_size = 3;
-    char name[3];
+  strncpy(name, stationname, sizeof(name));
+  name[2] = 0;
 
-    strncpy(name, stationname, sizeof(name));
-    name[2] = 0;
+  fwrite(&header_size, 1, sizeof(int32_t), output);
+  fwrite(name, 3, sizeof(char), output);
+}
 
-    fwrite(&header_size, 1, sizeof(int32_t), output_file);
-    fwrite(name, 3, sizeof(char), output_file);
+// Computes the delays of all sources in one scan, the scans are
+// independent of each other
+void
+generate_delay_scan(FILE *output, int scan)
+{
+  output_file = output;
+  scan_nr = scan;
+  for (source_nr = 0; source_nr < scan_data[scan_nr].n_sources; source_nr++) {
+    scan_data[scan_nr].sec = round(fmod(scan_data[scan_nr].scan_start, 60));
+    scan_data[scan_nr].sec_of_day = round(fmod(scan_data[scan_nr].scan_start, 24 * 60 * 60));
+    interval = 0;
+    calc();
   }
+}
 
-  for (scan_nr = 0; scan_nr < n_scans; scan_nr++) {
-    struct Scan_data *scan = &scan_data[scan_nr];
+void
+generate_delay_tables(FILE *output, char *stationname, double start,
+		      double stop)
+{
+  if (ftell(output) == 0)
+    write_delay_header(output, stationname);
+
+  int i;
+  for (i = 0; i < n_scans; i++) {
+    struct Scan_data *scan = &scan_data[i];
     if (scan->scan_stop <= start)
       continue;
     if (scan->scan_start >= stop)
       break;
-    for (source_nr = 0; source_nr < scan->n_sources; source_nr++) {
-      scan->sec = round(fmod(scan->scan_start, 60));
-      scan->sec_of_day = round(fmod(scan->scan_start, 24 * 60 * 60));
-      interval = 0;
-      calc();
-    }
+    generate_delay_scan(output, i);
   }
 }
 
@@ -6,17 +6,86 @@
   $Id$
 */
 #include <fstream>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "fringe_info.h"
 
 #define MAX_SNR_VALUE 8
 #define MIN_SNR_VALUE 3
 
+namespace {
+// gnuplot_init uses a static buffer to find gnuplot
+pthread_mutex_t gnuplot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Calls function(context, thread, item) for all items, the items are
+// divided dynamically over nr_threads threads
+struct Parallel_loop {
+  void (*function)(void *context, int thread, int item);
+  void *context;
+  int nr_items;
+  int next_item;
+};
+
+struct Parallel_thread {
+  Parallel_loop *loop;
+  int thread;
+};
+
+void *parallel_loop_thread(void *arg) {
+  Parallel_thread *self = (Parallel_thread *)arg;
+  Parallel_loop *loop = self->loop;
+  int item;
+  while ((item = __sync_fetch_and_add(&loop->next_item, 1)) < loop->nr_items)
+    loop->function(loop->context, self->thread, item);
+  return NULL;
+}
+
+void parallel_for(int nr_threads, int nr_items,
+                  void (*function)(void *context, int thread, int item),
+                  void *context) {
+  Parallel_loop loop;
+  loop.function = function;
+  loop.context = context;
+  loop.nr_items = nr_items;
+  loop.next_item = 0;
+
+  nr_threads = std::max(1, std::min(nr_threads, nr_items));
+  std::vector<Parallel_thread> threads(nr_threads);
+  std::vector<pthread_t> ids(nr_threads);
+  int nr_started = 1;
+  for (int i = 0; i < nr_threads; i++) {
+    threads[i].loop = &loop;
+    threads[i].thread = i;
+  }
+  // The calling thread is thread 0
+  for (int i = 1; i < nr_threads; i++) {
+    if (pthread_create(&ids[i], NULL, parallel_loop_thread, &threads[i]) != 0)
+      break;
+    nr_started++;
+  }
+  parallel_loop_thread(&threads[0]);
+  for (int i = 1; i < nr_started; i++)
+    pthread_join(ids[i], NULL);
+}
+
+struct Transform_context {
+  std::vector<Fringe_info> *fringe_infos;
+  std::vector<SFXC_FFT_FLOAT *> ffts;
+};
+
+void transform_fringe_info(void *context, int thread, int item) {
+  Transform_context *self = (Transform_context *)context;
+  (*self->fringe_infos)[item].transform(*self->ffts[thread]);
+}
+} // namespace
+
 Fringe_info::
 Fringe_info(const Output_header_baseline &header,
             const std::vector< std::complex<float> > &data_freq_,
             const std::vector< std::complex<float> > &data_lag_)
     : header(header), data_freq(data_freq_), data_lag(data_lag_),
-      initialised(true) {
+      snr(0), fringe_offset(0), initialised(true) {
   assert(data_freq_.size() == data_lag_.size() + 1);
 }
 
@@ -88,7 +157,9 @@ void Fringe_info::plot(char *filename, char *filename_large, char *title,
   }
 
   char cmd[80];
+  pthread_mutex_lock(&gnuplot_mutex);
   gnuplot_ctrl *g = gnuplot_init();
+  pthread_mutex_unlock(&gnuplot_mutex);
   // This works on huygens
   gnuplot_cmd(g, (char*)"set terminal png small size 300,200");
   // This works on das3
@@ -100,7 +171,9 @@ void Fringe_info::plot(char *filename, char *filename_large, char *title,
   gnuplot_plot_x(g, &data[0], data.size(), title) ;
   gnuplot_close(g);
 
+  pthread_mutex_lock(&gnuplot_mutex);
   g = gnuplot_init();
+  pthread_mutex_unlock(&gnuplot_mutex);
   // This works on huygens
   gnuplot_cmd(g, (char*)"set terminal png large size 1024,768");
   // This works on das3
@@ -121,6 +194,24 @@ void Fringe_info::plot(char *filename, char *filename_large, char *title,
   gnuplot_close(g);
 }
 
+void Fringe_info::transform(SFXC_FFT_FLOAT &fft) {
+  // Reverse the lowerside bands, so that channels are in increasing frequency order
+  if(header.sideband == 0){
+    for(int j = 0, N = data_freq.size() - 1 ; j <= N / 2; j++){
+      std::complex<float> temp = data_freq[j];
+      data_freq[j] = data_freq[N-j];
+      data_freq[N-j] = temp;
+    }
+  }
+  fft.ifft(&data_freq[0], &data_lag[0]);
+
+  // Move the fringe to the center of the plot
+  std::rotate(data_lag.begin(), data_lag.begin() + data_lag.size()/2, data_lag.end());
+
+  snr = signal_to_noise_ratio();
+  fringe_offset = max_value_offset();
+}
+
 float Fringe_info::signal_to_noise_ratio() const {
   const size_t N = data_lag.size();
   int index_max = max_value_offset();
@@ -176,7 +267,9 @@ int Fringe_info::max_value_offset() const {
 // Fringe_info_container
 
 Fringe_info_container::
-Fringe_info_container(FILE *input, bool stop_at_eof) : input(input) {
+Fringe_info_container(FILE *input, bool stop_at_eof)
+  : input(input), first_timeslice_offset(0), last_timeslice_offset(0),
+    nr_threads(std::max(1L, sysconf(_SC_NPROCESSORS_ONLN))) {
   // read-in the global header
   read_data_from_file(sizeof(Output_header_global),
                       (char *)&global_header, stop_at_eof);
@@ -184,25 +277,11 @@ Fringe_info_container(FILE *input, bool stop_at_eof) : input(input) {
 
   data_freq.resize(global_header.number_channels+1);
   data_lag.resize(global_header.number_channels);
-  fft.resize(global_header.number_channels); // FIXME : THIS SHOULD BE 2*NCHAN
+  visibility_buffer.resize(data_freq.size() *
+                           output_visibility_size(global_header.output_format_version));
 
   // Read the first timeslice header:
-  read_data_from_file(sizeof(Output_header_timeslice),
-                      (char*)&last_timeslice_header, stop_at_eof);
-  if (eof()) return;
-  
-  // Read the UVW coordinates, these are not used at the moment
-  for(int i=0 ; i<last_timeslice_header.number_uvw_coordinates ; i++){
-    struct Output_uvw_coordinates uvw_coordinates;
-    read_data_from_file(sizeof(Output_uvw_coordinates),
-                      (char*)&uvw_coordinates, stop_at_eof);
-    if (eof()) return;
-  }
-
-  // Read in the bit statistics and process them
-  new_statistics.resize(last_timeslice_header.number_statistics);
-  read_data_from_file(sizeof(Output_header_bitstatistics)*new_statistics.size(),
-                     (char*)&new_statistics[0], stop_at_eof);
+  if (!read_timeslice_header(stop_at_eof)) return;
 
   assert(last_timeslice_header.number_baselines != 0);
 }
@@ -226,12 +305,132 @@ Fringe_info_container::read_data_from_file(int to_read, char * data,
   }
 }
 
+bool
+Fringe_info_container::read_timeslice_header(bool stop_at_eof) {
+  last_timeslice_offset = ftello(input);
+  read_data_from_file(sizeof(Output_header_timeslice),
+                      (char*)&last_timeslice_header, stop_at_eof);
+  if ((stop_at_eof && eof()) || (last_timeslice_header.number_baselines == 0))
+    return false;
+
+  // Read the UVW coordinates, these are not used at the moment
+  for(int i=0 ; i<last_timeslice_header.number_uvw_coordinates ; i++){
+    struct Output_uvw_coordinates uvw_coordinates;
+    read_data_from_file(sizeof(Output_uvw_coordinates),
+                        (char*)&uvw_coordinates, stop_at_eof);
+    if (eof()) return false;
+  }
+
+  // Read in the bit statistics and process them
+  new_statistics.resize(last_timeslice_header.number_statistics);
+  if (!new_statistics.empty())
+    read_data_from_file(sizeof(Output_header_bitstatistics)*new_statistics.size(),
+                        (char*)&new_statistics[0], stop_at_eof);
+  return true;
+}
+
+off_t
+Fringe_info_container::
+timeslice_size(const Output_header_timeslice &header) const {
+  return sizeof(Output_header_timeslice) +
+         (off_t)header.number_uvw_coordinates * sizeof(Output_uvw_coordinates) +
+         (off_t)header.number_statistics * sizeof(Output_header_bitstatistics) +
+         (off_t)header.number_baselines *
+           (sizeof(Output_header_baseline) + visibility_buffer.size());
+}
+
+bool
+Fringe_info_container::goto_last_integration() {
+  struct stat info;
+  if (fstat(fileno(input), &info) != 0)
+    return false;
+
+  // Walk over the timeslice headers without reading the visibilities
+  int fd = fileno(input);
+  off_t offset = last_timeslice_offset;
+  off_t integration_offset = offset, last_complete = offset;
+  int integration_slice = last_timeslice_header.integration_slice;
+  while (true) {
+    Output_header_timeslice header;
+    if (pread(fd, &header, sizeof(header), offset) != sizeof(header))
+      break;
+    if (header.number_baselines == 0)
+      break;
+    if (header.integration_slice != integration_slice) {
+      // The previous integration is complete
+      last_complete = integration_offset;
+      integration_slice = header.integration_slice;
+      integration_offset = offset;
+    }
+    offset += timeslice_size(header);
+    if (offset > info.st_size)
+      break;
+  }
+  if (last_complete == last_timeslice_offset)
+    return false;
+
+  fseeko(input, last_complete, SEEK_SET);
+  return read_timeslice_header(true);
+}
+
+void
+Fringe_info_container::save_position(const char *filename) {
+  std::string tmp_filename = std::string(filename) + ".tmp";
+  std::ofstream out(tmp_filename.c_str());
+  if (!out.is_open())
+    return;
+  out << first_timeslice_offset << " " << global_header.start_year << " "
+      << global_header.start_day << " " << global_header.start_time << " "
+      << experiment_name() << std::endl;
+  out.close();
+  rename(tmp_filename.c_str(), filename);
+}
+
+std::string
+Fringe_info_container::experiment_name() const {
+  return std::string(global_header.experiment,
+                     strnlen(global_header.experiment, sizeof(global_header.experiment)));
+}
+
+bool
+Fringe_info_container::load_position(const char *filename, bool stop_at_eof) {
+  std::ifstream in(filename);
+  std::string experiment;
+  int start_year, start_day, start_time;
+  off_t offset;
+  if (!(in >> offset >> start_year >> start_day >> start_time))
+    return false;
+  in.get();
+  std::getline(in, experiment);
+  if ((experiment != experiment_name()) ||
+      (start_year != global_header.start_year) ||
+      (start_day != global_header.start_day) ||
+      (start_time != global_header.start_time))
+    return false;
+
+  Output_header_timeslice header = last_timeslice_header;
+  off_t header_offset = last_timeslice_offset;
+  fseeko(input, offset, SEEK_SET);
+  if (read_timeslice_header(stop_at_eof))
+    return true;
+
+  // The file changed, start from the beginning
+  clearerr(input);
+  last_timeslice_header = header;
+  fseeko(input, header_offset, SEEK_SET);
+  read_timeslice_header(stop_at_eof);
+  return false;
+}
+
 void
 Fringe_info_container::read_plots(bool stop_at_eof) {
   // Clear previous plots
   plots.clear();
   first_timeslice_header = last_timeslice_header;
+  first_timeslice_offset = last_timeslice_offset;
 
+  // The baselines are transformed in parallel once the integration is read
+  std::vector<Fringe_info> fringe_infos;
   bool first = true;
   while (first_timeslice_header.integration_slice ==
          last_timeslice_header.integration_slice) {
@@ -245,54 +444,24 @@ Fringe_info_container::read_plots(bool stop_at_eof) {
                           (char*)&baseline_header,
                           stop_at_eof && (!first));
       if (baseline_header.weight == -1) {
+        set_plots(fringe_infos);
         return;
       }
 
       // Read the data
-      read_data_from_file(data_freq.size()*sizeof(std::complex<float>),
-                          (char *)&data_freq[0],
+      read_data_from_file(visibility_buffer.size(), &visibility_buffer[0],
                           stop_at_eof && (!first));
-      // Reverse the lowerside bands, so that channels are in increasing frequency order
-      if(baseline_header.sideband == 0){
-        for(int j = 0, N = data_freq.size() - 1 ; j <= N / 2; j++){
-          std::complex<float> temp = data_freq[j];
-          data_freq[j] = data_freq[N-j];
-          data_freq[N-j] = temp;
-        }
-      }
-      fft.ifft(&data_freq[0], &data_lag[0]);
-
-      { // Move the fringe to the center of the plot
-        std::vector< std::complex<float> > tmp = data_lag;
-        const size_t size = data_lag.size();
-        for (size_t i=0; i<size; i++) {
-          data_lag[i] = tmp[(i+size/2)%size];
-        }
-      }
-
-      set_plot(Fringe_info(baseline_header, data_freq, data_lag));
+      decode_visibilities(global_header.output_format_version, baseline_header,
+                          &visibility_buffer[0], data_freq.size(), &data_freq[0]);
+      fringe_infos.push_back(Fringe_info(baseline_header, data_freq, data_lag));
     }
 
-    { // Read the next timeslice header
-      read_data_from_file(sizeof(Output_header_timeslice),
-                          (char*)&last_timeslice_header, stop_at_eof);
-      if (last_timeslice_header.number_baselines == 0) {
-        return;
-      }
-      first = false;
-      // Read the UVW coordinates, these are not used at the moment
-      for(int i=0 ; i<last_timeslice_header.number_uvw_coordinates ; i++){
-        struct Output_uvw_coordinates uvw_coordinates;
-        read_data_from_file(sizeof(Output_uvw_coordinates),
-                      (char*)&uvw_coordinates, stop_at_eof);
-        if (eof()) return;
-      }
-      // Read in the bit statistics and process them
-      new_statistics.resize(last_timeslice_header.number_statistics);
-      read_data_from_file(sizeof(Output_header_bitstatistics)*new_statistics.size(),
-                         (char*)&new_statistics[0], stop_at_eof);
-    }
+    // Read the next timeslice header
+    if (!read_timeslice_header(stop_at_eof))
+      break;
+    first = false;
   }
+  set_plots(fringe_infos);
 }
 
 void
@@ -584,6 +753,7 @@ Fringe_info_container::print_html(const Vex &vex, char *vex_filename, std::strin
     index_html << "</html>" << std::endl;
 
     index_html.close();
+    render_plots();
 
     // Atomic update
     rename("index2.html", "index.html");
@@ -748,6 +918,26 @@ void Fringe_info_container::end_data_row(std::ostream &index_html) {
   index_html << "</tr>" << std::endl;
 }
 
+void
+Fringe_info_container::set_plots(std::vector<Fringe_info> &fringe_infos) {
+  Transform_context context;
+  context.fringe_infos = &fringe_infos;
+  context.ffts.resize(std::min(nr_threads, (int)fringe_infos.size()));
+  for (size_t i = 0; i < context.ffts.size(); i++) {
+    // The fft plans are created here, the planner is not thread safe
+    context.ffts[i] = new SFXC_FFT_FLOAT();
+    context.ffts[i]->resize(global_header.number_channels); // FIXME : THIS SHOULD BE 2*NCHAN
+    context.ffts[i]->ifft(&data_freq[0], &data_lag[0]);
+  }
+  parallel_for(context.ffts.size(), fringe_infos.size(),
+               transform_fringe_info, &context);
+  for (size_t i = 0; i < context.ffts.size(); i++)
+    delete context.ffts[i];
+
+  for (size_t i = 0; i < fringe_infos.size(); i++)
+    set_plot(fringe_infos[i]);
+}
+
 void
 Fringe_info_container::set_plot(const Fringe_info &fringe_info) {
   assert(fringe_info.initialised);
@@ -757,6 +947,39 @@ Fringe_info_container::set_plot(const Fringe_info &fringe_info) {
   plots.insert(fringe_info);
 }
 
+void
+Fringe_info_container::
+queue_plot(const Fringe_info &fringe_info,
+           const char *filename, const char *filename_large, const char *title,
+           Fringe_info::SPACE space, Fringe_info::VALUE value,
+           double frequency, double bandwidth) {
+  Plot plot;
+  plot.fringe_info = &fringe_info;
+  snprintf(plot.filename, sizeof(plot.filename), "%s", filename);
+  snprintf(plot.filename_large, sizeof(plot.filename_large), "%s", filename_large);
+  snprintf(plot.title, sizeof(plot.title), "%s", title);
+  plot.space = space;
+  plot.value = value;
+  plot.frequency = frequency;
+  plot.bandwidth = bandwidth;
+  queued_plots.push_back(plot);
+}
+
+void
+Fringe_info_container::render_plot(void *context, int /*thread*/, int item) {
+  Plot &plot = (*(std::vector<Plot> *)context)[item];
+  plot.fringe_info->plot(plot.filename, plot.filename_large, plot.title,
+                         plot.space, plot.value, plot.frequency, plot.bandwidth);
+}
+
+void
+Fringe_info_container::render_plots() {
+  // Every plot runs its own gnuplot process
+  parallel_for(nr_threads, queued_plots.size(), render_plot, &queued_plots);
+  queued_plots.clear();
+  queued_data.clear();
+}
+
 const Fringe_info &
 Fringe_info_container::
 get_first_plot() const {
@@ -813,8 +1036,8 @@ print_auto(std::ostream &index_html, const Fringe_info &fringe_info, int bbc,
   char filename[80], filename_large[80], title[80];
   generate_filename(filename, filename_large, title, 80, fringe_info,
                     Fringe_info::FREQUENCY, Fringe_info::ABS);
-  fringe_info.plot(filename, filename_large, title, Fringe_info::FREQUENCY, 
-                   Fringe_info::ABS, frequency, bandwidth);
+  queue_plot(fringe_info, filename, filename_large, title, Fringe_info::FREQUENCY,
+             Fringe_info::ABS, frequency, bandwidth);
   index_html << "<A href = '" << filename_large << "' "
   << "OnMouseOver=\"show('" << filename << "');\">"
   << bbc << "</a>";
@@ -832,24 +1055,24 @@ print_cross(std::ostream &index_html, const Fringe_info &fringe_info,
     generate_filename(filename_abs, filename_large_abs,
                       title, 80, fringe_info,
                       Fringe_info::FREQUENCY, Fringe_info::ABS);
-    fringe_info.plot(filename_abs, filename_large_abs, title, Fringe_info::FREQUENCY, 
-                     Fringe_info::ABS, frequency, bandwidth);
+    queue_plot(fringe_info, filename_abs, filename_large_abs, title, Fringe_info::FREQUENCY,
+               Fringe_info::ABS, frequency, bandwidth);
 
     char filename_phase[80], filename_large_phase[80];
     generate_filename(filename_phase, filename_large_phase,
                       title, 80, fringe_info,
                       Fringe_info::FREQUENCY, Fringe_info::PHASE);
-    fringe_info.plot(filename_phase, filename_large_phase, title, Fringe_info::FREQUENCY, 
-                     Fringe_info::PHASE, frequency, bandwidth);
+    queue_plot(fringe_info, filename_phase, filename_large_phase, title, Fringe_info::FREQUENCY,
+               Fringe_info::PHASE, frequency, bandwidth);
 
     char filename[80], filename_large[80];
     generate_filename(filename, filename_large,
                       title, 80, fringe_info,
                       Fringe_info::LAG, Fringe_info::ABS);
-    fringe_info.plot(filename, filename_large, title, Fringe_info::LAG, 
-                     Fringe_info::ABS, frequency, bandwidth);
+    queue_plot(fringe_info, filename, filename_large, title, Fringe_info::LAG,
+               Fringe_info::ABS, frequency, bandwidth);
 
-    double snr = fringe_info.signal_to_noise_ratio();
+    double snr = fringe_info.snr;
     int color_val =
       (int)(255*(snr-MIN_SNR_VALUE) / (MAX_SNR_VALUE-MIN_SNR_VALUE));
     if (color_val < 0)
@@ -879,7 +1102,7 @@ print_cross(std::ostream &index_html, const Fringe_info &fringe_info,
     << "P" << "</a>"
     << "<br>"
     << "<font size=-2>offset: "
-    << (fringe_info.max_value_offset() -
+    << (fringe_info.fringe_offset -
         global_header.number_channels/2)
     << "</font>";
     index_html << "</td>";
@@ -935,8 +1158,10 @@ print_diff(std::ostream &index_html,
   char filename[80], filename_large[80], title[80];
   generate_filename(filename, filename_large, title, 80, fringe_info1,
                     space, Fringe_info::ABS);
-  fringe_info1.plot(filename, filename_large, title, space, Fringe_info::ABS,
-                    frequency, bandwidth);
+  // The difference is plotted after the page is written
+  queued_data.push_back(fringe_info1);
+  queue_plot(queued_data.back(), filename, filename_large, title, space,
+             Fringe_info::ABS, frequency, bandwidth);
   index_html << "<A href = '" << filename_large << "' "
   << "OnMouseOver=\"show('" << filename << "');\">"
   << max_diff << "</a>";
@@ -1161,6 +1386,7 @@ print_diff_html(const Vex &vex,
     index_html << "</html>" << std::endl;
 
     index_html.close();
+    render_plots();
 
     // Atomic update
     rename("index2.html", "index.html");
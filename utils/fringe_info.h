@@ -1,6 +1,9 @@
 #include <vector>
 #include <complex>
 #include <set>
+#include <algorithm>
+#include <list>
+#include <sys/types.h>
 
 #include "sfxc_fft_float.h"
 #include "utils.h"
@@ -23,7 +26,7 @@ public:
     PHASE
   };
 
-  Fringe_info() : initialised(false) {}
+  Fringe_info() : snr(0), fringe_offset(0), initialised(false) {}
 
   Fringe_info(const Output_header_baseline &header,
               const std::vector< std::complex<float> > &data_freq_,
@@ -32,6 +35,10 @@ public:
   void plot(char *filename, char *filename_large,
             char *title, SPACE space, VALUE value, double frequency, double bandwith) const;
 
+  // Computes data_lag from data_freq and finds the fringe (snr and
+  // fringe_offset), fft is owned by the calling thread
+  void transform(SFXC_FFT_FLOAT &fft);
+
   float signal_to_noise_ratio() const;
 
   int max_value_offset() const;
@@ -41,6 +48,9 @@ public:
 public:
   Output_header_baseline                 header;
   std::vector< std::complex<float> >     data_freq, data_lag;
+  // Signal to noise ratio and position of the fringe, set by transform()
+  float                                  snr;
+  int                                    fringe_offset;
   bool                                   initialised;
 };
 
@@ -64,6 +74,22 @@ public:
 
   void read_plots(bool stop_at_eof);
 
+  // Number of threads for the lag transforms and the plots, defaults to
+  // the number of processors
+  void set_nr_threads(int nr_threads_) { nr_threads = std::max(1, nr_threads_); }
+
+  // Skips to the last integration that is completely in the file, an
+  // integration is complete once the next one has started.
+  // Returns false if there is no newer complete integration.
+  bool goto_last_integration();
+
+  // The position of the integration that was read last is stored in a
+  // file, so that a next run continues from there
+  void save_position(const char *filename);
+  // Continues from the position stored by save_position, returns false if
+  // there is no position for this correlation file
+  bool load_position(const char *filename, bool stop_at_eof);
+
   void print_html(const Vex &vex, char *vex_filename, std::string setup_station);
   void print_html_bitstatistics(const Vex &vex, const std::string &mode, std::ofstream &index_html);
   const Fringe_info &get_first_plot() const;
@@ -76,6 +102,12 @@ public:
   bool eof();
 private:
   void read_data_from_file(int to_read, char * data, bool stop_at_eof);
+  // Reads the timeslice header with its uvw coordinates and bit
+  // statistics, returns false at the end of the data
+  bool read_timeslice_header(bool stop_at_eof);
+  std::string experiment_name() const;
+  // Size of a timeslice with the given header, including the header
+  off_t timeslice_size(const Output_header_timeslice &header) const;
   std::string get_statistics_color(int64_t val, int64_t N);
 
   bool get_channels(const Vex &vex, const std::string &mode, std::vector<Channel> &channels);
@@ -83,6 +115,8 @@ private:
                std::vector< std::vector<int> > &bbcs, std::vector<double> &bandwiths);
 
   void set_plot(const Fringe_info &fringe_info);
+  // Transforms the baselines to lag space in parallel and stores them
+  void set_plots(std::vector<Fringe_info> &fringe_infos);
   void process_new_bit_statistics();
 
   void generate_filename(char *filename,
@@ -93,6 +127,14 @@ private:
                          const Fringe_info::SPACE space,
                          const Fringe_info::VALUE value);
 
+  // The plots are rendered in parallel once the html page is written
+  void queue_plot(const Fringe_info &fringe_info,
+                  const char *filename, const char *filename_large, const char *title,
+                  Fringe_info::SPACE space, Fringe_info::VALUE value,
+                  double frequency, double bandwidth);
+  static void render_plot(void *context, int thread, int item);
+  void render_plots();
+
   void print_auto(std::ostream &index_html, const Fringe_info &fringe_info, int bbc, 
                   double frequency, double bandwidth);
 
@@ -123,6 +165,8 @@ private:
 
   // Header of the last timeslice read;
   Output_header_timeslice first_timeslice_header, last_timeslice_header;
+  // Positions of these headers in the file
+  off_t first_timeslice_offset, last_timeslice_offset;
 
   // Bit statistics, the bitstatistics are stored in an ordered set
   struct stats_comp {
@@ -147,9 +191,23 @@ private:
   std::vector<Output_header_bitstatistics> new_statistics;
   statistics_set statistics;
 
+  int nr_threads;
+
   // Arrays containing one fft
-  SFXC_FFT_FLOAT fft;
   std::vector< std::complex<float> > data_freq, data_lag;
+  // The visibilities as stored in the output file
+  std::vector<char> visibility_buffer;
+
+  struct Plot {
+    const Fringe_info *fringe_info;
+    char filename[80], filename_large[80], title[80];
+    Fringe_info::SPACE space;
+    Fringe_info::VALUE value;
+    double frequency, bandwidth;
+  };
+  std::vector<Plot> queued_plots;
+  // Data of queued plots that is not in plots (the differences)
+  std::list<Fringe_info> queued_data;
 
   // To be able to return a dummy reference
   Fringe_info empty_fringe_info;
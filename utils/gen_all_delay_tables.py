@@ -18,7 +18,7 @@ except:
     import simplejson as json
     pass
 
-def gen_delay_tables(vex_file, ctrl_file, nprocs):
+def gen_delay_tables(vex_file, ctrl_file, nprocs, cache_directory):
   if not os.path.exists(vex_file):
     print "Vex file does not exist : " + vex_file
     sys.exit(1)
@@ -49,42 +49,23 @@ def gen_delay_tables(vex_file, ctrl_file, nprocs):
     print "Control file does not have a stations field"
     exit(0)
   experiment_name = ctrl["exper_name"]
-  nstations = len(ctrl["stations"])
-  if nprocs == None:
-    nprocs = nstations
-  else:
-    nprocs = min(nstations, nprocs)
-  procs = [(None, None) for i in range(nprocs)]
-  for i in range(nprocs):
-    station = ctrl["stations"][i]
-    procs[i] = (station, gen_delay(delay_directory, experiment_name, vex_file, station))
-  for i in range(nprocs, nstations):
-    station = ctrl["stations"][i]
-    done = False
-    while not done:
-      for j in range(nprocs):
-        status = procs[j][1].poll()
-        if status != None:
-          if status < 0:
-            print "Error failed generating delay file for station", procs[j][0]
-            sys.exit(1)
-          else:
-            done = True
-            procs[j] = (station, gen_delay(delay_directory, experiment_name, vex_file, station))
-            break
-  # Wait for processes to finish
-  for j in range(nprocs):
-    status = procs[j][1].wait()
-    if status < 0:
-      print "Error failed generating delay file for station", procs[j][0]
+  stations = ctrl["stations"]
 
-def gen_delay(delay_directory, experiment_name, vex_file, station):
-  delay_file = delay_directory + "/" + experiment_name + "_" + station + ".del"
-  cmd = ["generate_delay_model", vex_file, station , delay_file]
+  # One run generates the delay files of all stations, the scans are
+  # computed by nprocs processes (default: the number of processors)
+  prefix = delay_directory + "/" + experiment_name
+  cmd = ["generate_delay_model", "-o", prefix]
+  if nprocs != None:
+    cmd += ["-j", str(nprocs)]
+  if cache_directory != None:
+    cmd += ["-c", cache_directory]
+  cmd += [vex_file] + stations
   print cmd
-  proc = subprocess.Popen(cmd)
-  print "Generating delay model for station " + station
-  return proc
+  print "Generating delay model for stations " + ", ".join(stations)
+  status = subprocess.call(cmd)
+  if status != 0:
+    print "Error failed generating the delay files"
+    sys.exit(1)
 
 
 ######### MAIN CODE
@@ -94,8 +75,11 @@ if __name__ == "__main__":
   parser.add_option("-p", "--number-process", dest="nprocs", 
                     help="Specify the number of generate jobs to be run simultaneously",
                     action="store", type="int")
+  parser.add_option("-c", "--cache-directory", dest="cache_directory",
+                    help="Keep the delay tables of the scans in this directory, a next run only computes the scans that changed",
+                    action="store", type="string")
   opts, args = parser.parse_args()
   if len(args) == 2:
-    gen_delay_tables(args[0], args[1], opts.nprocs)
+    gen_delay_tables(args[0], args[1], opts.nprocs, opts.cache_directory)
   else:
     parser.error("Invalid number of arguments")
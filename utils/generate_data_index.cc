@@ -0,0 +1,363 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * Generates the time index (<file>.sfxcidx) of Mark5B and VDIF recordings,
+ * which is used by the correlator to seek in the recordings.
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "data_index.h"
+#include "utils.h"
+
+#define BUFFER_SIZE       (16*1024*1024)
+#define MARK5B_SYNCWORD   0xabaddeed
+#define MARK5B_FRAME_SIZE (16+10000)
+#define FILL_PATTERN      0x11223344
+// The words of a header that are parsed, the Mark5B header and the VDIF
+// header in legacy mode have no more than that
+#define HEADER_SIZE       16
+
+enum Format {MARK5B, VDIF};
+
+// Reads a file sequentially in large blocks
+class Input_stream {
+public:
+  Input_stream() : fd(-1), buffer(BUFFER_SIZE), begin(0), end(0), pos(0) {}
+  ~Input_stream() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool open(const char *filename) {
+    fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+      return false;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+  }
+
+  // Returns a pointer to the next n bytes, or NULL at the end of the file
+  const char *data(size_t n) {
+    if (end - begin < n) {
+      memmove(&buffer[0], &buffer[begin], end - begin);
+      end -= begin;
+      begin = 0;
+      while (end < n) {
+        ssize_t result = read(fd, &buffer[end], buffer.size() - end);
+        if ((result < 0) && (errno == EINTR))
+          continue;
+        if (result <= 0)
+          return NULL;
+        end += result;
+      }
+    }
+    return &buffer[begin];
+  }
+
+  // Skips n bytes, which must have been requested with data()
+  void skip(size_t n) {
+    begin += n;
+    pos += n;
+  }
+
+  uint64_t position() const {
+    return pos;
+  }
+
+private:
+  int fd;
+  std::vector<char> buffer;
+  size_t begin, end;
+  uint64_t pos;
+};
+
+// The header information that is needed for the index
+struct Frame {
+  enum Type {VALID, INVALID, NO_SYNC};
+  Type type;
+  // Seconds since MJD 0
+  int64_t seconds;
+  int frame_nr;
+  int thread;
+  size_t size;
+};
+
+// An entry of the index, before the number of frames per second is known
+struct Raw_entry {
+  int64_t seconds;
+  int frame_nr;
+  uint64_t position;
+  uint32_t flags;
+};
+
+int bcd(uint32_t value, int ndigits) {
+  int result = 0;
+  for (int i = ndigits - 1; i >= 0; i--)
+    result = result * 10 + ((value >> (4 * i)) & 0xf);
+  return result;
+}
+
+class Indexer {
+public:
+  Indexer(Format format_) : format(format_), first_vdif(NULL) {}
+
+  bool is_fill(const uint32_t *words) {
+    for (int i = 0; i < 4; i++) {
+      if (words[i] == FILL_PATTERN)
+        return true;
+    }
+    return false;
+  }
+
+  // Size of a VDIF header, words 4-7 are not present in legacy mode
+  static size_t vdif_header_size(const uint32_t *words) {
+    return (((words[0] >> 30) & 1) ? 16 : 32);
+  }
+
+  // Parses the header at the start of data
+  void parse(const char *data, Frame &frame) {
+    const uint32_t *words = (const uint32_t *)data;
+    frame.thread = 0;
+    frame.frame_nr = 0;
+    frame.seconds = 0;
+    if (format == MARK5B) {
+      frame.size = MARK5B_FRAME_SIZE;
+      if (words[0] == MARK5B_SYNCWORD) {
+        frame.type = Frame::VALID;
+        frame.frame_nr = words[1] & 0x7fff;
+        // Only the MJD modulo 1000 is stored in the header, the index
+        // takes the time stamps modulo 1000 days
+        frame.seconds = (int64_t)bcd(words[2] >> 20, 3) * SECONDS_PER_DAY +
+                        bcd(words[2], 5);
+      } else {
+        frame.type = (words[0] == FILL_PATTERN ? Frame::INVALID : Frame::NO_SYNC);
+      }
+      return;
+    }
+
+    if (is_fill(words)) {
+      // The frame size is not known before the first valid header
+      frame.type = (first_vdif == NULL ? Frame::NO_SYNC : Frame::INVALID);
+      frame.size = (first_vdif == NULL ? 0 : (first_vdif[2] & 0xffffff) * 8);
+      return;
+    }
+    if (first_vdif == NULL) {
+      // The frame length includes the header
+      if ((words[2] & 0xffffff) * 8 <= vdif_header_size(words)) {
+        frame.type = Frame::NO_SYNC;
+        frame.size = 0;
+        return;
+      }
+      memcpy(vdif_header, words, sizeof(vdif_header));
+      first_vdif = vdif_header;
+    }
+    frame.size = (first_vdif[2] & 0xffffff) * 8;
+    // Frame length, number of channels, version, station, epoch and
+    // legacy mode should be the same as in the first frame
+    if ((words[2] != first_vdif[2]) ||
+        ((words[3] & 0xffff) != (first_vdif[3] & 0xffff)) ||
+        ((words[1] >> 24) != (first_vdif[1] >> 24)) ||
+        (vdif_header_size(words) != vdif_header_size(first_vdif))) {
+      frame.type = Frame::NO_SYNC;
+      return;
+    }
+    int epoch = (words[1] >> 24) & 0x3f;
+    int epoch_mjd = mjd(1, 1 + 6 * (epoch % 2), 2000 + epoch / 2);
+    frame.type = ((words[0] >> 31) ? Frame::INVALID : Frame::VALID);
+    frame.seconds = (int64_t)epoch_mjd * SECONDS_PER_DAY + (words[0] & 0x3fffffff);
+    frame.frame_nr = words[1] & 0xffffff;
+    frame.thread = (words[3] >> 16) & 0x3ff;
+  }
+
+  // Searches for the next valid header, returns false at the end of the file
+  bool resync(Input_stream &in, Frame &frame) {
+    const size_t step = (format == MARK5B ? 4 : 8);
+    in.skip(step);
+    for (const char *data = in.data(HEADER_SIZE); data != NULL;
+         data = in.data(HEADER_SIZE)) {
+      parse(data, frame);
+      if ((frame.type == Frame::VALID) &&
+          (last.empty() || (llabs(frame.seconds - last_seconds) <= SECONDS_PER_DAY)))
+        return true;
+      in.skip(step);
+    }
+    return false;
+  }
+
+  void add_entry(const Frame &frame, uint64_t position, uint32_t flags) {
+    Raw_entry entry;
+    entry.seconds = frame.seconds;
+    entry.frame_nr = frame.frame_nr;
+    entry.position = position;
+    entry.flags = flags;
+    entries.push_back(entry);
+  }
+
+  bool run(const char *filename, int interval, Data_index &index) {
+    Input_stream in;
+    if (!in.open(filename)) {
+      std::cerr << "Could not open " << filename << " for reading.\n";
+      return false;
+    }
+
+    entries.clear();
+    last.clear();
+    max_frame_nr = 0;
+    int64_t last_entry_seconds = 0;
+    bool in_invalid = false, lost_sync = false;
+    uint64_t nframes = 0;
+    Frame frame;
+    const char *data = in.data(HEADER_SIZE);
+    while (data != NULL) {
+      parse(data, frame);
+      uint64_t position = in.position();
+      if (frame.type == Frame::NO_SYNC) {
+        if (!lost_sync)
+          std::cerr << "Lost sync at byte " << position << "\n";
+        lost_sync = true;
+        if (!resync(in, frame))
+          break;
+        data = in.data(HEADER_SIZE);
+        continue;
+      }
+
+      if (frame.type == Frame::INVALID) {
+        if (!in_invalid && !last.empty()) {
+          // Time stamp of the frame following the last valid frame
+          Frame expected = frame;
+          expected.seconds = last_seconds;
+          expected.frame_nr = last_frame_nr + 1;
+          add_entry(expected, position, Data_index::INVALID);
+        }
+        in_invalid = true;
+      } else {
+        std::map<int, std::pair<int64_t, int> >::iterator it = last.find(frame.thread);
+        uint32_t flags = 0;
+        bool add = entries.empty() || in_invalid || lost_sync ||
+                   (frame.seconds >= last_entry_seconds + interval);
+        if (lost_sync || (entries.empty() && (position != 0)))
+          flags |= Data_index::RESYNC;
+        if (it != last.end()) {
+          int64_t sec = it->second.first;
+          int nr = it->second.second;
+          bool next = ((frame.seconds == sec) && (frame.frame_nr == nr + 1)) ||
+                      ((frame.seconds == sec + 1) && (frame.frame_nr == 0) &&
+                       (nr >= max_frame_nr));
+          if (!next && !in_invalid) {
+            flags |= Data_index::GAP;
+            add = true;
+          }
+        }
+        if (add) {
+          add_entry(frame, position, flags);
+          last_entry_seconds = frame.seconds - frame.seconds % interval;
+        }
+        last[frame.thread] = std::make_pair(frame.seconds, frame.frame_nr);
+        last_seconds = frame.seconds;
+        last_frame_nr = frame.frame_nr;
+        max_frame_nr = std::max(max_frame_nr, frame.frame_nr);
+        in_invalid = lost_sync = false;
+      }
+
+      if (in.data(frame.size) == NULL)
+        break;
+      in.skip(frame.size);
+      nframes++;
+      data = in.data(HEADER_SIZE);
+    }
+
+    if (entries.empty()) {
+      std::cerr << "No valid headers found in " << filename << "\n";
+      return false;
+    }
+    if (!in_invalid) {
+      frame.seconds = last_seconds;
+      frame.frame_nr = last_frame_nr + 1;
+      add_entry(frame, in.position(), Data_index::END);
+    }
+
+    // Convert the entries to time stamps
+    const int frames_per_second = max_frame_nr + 1;
+    index.set_format(format == MARK5B ? "Mark5B" : "VDIF", interval);
+    if (format == MARK5B)
+      index.set_period((int64_t)1000 * SECONDS_PER_DAY * MAX_SAMPLE_RATE);
+    for (size_t i = 0; i < entries.size(); i++) {
+      int64_t ticks = (entries[i].seconds - (int64_t)REFERENCE_MJD * SECONDS_PER_DAY) * MAX_SAMPLE_RATE +
+                      (int64_t)entries[i].frame_nr * MAX_SAMPLE_RATE / frames_per_second;
+      index.add(ticks, entries[i].position, entries[i].flags);
+    }
+    std::cout << filename << ": " << nframes << " frames, "
+              << frames_per_second << " frames per second, "
+              << index.size() << " index entries\n";
+    return true;
+  }
+
+private:
+  Format format;
+  uint32_t vdif_header[HEADER_SIZE / 4];
+  const uint32_t *first_vdif;
+
+  std::vector<Raw_entry> entries;
+  // Last valid frame of every thread
+  std::map<int, std::pair<int64_t, int> > last;
+  int64_t last_seconds;
+  int last_frame_nr, max_frame_nr;
+};
+
+void usage(char *filename) {
+  std::cout << "Usage : " << filename << " [OPTIONS] <file> [<file> ...]\n"
+            << "Options : -f <format>, data format: mark5b or vdif (required)\n"
+            << "          -n <seconds>, number of seconds between index entries (default 1)\n";
+}
+
+int main(int argc, char *argv[]) {
+  int c, interval = 1;
+  std::string format_name;
+  while ((c = getopt(argc, argv, "f:n:")) != -1) {
+    switch (c) {
+    case 'f':
+      format_name = optarg;
+      break;
+    case 'n':
+      interval = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((optind >= argc) || (interval <= 0) ||
+      ((format_name != "mark5b") && (format_name != "vdif"))) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int result = 0;
+  for (int i = optind; i < argc; i++) {
+    Indexer indexer(format_name == "mark5b" ? MARK5B : VDIF);
+    Data_index index;
+    struct stat sb;
+    if ((stat(argv[i], &sb) != 0) || !indexer.run(argv[i], interval, index)) {
+      result = 1;
+      continue;
+    }
+    std::string index_file = std::string(argv[i]) + DATA_INDEX_EXTENSION;
+    if (!index.save(index_file, sb.st_size)) {
+      std::cerr << "Could not write " << index_file << "\n";
+      result = 1;
+    }
+  }
+  return result;
+}
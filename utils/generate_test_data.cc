@@ -0,0 +1,466 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * $Id$
+ *
+ *  This file contains:
+ *     - a generator of synthetic VDIF or Mark5B recordings and matching
+ *       delay tables, used to test the correlator end-to-end without real
+ *       observations.
+ *
+ * Every frequency channel contains a common noise signal that is seen by
+ * all stations, plus independent noise per station. The data of station i
+ * is delayed by i * (delay_step + residual) samples, while its delay
+ * table only contains i * delay_step samples plus a delay rate of
+ * i * delay_rate. After correlation the baseline between stations a and b
+ * therefore has its fringe at a lag of (a - b) * residual samples and a
+ * fringe rate given by the difference of the delay rates.
+ *
+ * In VDIF every channel is a thread of its own. In Mark5B the channels are
+ * bitstreams of the same frames: channel c has its sign in bitstream 2c and
+ * its magnitude in bitstream 2c + 1.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <stdint.h>
+#include "correlator_time.h"
+#include "utils.h"
+
+#define VDIF_HEADER_SIZE  32
+#define MARK5B_SYNCWORD   0xabaddeed
+#define MARK5B_HEADER_SIZE (SIZE_MK5B_HEADER * SIZE_MK5B_WORD)
+#define MARK5B_FRAME_SIZE  (SIZE_MK5B_FRAME * SIZE_MK5B_WORD)
+#define BITS_PER_SAMPLE   2
+// Number of tabulated gaussian random numbers
+#define GAUSS_TABLE_SIZE  65536
+// 2 bit quantisation threshold in units of the standard deviation
+#define QUANT_THRESHOLD   0.9816
+
+enum Format {VDIF, MARK5B};
+
+struct Generator_parameters {
+  Format format;
+  std::string output_dir, exper, source;
+  std::vector<std::string> stations;
+  Time start;
+  int duration;
+  int channels;
+  int bandwidth; // MHz
+  int frame_size;
+  int delay_step, residual;
+  double delay_rate;
+  double correlation;
+  unsigned int seed;
+};
+
+/// Fast random numbers: xorshift64 indexing a table of gaussian numbers
+class Noise_generator {
+public:
+  Noise_generator(unsigned int seed) : state(0x9E3779B97F4A7C15ULL ^ seed), table(GAUSS_TABLE_SIZE) {
+    srand48(seed);
+    for (int i = 0; i < GAUSS_TABLE_SIZE; i += 2) {
+      // Box-Muller
+      double u1 = 1 - drand48(), u2 = drand48();
+      double r = sqrt(-2 * log(u1));
+      table[i] = r * cos(2 * M_PI * u2);
+      table[i + 1] = r * sin(2 * M_PI * u2);
+    }
+  }
+  // Fills buffer with n gaussian numbers with unit variance
+  void generate(float *buffer, int n) {
+    int i = 0;
+    while (i < n) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      uint64_t r = state;
+      for (int j = 0; (j < 4) && (i < n); j++, i++) {
+        buffer[i] = table[r & (GAUSS_TABLE_SIZE - 1)];
+        r >>= 16;
+      }
+    }
+  }
+private:
+  uint64_t state;
+  std::vector<float> table;
+};
+
+void usage(char *name) {
+  std::cout << "usage: " << name << " [OPTIONS] <output directory> <experiment> <station> [<station>...]\n"
+            << "Writes <output directory>/<experiment>_<station>.vdif (or .m5b) and the delay\n"
+            << "table <output directory>/<experiment>_<station>.del for every station.\n"
+            << "Options :\n"
+            << "  -f, --format=FORMAT       Data format, vdif or mark5b (default vdif)\n"
+            << "  -s, --start=TIME          Start time in vex format (default 2013y100d12h00m00s)\n"
+            << "  -t, --duration=SEC        Length of the recordings (default 12)\n"
+            << "  -c, --channels=N          Number of channels, one VDIF thread each or two Mark5B\n"
+            << "                            bitstreams each (1, 2, 4, 8 or 16) (default 2)\n"
+            << "  -b, --bandwidth=MHZ       Bandwidth of the channels (default 16)\n"
+            << "  -F, --frame-size=BYTES    VDIF frame size without header (default 8000), Mark5B\n"
+            << "                            frames are always 10000 bytes\n"
+            << "  -d, --delay-step=N        Delay per station in the model in samples (default 1000)\n"
+            << "  -r, --residual=N          Delay per station that is not in the model in samples (default 3)\n"
+            << "  -R, --delay-rate=RATE     Delay rate per station that is only in the model (default 1e-11)\n"
+            << "  -C, --correlation=RHO     Correlation coefficient between stations (default 0.5)\n"
+            << "  -S, --source=NAME         Source name in the delay tables (default TEST)\n"
+            << "  -x, --seed=N              Seed of the random generator (default 1)\n";
+}
+
+void get_options(int argc, char *argv[], Generator_parameters &param) {
+  int c, opt_index = 0;
+  static struct option long_options[] = {
+      {"help",        no_argument,       0, 'h'},
+      {"format",      required_argument, 0, 'f'},
+      {"start",       required_argument, 0, 's'},
+      {"duration",    required_argument, 0, 't'},
+      {"channels",    required_argument, 0, 'c'},
+      {"bandwidth",   required_argument, 0, 'b'},
+      {"frame-size",  required_argument, 0, 'F'},
+      {"delay-step",  required_argument, 0, 'd'},
+      {"residual",    required_argument, 0, 'r'},
+      {"delay-rate",  required_argument, 0, 'R'},
+      {"correlation", required_argument, 0, 'C'},
+      {"source",      required_argument, 0, 'S'},
+      {"seed",        required_argument, 0, 'x'},
+      {0, 0, 0, 0}
+  };
+  std::string start = "2013y100d12h00m00s";
+  param.format = VDIF;
+  param.source = "TEST";
+  param.duration = 12;
+  param.channels = 2;
+  param.bandwidth = 16;
+  param.frame_size = 8000;
+  param.delay_step = 1000;
+  param.residual = 3;
+  param.delay_rate = 1e-11;
+  param.correlation = 0.5;
+  param.seed = 1;
+  bool error = false;
+  while ((c = getopt_long(argc, argv, "hf:s:t:c:b:F:d:r:R:C:S:x:", long_options,
+                          &opt_index)) != -1) {
+    switch (c) {
+    case 'h':
+      usage(argv[0]);
+      exit(0);
+    case 'f':
+      if (strcmp(optarg, "vdif") == 0)
+        param.format = VDIF;
+      else if (strcmp(optarg, "mark5b") == 0)
+        param.format = MARK5B;
+      else
+        error = true;
+      break;
+    case 's':
+      start = optarg;
+      break;
+    case 't':
+      error = (sscanf(optarg, "%d", &param.duration) != 1) || (param.duration <= 0);
+      break;
+    case 'c':
+      error = (sscanf(optarg, "%d", &param.channels) != 1) || (param.channels <= 0);
+      break;
+    case 'b':
+      error = (sscanf(optarg, "%d", &param.bandwidth) != 1) || (param.bandwidth <= 0);
+      break;
+    case 'F':
+      error = ((sscanf(optarg, "%d", &param.frame_size) != 1) ||
+               (param.frame_size <= 0) || (param.frame_size % 8 != 0));
+      break;
+    case 'd':
+      error = (sscanf(optarg, "%d", &param.delay_step) != 1) || (param.delay_step < 0);
+      break;
+    case 'r':
+      error = (sscanf(optarg, "%d", &param.residual) != 1) || (param.residual < 0);
+      break;
+    case 'R':
+      error = (sscanf(optarg, "%lf", &param.delay_rate) != 1);
+      break;
+    case 'C':
+      error = ((sscanf(optarg, "%lf", &param.correlation) != 1) ||
+               (param.correlation < 0) || (param.correlation > 1));
+      break;
+    case 'S':
+      param.source = optarg;
+      break;
+    case 'x':
+      error = (sscanf(optarg, "%u", &param.seed) != 1);
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+    if (error) {
+      std::cout << "Bad argument to option " << argv[optind - 1] << "\n";
+      exit(1);
+    }
+  }
+  if (argc - optind < 3) {
+    usage(argv[0]);
+    exit(1);
+  }
+  param.output_dir = argv[optind];
+  param.exper = argv[optind + 1];
+  for (int i = optind + 2; i < argc; i++)
+    param.stations.push_back(argv[i]);
+  try {
+    param.start = Time(start);
+  } catch (std::exception &e) {
+    std::cout << e.what() << "\n";
+    exit(1);
+  }
+}
+
+std::string
+output_file(const Generator_parameters &param, int station, const char *extension) {
+  return param.output_dir + "/" + param.exper + "_" + param.stations[station] + extension;
+}
+
+void write_delay_table(const Generator_parameters &param, int station) {
+  std::string filename = output_file(param, station, ".del");
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    std::cout << "Could not create " << filename << "\n";
+    exit(1);
+  }
+  const std::string &name = param.stations[station];
+  int32_t header_size = name.size() + 1;
+  fwrite(&header_size, sizeof(header_size), 1, file);
+  fwrite(name.c_str(), header_size, 1, file);
+
+  char source[81];
+  memset(source, ' ', sizeof(source));
+  memcpy(source, param.source.c_str(), std::min(param.source.size(), (size_t)80));
+  source[80] = 0;
+  int32_t mjd = (int32_t)param.start.get_mjd();
+  fwrite(source, sizeof(source), 1, file);
+  fwrite(&mjd, sizeof(mjd), 1, file);
+
+  double sample_rate = 2e6 * param.bandwidth;
+  double start_sec = param.start.get_time();
+  for (int i = 0; i <= param.duration; i++) {
+    double t = i - param.duration / 2.;
+    double record[7];
+    record[0] = start_sec + i;
+    // The uvw coordinates are not used for the fringe check
+    record[1] = 1e6 * station;
+    record[2] = -5e5 * station;
+    record[3] = 1e5 * station;
+    record[4] = station * (param.delay_step / sample_rate + param.delay_rate * t);
+    record[5] = 0;
+    record[6] = 1;
+    fwrite(record, sizeof(record), 1, file);
+  }
+  double end[7] = {0, 0, 0, 0, 0, 0, 0};
+  fwrite(end, sizeof(end), 1, file);
+  if (fclose(file) != 0) {
+    std::cout << "Could not write " << filename << "\n";
+    exit(1);
+  }
+}
+
+// Word 0-3 of a VDIF header, words 4-7 (extended user data) are zero
+void set_vdif_header(const Generator_parameters &param, int station, int thread,
+                     int ref_epoch, uint32_t sec_from_epoch, int frame_nr, uint32_t *header) {
+  const std::string &name = param.stations[station];
+  uint32_t station_id = ((uint32_t)(uint8_t)name[0] << 8) |
+                        (name.size() > 1 ? (uint8_t)name[1] : 0);
+  memset(header, 0, VDIF_HEADER_SIZE);
+  header[0] = sec_from_epoch & 0x3fffffff;
+  header[1] = (frame_nr & 0xffffff) | (ref_epoch << 24);
+  header[2] = (param.frame_size + VDIF_HEADER_SIZE) / 8;
+  header[3] = station_id | (thread << 16) | ((BITS_PER_SAMPLE - 1) << 26);
+}
+
+int bcd(int value, int ndigits) {
+  int result = 0;
+  for (int i = 0; i < ndigits; i++) {
+    result |= (value % 10) << (4 * i);
+    value /= 10;
+  }
+  return result;
+}
+
+// CRC-16 (polynomial 0x8005) of the time code in word 2 and 3, the most
+// significant byte first, as checked by the Mark5B reader
+uint16_t mark5b_crc(const uint32_t *header) {
+  uint8_t bytes[6] = {(uint8_t)(header[2] >> 24), (uint8_t)(header[2] >> 16),
+                      (uint8_t)(header[2] >> 8), (uint8_t)header[2],
+                      (uint8_t)(header[3] >> 24), (uint8_t)(header[3] >> 16)};
+  uint16_t crc = 0;
+  for (int i = 0; i < 6; i++) {
+    crc ^= bytes[i] << 8;
+    for (int j = 0; j < 8; j++)
+      crc = ((crc & 0x8000) ? (crc << 1) ^ 0x8005 : (crc << 1));
+  }
+  return crc;
+}
+
+// Mark5B header with the frame number and the VLBA time code: the mjd
+// modulo 1000, the seconds of the day and the fraction of the second in
+// units of 0.1 ms
+void set_mark5b_header(int mjd, int sec_of_day, int frame_nr, int frames_per_second,
+                       uint32_t *header) {
+  header[0] = MARK5B_SYNCWORD;
+  header[1] = frame_nr & 0x7fff;
+  header[2] = (bcd(mjd % 1000, 3) << 20) | bcd(sec_of_day, 5);
+  header[3] = bcd((int)((int64_t)frame_nr * 10000 / frames_per_second), 4) << 16;
+  header[3] |= mark5b_crc(header);
+}
+
+// 2 bit offset binary value of a sample
+inline int sample_value(float x) {
+  return (x < 0 ? (x < -QUANT_THRESHOLD ? 0 : 1) : (x < QUANT_THRESHOLD ? 2 : 3));
+}
+
+// 2 bit offset binary, the first sample in the least significant bits
+void quantise(const float *samples, int n, unsigned char *data) {
+  for (int i = 0; i < n; i += 4) {
+    unsigned char byte = 0;
+    for (int j = 0; j < 4; j++)
+      byte |= sample_value(samples[i + j]) << (2 * j);
+    data[i / 4] = byte;
+  }
+}
+
+// Adds the samples of a channel to the 32 bit words of a Mark5B frame.
+// Every word holds 32 / nbitstreams consecutive samples of every channel,
+// the sign (the most significant bit of the offset binary value) in
+// bitstream 2 * channel and the magnitude in the next bitstream.
+void add_mark5b_channel(const float *samples, int n, int channel, int nbitstreams,
+                        uint32_t *words) {
+  const int samples_per_word = 32 / nbitstreams;
+  for (int i = 0; i < n; i++) {
+    int value = sample_value(samples[i]);
+    int bit = 2 * channel + (i % samples_per_word) * nbitstreams;
+    words[i / samples_per_word] |= ((uint32_t)(value >> 1) << bit) |
+                                   ((uint32_t)(value & 1) << (bit + 1));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Generator_parameters param;
+  get_options(argc, argv, param);
+
+  const int nstations = param.stations.size();
+  const int64_t sample_rate = 2000000LL * param.bandwidth;
+  // A Mark5B frame holds the samples of all channels, a VDIF frame those of one
+  const int nbitstreams = BITS_PER_SAMPLE * param.channels;
+  const int samples_per_frame = (param.format == MARK5B ?
+                                 MARK5B_FRAME_SIZE * 8 / nbitstreams :
+                                 param.frame_size * 8 / BITS_PER_SAMPLE);
+  if (param.format == MARK5B && (nbitstreams > 32 || 32 % nbitstreams != 0)) {
+    std::cout << "Mark5B data has 1, 2, 4, 8 or 16 channels\n";
+    exit(1);
+  }
+  if (sample_rate % samples_per_frame != 0) {
+    std::cout << "The sample rate (" << sample_rate << ") is not a multiple of the "
+              << samples_per_frame << " samples in a frame\n";
+    exit(1);
+  }
+  const int frames_per_second = sample_rate / samples_per_frame;
+  if (param.format == MARK5B &&
+      (frames_per_second % N_MK5B_BLOCKS_TO_READ != 0 || frames_per_second > 0x7fff)) {
+    std::cout << "The " << frames_per_second << " Mark5B frames per second are not a "
+              << "multiple of " << N_MK5B_BLOCKS_TO_READ << " or do not fit the frame number\n";
+    exit(1);
+  }
+
+  // VDIF time stamps count from the start of a half year since 2000
+  int year, day;
+  param.start.get_date(year, day);
+  int ref_epoch = 2 * (year - 2000);
+  int start_mjd = (int)param.start.get_mjd();
+  if (start_mjd >= mjd(1, 7, year))
+    ref_epoch++;
+  int epoch_mjd = mjd(1, 1 + 6 * (ref_epoch % 2), year);
+  uint32_t start_sec = (start_mjd - epoch_mjd) * 86400 + (uint32_t)param.start.get_time();
+
+  // Data delay of every station in samples
+  std::vector<int> delays(nstations);
+  int max_delay = 0;
+  for (int i = 0; i < nstations; i++) {
+    delays[i] = i * (param.delay_step + param.residual);
+    max_delay = std::max(max_delay, delays[i]);
+  }
+
+  std::vector<FILE *> files(nstations);
+  for (int i = 0; i < nstations; i++) {
+    write_delay_table(param, i);
+    std::string filename = output_file(param, i, (param.format == MARK5B ? ".m5b" : ".vdif"));
+    files[i] = fopen(filename.c_str(), "wb");
+    if (files[i] == NULL) {
+      std::cout << "Could not create " << filename << "\n";
+      exit(1);
+    }
+  }
+
+  Noise_generator noise(param.seed);
+  const float signal_weight = sqrt(param.correlation);
+  const float noise_weight = sqrt(1 - param.correlation);
+  // Common signal of every channel, the last max_delay samples of the
+  // previous frame followed by the samples of the current frame
+  std::vector< std::vector<float> > common(param.channels,
+                                           std::vector<float>(max_delay + samples_per_frame));
+  for (int ch = 0; ch < param.channels; ch++)
+    noise.generate(&common[ch][0], common[ch].size());
+  std::vector<float> samples(samples_per_frame);
+  std::vector<unsigned char> frame(VDIF_HEADER_SIZE + param.frame_size);
+  // The Mark5B frames of all stations, which are complete after the last channel
+  std::vector< std::vector<uint32_t> > mark5b_frames;
+  if (param.format == MARK5B)
+    mark5b_frames.resize(nstations, std::vector<uint32_t>(SIZE_MK5B_HEADER + SIZE_MK5B_FRAME));
+
+  for (int sec = 0; sec < param.duration; sec++) {
+    const int sec_of_day = ((int)param.start.get_time() + sec) % 86400;
+    const int day_mjd = start_mjd + ((int)param.start.get_time() + sec) / 86400;
+    for (int frame_nr = 0; frame_nr < frames_per_second; frame_nr++) {
+      for (int station = 0; station < (int)mark5b_frames.size(); station++) {
+        uint32_t *words = &mark5b_frames[station][0];
+        set_mark5b_header(day_mjd, sec_of_day, frame_nr, frames_per_second, words);
+        std::fill(words + SIZE_MK5B_HEADER, words + SIZE_MK5B_HEADER + SIZE_MK5B_FRAME, 0);
+      }
+      for (int ch = 0; ch < param.channels; ch++) {
+        std::vector<float> &signal = common[ch];
+        memmove(&signal[0], &signal[samples_per_frame], max_delay * sizeof(float));
+        noise.generate(&signal[max_delay], samples_per_frame);
+        for (int station = 0; station < nstations; station++) {
+          noise.generate(&samples[0], samples_per_frame);
+          const float *delayed = &signal[max_delay - delays[station]];
+          for (int i = 0; i < samples_per_frame; i++)
+            samples[i] = signal_weight * delayed[i] + noise_weight * samples[i];
+          if (param.format == MARK5B) {
+            add_mark5b_channel(&samples[0], samples_per_frame, ch, nbitstreams,
+                               &mark5b_frames[station][SIZE_MK5B_HEADER]);
+            continue;
+          }
+          set_vdif_header(param, station, ch, ref_epoch, start_sec + sec, frame_nr,
+                          (uint32_t *)&frame[0]);
+          quantise(&samples[0], samples_per_frame, &frame[VDIF_HEADER_SIZE]);
+          if (fwrite(&frame[0], frame.size(), 1, files[station]) != 1) {
+            std::cout << "Could not write the data of " << param.stations[station] << "\n";
+            exit(1);
+          }
+        }
+      }
+      for (int station = 0; station < (int)mark5b_frames.size(); station++) {
+        if (fwrite(&mark5b_frames[station][0], MARK5B_HEADER_SIZE + MARK5B_FRAME_SIZE, 1,
+                   files[station]) != 1) {
+          std::cout << "Could not write the data of " << param.stations[station] << "\n";
+          exit(1);
+        }
+      }
+    }
+  }
+  for (int i = 0; i < nstations; i++)
+    fclose(files[i]);
+  return 0;
+}
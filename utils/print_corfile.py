@@ -1,35 +1,28 @@
 #!/usr/bin/env python
-import sys, struct, pdb
+import sys, pdb
 from numpy import *
 from optparse import OptionParser
+try:
+  import sfxc_cor
+except ImportError:
+  # The sfxc_cor module is only built with ./configure --enable-python
+  import cor_file as sfxc_cor
 
-timeslice_header_size = 16
-uvw_header_size = 32
-stat_header_size = 24
-baseline_header_size = 8
-max_stations = 32
 fringe_guard = 0.05  # Used to compute the SNR, this is the percentage that is ignored around the maximum
 
-def print_global_header(infile):
-  infile.seek(0)
-  gheader_buf = infile.read(global_header_size)
-  if global_header_size == 64:
-    global_header = struct.unpack('i32s2h5ib3c',gheader_buf[:64])
-  else:
-    global_header = struct.unpack('i32s2h5ib15s',gheader_buf[:76])
-  hour = global_header[4] / (60*60)
-  minute = (global_header[4]%(60*60))/60
-  second = global_header[4]%60
-  pol = ['LL', 'RR', 'LL+RR', 'LL+RR+LR+RL'][global_header[9]]
+def print_global_header(cor):
+  header = cor.header
+  hour = header["start_time"] / (60*60)
+  minute = (header["start_time"]%(60*60))/60
+  second = header["start_time"]%60
+  pol = ['LL', 'RR', 'LL+RR', 'LL+RR+LR+RL'][header["polarisation_type"]]
   
-  if global_header_size == 64:
-    print "SFXC version = %s"%(global_header[8])
+  if header["header_size"] == 64:
+    print "SFXC version = %s"%(header["correlator_version"])
   else:
-    n = global_header[-1].index('\0')
-    print "SFXC version = %s, branch = %s"%(global_header[8], global_header[-1][:n])
+    print "SFXC version = %s, branch = %s"%(header["correlator_version"], header["correlator_branch"])
 
-  n = global_header[1].index('\0')
-  print "Experiment %s, date = %dy%dd%dh%dm%ds, int_time = %d, nchan = %d, polarization = %s"%(global_header[1][:n], global_header[2], global_header[3], hour, minute, second, global_header[6], global_header[5], pol)
+  print "Experiment %s, date = %dy%dd%dh%dm%ds, int_time = %d, nchan = %d, polarization = %s"%(header["experiment"], header["start_year"], header["start_day"], hour, minute, second, header["integration_time"], header["number_channels"], pol)
 
 def print_uvw(uvws, stations=None):
   for uvw in uvws.iteritems():
@@ -82,35 +75,27 @@ def get_baseline_stats(data):
   fringe_offset = fringe_pos - n / 2
   return (fringe_val, snr, fringe_offset)
 
-def read_uvw(infile, uvw, nuvw):
-  uvw_buffer = infile.read(uvw_header_size * nuvw)
-  if len(uvw_buffer) != uvw_header_size * nuvw:
-    raise Exception("EOF")
-  index = 0
-  for i in range(nuvw):
-    header = struct.unpack('2i3d', uvw_buffer[index:index + uvw_header_size])
-    index += uvw_header_size
-    station_nr = header[0]
-    (u,v,w) = header[2:]
+def read_uvw(timeslice, uvw):
+  for coordinates in timeslice["uvw"]:
+    station_nr = int(coordinates["station_nr"])
+    (u,v,w) = (coordinates["u"], coordinates["v"], coordinates["w"])
     nstr = 'u = %.15g, v = %.15g, w = %.15g'%(u,v,w)
+    # Baseline dependent averaging
+    if coordinates["averaged_integrations"] > 0:
+      nstr += ', averaged over %d integrations (%d to %d)'%(coordinates["averaged_integrations"],
+                timeslice["first_integration_slice"], timeslice["integration_slice"])
     try:
       uvw[station_nr].append(nstr)
     except KeyError:
       uvw[station_nr] = [nstr]
 
-def read_statistics(infile, stats, nstatistics):
-  stat_buffer = infile.read(stat_header_size * nstatistics)
-  if len(stat_buffer) != stat_header_size * nstatistics:
-    raise Exception("EOF")
-  index = 0
-  for i in range(nstatistics):
-    sheader = struct.unpack('4B5i', stat_buffer[index:index + stat_header_size])
-    index += stat_header_size
-    station_nr = sheader[0]
-    frequency_nr = sheader[1]
-    sideband = sheader[2]
-    polarisation = sheader[3]
-    levels = sheader[4:9]
+def read_statistics(timeslice, stats):
+  for statistics in timeslice["statistics"]:
+    station_nr = int(statistics["station_nr"])
+    frequency_nr = statistics["frequency_nr"]
+    sideband = statistics["sideband"]
+    polarisation = statistics["polarisation"]
+    levels = list(statistics["levels"]) + [statistics["n_invalid"]]
     tot = sum(levels) + 0.0001
     levels = [a / tot for a in levels]
     nstr = 'freq = ' + str(frequency_nr) + ", sb = " + str(sideband) + ", pol = " + str(polarisation) + \
@@ -121,40 +106,30 @@ def read_statistics(infile, stats, nstatistics):
     except KeyError:
       stats[station_nr] = [nstr]
 
-def read_baselines(infile, data, nbaseline, nchan, printauto):
-  baseline_data_size = (nchan + 1) * 8 # data is complex floats
-  baseline_buffer = infile.read(nbaseline * (baseline_header_size + baseline_data_size)) 
-  if len(baseline_buffer) != nbaseline * (baseline_header_size + baseline_data_size):
-    raise Exception("EOF")
-  fmt = str(2*(nchan+1)) + 'f'
-
-  index = 0
-  for b in range(nbaseline):
-    bheader = struct.unpack('i4B', baseline_buffer[index:index + baseline_header_size])
-    index += baseline_header_size
-    weight = bheader[0]
-    station1 = bheader[1]
-    station2 = bheader[2]
+def read_baselines(timeslice, data, nchan, printauto):
+  # The visibilities are converted to complex floats by sfxc_cor, whatever
+  # the output format version
+  baselines = timeslice["baselines"]
+  visibilities = timeslice["visibilities"]
+  for b in range(baselines.size):
+    weight = baselines["weight"][b]
+    station1 = int(baselines["station1"][b])
+    station2 = int(baselines["station2"][b])
     baseline = (station1, station2)
-    byte = bheader[3]
+    byte = int(baselines["flags"][b])
     pol = byte&3
     sideband = (byte>>2)&1
     freq_nr = byte>>3
-    J = complex(0,1)
     if (station1 != station2) or (station1 == station2 and printauto):
-      buf = struct.unpack(fmt, baseline_buffer[index:index + baseline_data_size])
-      # Skip over the first/last channel
-      vreal = array(buf[0:2*(nchan+1):2])
-      vim = array(buf[1:2*(nchan+1):2])
-      if isnan(vreal).any()==False and isnan(vim).any()==False:
-        #pdb.set_trace()
+      vis = visibilities[b].astype(complex128)
+      if isnan(vis.real).any()==False and isnan(vis.imag).any()==False:
         # format is [nbaseline, nif, num_sb, npol, nchan+1], dtype=complex128
         if (station1 == station2):
-          amp_real = sum(vreal) / nchan
-          amp_imag = sum(vim) / nchan 
+          amp_real = sum(vis.real) / nchan
+          amp_imag = sum(vis.imag) / nchan 
           nstr = 'freq = %d, sb = %d , pol = %d, ampl_real = %.6e , ampl_imag == %.6e, weight = %.6f'%(freq_nr, sideband, pol, amp_real, amp_imag, weight)
         else:
-          val, snr, offset = get_baseline_stats(vreal + J*vim)
+          val, snr, offset = get_baseline_stats(vis)
           nstr = 'freq = %d, sb = %d , pol = %d, fringe ampl = %.6f , SNR = %.6f, offset = %d, weight = %.6f'%(freq_nr, sideband, pol, val, snr, offset, weight)
         try:
           data[baseline].append(nstr)
@@ -163,33 +138,14 @@ def read_baselines(infile, data, nbaseline, nchan, printauto):
       else:
         print "b="+`baseline`+", freq_nr = "+`freq_nr`+",sb="+`sideband`+",pol="+`pol`
         pdb.set_trace()
-    index += baseline_data_size
 
-def read_time_slice(infile, stats, uvw, data, nchan, printauto):
-  #get timeslice header
-  tsheader_buf = infile.read(timeslice_header_size)
-  if len(tsheader_buf) != timeslice_header_size:
-    raise Exception("EOF")
-  timeslice_header = struct.unpack('4i', tsheader_buf)
-  current_slice = timeslice_header[0]  
-  
-  while current_slice == timeslice_header[0]:
-    #Read UVW coordinates
-    nuvw = timeslice_header[2]
-    read_uvw(infile, uvw, nuvw)
-    # Read the bit statistics
-    nstatistics = timeslice_header[3]
-    read_statistics(infile, stats, nstatistics)
-    # Read the baseline data    
-    nbaseline = timeslice_header[1]
-    read_baselines(infile, data, nbaseline, nchan, printauto)
-    # Get next time slice header
-    tsheader_buf = infile.read(timeslice_header_size)
-    if len(tsheader_buf) != timeslice_header_size:
-      return 
-    timeslice_header = struct.unpack('4i', tsheader_buf)
-  # We read one time slice to many
-  infile.seek(-timeslice_header_size, 1) 
+def read_integration(cor, first, last, stats, uvw, data, nchan, printauto):
+  # All time slices of one integration
+  for i in range(first, last):
+    timeslice = cor.timeslice(i)
+    read_uvw(timeslice, uvw)
+    read_statistics(timeslice, stats)
+    read_baselines(timeslice, data, nchan, printauto)
 
 def get_stations(vex_file):
   f = open(vex_file, 'r')
@@ -242,36 +198,28 @@ def get_options():
 filename, noheader, printstats, printvis, printuvw, printauto, vex_file = get_options()
 
 try:
-  infile = open(filename, 'rb')
-except:
+  cor = sfxc_cor.CorFile(filename)
+except IOError:
   print "Could not open file : " + filename
   sys.exit()
 
 # Get list of station names
 stations = get_stations(vex_file) if vex_file != None else None
 
-# Read global header
-global_header_size = struct.unpack('i', infile.read(4))[0]
 if not noheader:
-  print_global_header(infile)
+  print_global_header(cor)
 
-infile.seek(0)
-gheader_buf = infile.read(global_header_size)
-global_header = struct.unpack('i32s2h5i4c',gheader_buf[:64])
-nchan = global_header[5]
+nchan = cor.header["number_channels"]
 nslices = 0
-while True:
+i = 0
+while i < len(cor):
   stats = {}
   uvw = {}
   data = {}
-  try:
-    read_time_slice(infile, stats, uvw, data, nchan, printauto)
-    nslices += 1
-  except Exception, e:
-    if e.args[0] != 'EOF':
-      raise
-    print "Reached end of file"
-    sys.exit(0)
+  next = cor.next_integration(i)
+  read_integration(cor, i, next, stats, uvw, data, nchan, printauto)
+  nslices += 1
+  i = next
    
   print "---------- time slice ", nslices," ---------"
   if printstats:
@@ -282,3 +230,4 @@ while True:
 
   if printvis:
     print_baselines(data, stations)
+print "Reached end of file"
@@ -26,6 +26,9 @@ int main(int argc, char *argv[]) {
   std::cout << global_header;
 
   std::complex<float> data[global_header.number_channels+1];
+  // The visibilities as stored in the file, converted to float in data
+  size_t size = output_visibility_size(global_header.output_format_version);
+  char buffer[(global_header.number_channels+1) * size];
 
   while (!in.eof()) {
     // Read the timeslice header
@@ -49,7 +52,9 @@ int main(int argc, char *argv[]) {
       if (in.eof()) return 0;
       std::cout << baseline_header;
 
-      in.read((char *)&data[0], sizeof(data));
+      in.read(buffer, sizeof(buffer));
+      decode_visibilities(global_header.output_format_version, baseline_header,
+                          buffer, global_header.number_channels+1, data);
       for (int i=0; i<global_header.number_channels+1; i++) {
         out << data[i].real() << " "
         << data[i].imag() << std::endl;
@@ -27,6 +27,10 @@
 
 #include <sys/stat.h>
 
+// Position of the last integration that was plotted with --latest, stored
+// in the output directory
+#define POSITION_FILE "plotpage_position"
+
 bool file_exists(char *filename) {
   struct stat stFileInfo;
   int result;
@@ -52,7 +56,13 @@ void usage(char *argv[]){
   std::cout << "Usage: " << argv[0] << " [options] <vex-file> <correlation_file> [<output_directory>]\n"
             << "       Options : -h, --help, Print this message\n"
             << "                 -f, --monitor, Don't stop reading at EOF\n"
-            << "                 -s, --setup-station [STATION CODE], Set setup station\n";
+            << "                 -s, --setup-station [STATION CODE], Set setup station\n"
+            << "                 -l, --latest, Plot the last complete integration instead of the\n"
+            << "                     first one, a next run only reads the new integrations.\n"
+            << "                     Only the offset of the plotted integration is kept,\n"
+            << "                     earlier integrations are not remembered or accumulated\n"
+            << "                 -j, --threads [N], Number of threads for the lag transforms and\n"
+            << "                     the plots, defaults to the number of processors\n";
 }
 
 // Generates the html-pages used for the ftp-fringe tests.
@@ -64,13 +74,17 @@ int main(int argc, char *argv[]) {
   struct option options[] = {{"monitor",  no_argument,       0, 'f'},
                              {"help", no_argument, 0, 'h'},
                              {"setup-station",    required_argument, 0, 's'},
+                             {"latest", no_argument, 0, 'l'},
+                             {"threads",    required_argument, 0, 'j'},
                              {0, 0, 0, 0}};
   int c;
   bool update = false;
+  bool latest = false;
+  int nr_threads = 0;
   std::string setup_station = "";
   while(true){
     int option_index = 0;
-    c = getopt_long (argc, argv, "hfs:", options, &option_index);
+    c = getopt_long (argc, argv, "hfs:lj:", options, &option_index);
 
     /* Detect the end of the options. */
     if (c == -1)
@@ -87,6 +101,12 @@ int main(int argc, char *argv[]) {
     case 's':
       setup_station = optarg;
       break;
+    case 'l':
+      latest = true;
+      break;
+    case 'j':
+      nr_threads = atoi(optarg);
+      break;
     default:
       std::cerr << "Error : invalid option\n";
       usage(argv);
@@ -159,14 +179,30 @@ int main(int argc, char *argv[]) {
     std::cout << "Empty correlation file" << std::endl;
     return 1;
   }
-
+  if (nr_threads > 0)
+    fringe_info.set_nr_threads(nr_threads);
+
+  if (latest) {
+    // Continue after the integration that was plotted by the previous run
+    bool resumed = fringe_info.load_position(POSITION_FILE, !update);
+    if (!fringe_info.goto_last_integration() && resumed && (!update)) {
+      std::cout << "No new integrations since the previous run" << std::endl;
+      return 0;
+    }
+  }
 
   do {
     fringe_info.read_plots(!update);
 
     fringe_info.print_html(vex, vex_file, setup_station);
+    if (latest)
+      fringe_info.save_position(POSITION_FILE);
 
     std::cout << "Produced html page" << std::endl;
+
+    // Skip the integrations that were written while plotting
+    if (latest && update)
+      fringe_info.goto_last_integration();
   } while (update);
 
   return 0;
@@ -1,88 +1,53 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
-import sys, struct
+import sys
 from numpy import *
 from pylab import *
 from time import sleep
 from optparse import OptionParser
 import pdb
-
-timeslice_header_size = 16
-uvw_header_size = 32
-stat_header_size = 24
-baseline_header_size = 8
+try:
+  import sfxc_cor
+except ImportError:
+  # The sfxc_cor module is only built with ./configure --enable-python
+  import cor_file as sfxc_cor
 
 plots_per_row = 2   # The number of pulse profiles per row in the plot window
 
-def read_time_slice(inputfiles, visibilities, station_idx, ref_station, pol, sb, nchan):
+def read_time_slice(inputfiles, time_slice, visibilities, station_idx, ref_station, nchan):
   nbins = len(inputfiles)
-  nif = visibilities.shape[2]
   num_sb = visibilities.shape[3]
   npol = visibilities.shape[4]
   for bin in range(nbins):
-    inputfile = inputfiles[bin]
-    #get timeslice header
-    tsheader_buf = read_data(inputfile, timeslice_header_size)
-    timeslice_header = struct.unpack('4i', tsheader_buf)
-    
-    nuvw = timeslice_header[2]
-    inputfile.seek(uvw_header_size * nuvw, 1)
-    
-    # Read the bit statistics
-    nstatistics = timeslice_header[3]
-    stat_buffer = inputfile.seek(stat_header_size * nstatistics, 1)
-    
-    nbaseline = timeslice_header[1]
-    baseline_data_size = (nchan + 1) * 8 # data is complex floats
-    baseline_buffer = read_data(inputfile, nbaseline * (baseline_header_size + baseline_data_size)) 
-    fmt = str(2*(nchan+1)) + 'f'
-
-    index = 0
-    for b in range(nbaseline):
-      bheader = struct.unpack('i4c', baseline_buffer[index:index + baseline_header_size])
-      index += baseline_header_size
-      station1 = struct.unpack('i', bheader[1]+'\x00\x00\x00')[0]
-      station2 = struct.unpack('i', bheader[2]+'\x00\x00\x00')[0]
-      byte = struct.unpack('i', bheader[3]+'\x00\x00\x00')[0]
-      pol1 = byte&1
-      pol2 = (byte>>1)&1
-      sideband = (byte>>2)&1
-      freq_nr = byte>>3
-      #print 'pol1='+str(pol1) +  ', pol2='+str(pol2)+',sideband='+str(sideband)+',freq_nr='+str(freq_nr)+' ; s1='+str(station1)+', s2='+str(station2)
-      J = complex(0,1)
-      if ((station1 == ref_station and station2 != ref_station) or (station2 == ref_station and station1 != ref_station)) and (pol1 == pol2):
-        if station1 == ref_station:
-          station = station_idx[station2]
-        else:
-          station = station_idx[station1]
-        if npol == 1:
-	  pol_idx = 0
-	else:
-	  pol_idx = pol1
-        if num_sb == 1:
-	  sb_idx = 0
-	else:
-	  sb_idx = sideband
-
-        buf = struct.unpack(fmt,baseline_buffer[index:index + baseline_data_size])
-	# Skip over the first/last channel
-        vreal = sum(buf[2:2*nchan:2])
-        vim = sum(buf[3:2*nchan:2])
-	if isnan(vreal)==False and isnan(vim)==False:
-          #pdb.set_trace()
-	  visibilities[station, bin, freq_nr, sb_idx, pol_idx] += vreal + J * vim
-      index += baseline_data_size
+    timeslice = get_timeslice(inputfiles[bin], time_slice)
+    baselines = timeslice["baselines"]
+    station1 = baselines["station1"].astype(int)
+    station2 = baselines["station2"].astype(int)
+    flags = baselines["flags"].astype(int)
+    pol1 = flags&1
+    pol2 = (flags>>1)&1
+    sideband = (flags>>2)&1
+    freq_nr = flags>>3
+    # Skip over the first/last channel
+    vis = timeslice["visibilities"][:, 1:nchan].sum(1)
+    selected = ((station1 == ref_station) != (station2 == ref_station)) & (pol1 == pol2) & \
+               (isnan(vis.real) == False) & (isnan(vis.imag) == False)
+    for b in nonzero(selected)[0]:
+      if station1[b] == ref_station:
+        station = station_idx[station2[b]]
+      else:
+        station = station_idx[station1[b]]
+      pol_idx = 0 if npol == 1 else pol1[b]
+      sb_idx = 0 if num_sb == 1 else sideband[b]
+      visibilities[station, bin, freq_nr[b], sb_idx, pol_idx] += vis[b]
   return visibilities
 
-def read_data(inputfile, ndata):
-  data = ''
-  data_read = 0
-  while data_read < ndata:
-    data += inputfile.read(ndata - data_read)
-    data_read = len(data)
-    if data_read < ndata:
-      sleep(1) # if not enough data is available sleep for 1 sec
-  return data
+def get_timeslice(inputfile, time_slice):
+  # The correlator might still be writing the file
+  while time_slice >= len(inputfile):
+    sleep(1) # if not enough data is available sleep for 1 sec
+    inputfile.update()
+  return inputfile.timeslice(time_slice)
 
 def update_plots(visibilities, plots):
   nstation = visibilities.shape[0]
@@ -132,65 +97,37 @@ def get_station_list(vexfile):
 
 def initialize(base_file_name, nbins, station_list):
   inputfiles = []
-  # open all input files and read global header
+  # open all input files
   for bin in range(nbins):
     filename = base_file_name + '.bin'+str(bin)
     try:
-      inputfile = open(filename, 'rb')
-    except:
+      inputfile = sfxc_cor.CorFile(filename)
+    except IOError:
       print "Error : Could not open " + filename
       sys.exit(1)
-    gheader_size_buf = read_data(inputfile, 4)
-    global_header_size = struct.unpack('i', gheader_size_buf)[0]
-    inputfile.seek(0)
-    gheader_buf = read_data(inputfile, global_header_size)
-    global_header = struct.unpack('i32s2h5i4c',gheader_buf[:64])
-    nchan = global_header[5]
+    nchan = inputfile.header["number_channels"]
     inputfiles.append(inputfile)
-  # determine parameters from first bin
+  # determine parameters from the first integration of the first bin
   inputfile = inputfiles[0]
-  #get timeslice header
-  tsheader_buf = read_data(inputfile, timeslice_header_size)
-  timeslice_header = struct.unpack('4i', tsheader_buf)
-  integration_slice = timeslice_header[0]
   stations_found = zeros(len(station_list))
   nsubint = 0
   pol=0
   sb=0
   nif=0
-  while(integration_slice == 0):
-    # get the uvw buffer
-    nuvw = timeslice_header[2]
-    inputfile.seek(uvw_header_size * nuvw, 1)
-    
-    # Read the bit statistics
-    nstatistics = timeslice_header[3]
-    stat_buffer = inputfile.seek(stat_header_size * nstatistics, 1)
-    
-    nbaseline = timeslice_header[1]
-    baseline_data_size = (nchan + 1) * 8 # data is complex floats
-    baseline_buffer = read_data(inputfile, nbaseline * (baseline_header_size + baseline_data_size)) 
-
-    index = 0
-    for b in range(nbaseline):
-      bheader = struct.unpack('i4c', baseline_buffer[index:index + baseline_header_size])
-      index += baseline_header_size
-      station1 = struct.unpack('i', bheader[1]+'\x00\x00\x00')[0]
-      station2 = struct.unpack('i', bheader[2]+'\x00\x00\x00')[0]
+  while(get_timeslice(inputfile, nsubint)["integration_slice"] == 0):
+    baselines = inputfile.timeslice(nsubint)["baselines"]
+    for b in range(baselines.size):
+      station1 = int(baselines["station1"][b])
+      station2 = int(baselines["station2"][b])
       stations_found[station1] = 1
       stations_found[station2] = 1
-      byte = struct.unpack('i', bheader[3]+'\x00\x00\x00')[0]
+      byte = int(baselines["flags"][b])
       pol |=  byte&3
       sb |= ((byte>>2)&1) + 1 
       nif = max((byte>>3) + 1, nif)
       print 's1=%d, s2=%d, pol=%d, sb=%d, nif=%d, if_found=%d, sb_found=%d'%(station1, station2, pol, sb, nif, byte>>3, (byte>>2)&1)
-      index += baseline_data_size
-    tsheader_buf = read_data(inputfile, timeslice_header_size)
-    timeslice_header = struct.unpack('4i', tsheader_buf)
-    integration_slice = timeslice_header[0]
     nsubint += 1
   
-  inputfile.seek(global_header_size)
   stations_in_job = []
   for i in range(stations_found.size):
     if stations_found[i] == 1:
@@ -256,7 +193,7 @@ plots = create_plot_window(station_list, stations_in_job, ref_station, nbins)
 time_slice = 0
 while True:
   #read one integration
-  read_time_slice(inputfiles, visibilities, station_idx, ref_station, pol, sb, nchan)
+  read_time_slice(inputfiles, time_slice, visibilities, station_idx, ref_station, nchan)
   time_slice += 1
   #update plot
   if time_slice % nsubint == 0:
@@ -0,0 +1,575 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+# All rights reserved.
+#
+# $Id$
+#
+# Runs the complete correlator on synthetic data on a single machine.
+#
+# The data and the delay tables are written by generate_test_data, the vex
+# and control files by this script. While sfxc runs, the CPU time of every
+# MPI process and the bytes sent over every TCP connection between the
+# processes are sampled from /proc and ss. Afterwards the real-time factor
+# (length of the correlated data / wall clock time) is reported and the
+# fringe of every baseline and channel is checked against the delays that
+# were put in the data, so that a change which speeds up the correlator
+# but breaks the correlation doesn't go unnoticed. With --baseline-averaging
+# the integration intervals of the averaged time slices are checked as well.
+# The data is VDIF, or Mark5B with --format=mark5b. With --resume-after
+# sfxc is stopped during the correlation and resumed from its checkpoint,
+# and the phase-cal and Tsys files are checked for repeated and missing
+# records.
+
+import sys, os, re, time, shutil, tempfile, subprocess, optparse, struct
+import simplejson
+
+EXPER = "SYNTH"
+SOURCE = "TEST"
+MODE = "SYNTH"
+START_MJD_STRING = "2013y100d"
+START_SECONDS = 12 * 3600
+SKY_FREQUENCY = 5000. # MHz, of the first channel
+FRAME_SIZE = 8000
+VDIF_HEADER_SIZE = 32
+MARK5B_FRAME_SIZE = 10000
+MARK5B_HEADER_SIZE = 16
+FIRST_UDP_PORT = 12000
+
+def which(filename):
+  if os.path.dirname(filename) != "":
+    return filename
+  # Look next to this script first, then in the PATH
+  path = [os.path.dirname(os.path.abspath(sys.argv[0]))]
+  path += os.environ.get('PATH', os.defpath).split(os.pathsep)
+  for p in path:
+    f = os.path.join(p, filename)
+    if os.access(f, os.X_OK):
+      return f
+  return None
+
+def vex_time(seconds):
+  return "%s%02dh%02dm%02ds"%(START_MJD_STRING, seconds / 3600, (seconds / 60) % 60, seconds % 60)
+
+def station_names(n):
+  return ["A" + chr(ord('a') + i) for i in range(n)]
+
+def channel_names(n):
+  return ["CH%02d"%(i + 1) for i in range(n)]
+
+def data_file(opts, workdir, station):
+  extension = {"vdif": "vdif", "mark5b": "m5b"}[opts.format]
+  return os.path.join(workdir, "%s_%s.%s"%(EXPER, station, extension))
+
+def frame_size(opts):
+  # Payload and total size of a frame in the data files
+  if opts.format == "mark5b":
+    return (MARK5B_FRAME_SIZE, MARK5B_FRAME_SIZE + MARK5B_HEADER_SIZE)
+  return (FRAME_SIZE, FRAME_SIZE + VDIF_HEADER_SIZE)
+
+def write_vex(filename, opts, stations):
+  channels = channel_names(opts.channels)
+  bw = opts.bandwidth
+  start = vex_time(START_SECONDS)
+  f = open(filename, 'w')
+  f.write("VEX_rev = 1.5;\n")
+  f.write("$GLOBAL;\n     ref $EXPER = %s;\n"%EXPER)
+  f.write("$EXPER;\ndef %s;\n     exper_name = %s;\n     exper_description = \"Synthetic data\";\nenddef;\n"%(EXPER, EXPER))
+  f.write("$MODE;\ndef %s;\n"%MODE)
+  for block in ["FREQ", "IF", "BBC", "THREADS" if opts.format == "vdif" else "BITSTREAMS"]:
+    f.write("     ref $%s = %s:%s;\n"%(block, MODE, ":".join(stations)))
+  f.write("enddef;\n")
+  f.write("$STATION;\n")
+  for station in stations:
+    f.write("def %s;\n     ref $CLOCK = %s;\n     ref $SITE = %s;\n     ref $ANTENNA = %s;\n     ref $DAS = DAS;\nenddef;\n"%(station, station, station, station))
+  f.write("$SITE;\n")
+  for i, station in enumerate(stations):
+    f.write("def %s;\n     site_type = fixed;\n     site_name = %s;\n     site_ID = %s;\n"%(station, station, station))
+    f.write("     site_position = %.4f m: %.4f m: %.4f m;\nenddef;\n"%(3800000. + 1e5 * i, 1e5 * i, 5000000. - 1e5 * i))
+  f.write("$ANTENNA;\n")
+  for station in stations:
+    f.write("def %s;\n     axis_type = az : el;\n     axis_offset = 0.0 m;\nenddef;\n"%station)
+  # sfxc reads Mark5C recordings of a DBBC as VDIF
+  transport = {"vdif": "Mark5C", "mark5b": "Mark5B"}[opts.format]
+  f.write("$DAS;\ndef DAS;\n     record_transport_type = %s;\n     electronics_rack_type = DBBC;\n     number_drives = 1;\nenddef;\n"%transport)
+  f.write("$SOURCE;\ndef %s;\n     source_name = %s;\n     ra = 12h00m00.000000s; dec = 45d00'00.00000\"; ref_coord_frame = J2000;\nenddef;\n"%(SOURCE, SOURCE))
+  f.write("$FREQ;\ndef %s;\n     sample_rate = %.3f Ms/sec;\n"%(MODE, 2. * bw))
+  for i, ch in enumerate(channels):
+    f.write("     chan_def = : %.2f MHz : U : %.3f MHz : &%s : &BBC%02d : &NoCal;\n"%(SKY_FREQUENCY + i * bw, bw, ch, i + 1))
+  f.write("enddef;\n")
+  f.write("$IF;\ndef %s;\n     if_def = &IF_A : A : R : %.1f MHz : U : 1 MHz;\nenddef;\n"%(MODE, SKY_FREQUENCY - 500.))
+  f.write("$BBC;\ndef %s;\n"%MODE)
+  for i in range(len(channels)):
+    f.write("     BBC_assign = &BBC%02d : %d : &IF_A;\n"%(i + 1, i + 1))
+  f.write("enddef;\n")
+  if opts.format == "vdif":
+    # One VDIF thread per channel, sfxc reads the number of bits from the
+    # sixth field and the frame size from the ninth field of a thread
+    f.write("$THREADS;\ndef %s;\n     format = VDIF : : %d;\n"%(MODE, FRAME_SIZE + VDIF_HEADER_SIZE))
+    for i in range(len(channels)):
+      f.write("     thread = %d : 1 : 1 : %.3f Ms/sec : 1 : 2 : real : : %d;\n"%(i, 2. * bw, FRAME_SIZE))
+    for i, ch in enumerate(channels):
+      f.write("     channel = &%s : %d : 0;\n"%(ch, i))
+  else:
+    # The sign and magnitude of channel i are Mark5B bitstreams 2i and 2i+1
+    f.write("$BITSTREAMS;\ndef %s;\n"%MODE)
+    for i, ch in enumerate(channels):
+      f.write("     stream_def = &%s : sign : %d : %d;\n"%(ch, 2 * i, 2 * i))
+      f.write("     stream_def = &%s : mag : %d : %d;\n"%(ch, 2 * i + 1, 2 * i + 1))
+  f.write("enddef;\n")
+  f.write("$CLOCK;\n")
+  for station in stations:
+    f.write("def %s;\n     clock_early = %s : 0.000 usec : %s : 0.0;\nenddef;\n"%(station, start, start))
+  f.write("$SCHED;\nscan No0001;\n     start = %s; mode = %s; source = %s;\n"%(start, MODE, SOURCE))
+  for station in stations:
+    f.write("     station = %s : 0 sec : %d sec : 0.000 GB : : : 1;\n"%(station, opts.duration + 2))
+  f.write("endscan;\n")
+  f.close()
+
+def write_ctrl(filename, opts, stations, workdir):
+  ctrl = {"exper_name": EXPER,
+          "start": vex_time(START_SECONDS + 1),
+          "stop": vex_time(START_SECONDS + 1 + opts.duration),
+          "stations": stations,
+          "channels": channel_names(opts.channels),
+          "reference_station": "",
+          "cross_polarize": False,
+          "number_channels": opts.nchan,
+          "integr_time": opts.integr_time,
+          "message_level": 0,
+          "delay_directory": "file://" + workdir,
+          "output_file": "file://" + os.path.join(workdir, EXPER + ".cor"),
+          "data_sources": {}}
+  if opts.averaging > 0:
+    ctrl["baseline_averaging"] = {"field_of_view": opts.field_of_view,
+                                  "max_integrations": opts.averaging}
+  if opts.resume_after > 0:
+    ctrl["checkpoint"] = True
+    ctrl["checkpoint_interval"] = 1
+    ctrl["phasecal_file"] = "file://" + os.path.join(workdir, EXPER + ".phasecal")
+    ctrl["phasecal_integr_time"] = 1
+    ctrl["tsys_file"] = "file://" + os.path.join(workdir, EXPER + ".tsys")
+  for i, station in enumerate(stations):
+    if opts.udp:
+      ctrl["data_sources"][station] = ["udp://%d"%(FIRST_UDP_PORT + i)]
+    else:
+      ctrl["data_sources"][station] = ["file://" + data_file(opts, workdir, station)]
+  f = open(filename, 'w')
+  simplejson.dump(ctrl, f, indent=2)
+  f.close()
+
+############################## Monitoring ##############################
+
+def sfxc_processes(ctrl_file):
+  # Returns {pid: rank} of the running sfxc processes of this test
+  result = {}
+  for pid in os.listdir("/proc"):
+    if not pid.isdigit():
+      continue
+    try:
+      cmdline = open("/proc/%s/cmdline"%pid).read().split('\0')
+      if os.path.basename(cmdline[0]) != "sfxc" or ctrl_file not in cmdline:
+        continue
+      environ = open("/proc/%s/environ"%pid).read().split('\0')
+    except IOError:
+      continue
+    rank = None
+    for var in environ:
+      name, sep, value = var.partition('=')
+      if name in ["OMPI_COMM_WORLD_RANK", "PMI_RANK", "PMIX_RANK", "MV2_COMM_WORLD_RANK"]:
+        rank = int(value)
+        break
+    if rank != None:
+      result[int(pid)] = rank
+  return result
+
+def cpu_time(pid):
+  # User plus system time of all threads of the process in seconds
+  try:
+    stat = open("/proc/%d/stat"%pid).read()
+  except IOError:
+    return None
+  fields = stat[stat.rfind(')') + 2:].split()
+  return (int(fields[11]) + int(fields[12])) / float(os.sysconf('SC_CLK_TCK'))
+
+def tcp_connections():
+  # Returns a list of (local address, peer address, pid, bytes sent)
+  try:
+    output = subprocess.Popen(["ss", "-tinp"], stdout=subprocess.PIPE,
+                              stderr=open(os.devnull, 'w')).communicate()[0]
+  except OSError:
+    return None
+  result = []
+  connection = None
+  for line in output.splitlines():
+    if line.startswith("ESTAB"):
+      fields = line.split()
+      m = re.search(r'pid=(\d+)', line)
+      connection = [fields[3], fields[4], int(m.group(1)) if m else None]
+    elif connection != None:
+      m = re.search(r'bytes_acked:(\d+)', line)
+      if m == None:
+        m = re.search(r'bytes_sent:(\d+)', line)
+      if m != None:
+        result.append((connection[0], connection[1], connection[2], int(m.group(1))))
+      connection = None
+  return result
+
+class Monitor:
+  def __init__(self, ctrl_file):
+    self.ctrl_file = ctrl_file
+    self.ranks = {}
+    self.cpu = {}
+    self.connections = {}
+    self.owner = {}
+    self.have_ss = True
+
+  def sample(self):
+    self.ranks.update(sfxc_processes(self.ctrl_file))
+    for pid, rank in self.ranks.iteritems():
+      t = cpu_time(pid)
+      if t != None:
+        self.cpu[rank] = t
+    if not self.have_ss:
+      return
+    connections = tcp_connections()
+    if connections == None:
+      self.have_ss = False
+      return
+    for local, peer, pid, nbytes in connections:
+      if pid in self.ranks:
+        self.owner[local] = self.ranks[pid]
+        key = (local, peer)
+        self.connections[key] = max(self.connections.get(key, 0), nbytes)
+
+  def links(self):
+    # Bytes sent per (source rank, destination rank)
+    result = {}
+    for (local, peer), nbytes in self.connections.iteritems():
+      if (local in self.owner) and (peer in self.owner):
+        key = (self.owner[local], self.owner[peer])
+        result[key] = result.get(key, 0) + nbytes
+    return result
+
+def udp_port_bound(port):
+  for filename in ["/proc/net/udp", "/proc/net/udp6"]:
+    try:
+      lines = open(filename).readlines()[1:]
+    except IOError:
+      continue
+    for line in lines:
+      local = line.split()[1]
+      if int(local.split(':')[1], 16) == port:
+        return True
+  return False
+
+def run_sfxc(opts, stations, workdir, vex_file, ctrl_file, resume=False, stop_after=None):
+  # With stop_after sfxc is stopped after that many seconds
+  nprocesses = 3 + len(stations) + opts.correlator_nodes
+  cmd = opts.mpirun.split() + ["-np", str(nprocesses), opts.sfxc] + \
+        (["--resume"] if resume else []) + [ctrl_file, vex_file]
+  print " ".join(cmd)
+  log = open(os.path.join(workdir, "sfxc.log"), 'a' if resume else 'w')
+  monitor = Monitor(ctrl_file)
+  start = time.time()
+  proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+  generators = []
+  while proc.poll() == None:
+    monitor.sample()
+    if opts.udp and (len(generators) == 0):
+      # Send the data in real time once all input nodes listen
+      ports = [FIRST_UDP_PORT + i for i in range(len(stations))]
+      if all([udp_port_bound(port) for port in ports]):
+        payload, size = frame_size(opts)
+        rate = opts.channels * 2 * opts.bandwidth * 2 * size / float(payload)
+        for i, station in enumerate(stations):
+          generators.append(subprocess.Popen([opts.udp_generator, "-f", data_file(opts, workdir, station),
+                                              "-s", str(size),
+                                              "-r", str(rate), "127.0.0.1", str(ports[i])]))
+    if (stop_after != None) and (time.time() - start > stop_after):
+      proc.terminate()
+      proc.wait()
+      break
+    time.sleep(opts.interval)
+  wall_time = time.time() - start
+  for generator in generators:
+    if generator.poll() == None:
+      generator.terminate()
+    generator.wait()
+  log.close()
+  return (proc.returncode, wall_time, monitor)
+
+def node_name(rank, stations):
+  if rank == 0:
+    return "manager"
+  if rank == 1:
+    return "log"
+  if rank == 2:
+    return "output"
+  if rank < 3 + len(stations):
+    return "input " + stations[rank - 3]
+  return "correlator %d"%(rank - 3 - len(stations))
+
+def print_report(opts, stations, wall_time, monitor, result):
+  rtf = opts.duration / wall_time
+  result["wall_time"] = wall_time
+  result["realtime_factor"] = rtf
+  print "%d s of data (%d stations, %d channels of %d MHz) in %.1f s: real-time factor %.3f"% \
+        (opts.duration, len(stations), opts.channels, opts.bandwidth, wall_time, rtf)
+  print "%-16s %12s %8s"%("node", "cpu (s)", "cpu (%)")
+  result["nodes"] = {}
+  for rank in sorted(monitor.cpu.keys()):
+    name = node_name(rank, stations)
+    cpu = monitor.cpu[rank]
+    print "%-16s %12.2f %8.1f"%(name, cpu, 100. * cpu / wall_time)
+    result["nodes"][name] = {"rank": rank, "cpu_time": cpu}
+  if not monitor.have_ss:
+    print "ss is not available, no link statistics"
+    return
+  links = monitor.links()
+  print "%-16s %-16s %12s %12s"%("from", "to", "bytes", "MB/s")
+  result["links"] = []
+  for (src, dst) in sorted(links.keys()):
+    nbytes = links[(src, dst)]
+    if nbytes == 0:
+      continue
+    print "%-16s %-16s %12d %12.2f"%(node_name(src, stations), node_name(dst, stations),
+                                     nbytes, nbytes / wall_time / 1e6)
+    result["links"].append({"from": node_name(src, stations), "to": node_name(dst, stations),
+                            "bytes": nbytes, "bytes_per_second": nbytes / wall_time})
+
+def check_fringes(opts, stations, cor_file, result):
+  # The generator delays station i by i*residual samples with respect to
+  # its delay model, the fringe of baseline (a, b) is at lag (a-b)*residual
+  cmd = [opts.print_corfile, "-S", "-U", "-n", cor_file]
+  output = subprocess.Popen(cmd, stdout=subprocess.PIPE).communicate()[0]
+  baseline_re = re.compile(r'Baseline :\s+station1 =\s+(\d+)\s*,\s*station2 =\s+(\d+)')
+  fringe_re = re.compile(r'freq = (\d+).*SNR = ([^,]+), offset = (-?\d+)')
+  baseline = None
+  found = {}
+  errors = 0
+  for line in output.splitlines():
+    m = baseline_re.search(line)
+    if m:
+      baseline = (int(m.group(1)), int(m.group(2)))
+      continue
+    m = fringe_re.search(line)
+    if (m == None) or (baseline == None):
+      continue
+    freq, snr, offset = int(m.group(1)), float(m.group(2)), int(m.group(3))
+    expected = (baseline[0] - baseline[1]) * opts.residual
+    found[(baseline, freq)] = found.get((baseline, freq), 0) + 1
+    if (offset != expected) or (snr < opts.min_snr):
+      errors += 1
+      print "Baseline %s-%s, channel %d: fringe at %d (expected %d), SNR %.1f"% \
+            (stations[baseline[0]], stations[baseline[1]], freq, offset, expected, snr)
+  nbaselines = len(stations) * (len(stations) - 1) / 2
+  missing = nbaselines * opts.channels - len(found)
+  if missing > 0:
+    print "%d baseline/channel combinations are missing in the output"%missing
+  result["fringe_errors"] = errors
+  result["fringes_missing"] = missing
+  ok = (errors == 0) and (missing == 0) and (len(found) > 0)
+  print "Fringe check " + ("passed" if ok else "FAILED") + \
+        " (%d baselines, %d channels, %d integrations checked)"% \
+        (nbaselines, opts.channels, sum(found.values()) / max(len(found), 1))
+  return ok
+
+def check_averaging(opts, cor_file, result):
+  # Every averaged time slice should cover the averaged_integrations up to
+  # and including its integration_slice, and the time slices should be in
+  # the order of their last integration
+  cmd = [opts.print_corfile, "-S", "-V", "-n", cor_file]
+  output = subprocess.Popen(cmd, stdout=subprocess.PIPE).communicate()[0]
+  interval_re = re.compile(r'averaged over (\d+) integrations \((-?\d+) to (-?\d+)\)')
+  errors = 0
+  intervals = {}
+  last_slice = None
+  for line in output.splitlines():
+    m = interval_re.search(line)
+    if m == None:
+      continue
+    nr, first, last = int(m.group(1)), int(m.group(2)), int(m.group(3))
+    if (nr < 1) or (nr > opts.averaging) or (last - first + 1 != nr):
+      errors += 1
+      print "Time slice %d: %d integrations averaged over %d to %d"%(last, nr, first, last)
+    if (last_slice != None) and (last < last_slice):
+      errors += 1
+      print "Time slice %d follows time slice %d"%(last, last_slice)
+    last_slice = last
+    intervals[(first, last)] = nr
+  result["averaging_errors"] = errors
+  result["averaged_intervals"] = len(intervals)
+  ok = (errors == 0) and (len(intervals) > 0)
+  print "Averaging check " + ("passed" if ok else "FAILED") + \
+        " (%d intervals, at most %d integrations)"% \
+        (len(intervals), max([0] + intervals.values()))
+  return ok
+
+def read_records(filename, record_size):
+  # Returns {(station, frequency, sideband, polarisation): [seconds]} of a
+  # phase-cal or Tsys file, the number of repeated records and whether the
+  # last record is torn
+  data = open(filename, 'rb').read()
+  pos = struct.unpack("<i", data[:4])[0]
+  records = {}
+  repeated = 0
+  while pos < len(data):
+    size = record_size(data, pos)
+    if pos + size > len(data):
+      return records, repeated, True
+    station, freq, sideband, pol, mjd, secs = struct.unpack("<4BII", data[pos:pos + 12])
+    times = records.setdefault((station, freq, sideband, pol), [])
+    if mjd * 86400 + secs in times:
+      repeated += 1
+    times.append(mjd * 86400 + secs)
+    pos += size
+  return records, repeated, False
+
+def check_records(opts, workdir, result):
+  # After resuming, every stream should have one phase-cal record per
+  # second and one Tsys record per integration without gaps
+  def phasecal_size(data, pos):
+    return 20 + 4 * struct.unpack("<I", data[pos + 16:pos + 20])[0]
+  def tsys_size(data, pos):
+    return 44
+  ok = True
+  for name, key, record_size, step in \
+      [("Phase-cal", "phasecal", phasecal_size, 1), ("Tsys", "tsys", tsys_size, int(opts.integr_time))]:
+    records, repeated, torn = read_records(os.path.join(workdir, EXPER + "." + key), record_size)
+    missing = 0
+    for stream, times in records.iteritems():
+      times.sort()
+      for t0, t1 in zip(times[:-1], times[1:]):
+        if t1 - t0 > step:
+          missing += (t1 - t0) / step - 1
+    result[key + "_repeated"] = repeated
+    result[key + "_missing"] = missing
+    check = (repeated == 0) and (missing == 0) and (not torn) and (len(records) > 0)
+    print "%s check "%name + ("passed" if check else "FAILED") + \
+          " (%d streams, %d repeated and %d missing records%s)"% \
+          (len(records), repeated, missing, ", torn record at the end" if torn else "")
+    ok = ok and check
+  return ok
+
+def get_options():
+  parser = optparse.OptionParser("%prog [options]")
+  parser.add_option("-n", "--stations", dest="stations", type="int", default=4,
+                    help="Number of stations [default: %default]")
+  parser.add_option("-c", "--channels", dest="channels", type="int", default=2,
+                    help="Number of frequency channels [default: %default]")
+  parser.add_option("-b", "--bandwidth", dest="bandwidth", type="int", default=16,
+                    help="Bandwidth of a channel in MHz [default: %default]")
+  parser.add_option("-t", "--duration", dest="duration", type="int", default=10,
+                    help="Seconds of data to correlate [default: %default]")
+  parser.add_option("-N", "--number-channels", dest="nchan", type="int", default=1024,
+                    help="Number of spectral channels [default: %default]")
+  parser.add_option("-i", "--integration-time", dest="integr_time", type="float", default=1.,
+                    help="Integration time in seconds [default: %default]")
+  parser.add_option("-p", "--correlator-nodes", dest="correlator_nodes", type="int", default=2,
+                    help="Number of correlator nodes [default: %default]")
+  parser.add_option("-r", "--residual", dest="residual", type="int", default=3,
+                    help="Residual delay per station in samples [default: %default]")
+  parser.add_option("-f", "--format", dest="format", type="choice", choices=["vdif", "mark5b"],
+                    default="vdif", help="Data format, vdif or mark5b [default: %default]")
+  parser.add_option("-u", "--udp", dest="udp", action="store_true", default=False,
+                    help="Send the data to sfxc in real time over loopback UDP instead of reading files")
+  parser.add_option("-s", "--min-snr", dest="min_snr", type="float", default=10.,
+                    help="Minimum SNR of a fringe [default: %default]")
+  parser.add_option("--resume-after", dest="resume_after", type="float", default=0,
+                    help="Stop sfxc after this many seconds and resume it, with phase-cal and Tsys files [default: off]")
+  parser.add_option("-a", "--baseline-averaging", dest="averaging", type="int", default=0,
+                    help="Average baselines over at most this many integrations [default: off]")
+  parser.add_option("--field-of-view", dest="field_of_view", type="float", default=1.,
+                    help="Field of view for the baseline averaging in arcsec [default: %default]")
+  parser.add_option("-w", "--workdir", dest="workdir", type="string",
+                    help="Directory for the test files [default: a temporary directory]")
+  parser.add_option("-k", "--keep", dest="keep", action="store_true", default=False,
+                    help="Keep the test files")
+  parser.add_option("-j", "--json", dest="json", type="string",
+                    help="Also write the results to this file")
+  parser.add_option("--mpirun", dest="mpirun", type="string", default="mpirun",
+                    help="MPI launcher [default: %default]")
+  parser.add_option("--sfxc", dest="sfxc", type="string", default="sfxc")
+  parser.add_option("--generator", dest="generator", type="string", default="generate_test_data")
+  parser.add_option("--udp-generator", dest="udp_generator", type="string", default="udp_generator")
+  parser.add_option("--print-corfile", dest="print_corfile", type="string", default="print_corfile.py")
+  parser.add_option("--interval", dest="interval", type="float", default=0.5,
+                    help="Sampling interval of the monitoring in seconds [default: %default]")
+  (opts, args) = parser.parse_args()
+  if len(args) != 0:
+    parser.error("too many arguments")
+  if (opts.stations < 2) or (opts.stations > 26):
+    parser.error("the number of stations should be between 2 and 26")
+  if opts.averaging < 0:
+    parser.error("the number of averaged integrations should be positive")
+  if (opts.resume_after > 0) and (opts.integr_time != int(opts.integr_time)):
+    parser.error("resuming needs an integration time of whole seconds")
+  if opts.residual * (opts.stations - 1) >= opts.nchan:
+    parser.error("the residual delays don't fit in the lag range")
+  for program in ["sfxc", "generator", "print_corfile"] + (["udp_generator"] if opts.udp else []):
+    path = which(getattr(opts, program))
+    if path == None:
+      parser.error("cannot find " + getattr(opts, program))
+    setattr(opts, program, path)
+  return opts
+
+############################## Main program ##########################
+
+opts = get_options()
+stations = station_names(opts.stations)
+workdir = opts.workdir
+if workdir == None:
+  workdir = tempfile.mkdtemp(prefix="sfxc_test_")
+elif not os.path.isdir(workdir):
+  os.makedirs(workdir)
+workdir = os.path.abspath(workdir)
+vex_file = os.path.join(workdir, EXPER + ".vix")
+ctrl_file = os.path.join(workdir, EXPER + ".ctrl")
+
+write_vex(vex_file, opts, stations)
+write_ctrl(ctrl_file, opts, stations, workdir)
+cmd = [opts.generator, "-f", opts.format, "-s", vex_time(START_SECONDS), "-t", str(opts.duration + 2),
+       "-c", str(opts.channels), "-b", str(opts.bandwidth), "-F", str(FRAME_SIZE),
+       "-r", str(opts.residual), "-S", SOURCE, workdir, EXPER] + stations
+print " ".join(cmd)
+if subprocess.call(cmd) != 0:
+  print "generate_test_data: returned error."
+  sys.exit(1)
+
+if opts.resume_after > 0:
+  status, wall_time, monitor = run_sfxc(opts, stations, workdir, vex_file, ctrl_file,
+                                        stop_after=opts.resume_after)
+  if status == 0:
+    print "sfxc: finished before it was stopped, use a smaller --resume-after"
+    sys.exit(1)
+  status, wall_time, monitor = run_sfxc(opts, stations, workdir, vex_file, ctrl_file,
+                                        resume=True)
+else:
+  status, wall_time, monitor = run_sfxc(opts, stations, workdir, vex_file, ctrl_file)
+if status != 0:
+  print "sfxc: returned error, see " + os.path.join(workdir, "sfxc.log")
+  sys.exit(1)
+
+result = {}
+print_report(opts, stations, wall_time, monitor, result)
+ok = check_fringes(opts, stations, os.path.join(workdir, EXPER + ".cor"), result)
+result["fringe_check"] = ok
+if opts.averaging > 0:
+  averaging_ok = check_averaging(opts, os.path.join(workdir, EXPER + ".cor"), result)
+  result["averaging_check"] = averaging_ok
+  ok = ok and averaging_ok
+if opts.resume_after > 0:
+  records_ok = check_records(opts, workdir, result)
+  result["records_check"] = records_ok
+  ok = ok and records_ok
+if opts.json != None:
+  f = open(opts.json, 'w')
+  simplejson.dump(result, f, indent=2)
+  f.close()
+
+if opts.keep or (opts.workdir != None):
+  print "Test files are in " + workdir
+else:
+  shutil.rmtree(workdir)
+sys.exit(0 if ok else 1)
@@ -0,0 +1,374 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * Python module (sfxc_cor) for reading correlator output files. The file
+ * is memory mapped by a Cor_file, the headers and visibilities of a time
+ * slice are returned as numpy arrays that point into the mapping, so
+ * nothing is copied or parsed in Python:
+ *
+ *   import sfxc_cor
+ *   cor = sfxc_cor.CorFile("exp.cor")
+ *   cor.header["number_channels"]
+ *   for i in range(len(cor)):
+ *     slice = cor.timeslice(i)
+ *     slice["baselines"]["station1"], slice["visibilities"][b, :]
+ *
+ * The visibilities of output format versions 2 and 3 are stored with
+ * reduced precision, these are converted to complex64 (a copy). update()
+ * maps the file again to see the time slices that were written since,
+ * arrays of the old mapping stay valid.
+ */
+
+#include <Python.h>
+#include <numpy/arrayobject.h>
+
+#include <vector>
+#include <string>
+#include <string.h>
+
+#include "cor_file.h"
+
+// The memory mapping, base object of all arrays that point into it
+typedef struct {
+  PyObject_HEAD
+  Cor_file *cor_file;
+} Mapping;
+
+typedef struct {
+  PyObject_HEAD
+  PyObject *filename;
+  Mapping *mapping;
+} CorFile;
+
+static void
+Mapping_dealloc(Mapping *self) {
+  delete self->cor_file;
+  self->ob_type->tp_free((PyObject *)self);
+}
+
+static PyTypeObject MappingType = {
+  PyObject_HEAD_INIT(NULL)
+  0,                          /* ob_size */
+  "sfxc_cor._Mapping",        /* tp_name */
+  sizeof(Mapping),            /* tp_basicsize */
+  0,                          /* tp_itemsize */
+  (destructor)Mapping_dealloc,/* tp_dealloc */
+};
+
+static PyArray_Descr *uvw_descr = NULL;
+static PyArray_Descr *statistics_descr = NULL;
+static PyArray_Descr *baseline_descr = NULL;
+
+static PyArray_Descr *
+make_descr(PyObject *spec) {
+  PyArray_Descr *descr = NULL;
+  if (spec != NULL)
+    PyArray_DescrConverter(spec, &descr);
+  Py_XDECREF(spec);
+  return descr;
+}
+
+static Mapping *
+open_mapping(PyObject *filename) {
+  Mapping *mapping = PyObject_New(Mapping, &MappingType);
+  if (mapping == NULL)
+    return NULL;
+  mapping->cor_file = new Cor_file();
+  if (!mapping->cor_file->open(PyString_AsString(filename))) {
+    PyErr_SetFromErrnoWithFilename(PyExc_IOError, PyString_AsString(filename));
+    Py_DECREF(mapping);
+    return NULL;
+  }
+  return mapping;
+}
+
+// A read-only array of the given shape and strides that points into the
+// mapping
+static PyObject *
+mapped_array(Mapping *mapping, PyArray_Descr *descr, int nd, npy_intp *dims,
+             npy_intp *strides, const void *data) {
+  Py_INCREF(descr);
+  PyObject *array = PyArray_NewFromDescr(&PyArray_Type, descr, nd, dims, strides,
+                                         (void *)data, 0, NULL);
+  if (array == NULL)
+    return NULL;
+  Py_INCREF(mapping);
+  if (PyArray_SetBaseObject((PyArrayObject *)array, (PyObject *)mapping) < 0) {
+    Py_DECREF(array);
+    return NULL;
+  }
+  PyArray_UpdateFlags((PyArrayObject *)array, NPY_ARRAY_UPDATE_ALL);
+  PyArray_CLEARFLAGS((PyArrayObject *)array, NPY_ARRAY_WRITEABLE);
+  return array;
+}
+
+// Adds value to dict under key and drops the reference to value
+static bool
+set_item(PyObject *dict, const char *key, PyObject *value) {
+  if (value == NULL)
+    return false;
+  int result = PyDict_SetItemString(dict, key, value);
+  Py_DECREF(value);
+  return result == 0;
+}
+
+static int
+CorFile_init(CorFile *self, PyObject *args, PyObject *kwds) {
+  static char *kwlist[] = {(char *)"filename", NULL};
+  PyObject *filename;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "S", kwlist, &filename))
+    return -1;
+  Mapping *mapping = open_mapping(filename);
+  if (mapping == NULL)
+    return -1;
+  Py_INCREF(filename);
+  Py_XDECREF(self->filename);
+  self->filename = filename;
+  Py_XDECREF(self->mapping);
+  self->mapping = mapping;
+  return 0;
+}
+
+static void
+CorFile_dealloc(CorFile *self) {
+  Py_XDECREF(self->filename);
+  Py_XDECREF(self->mapping);
+  self->ob_type->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+CorFile_length(CorFile *self) {
+  return self->mapping->cor_file->nr_timeslices();
+}
+
+static PyObject *
+CorFile_get_header(CorFile *self, void *closure) {
+  const Output_header_global &header = self->mapping->cor_file->global_header();
+  PyObject *dict = PyDict_New();
+  if (dict == NULL)
+    return NULL;
+  if (set_item(dict, "header_size", PyInt_FromLong(header.header_size)) &&
+      set_item(dict, "experiment",
+               PyString_FromStringAndSize(header.experiment,
+                                          strnlen(header.experiment, sizeof(header.experiment)))) &&
+      set_item(dict, "start_year", PyInt_FromLong(header.start_year)) &&
+      set_item(dict, "start_day", PyInt_FromLong(header.start_day)) &&
+      set_item(dict, "start_time", PyInt_FromLong(header.start_time)) &&
+      set_item(dict, "number_channels", PyInt_FromLong(header.number_channels)) &&
+      set_item(dict, "integration_time", PyInt_FromLong(header.integration_time)) &&
+      set_item(dict, "output_format_version", PyInt_FromLong(header.output_format_version)) &&
+      set_item(dict, "correlator_version", PyInt_FromLong(header.correlator_version)) &&
+      set_item(dict, "polarisation_type", PyInt_FromLong(header.polarisation_type)) &&
+      set_item(dict, "correlator_branch",
+               PyString_FromStringAndSize(header.correlator_branch,
+                                          strnlen(header.correlator_branch,
+                                                  sizeof(header.correlator_branch)))) &&
+      set_item(dict, "job_nr", PyInt_FromLong(header.job_nr)) &&
+      set_item(dict, "subjob_nr", PyInt_FromLong(header.subjob_nr)))
+    return dict;
+  Py_DECREF(dict);
+  return NULL;
+}
+
+static PyObject *
+CorFile_update(CorFile *self) {
+  Mapping *mapping = open_mapping(self->filename);
+  if (mapping == NULL)
+    return NULL;
+  Py_DECREF(self->mapping);
+  self->mapping = mapping;
+  return PyInt_FromSize_t(mapping->cor_file->nr_timeslices());
+}
+
+static PyObject *
+CorFile_next_integration(CorFile *self, PyObject *args) {
+  Py_ssize_t i;
+  if (!PyArg_ParseTuple(args, "n", &i))
+    return NULL;
+  const Cor_file &cor_file = *self->mapping->cor_file;
+  if ((i < 0) || ((size_t)i >= cor_file.nr_timeslices())) {
+    PyErr_SetString(PyExc_IndexError, "time slice index out of range");
+    return NULL;
+  }
+  return PyInt_FromSize_t(cor_file.next_integration(i));
+}
+
+static PyObject *
+CorFile_timeslice(CorFile *self, PyObject *args) {
+  Py_ssize_t i;
+  if (!PyArg_ParseTuple(args, "n", &i))
+    return NULL;
+  Mapping *mapping = self->mapping;
+  const Cor_file &cor_file = *mapping->cor_file;
+  if (i < 0)
+    i += cor_file.nr_timeslices();
+  if ((i < 0) || ((size_t)i >= cor_file.nr_timeslices())) {
+    PyErr_SetString(PyExc_IndexError, "time slice index out of range");
+    return NULL;
+  }
+  const Output_header_timeslice &timeslice = cor_file.timeslice(i);
+  int nchan = cor_file.number_channels();
+  npy_intp nbaselines = timeslice.number_baselines;
+
+  PyObject *dict = PyDict_New();
+  if (dict == NULL)
+    return NULL;
+  if (!set_item(dict, "integration_slice", PyInt_FromLong(timeslice.integration_slice)))
+    goto error;
+  if (!set_item(dict, "first_integration_slice",
+                PyInt_FromLong(cor_file.first_integration_slice(i))))
+    goto error;
+  {
+    npy_intp dims[] = {timeslice.number_uvw_coordinates};
+    if (!set_item(dict, "uvw", mapped_array(mapping, uvw_descr, 1, dims, NULL,
+                                            cor_file.uvw_coordinates(i))))
+      goto error;
+  }
+  {
+    npy_intp dims[] = {timeslice.number_statistics};
+    if (!set_item(dict, "statistics", mapped_array(mapping, statistics_descr, 1, dims, NULL,
+                                                   cor_file.statistics(i))))
+      goto error;
+  }
+  {
+    npy_intp dims[] = {nbaselines};
+    npy_intp strides[] = {(npy_intp)cor_file.baseline_size()};
+    if (!set_item(dict, "baselines", mapped_array(mapping, baseline_descr, 1, dims, strides,
+                                                  cor_file.baselines(i))))
+      goto error;
+  }
+  {
+    npy_intp dims[] = {nbaselines, nchan + 1};
+    PyObject *visibilities;
+    if (cor_file.global_header().output_format_version <= 1) {
+      npy_intp strides[] = {(npy_intp)cor_file.baseline_size(), sizeof(std::complex<float>)};
+      PyArray_Descr *descr = PyArray_DescrFromType(NPY_CFLOAT);
+      visibilities = mapped_array(mapping, descr, 2, dims, strides,
+                                  cor_file.visibilities(i, 0));
+      Py_DECREF(descr);
+    } else {
+      visibilities = PyArray_SimpleNew(2, dims, NPY_CFLOAT);
+      if (visibilities != NULL) {
+        std::complex<float> *data =
+          (std::complex<float> *)PyArray_DATA((PyArrayObject *)visibilities);
+        for (int b = 0; b < nbaselines; b++)
+          cor_file.get_visibilities(i, b, data + b * (nchan + 1));
+      }
+    }
+    if (!set_item(dict, "visibilities", visibilities))
+      goto error;
+  }
+  return dict;
+
+error:
+  Py_DECREF(dict);
+  return NULL;
+}
+
+static PySequenceMethods CorFile_as_sequence = {
+  (lenfunc)CorFile_length,    /* sq_length */
+};
+
+static PyGetSetDef CorFile_getset[] = {
+  {(char *)"header", (getter)CorFile_get_header, NULL,
+   (char *)"The global header as a dict", NULL},
+  {NULL}
+};
+
+static PyMethodDef CorFile_methods[] = {
+  {"timeslice", (PyCFunction)CorFile_timeslice, METH_VARARGS,
+   "timeslice(i) -> dict with the integration_slice and the uvw, statistics,\n"
+   "baselines and visibilities arrays of time slice i"},
+  {"next_integration", (PyCFunction)CorFile_next_integration, METH_VARARGS,
+   "next_integration(i) -> index of the first time slice after the integration\n"
+   "of time slice i"},
+  {"update", (PyCFunction)CorFile_update, METH_NOARGS,
+   "Maps the file again to see new time slices, returns the number of time slices"},
+  {NULL}
+};
+
+static PyTypeObject CorFileType = {
+  PyObject_HEAD_INIT(NULL)
+  0,                          /* ob_size */
+  "sfxc_cor.CorFile",         /* tp_name */
+  sizeof(CorFile),            /* tp_basicsize */
+  0,                          /* tp_itemsize */
+  (destructor)CorFile_dealloc,/* tp_dealloc */
+  0,                          /* tp_print */
+  0,                          /* tp_getattr */
+  0,                          /* tp_setattr */
+  0,                          /* tp_compare */
+  0,                          /* tp_repr */
+  0,                          /* tp_as_number */
+  &CorFile_as_sequence,       /* tp_as_sequence */
+  0,                          /* tp_as_mapping */
+  0,                          /* tp_hash */
+  0,                          /* tp_call */
+  0,                          /* tp_str */
+  0,                          /* tp_getattro */
+  0,                          /* tp_setattro */
+  0,                          /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,         /* tp_flags */
+  "CorFile(filename): memory mapped correlator output file", /* tp_doc */
+  0,                          /* tp_traverse */
+  0,                          /* tp_clear */
+  0,                          /* tp_richcompare */
+  0,                          /* tp_weaklistoffset */
+  0,                          /* tp_iter */
+  0,                          /* tp_iternext */
+  CorFile_methods,            /* tp_methods */
+  0,                          /* tp_members */
+  CorFile_getset,             /* tp_getset */
+  0,                          /* tp_base */
+  0,                          /* tp_dict */
+  0,                          /* tp_descr_get */
+  0,                          /* tp_descr_set */
+  0,                          /* tp_dictoffset */
+  (initproc)CorFile_init,     /* tp_init */
+};
+
+static PyMethodDef module_methods[] = {
+  {NULL}
+};
+
+PyMODINIT_FUNC
+initsfxc_cor(void) {
+  import_array();
+
+  MappingType.tp_flags = Py_TPFLAGS_DEFAULT;
+  if (PyType_Ready(&MappingType) < 0)
+    return;
+  CorFileType.tp_new = PyType_GenericNew;
+  if (PyType_Ready(&CorFileType) < 0)
+    return;
+
+  // The layout of the headers in output_header.h, the flags of a baseline
+  // are polarisation1 (bit 0), polarisation2 (bit 1), sideband (bit 2)
+  // and frequency_nr (bits 3-7)
+  uvw_descr = make_descr(Py_BuildValue("[(s,s),(s,s),(s,s),(s,s),(s,s)]",
+                                       "station_nr", "<i4",
+                                       "averaged_integrations", "<i4",
+                                       "u", "<f8", "v", "<f8", "w", "<f8"));
+  statistics_descr = make_descr(Py_BuildValue("[(s,s),(s,s),(s,s),(s,s),(s,s,(i)),(s,s)]",
+                                              "station_nr", "u1",
+                                              "frequency_nr", "u1",
+                                              "sideband", "u1",
+                                              "polarisation", "u1",
+                                              "levels", "<i4", 4,
+                                              "n_invalid", "<i4"));
+  baseline_descr = make_descr(Py_BuildValue("[(s,s),(s,s),(s,s),(s,s),(s,s)]",
+                                            "weight", "<i4",
+                                            "station1", "u1",
+                                            "station2", "u1",
+                                            "flags", "u1",
+                                            "scale_exponent", "i1"));
+  if ((uvw_descr == NULL) || (statistics_descr == NULL) || (baseline_descr == NULL))
+    return;
+
+  PyObject *module = Py_InitModule3("sfxc_cor", module_methods,
+                                    "Memory mapped correlator output files");
+  if (module == NULL)
+    return;
+  Py_INCREF(&CorFileType);
+  PyModule_AddObject(module, "CorFile", (PyObject *)&CorFileType);
+}
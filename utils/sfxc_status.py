@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+# All rights reserved.
+#
+# $Id$
+#
+# Shows the live status of a correlation in a terminal.
+#
+# The manager node publishes the status if the control file has a "status"
+# entry. With "file:///path/name" the file is read every interval, with
+# "unix:///path/socket" this script listens on the socket and sfxc
+# connects to it and writes one line of JSON per update. Every update
+# shows the progress, the real time factor, the utilisation of the input,
+# F, X and output stages, the input rate of every station and the lag of
+# every correlator node. The stage with the highest utilisation limits
+# the correlation.
+
+import sys, os, time, socket, optparse
+import simplejson
+
+STAGES = ["input", "F", "X", "output"]
+BAR_WIDTH = 30
+
+def bar(fraction):
+  if fraction == None:
+    return "[" + " " * BAR_WIDTH + "]    -"
+  n = int(round(fraction * BAR_WIDTH))
+  return "[" + "#" * n + " " * (BAR_WIDTH - n) + "] %3d%%" % round(fraction * 100)
+
+def percentage(fraction):
+  if fraction == None:
+    return "   -"
+  return "%3d%%" % round(fraction * 100)
+
+def render(status):
+  lines = []
+  lines.append("Correlating %s - %s" % (status["start"], status["stop"]))
+  lines.append("Correlated until %s %s" % (status["correlated_until"],
+                                           bar(status["progress"])))
+  lines.append("Real time factor %.2f (average %.2f), %d integrations in flight" %
+               (status["real_time_factor"], status["average_real_time_factor"],
+                status["integrations_in_flight"]))
+  lines.append("")
+  limiting = status["limiting_stage"]
+  for stage in STAGES:
+    mark = ""
+    if stage == limiting:
+      mark = "  <- limiting"
+    lines.append("  %-6s %s%s" % (stage, bar(status["stages"][stage]), mark))
+  lines.append("")
+  lines.append("  %-8s %5s %12s %6s" % ("station", "rank", "rate Mb/s", "busy"))
+  for station in status["stations"]:
+    lines.append("  %-8s %5d %12.1f %6s" % (station["name"], station["rank"],
+                                             station["rate_mbit"],
+                                             percentage(station["usage"])))
+  lines.append("")
+  lines.append("  %-8s %5s %9s %6s %8s %6s %6s" %
+               ("node", "rank", "in flight", "done", "lag (s)", "F", "X"))
+  for node in status["correlator_nodes"]:
+    lines.append("  %-8d %5d %9d %6d %8.1f %6s %6s" %
+                 (node["node"], node["rank"], node["in_flight"], node["done"],
+                  node["lag_sec"], percentage(node["F"]), percentage(node["X"])))
+  return "\n".join(lines)
+
+def show(status, clear):
+  if clear:
+    # Move to the top left corner and clear the screen
+    sys.stdout.write("\033[H\033[2J")
+  print render(status)
+  sys.stdout.flush()
+
+def read_file(path, options):
+  last_time = None
+  while True:
+    try:
+      status = simplejson.load(open(path))
+    except (IOError, ValueError):
+      status = None
+    if (status != None) and (status["time"] != last_time):
+      show(status, not options.once)
+      last_time = status["time"]
+      if options.once:
+        return
+    time.sleep(options.interval)
+
+def read_socket(path, options):
+  if os.path.exists(path):
+    os.unlink(path)
+  server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  server.bind(path)
+  server.listen(1)
+  try:
+    while True:
+      connection, address = server.accept()
+      data = ""
+      while True:
+        received = connection.recv(65536)
+        if received == "":
+          break
+        data += received
+        while "\n" in data:
+          line, data = data.split("\n", 1)
+          show(simplejson.loads(line), not options.once)
+          if options.once:
+            return
+      connection.close()
+  finally:
+    os.unlink(path)
+
+usage = "usage: %prog [options] file:///path/name | unix:///path/socket"
+parser = optparse.OptionParser(usage=usage)
+parser.add_option("-i", "--interval", type="float", default=1,
+                  help="Time in seconds between two reads of a status file [default: %default]")
+parser.add_option("-1", "--once", action="store_true", default=False,
+                  help="Show one status and exit")
+(options, args) = parser.parse_args()
+if len(args) != 1:
+  parser.error("invalid number of arguments")
+
+output = args[0]
+try:
+  if output.startswith("unix://"):
+    read_socket(output[7:], options)
+  elif output.startswith("file://"):
+    read_file(output[7:], options)
+  else:
+    read_file(output, options)
+except KeyboardInterrupt:
+  pass
@@ -0,0 +1,193 @@
+/* Copyright (c) 2013 Joint Institute for VLBI in Europe (Netherlands)
+ * All rights reserved.
+ *
+ * Sends a file or a test pattern as a stream of UDP packets in the format
+ * read by Data_reader_udp (a 32 bit packet counter in network byte order
+ * followed by the payload). Packets can be dropped, duplicated and
+ * reordered on purpose to test the receiving side.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_BATCH 64
+
+void usage(char *name) {
+  std::cout << "Usage : " << name << " [OPTIONS] <host> <port>\n"
+            << "Options : -f <file>, send the contents of file (default: test pattern)\n"
+            << "          -s <bytes>, payload size of the packets (default 8000)\n"
+            << "          -n <packets>, number of packets to send (default: the whole\n"
+            << "             file, or unlimited for the test pattern)\n"
+            << "          -r <Mbit/s>, data rate (default: as fast as possible)\n"
+            << "          -c <counter>, counter of the first packet (default 0)\n"
+            << "          -l <fraction>, fraction of the packets to drop\n"
+            << "          -d <fraction>, fraction of the packets to send twice\n"
+            << "          -o <fraction>, fraction of the packets to swap with the next one\n"
+            << "          -S <seed>, seed of the random generator\n";
+}
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Test pattern: every 32 bit word contains the counter of its packet
+void fill_test_pattern(char *payload, size_t size, uint32_t counter) {
+  for (size_t i = 0; i + 4 <= size; i += 4)
+    memcpy(payload + i, &counter, 4);
+}
+
+int main(int argc, char *argv[]) {
+  const char *filename = NULL;
+  size_t payload_size = 8000;
+  long long max_packets = -1;
+  double rate = 0, loss = 0, duplicate = 0, reorder = 0;
+  uint32_t counter = 0;
+  int c;
+  while ((c = getopt(argc, argv, "f:s:n:r:c:l:d:o:S:")) != -1) {
+    switch (c) {
+    case 'f': filename = optarg; break;
+    case 's': payload_size = atoi(optarg); break;
+    case 'n': max_packets = atoll(optarg); break;
+    case 'r': rate = atof(optarg) * 1e6; break;
+    case 'c': counter = strtoul(optarg, NULL, 0); break;
+    case 'l': loss = atof(optarg); break;
+    case 'd': duplicate = atof(optarg); break;
+    case 'o': reorder = atof(optarg); break;
+    case 'S': srand48(atol(optarg)); break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((argc - optind != 2) || (payload_size == 0) || (payload_size > 8996)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(argv[optind + 1]));
+  if (inet_aton(argv[optind], &addr.sin_addr) == 0) {
+    std::cerr << "Invalid address " << argv[optind] << "\n";
+    return 1;
+  }
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if ((sock < 0) || (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)) {
+    std::cerr << "Cannot connect to " << argv[optind] << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  FILE *infile = NULL;
+  if (filename != NULL) {
+    infile = fopen(filename, "rb");
+    if (infile == NULL) {
+      std::cerr << "Could not open " << filename << " for reading.\n";
+      return 1;
+    }
+  }
+
+  const size_t packet_size = payload_size + 4;
+  std::vector<char> buffer(2 * MAX_BATCH * packet_size);
+  struct mmsghdr msgs[2 * MAX_BATCH];
+  struct iovec iovecs[2 * MAX_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+
+  long long nsent = 0, npackets = 0, ndropped = 0, nduplicated = 0, nreordered = 0;
+  double start = now();
+  bool done = false;
+  while (!done) {
+    // Create a batch of packets
+    int n = 0;
+    for (int i = 0; (i < MAX_BATCH) && !done; i++) {
+      if ((max_packets >= 0) && (npackets >= max_packets)) {
+        done = true;
+        break;
+      }
+      char *packet = &buffer[n * packet_size];
+      char *payload = packet + 4;
+      if (infile != NULL) {
+        size_t nread = fread(payload, 1, payload_size, infile);
+        if (nread < payload_size) {
+          done = true;
+          if (nread == 0)
+            break;
+          memset(payload + nread, 0, payload_size - nread);
+        }
+      } else {
+        fill_test_pattern(payload, payload_size, counter);
+      }
+      uint32_t net_counter = htonl(counter);
+      memcpy(packet, &net_counter, 4);
+      counter++;
+      npackets++;
+
+      if (drand48() < loss) {
+        ndropped++;
+        continue;
+      }
+      iovecs[n].iov_base = packet;
+      iovecs[n].iov_len = packet_size;
+      n++;
+      if (drand48() < duplicate) {
+        iovecs[n] = iovecs[n - 1];
+        n++;
+        nduplicated++;
+      }
+      if ((n >= 2) && (drand48() < reorder)) {
+        std::swap(iovecs[n - 1], iovecs[n - 2]);
+        nreordered++;
+      }
+    }
+
+    for (int i = 0; i < n; i++) {
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int offset = 0;
+    while (offset < n) {
+      int result = sendmmsg(sock, &msgs[offset], n - offset, 0);
+      if (result < 0) {
+        if ((errno == EINTR) || (errno == ENOBUFS) || (errno == ECONNREFUSED))
+          continue;
+        std::cerr << "Error sending packets: " << strerror(errno) << "\n";
+        return 1;
+      }
+      offset += result;
+    }
+    nsent += n;
+
+    if (rate > 0) {
+      // Wait until the data sent so far is due
+      double due = start + (npackets * packet_size * 8.) / rate;
+      double wait = due - now();
+      if (wait > 0)
+        usleep((useconds_t)(wait * 1e6));
+    }
+  }
+
+  double time = now() - start;
+  std::cout << "Sent " << nsent << " packets of " << packet_size << " bytes in "
+            << time << " s (" << (time > 0 ? nsent * packet_size * 8e-6 / time : 0)
+            << " Mbit/s), dropped " << ndropped << ", duplicated " << nduplicated
+            << ", reordered " << nreordered << "\n";
+  if (infile != NULL)
+    fclose(infile);
+  close(sock);
+  return 0;
+}